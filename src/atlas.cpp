@@ -0,0 +1,231 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "gfx_image/create.h"
+#include "atlas.hpp"
+#include "blit.hpp"
+#include "parallel.hpp"
+#include "pixelrows.hpp"
+#include <algorithm>
+
+namespace LuaImage {
+
+namespace {
+
+class Skyline {
+public:
+	Skyline(uint32_t width, uint32_t height) : width(width), height(height) {
+		nodes.push_back(Node{0, 0, (int32_t) width});
+	}
+
+	// bottom left placement of a w x h rect, false if it doesn't fit
+	bool Insert(uint32_t w, uint32_t h, uint32_t &outX, uint32_t &outY) {
+		size_t best = nodes.size();
+		uint32_t bestY = UINT32_MAX;
+		int32_t bestWidth = INT32_MAX;
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			uint32_t y;
+			if (!Fit(i, w, h, y)) continue;
+			if (y + h < bestY || (y + h == bestY && nodes[i].width < bestWidth)) {
+				best = i;
+				bestY = y + h;
+				bestWidth = nodes[i].width;
+			}
+		}
+		if (best == nodes.size()) return false;
+
+		outX = (uint32_t) nodes[best].x;
+		outY = bestY - h;
+		Add(best, outX, outY, w, h);
+		usedWidth = std::max(usedWidth, outX + w);
+		usedHeight = std::max(usedHeight, outY + h);
+		return true;
+	}
+
+	uint32_t usedWidth = 0;
+	uint32_t usedHeight = 0;
+
+private:
+	struct Node {
+		int32_t x;
+		int32_t y;
+		int32_t width;
+	};
+
+	// lowest y a rect starting at node i can sit at
+	bool Fit(size_t i, uint32_t w, uint32_t h, uint32_t &outY) const {
+		if ((uint32_t) nodes[i].x + w > width) return false;
+		int32_t left = (int32_t) w;
+		int32_t y = nodes[i].y;
+		for (size_t j = i; left > 0; ++j) {
+			if (j == nodes.size()) return false;
+			y = std::max(y, nodes[j].y);
+			if ((uint32_t) y + h > height) return false;
+			left -= nodes[j].width;
+		}
+		outY = (uint32_t) y;
+		return true;
+	}
+
+	void Add(size_t index, uint32_t x, uint32_t y, uint32_t w, uint32_t h) {
+		nodes.insert(nodes.begin() + index, Node{(int32_t) x, (int32_t) (y + h), (int32_t) w});
+
+		// trim the nodes now under the new one
+		for (size_t i = index + 1; i < nodes.size(); ++i) {
+			Node const &prev = nodes[i - 1];
+			int32_t const overlap = (prev.x + prev.width) - nodes[i].x;
+			if (overlap <= 0) break;
+			nodes[i].x += overlap;
+			nodes[i].width -= overlap;
+			if (nodes[i].width > 0) break;
+			nodes.erase(nodes.begin() + i);
+			--i;
+		}
+
+		// merge neighbours at the same height
+		for (size_t i = 0; i + 1 < nodes.size(); ++i) {
+			if (nodes[i].y == nodes[i + 1].y) {
+				nodes[i].width += nodes[i + 1].width;
+				nodes.erase(nodes.begin() + i + 1);
+				--i;
+			}
+		}
+	}
+
+	uint32_t width;
+	uint32_t height;
+	std::vector<Node> nodes;
+};
+
+uint32_t NextPowerOfTwo(uint32_t v) {
+	uint32_t p = 1;
+	while (p < v) p <<= 1;
+	return p;
+}
+
+// copies image into the page and fills its padding with copies of its edges
+void Place(Image_ImageHeader const *page, uint32_t slice, Image_ImageHeader const *image,
+					 AtlasPlacement const &placement, uint32_t padding, bool extrude) {
+	BlitOptions options;
+	options.threadCount = 1;
+	uint32_t const w = placement.width;
+	uint32_t const h = placement.height;
+	BlitBox const origin{placement.x, placement.y, 0, slice};
+	Blit(page, origin, image, BlitBox{0, 0, 0, 0}, w, h, 1, options);
+	if (!extrude || padding == 0) return;
+
+	// rows above and below then whole columns (padding included) left and right
+	for (uint32_t i = 1; i <= padding; ++i) {
+		Blit(page, BlitBox{placement.x, placement.y - i, 0, slice},
+				 page, BlitBox{placement.x, placement.y, 0, slice}, w, 1, 1, options);
+		Blit(page, BlitBox{placement.x, placement.y + h - 1 + i, 0, slice},
+				 page, BlitBox{placement.x, placement.y + h - 1, 0, slice}, w, 1, 1, options);
+	}
+	uint32_t const top = placement.y - padding;
+	uint32_t const columnHeight = h + (padding * 2);
+	for (uint32_t i = 1; i <= padding; ++i) {
+		Blit(page, BlitBox{placement.x - i, top, 0, slice},
+				 page, BlitBox{placement.x, top, 0, slice}, 1, columnHeight, 1, options);
+		Blit(page, BlitBox{placement.x + w - 1 + i, top, 0, slice},
+				 page, BlitBox{placement.x + w - 1, top, 0, slice}, 1, columnHeight, 1, options);
+	}
+}
+
+} // end anonymous namespace
+
+bool Atlas_Pack(Image_ImageHeader const *const *images,
+								size_t count,
+								AtlasOptions const &options,
+								AtlasResult &result,
+								char const *&error) {
+	result.images.clear();
+	result.placements.assign(count, AtlasPlacement{0, 0, 0, 0, 0});
+	if (count == 0) {
+		error = "no images to pack";
+		return false;
+	}
+
+	TinyImageFormat const format = options.format != TinyImageFormat_UNDEFINED ? options.format : images[0]->format;
+	if (!CanAccessPixelRuns(format)) {
+		error = "atlas format can't be written a row at a time";
+		return false;
+	}
+
+	uint32_t const padding = options.padding;
+	for (size_t i = 0; i < count; ++i) {
+		if (!CanAccessPixelRuns(images[i]->format)) {
+			error = "image format can't be read a row at a time";
+			return false;
+		}
+		if (images[i]->width + (padding * 2) > options.maxWidth ||
+				images[i]->height + (padding * 2) > options.maxHeight) {
+			error = "image too big for the atlas";
+			return false;
+		}
+	}
+
+	// tallest (then widest) first packs skylines tightly
+	std::vector<size_t> order(count);
+	for (size_t i = 0; i < count; ++i) order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [images](size_t a, size_t b) {
+		if (images[a]->height != images[b]->height) return images[a]->height > images[b]->height;
+		return images[a]->width > images[b]->width;
+	});
+
+	std::vector<Skyline> pages;
+	for (size_t i : order) {
+		uint32_t const w = images[i]->width + (padding * 2);
+		uint32_t const h = images[i]->height + (padding * 2);
+		uint32_t x = 0, y = 0;
+		size_t page = 0;
+		while (page < pages.size() && !pages[page].Insert(w, h, x, y)) ++page;
+		if (page == pages.size()) {
+			pages.emplace_back(options.maxWidth, options.maxHeight);
+			pages.back().Insert(w, h, x, y);
+		}
+		result.placements[i] = AtlasPlacement{(uint32_t) page, x + padding, y + padding,
+																					images[i]->width, images[i]->height};
+	}
+
+	// every page shares a size so they can also be array slices
+	uint32_t pageWidth = 1, pageHeight = 1;
+	for (auto const &page : pages) {
+		pageWidth = std::max(pageWidth, page.usedWidth);
+		pageHeight = std::max(pageHeight, page.usedHeight);
+	}
+	if (options.powerOfTwo) {
+		pageWidth = std::min(NextPowerOfTwo(pageWidth), std::max(options.maxWidth, pageWidth));
+		pageHeight = std::min(NextPowerOfTwo(pageHeight), std::max(options.maxHeight, pageHeight));
+	}
+	result.pageWidth = pageWidth;
+	result.pageHeight = pageHeight;
+
+	if (options.array) {
+		auto const image = Image_Create2DArray(pageWidth, pageHeight, (uint32_t) pages.size(), format);
+		if (image) result.images.push_back(image);
+	} else {
+		for (size_t i = 0; i < pages.size(); ++i) {
+			auto const image = Image_Create2D(pageWidth, pageHeight, format);
+			if (!image) break;
+			result.images.push_back(image);
+		}
+	}
+	if (result.images.size() != (options.array ? 1 : pages.size())) {
+		for (auto image : result.images) Image_Destroy(image);
+		result.images.clear();
+		error = "out of memory creating atlas";
+		return false;
+	}
+
+	// placements never overlap (padding included) so images copy in parallel
+	ParallelFor(count, options.threadCount, 8, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			AtlasPlacement const &placement = result.placements[i];
+			auto const page = options.array ? result.images[0] : result.images[placement.page];
+			uint32_t const slice = options.array ? placement.page : 0;
+			Place(page, slice, images[i], placement, padding, options.extrude);
+		}
+	});
+	return true;
+}
+
+} // end namespace LuaImage
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef LUA_IMAGE_ATLAS_HPP_
+#define LUA_IMAGE_ATLAS_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include <vector>
+
+namespace LuaImage {
+
+struct AtlasOptions {
+	uint32_t maxWidth = 4096;
+	uint32_t maxHeight = 4096;
+	// pixels around every image, filled with copies of its edge if extrude
+	uint32_t padding = 2;
+	bool extrude = true;
+	// round page sizes up to powers of two
+	bool powerOfTwo = true;
+	// one 2D array image with a slice per page rather than an image per page
+	bool array = false;
+	// atlas format, UNDEFINED uses the first image's
+	TinyImageFormat format = TinyImageFormat_UNDEFINED;
+	uint32_t threadCount = 0; // 0 = all hardware threads
+};
+
+// where an image ended up, x and y are of the image not its padding
+struct AtlasPlacement {
+	uint32_t page;
+	uint32_t x;
+	uint32_t y;
+	uint32_t width;
+	uint32_t height;
+};
+
+struct AtlasResult {
+	// one image per page or a single array image (owned by the caller)
+	std::vector<Image_ImageHeader const *> images;
+	// one per input image in input order
+	std::vector<AtlasPlacement> placements;
+	uint32_t pageWidth;
+	uint32_t pageHeight;
+};
+
+// packs the top level (first page, first slice) of each image with a
+// skyline bottom left packer, tallest first, opening pages as needed and
+// copying every image (with extrusion) natively. false with error set if
+// an image can't fit or be converted
+bool Atlas_Pack(Image_ImageHeader const *const *images,
+								size_t count,
+								AtlasOptions const &options,
+								AtlasResult &result,
+								char const *&error);
+
+} // end namespace LuaImage
+
+#endif
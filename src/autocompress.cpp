@@ -0,0 +1,294 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "gfx_image/create.h"
+#include "autocompress.hpp"
+#include "blit.hpp"
+#include "compare.hpp"
+#include "decompress.hpp"
+#include "parallel.hpp"
+#include "pixelrows.hpp"
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+namespace LuaImage {
+
+namespace {
+
+struct BCName {
+	char const *name;
+	CompressBC bc;
+};
+
+BCName const BCNames[] = {
+		{"BC1", CompressBC::BC1},
+		{"BC2", CompressBC::BC2},
+		{"BC3", CompressBC::BC3},
+		{"BC4", CompressBC::BC4},
+		{"BC5", CompressBC::BC5},
+		{"BC6H", CompressBC::BC6H},
+		{"BC7", CompressBC::BC7},
+};
+
+// cheapest first, 4 bits per pixel then 8 (BC2 is never better than BC3)
+CompressBC const DefaultOrder[] = {
+		CompressBC::BC4,
+		CompressBC::BC1,
+		CompressBC::BC5,
+		CompressBC::BC3,
+		CompressBC::BC7,
+		CompressBC::BC6H,
+};
+
+// 1/2 of an 8 bit step, counts as the same value
+float const Tolerance = 0.5f / 255.0f;
+
+// colour channels a candidate has to reproduce, the source's own unless a
+// grey texture is allowed to keep only red
+uint32_t NeededChannels(AutoCandidate const &candidate, TextureAnalysis const &analysis, AutoCompressOptions const &options) {
+	uint32_t const candidateChannels = candidate.compressed ?
+			(candidate.bc == CompressBC::BC4 ? 1 : candidate.bc == CompressBC::BC5 ? 2 : 3) :
+			TinyImageFormat_ChannelCount(candidate.format);
+	if (candidateChannels == 1 && analysis.grey && options.greyAsRed) return 1;
+	return analysis.channels;
+}
+
+bool Viable(AutoCandidate const &candidate, TextureAnalysis const &analysis, AutoCompressOptions const &options) {
+	uint32_t const needed = NeededChannels(candidate, analysis, options);
+	if (!candidate.compressed) {
+		if (analysis.hdr && !TinyImageFormat_IsFloat(candidate.format)) return false;
+		if (analysis.alpha != AlphaUsage::None && TinyImageFormat_ChannelCount(candidate.format) < 4) return false;
+		return TinyImageFormat_ChannelCount(candidate.format) >= needed;
+	}
+
+	switch (candidate.bc) {
+		case CompressBC::BC6H: return analysis.alpha == AlphaUsage::None;
+		case CompressBC::BC1: return !analysis.hdr && analysis.alpha != AlphaUsage::Full;
+		case CompressBC::BC4: return !analysis.hdr && analysis.alpha == AlphaUsage::None && needed == 1;
+		case CompressBC::BC5: return !analysis.hdr && analysis.alpha == AlphaUsage::None && needed <= 2;
+		default: return !analysis.hdr;
+	}
+}
+
+// error over the channels the candidate has to reproduce
+double ErrorOf(CompareResult const &compared, uint32_t channels, TextureAnalysis const &analysis, AutoMetric metric) {
+	double const *values = metric == AutoMetric::Rmse ? compared.mse : compared.maxDiff;
+	double sum = 0, largest = 0;
+	uint32_t used = 0;
+	for (uint32_t c = 0; c < 4; ++c) {
+		bool const isUsed = c < 3 ? c < channels : analysis.alpha != AlphaUsage::None;
+		if (!isUsed) continue;
+		sum += values[c];
+		largest = std::fmax(largest, values[c]);
+		used++;
+	}
+	if (metric == AutoMetric::MaxDiff) return largest;
+	return std::sqrt(sum / (used ? used : 1));
+}
+
+// a 2D image of up to trialTiles tiles spread over the top page, stacked vertically
+Image_ImageHeader const *TrialSample(Image_ImageHeader const *image, AutoCompressOptions const &options) {
+	uint32_t const tileSize = options.tileSize ? ((options.tileSize + 3) & ~3u) : 64;
+	uint32_t const tw = image->width < tileSize ? image->width : tileSize;
+	uint32_t const th = image->height < tileSize ? image->height : tileSize;
+	uint32_t const gridX = image->width / tw;
+	uint32_t const gridY = image->height / th;
+	size_t const total = (size_t) gridX * gridY;
+
+	BlitOptions blitOptions;
+	blitOptions.threadCount = 1;
+
+	if (total <= options.trialTiles || options.trialTiles == 0) {
+		auto sample = Image_Create2DNoClear(image->width, image->height, image->format);
+		if (sample) Blit(sample, BlitBox{0, 0, 0, 0}, image, BlitBox{0, 0, 0, 0}, image->width, image->height, 1, blitOptions);
+		return sample;
+	}
+
+	uint32_t const count = options.trialTiles;
+	auto sample = Image_Create2DNoClear(tw, th * count, image->format);
+	if (!sample) return nullptr;
+	for (uint32_t k = 0; k < count; ++k) {
+		size_t const t = (((size_t) k * total) + (total / 2)) / count;
+		uint32_t const x = (uint32_t) (t % gridX) * tw;
+		uint32_t const y = (uint32_t) (t / gridX) * th;
+		Blit(sample, BlitBox{0, k * th, 0, 0}, image, BlitBox{x, y, 0, 0}, tw, th, 1, blitOptions);
+	}
+	return sample;
+}
+
+// compresses (or converts) the sample and measures what comes back
+double Trial(Image_ImageHeader const *sample,
+						 AutoCandidate const &candidate,
+						 TextureAnalysis const &analysis,
+						 AutoCompressOptions const &options) {
+	double const failed = std::numeric_limits<double>::infinity();
+
+	Image_ImageHeader const *result;
+	if (candidate.compressed) {
+		CompressOptions compress = options.compress;
+		compress.threadCount = 1;
+		compress.useAlpha = analysis.alpha == AlphaUsage::Binary;
+		auto const compressed = CompressAMD(sample, candidate.bc, compress);
+		if (!compressed) return failed;
+
+		DecompressOptions decompress;
+		decompress.format = TinyImageFormat_R32G32B32A32_SFLOAT;
+		decompress.threadCount = 1;
+		result = Decompress(compressed, decompress);
+		Image_Destroy(compressed);
+	} else {
+		result = ConvertChain(sample, candidate.format, 1);
+	}
+	if (!result) return failed;
+
+	CompareOptions compare;
+	compare.ssim = false;
+	compare.threadCount = 1;
+	CompareResult compared;
+	char const *error = nullptr;
+	bool const ok = Compare(sample, result, compare, compared, error);
+	Image_Destroy(result);
+	return ok ? ErrorOf(compared, NeededChannels(candidate, analysis, options), analysis, options.metric) : failed;
+}
+
+} // end anonymous namespace
+
+bool AutoCandidate_FromName(char const *name, AutoCandidate &candidate) {
+	for (auto const &bc : BCNames) {
+		if (strcmp(name, bc.name) == 0) {
+			candidate = AutoCandidate{true, bc.bc, TinyImageFormat_UNDEFINED};
+			return true;
+		}
+	}
+	TinyImageFormat const format = TinyImageFormat_FromName(name);
+	if (format == TinyImageFormat_UNDEFINED || TinyImageFormat_IsCompressed(format) || !CanAccessPixelRuns(format)) {
+		return false;
+	}
+	candidate = AutoCandidate{false, CompressBC::BC1, format};
+	return true;
+}
+
+char const *AutoCandidate_Name(AutoCandidate const &candidate) {
+	if (!candidate.compressed) return TinyImageFormat_Name(candidate.format);
+	for (auto const &bc : BCNames) {
+		if (bc.bc == candidate.bc) return bc.name;
+	}
+	return "";
+}
+
+TextureAnalysis AnalyseTexture(Image_ImageHeader const *image, uint32_t threadCount) {
+	bool alphaNotOne = false, alphaNotBinary = false, notGrey = false, hdr = false;
+	std::mutex mutex;
+
+	size_t const rows = (size_t) image->height * image->depth * image->slices;
+	ParallelFor(rows, threadCount, 16, [&](size_t begin, size_t end) {
+		bool rowAlphaNotOne = false, rowAlphaNotBinary = false, rowNotGrey = false, rowHdr = false;
+		std::vector<float> pixels((size_t) image->width * 4);
+		for (size_t row = begin; row < end; ++row) {
+			DecodePixelRunF(image, row * image->width, image->width, pixels.data());
+			for (size_t i = 0; i < pixels.size(); i += 4) {
+				float const *p = &pixels[i];
+				float const a = p[3];
+				rowAlphaNotOne |= a < 1.0f - Tolerance;
+				rowAlphaNotBinary |= a > Tolerance && a < 1.0f - Tolerance;
+				rowNotGrey |= std::fabs(p[0] - p[1]) > Tolerance || std::fabs(p[0] - p[2]) > Tolerance;
+				for (int c = 0; c < 4; ++c) {
+					rowHdr |= p[c] < -Tolerance || p[c] > 1.0f + Tolerance;
+				}
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		alphaNotOne |= rowAlphaNotOne;
+		alphaNotBinary |= rowAlphaNotBinary;
+		notGrey |= rowNotGrey;
+		hdr |= rowHdr;
+	});
+
+	TextureAnalysis analysis;
+	analysis.alpha = !alphaNotOne ? AlphaUsage::None : (alphaNotBinary ? AlphaUsage::Full : AlphaUsage::Binary);
+	uint32_t const formatChannels = TinyImageFormat_ChannelCount(image->format);
+	uint32_t const colourChannels = formatChannels >= 4 ? 3 : formatChannels;
+	analysis.channels = colourChannels ? colourChannels : 1;
+	analysis.grey = colourChannels >= 3 && !notGrey;
+	analysis.hdr = hdr;
+	return analysis;
+}
+
+bool CompressAuto(Image_ImageHeader const *image, AutoCompressOptions const &options, AutoCompressResult &result) {
+	result.analysis = TextureAnalysis{AlphaUsage::None, 1, false, false};
+	result.trials.clear();
+	result.chosen = 0;
+	result.image = nullptr;
+	if (!image) return false;
+
+	// already compressed textures are re-encoded from what they decode to
+	Image_ImageHeader const *decoded = nullptr;
+	if (TinyImageFormat_IsCompressed(image->format)) {
+		DecompressOptions decompress;
+		decompress.format = TinyImageFormat_R32G32B32A32_SFLOAT;
+		decompress.threadCount = options.compress.threadCount;
+		image = decoded = Decompress(image, decompress);
+		if (!image) return false;
+	}
+	if (!CanAccessPixelRuns(image->format)) return false;
+
+	result.analysis = AnalyseTexture(image, options.compress.threadCount);
+	if (options.alpha != AlphaUsage::Auto) result.analysis.alpha = options.alpha;
+
+	if (options.candidates.empty()) {
+		for (auto bc : DefaultOrder) {
+			result.trials.push_back(AutoTrial{AutoCandidate{true, bc, TinyImageFormat_UNDEFINED}, false, 0.0});
+		}
+	} else {
+		for (auto const &candidate : options.candidates) {
+			result.trials.push_back(AutoTrial{candidate, false, 0.0});
+		}
+	}
+
+	std::vector<size_t> viable;
+	for (size_t i = 0; i < result.trials.size(); ++i) {
+		result.trials[i].error = std::numeric_limits<double>::infinity();
+		if (Viable(result.trials[i].candidate, result.analysis, options)) viable.push_back(i);
+	}
+
+	auto const sample = viable.empty() ? nullptr : TrialSample(image, options);
+	if (!sample) {
+		if (decoded) Image_Destroy(decoded);
+		return false;
+	}
+
+	// every viable candidate is tried at once, then the cheapest that fits wins
+	ParallelFor(viable.size(), options.compress.threadCount, 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			AutoTrial &trial = result.trials[viable[i]];
+			trial.tried = true;
+			trial.error = Trial(sample, trial.candidate, result.analysis, options);
+		}
+	});
+	Image_Destroy(sample);
+
+	// nothing within budget falls back to the smallest error
+	size_t best = viable.front();
+	for (size_t i : viable) {
+		if (result.trials[i].error <= options.maxError) {
+			best = i;
+			break;
+		}
+		if (result.trials[i].error < result.trials[best].error) best = i;
+	}
+	result.chosen = best;
+
+	AutoCandidate const &chosen = result.trials[best].candidate;
+	if (chosen.compressed) {
+		CompressOptions compress = options.compress;
+		compress.useAlpha = result.analysis.alpha == AlphaUsage::Binary;
+		result.image = CompressAMD(image, chosen.bc, compress);
+	} else {
+		result.image = ConvertChain(image, chosen.format, options.compress.threadCount);
+	}
+
+	if (decoded) Image_Destroy(decoded);
+	return result.image != nullptr;
+}
+
+} // end namespace LuaImage
@@ -0,0 +1,86 @@
+#pragma once
+#ifndef LUA_IMAGE_AUTOCOMPRESS_HPP_
+#define LUA_IMAGE_AUTOCOMPRESS_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "compress.hpp"
+#include <vector>
+
+namespace LuaImage {
+
+enum class AlphaUsage {
+	Auto,   // options only, measure it
+	None,   // alpha is 1 everywhere
+	Binary, // alpha is only 0 or 1
+	Full,
+};
+
+struct TextureAnalysis {
+	AlphaUsage alpha;
+	// colour channels the format has (1 to 3)
+	uint32_t channels;
+	// every pixel has r == g == b
+	bool grey;
+	// values outside 0..1
+	bool hdr;
+};
+
+// a BC compressor or an uncompressed format reached by conversion
+struct AutoCandidate {
+	bool compressed;
+	CompressBC bc;
+	TinyImageFormat format;
+};
+
+enum class AutoMetric {
+	Rmse,    // root mean squared error over the used channels
+	MaxDiff, // largest single channel difference
+};
+
+struct AutoCompressOptions {
+	float maxError = 0.02f;
+	AutoMetric metric = AutoMetric::Rmse;
+	// tried cheapest first in this order, empty = every BC format by bits per pixel
+	std::vector<AutoCandidate> candidates;
+	AlphaUsage alpha = AlphaUsage::Auto;
+	// grey textures may use single channel candidates (BC4, R formats), the
+	// caller replicates red when sampling
+	bool greyAsRed = false;
+	// trial sample of up to this many tiles spread over the top level
+	uint32_t trialTiles = 16;
+	uint32_t tileSize = 64;
+	// used for the trials (single threaded each) and the final compression
+	CompressOptions compress;
+};
+
+struct AutoTrial {
+	AutoCandidate candidate;
+	// false if the analysis ruled it out without a trial
+	bool tried;
+	double error;
+};
+
+struct AutoCompressResult {
+	TextureAnalysis analysis;
+	std::vector<AutoTrial> trials;
+	// index into trials of the one used, the first within budget or the best
+	size_t chosen;
+	Image_ImageHeader const *image; // owned by the caller
+};
+
+// "BC1".."BC7", "BC6H" or an uncompressed format name, false if neither
+bool AutoCandidate_FromName(char const *name, AutoCandidate &candidate);
+char const *AutoCandidate_Name(AutoCandidate const &candidate);
+
+// alpha usage, channels and range of the top level
+TextureAnalysis AnalyseTexture(Image_ImageHeader const *image, uint32_t threadCount);
+
+// analyses the image, runs every viable candidate in parallel on a sample of
+// tiles, picks the cheapest within maxError and produces the whole chain in
+// it. false if nothing could be tried or the final compression failed
+bool CompressAuto(Image_ImageHeader const *image, AutoCompressOptions const &options, AutoCompressResult &result);
+
+} // end namespace LuaImage
+
+#endif
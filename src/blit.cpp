@@ -0,0 +1,172 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "gfx_image/create.h"
+#include "tiny_imageformat/tinyimageformat_query.h"
+#include "blit.hpp"
+#include "parallel.hpp"
+#include "pixelrows.hpp"
+#include <vector>
+
+namespace LuaImage {
+
+namespace {
+
+// sprite sized blits aren't worth waking threads for
+size_t const MinRowsPerThread = 64;
+
+void BlendRow(float *dst, float const *src, uint32_t count, BlitBlend blend, float opacity) {
+	size_t const floats = (size_t) count * 4;
+	switch (blend) {
+		case BlitBlend::None:
+			memcpy(dst, src, floats * sizeof(float));
+			break;
+		case BlitBlend::Alpha:
+			for (size_t i = 0; i < floats; i += 4) {
+				float const a = src[i + 3] * opacity;
+				float const ia = 1.0f - a;
+				dst[i + 0] = (src[i + 0] * a) + (dst[i + 0] * ia);
+				dst[i + 1] = (src[i + 1] * a) + (dst[i + 1] * ia);
+				dst[i + 2] = (src[i + 2] * a) + (dst[i + 2] * ia);
+				dst[i + 3] = a + (dst[i + 3] * ia);
+			}
+			break;
+		case BlitBlend::Premultiplied:
+			for (size_t i = 0; i < floats; i += 4) {
+				float const ia = 1.0f - (src[i + 3] * opacity);
+				dst[i + 0] = (src[i + 0] * opacity) + (dst[i + 0] * ia);
+				dst[i + 1] = (src[i + 1] * opacity) + (dst[i + 1] * ia);
+				dst[i + 2] = (src[i + 2] * opacity) + (dst[i + 2] * ia);
+				dst[i + 3] = (src[i + 3] * opacity) + (dst[i + 3] * ia);
+			}
+			break;
+		case BlitBlend::Additive:
+			for (size_t i = 0; i < floats; i += 4) {
+				float const a = src[i + 3] * opacity;
+				dst[i + 0] += src[i + 0] * a;
+				dst[i + 1] += src[i + 1] * a;
+				dst[i + 2] += src[i + 2] * a;
+			}
+			break;
+	}
+}
+
+bool Overlaps(Image_ImageHeader const *dst, BlitBox const &dstBox,
+							Image_ImageHeader const *src, BlitBox const &srcBox,
+							uint32_t width, uint32_t height, uint32_t depth) {
+	if (dst != src || dstBox.slice != srcBox.slice) return false;
+	auto const apart = [](uint32_t a, uint32_t b, uint32_t size) { return a + size <= b || b + size <= a; };
+	return !apart(dstBox.x, srcBox.x, width) && !apart(dstBox.y, srcBox.y, height) &&
+			!apart(dstBox.z, srcBox.z, depth);
+}
+
+} // end anonymous namespace
+
+bool Blit(Image_ImageHeader const *dst, BlitBox const &dstBox,
+					Image_ImageHeader const *src, BlitBox const &srcBox,
+					uint32_t width, uint32_t height, uint32_t depth,
+					BlitOptions const &options) {
+	if (!CanAccessPixelRuns(src->format) || !CanAccessPixelRuns(dst->format)) return false;
+	if (width == 0 || height == 0 || depth == 0) return true;
+
+	size_t const rows = (size_t) height * depth;
+	bool const overlapping = Overlaps(dst, dstBox, src, srcBox, width, height, depth);
+
+	// overlapping blits walk rows away from the region they write into, each
+	// row is read whole before it is written so rows can overlap themselves
+	bool const backwards = overlapping &&
+			(dstBox.z > srcBox.z || (dstBox.z == srcBox.z && dstBox.y > srcBox.y));
+	auto const rowAt = [&](size_t i, BlitBox const &box, Image_ImageHeader const *image) {
+		size_t const r = backwards ? rows - 1 - i : i;
+		return Image_CalculateIndex(image, box.x, box.y + (uint32_t) (r % height), box.z + (uint32_t) (r / height), box.slice);
+	};
+
+	if (src->format == dst->format && options.blend == BlitBlend::None) {
+		size_t const bytesPerPixel = TinyImageFormat_BitSizeOfBlock(src->format) / 8;
+		size_t const rowBytes = (size_t) width * bytesPerPixel;
+		auto const srcBytes = (uint8_t const *) Image_RawDataPtr(src);
+		auto const dstBytes = (uint8_t *) Image_RawDataPtr(dst);
+		ParallelFor(rows, overlapping ? 1 : options.threadCount, MinRowsPerThread, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				memmove(dstBytes + (rowAt(i, dstBox, dst) * bytesPerPixel),
+								srcBytes + (rowAt(i, srcBox, src) * bytesPerPixel),
+								rowBytes);
+			}
+		});
+		return true;
+	}
+
+	bool const readDst = options.blend != BlitBlend::None;
+	ParallelFor(rows, overlapping ? 1 : options.threadCount, MinRowsPerThread, [&](size_t begin, size_t end) {
+		std::vector<float> srcRow((size_t) width * 4);
+		std::vector<float> dstRow((size_t) width * 4);
+		for (size_t i = begin; i < end; ++i) {
+			size_t const dstIndex = rowAt(i, dstBox, dst);
+			DecodePixelRunF(src, rowAt(i, srcBox, src), width, srcRow.data());
+			if (readDst) DecodePixelRunF(dst, dstIndex, width, dstRow.data());
+			BlendRow(dstRow.data(), srcRow.data(), width, options.blend, options.opacity);
+			EncodePixelRunF(dst, dstIndex, width, dstRow.data());
+		}
+	});
+	return true;
+}
+
+Image_ImageHeader const *ConvertChain(Image_ImageHeader const *image, TinyImageFormat format, uint32_t threadCount) {
+	if (!CanAccessPixelRuns(format)) return nullptr;
+	BlitOptions blitOptions;
+	blitOptions.threadCount = threadCount;
+
+	Image_ImageHeader *first = nullptr;
+	Image_ImageHeader *previous = nullptr;
+	for (size_t i = 0; i < Image_LinkedImageCountOf(image); ++i) {
+		auto const level = Image_LinkedImageOf(image, i);
+		auto const converted = (Image_ImageHeader *) Image_CreateNoClear(level->width, level->height, level->depth,
+																																			 level->slices, format);
+		if (!converted) {
+			if (first) Image_Destroy(first);
+			return nullptr;
+		}
+		converted->flags = level->flags;
+		if (previous) {
+			previous->nextType = Image_LinkedImageOf(image, i - 1)->nextType;
+			previous->nextImage = converted;
+		} else {
+			first = converted;
+		}
+		previous = converted;
+
+		for (uint32_t s = 0; s < level->slices; ++s) {
+			if (!Blit(converted, BlitBox{0, 0, 0, s}, level, BlitBox{0, 0, 0, s},
+								level->width, level->height, level->depth, blitOptions)) {
+				Image_Destroy(first);
+				return nullptr;
+			}
+		}
+	}
+	return first;
+}
+
+Image_ImageHeader const *CloneChain(Image_ImageHeader const *image) {
+	Image_ImageHeader *first = nullptr;
+	Image_ImageHeader *previous = nullptr;
+	for (size_t i = 0; i < Image_LinkedImageCountOf(image); ++i) {
+		auto const level = Image_LinkedImageOf(image, i);
+		auto const copy = (Image_ImageHeader *) Image_CreateNoClear(level->width, level->height, level->depth,
+																																level->slices, level->format);
+		if (!copy) {
+			if (first) Image_Destroy(first);
+			return nullptr;
+		}
+		copy->flags = level->flags;
+		memcpy(Image_RawDataPtr(copy), Image_RawDataPtr(level), Image_ByteCountOf(level));
+		if (previous) {
+			previous->nextType = Image_LinkedImageOf(image, i - 1)->nextType;
+			previous->nextImage = copy;
+		} else {
+			first = copy;
+		}
+		previous = copy;
+	}
+	return first;
+}
+
+} // end namespace LuaImage
@@ -0,0 +1,50 @@
+#pragma once
+#ifndef LUA_IMAGE_BLIT_HPP_
+#define LUA_IMAGE_BLIT_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+
+namespace LuaImage {
+
+enum class BlitBlend {
+	None,          // dst = src
+	Alpha,         // dst = src * src.a + dst * (1 - src.a)
+	Premultiplied, // dst = src + dst * (1 - src.a)
+	Additive,      // dst.rgb += src.rgb * src.a
+};
+
+// a box of pixels within one slice of an image
+struct BlitBox {
+	uint32_t x;
+	uint32_t y;
+	uint32_t z;
+	uint32_t slice;
+};
+
+struct BlitOptions {
+	BlitBlend blend = BlitBlend::None;
+	float opacity = 1.0f; // scales source alpha when blending
+	uint32_t threadCount = 0; // 0 = all hardware threads
+};
+
+// copies a width x height x depth box of src at srcBox to dst at dstBox in
+// one pass, converting format and blending as needed. Matching formats
+// without blending are straight row copies. Boxes must be inside their
+// images, src and dst may be the same image (even overlapping).
+// false if either format can't be accessed a row at a time
+bool Blit(Image_ImageHeader const *dst, BlitBox const &dstBox,
+					Image_ImageHeader const *src, BlitBox const &srcBox,
+					uint32_t width, uint32_t height, uint32_t depth,
+					BlitOptions const &options);
+
+// a copy of the whole linked chain in another (row accessible) format made
+// by blitting every level, nullptr if it can't be
+Image_ImageHeader const *ConvertChain(Image_ImageHeader const *image, TinyImageFormat format, uint32_t threadCount);
+
+// a copy of every level of the linked chain in its own format
+Image_ImageHeader const *CloneChain(Image_ImageHeader const *image);
+
+} // end namespace LuaImage
+
+#endif
@@ -0,0 +1,467 @@
+#include "al2o3_platform/platform.h"
+#include "al2o3_vfile/vfile.hpp"
+#include "gfx_image/image.h"
+#include "gfx_imageio/io.h"
+#include "tiny_imageformat/tinyimageformat_query.h"
+#include "cache.hpp"
+#include "containers.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/utime.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+namespace LuaImage {
+
+namespace {
+
+// xxhash64 style mixing, fast enough to be limited by memory bandwidth
+uint64_t const Prime1 = 0x9E3779B185EBCA87ull;
+uint64_t const Prime2 = 0xC2B2AE3D27D4EB4Full;
+uint64_t const Prime3 = 0x165667B19E3779F9ull;
+
+uint64_t Rotate(uint64_t v, int bits) {
+	return (v << bits) | (v >> (64 - bits));
+}
+
+uint64_t Round(uint64_t acc, uint64_t v) {
+	return Rotate(acc + (v * Prime2), 31) * Prime1;
+}
+
+uint64_t Avalanche(uint64_t h) {
+	h ^= h >> 33;
+	h *= Prime2;
+	h ^= h >> 29;
+	h *= Prime3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t Load64(uint8_t const *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+uint64_t HashBytes(void const *data, size_t size, uint64_t seed) {
+	auto p = (uint8_t const *) data;
+	auto const end = p + size;
+
+	// four independent lanes over 32 byte stripes
+	uint64_t lanes[4] = {seed + Prime1 + Prime2, seed + Prime2, seed, seed - Prime1};
+	while (end - p >= 32) {
+		for (int i = 0; i < 4; ++i) {
+			lanes[i] = Round(lanes[i], Load64(p + (i * 8)));
+		}
+		p += 32;
+	}
+	uint64_t h = Rotate(lanes[0], 1) + Rotate(lanes[1], 7) + Rotate(lanes[2], 12) + Rotate(lanes[3], 18);
+	h += size;
+	while (end - p >= 8) {
+		h = Round(h, Load64(p));
+		p += 8;
+	}
+	while (p < end) {
+		h = Round(h, *p++);
+	}
+	return Avalanche(h);
+}
+
+// big images hash in parallel chunks, combined in order
+uint64_t HashPixels(void const *data, size_t size) {
+	size_t const ChunkBytes = 4 * 1024 * 1024;
+	size_t const chunks = (size + ChunkBytes - 1) / ChunkBytes;
+	if (chunks <= 1) return HashBytes(data, size, 0);
+
+	std::vector<uint64_t> hashes(chunks);
+	ParallelFor(chunks, 0, 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			size_t const offset = i * ChunkBytes;
+			hashes[i] = HashBytes(((uint8_t const *) data) + offset, std::min(ChunkBytes, size - offset), i);
+		}
+	});
+	return HashBytes(hashes.data(), hashes.size() * sizeof(uint64_t), size);
+}
+
+struct Entry {
+	size_t bytes;
+	uint64_t lastUse;
+};
+
+// an entry file handed out mapped by Cache_Find
+struct Mapping {
+	std::string path;
+	// evicted while mapped, deleted when its last mapping is released
+	bool evicted;
+};
+
+struct Cache {
+	std::string PathOf(uint64_t key) const {
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.dds", (unsigned long long) key);
+		return directory + "/" + name;
+	}
+
+	// marks path's mappings evicted, false if it has none
+	bool DeferRemoveLocked(std::string const &path) {
+		bool mappedNow = false;
+		for (auto &mapping : mappings) {
+			if (mapping.second.path != path) continue;
+			mapping.second.evicted = true;
+			mappedNow = true;
+		}
+		return mappedNow;
+	}
+
+	// evicts least recently used entries until at most target bytes, mutex must be held
+	void EvictLocked(size_t target) {
+		if (bytes <= target) return;
+
+		std::vector<std::pair<uint64_t, uint64_t>> byAge;
+		byAge.reserve(entries.size());
+		for (auto const &entry : entries) {
+			byAge.emplace_back(entry.second.lastUse, entry.first);
+		}
+		std::sort(byAge.begin(), byAge.end());
+
+		for (auto const &old : byAge) {
+			if (bytes <= target) break;
+			auto it = entries.find(old.second);
+			std::string const path = PathOf(old.second);
+			if (!DeferRemoveLocked(path)) remove(path.c_str());
+			bytes -= it->second.bytes;
+			entries.erase(it);
+			evictions++;
+		}
+	}
+
+	std::mutex mutex;
+	bool open = false;
+	std::string directory;
+	std::unordered_map<uint64_t, Entry> entries;
+	std::unordered_map<void const *, Mapping> mappings;
+	uint64_t useCounter = 0;
+
+	size_t limit = 0;
+	size_t bytes = 0;
+	size_t hits = 0;
+	size_t misses = 0;
+	size_t stores = 0;
+	size_t evictions = 0;
+};
+
+Cache &TheCache() {
+	static Cache cache;
+	return cache;
+}
+
+bool StatFile(std::string const &path, size_t &size, int64_t &modified) {
+#if defined(_WIN32)
+	struct _stat64 st;
+	if (_stat64(path.c_str(), &st) != 0) return false;
+#else
+	struct stat st;
+	if (stat(path.c_str(), &st) != 0) return false;
+#endif
+	size = (size_t) st.st_size;
+	modified = (int64_t) st.st_mtime;
+	return true;
+}
+
+// bumps the file's modified time so least recently used survives restarts
+void Touch(std::string const &path) {
+#if defined(_WIN32)
+	_utime(path.c_str(), nullptr);
+#else
+	utime(path.c_str(), nullptr);
+#endif
+}
+
+// a temporary name for path no other writer uses, whether another thread
+// or another process sharing the directory
+std::string TempPathOf(std::string const &path) {
+	static std::atomic<uint64_t> counter{0};
+#if defined(_WIN32)
+	unsigned long const pid = (unsigned long) GetCurrentProcessId();
+#else
+	unsigned long const pid = (unsigned long) getpid();
+#endif
+	char suffix[64];
+	snprintf(suffix, sizeof(suffix), ".%lu-%llu.tmp", pid, (unsigned long long) counter++);
+	return path + suffix;
+}
+
+// moves temp over path in one step, readers see the old entry or the new one
+bool AtomicReplace(std::string const &temp, std::string const &path) {
+#if defined(_WIN32)
+	return MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(temp.c_str(), path.c_str()) == 0;
+#endif
+}
+
+bool Matches(Image_ImageHeader const *image, CacheShape const &shape) {
+	if (image->width != shape.width || image->height != shape.height ||
+			image->depth != shape.depth || image->slices != shape.slices) {
+		return false;
+	}
+	bool const format = shape.format == TinyImageFormat_UNDEFINED ? TinyImageFormat_IsCompressed(image->format) :
+											image->format == shape.format;
+	return format && (shape.levels == 0 || Image_LinkedImageCountOf(image) == shape.levels);
+}
+
+// entry files are 16 hex digits then .dds
+bool KeyOfName(char const *name, uint64_t &key) {
+	if (strlen(name) != 20 || strcmp(name + 16, ".dds") != 0) return false;
+	key = 0;
+	for (int i = 0; i < 16; ++i) {
+		char const c = name[i];
+		uint64_t digit;
+		if (c >= '0' && c <= '9') digit = (uint64_t) (c - '0');
+		else if (c >= 'a' && c <= 'f') digit = (uint64_t) (c - 'a' + 10);
+		else return false;
+		key = (key << 4) | digit;
+	}
+	return key != 0;
+}
+
+bool ListEntries(std::string const &directory, std::vector<std::string> &names) {
+#if defined(_WIN32)
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((directory + "/*.dds").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE) return GetLastError() == ERROR_FILE_NOT_FOUND;
+	do {
+		names.emplace_back(data.cFileName);
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+#else
+	DIR *dir = opendir(directory.c_str());
+	if (!dir) return false;
+	while (struct dirent *ent = readdir(dir)) {
+		names.emplace_back(ent->d_name);
+	}
+	closedir(dir);
+#endif
+	return true;
+}
+
+} // end anonymous namespace
+
+bool Cache_Open(char const *directory, size_t limit) {
+	std::vector<std::string> names;
+	if (!ListEntries(directory, names)) return false;
+
+	auto &cache = TheCache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.open = true;
+	cache.directory = directory;
+	cache.entries.clear();
+	cache.bytes = 0;
+	cache.limit = limit;
+
+	// existing entries are ordered by when they were last used
+	std::vector<std::pair<int64_t, uint64_t>> found;
+	std::vector<size_t> sizes;
+	for (auto const &name : names) {
+		uint64_t key;
+		size_t size;
+		int64_t modified;
+		if (!KeyOfName(name.c_str(), key)) continue;
+		if (!StatFile(cache.PathOf(key), size, modified)) continue;
+		found.emplace_back(modified, key);
+		cache.entries[key] = Entry{size, 0};
+		cache.bytes += size;
+	}
+	std::sort(found.begin(), found.end());
+	for (auto const &entry : found) {
+		cache.entries[entry.second].lastUse = ++cache.useCounter;
+	}
+
+	if (cache.limit) cache.EvictLocked(cache.limit);
+	return true;
+}
+
+void Cache_Close() {
+	auto &cache = TheCache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.open = false;
+	cache.entries.clear();
+	cache.bytes = 0;
+}
+
+bool Cache_IsOpen() {
+	auto &cache = TheCache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	return cache.open;
+}
+
+uint64_t Cache_Key(Image_ImageHeader const *image, bool wholeChain, char const *operation) {
+	uint64_t h = HashBytes(operation, strlen(operation), Prime3);
+	size_t const levels = wholeChain ? Image_LinkedImageCountOf(image) : 1;
+	for (size_t i = 0; i < levels; ++i) {
+		auto const level = Image_LinkedImageOf(image, i);
+		uint64_t const shape[] = {
+				level->width, level->height, level->depth, level->slices,
+				(uint64_t) level->format, level->flags, (uint64_t) level->nextType,
+		};
+		h = Round(h, HashBytes(shape, sizeof(shape), i));
+		h = Round(h, HashPixels(Image_RawDataPtr(level), Image_ByteCountOf(level)));
+	}
+	h = Avalanche(h);
+	return h ? h : Prime1;
+}
+
+Image_ImageHeader const *Cache_Find(uint64_t key, CacheShape const &shape, MappedFile &mapped) {
+	mapped.base = nullptr;
+	mapped.size = 0;
+
+	auto &cache = TheCache();
+	std::string path;
+	{
+		std::lock_guard<std::mutex> lock(cache.mutex);
+		if (!cache.open) return nullptr;
+		auto it = cache.entries.find(key);
+		if (it == cache.entries.end()) {
+			cache.misses++;
+			return nullptr;
+		}
+		it->second.lastUse = ++cache.useCounter;
+		path = cache.PathOf(key);
+	}
+
+	// single images are mapped straight from the entry, chains are loaded
+	Image_ImageHeader const *image = nullptr;
+	{
+		VFile::ScopedFile file = VFile::File::FromFile(path.c_str(), Os_FM_ReadBinary);
+		ContainerInfo info;
+		if (file && Container_Probe(file, info)) {
+			if (info.levels <= 1) image = Mapped_Load(path.c_str(), mapped);
+			if (!image && VFile_Seek(file, 0, VFile_SD_Begin)) image = Image_Load(file);
+		}
+	}
+	if (image && !Matches(image, shape)) {
+		if (mapped.base) Mapped_Release(image, mapped);
+		else Image_Destroy(image);
+		mapped = MappedFile{nullptr, 0};
+		image = nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	if (image) {
+		if (mapped.base) cache.mappings[mapped.base] = Mapping{path, false};
+		Touch(path);
+		cache.hits++;
+	} else {
+		// unreadable (deleted or damaged) or mismatched entries are forgotten,
+		// the next store for the key replaces the file
+		auto it = cache.entries.find(key);
+		if (it != cache.entries.end()) {
+			cache.bytes -= it->second.bytes;
+			cache.entries.erase(it);
+		}
+		cache.misses++;
+	}
+	return image;
+}
+
+bool Cache_Store(uint64_t key, Image_ImageHeader const *image) {
+	if (!image || !Image_CanSaveAsDDS(image)) return false;
+
+	auto &cache = TheCache();
+	std::string path;
+	{
+		std::lock_guard<std::mutex> lock(cache.mutex);
+		if (!cache.open) return false;
+		path = cache.PathOf(key);
+	}
+
+	// written under a temporary name so readers never see half an entry
+	std::string const temp = TempPathOf(path);
+	bool saved;
+	{
+		VFile::ScopedFile file = VFile::File::FromFile(temp.c_str(), Os_FM_WriteBinary);
+		saved = file && Image_SaveAsDDS(image, file);
+	}
+	size_t size = 0;
+	int64_t modified;
+	if (!saved || !StatFile(temp, size, modified) || !AtomicReplace(temp, path)) {
+		remove(temp.c_str());
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	// a new file now, what's still mapped is the old one (POSIX) or nothing
+	// was replaced (Windows fails to replace a mapped file)
+	for (auto &mapping : cache.mappings) {
+		if (mapping.second.path == path) mapping.second.evicted = false;
+	}
+	auto &entry = cache.entries[key];
+	cache.bytes = cache.bytes - entry.bytes + size;
+	entry.bytes = size;
+	entry.lastUse = ++cache.useCounter;
+	cache.stores++;
+	if (cache.limit) cache.EvictLocked(cache.limit);
+	return true;
+}
+
+void Cache_ReleaseMapped(Image_ImageHeader const *image, MappedFile &mapped) {
+	void const *const base = mapped.base;
+	Mapped_Release(image, mapped);
+
+	auto &cache = TheCache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	auto it = cache.mappings.find(base);
+	if (it == cache.mappings.end()) return;
+	Mapping const mapping = it->second;
+	cache.mappings.erase(it);
+	if (!mapping.evicted) return;
+	for (auto const &other : cache.mappings) {
+		if (other.second.path == mapping.path) return;
+	}
+	remove(mapping.path.c_str());
+}
+
+void Cache_SetLimit(size_t limit) {
+	auto &cache = TheCache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.limit = limit;
+	if (limit) cache.EvictLocked(limit);
+}
+
+void Cache_Trim(size_t bytes) {
+	auto &cache = TheCache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	cache.EvictLocked(bytes);
+}
+
+CacheStats Cache_Stats() {
+	auto &cache = TheCache();
+	std::lock_guard<std::mutex> lock(cache.mutex);
+	return CacheStats{
+			cache.hits,
+			cache.misses,
+			cache.stores,
+			cache.evictions,
+			cache.bytes,
+			cache.entries.size(),
+			cache.limit,
+	};
+}
+
+} // end namespace LuaImage
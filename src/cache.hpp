@@ -0,0 +1,67 @@
+#pragma once
+#ifndef LUA_IMAGE_CACHE_HPP_
+#define LUA_IMAGE_CACHE_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "mapped.hpp"
+
+namespace LuaImage {
+
+// On disk cache of operation results keyed by a hash of the source pixels,
+// shapes, formats and a string naming the operation and its parameters.
+// Entries are DDS files named by key in one directory and are evicted least
+// recently used first once over a byte limit. Thread safe, off until opened
+
+struct CacheStats {
+	size_t hits;
+	size_t misses;
+	size_t stores;
+	size_t evictions;
+	size_t bytes;
+	size_t entries;
+	size_t limit;
+};
+
+// uses directory (which must exist) for the cache picking up any entries
+// already there, limit 0 = unlimited. false if the directory can't be read
+bool Cache_Open(char const *directory, size_t limit);
+// stops using the cache, entries stay on disk
+void Cache_Close();
+bool Cache_IsOpen();
+
+// what a cached result has to look like to be used. Anything else found
+// under its key (a stale entry, or one the DDS round trip changed) is a miss
+struct CacheShape {
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	uint32_t slices;
+	TinyImageFormat format; // UNDEFINED = any block compressed format
+	uint32_t levels;        // 0 = any number
+};
+
+// key of running operation on image (or its whole chain), never 0
+uint64_t Cache_Key(Image_ImageHeader const *image, bool wholeChain, char const *operation);
+
+// the cached result for key or nullptr. If mapped.base is set on return the
+// image lives in a file mapping and must be released with Cache_ReleaseMapped
+Image_ImageHeader const *Cache_Find(uint64_t key, CacheShape const &shape, MappedFile &mapped);
+
+// Mapped_Release for any mapped image, cache entries evicted while mapped
+// are deleted once their last mapping goes (Windows can't delete them before)
+void Cache_ReleaseMapped(Image_ImageHeader const *image, MappedFile &mapped);
+
+// saves image as the result for key, evicting old entries if over the limit.
+// false if it couldn't be saved (e.g. a format DDS can't hold)
+bool Cache_Store(uint64_t key, Image_ImageHeader const *image);
+
+void Cache_SetLimit(size_t limit);
+// evicts least recently used entries until at most bytes are cached
+void Cache_Trim(size_t bytes);
+
+CacheStats Cache_Stats();
+
+} // end namespace LuaImage
+
+#endif
@@ -0,0 +1,312 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "gfx_image/create.h"
+#include "compare.hpp"
+#include "decompress.hpp"
+#include "parallel.hpp"
+#include "pixelrows.hpp"
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+namespace LuaImage {
+
+namespace {
+
+uint32_t const SsimWindow = 8;
+uint32_t const SsimStride = 4;
+double const SsimC1 = 0.01 * 0.01;
+double const SsimC2 = 0.03 * 0.03;
+
+// one row (or window row for ssim) of one page of one level
+struct Row {
+	size_t level;
+	uint32_t y;
+	uint32_t z;
+	uint32_t slice;
+};
+
+struct Sums {
+	double squaredError[4] = {};
+	double maxDiff[4] = {};
+	double ssim[4] = {};
+	double pixels = 0;
+
+	void Add(Sums const &other) {
+		for (int c = 0; c < 4; ++c) {
+			squaredError[c] += other.squaredError[c];
+			maxDiff[c] = std::fmax(maxDiff[c], other.maxDiff[c]);
+			ssim[c] += other.ssim[c];
+		}
+		pixels += other.pixels;
+	}
+};
+
+// window starts at the given stride, with a last one flush with the edge
+void WindowStarts(uint32_t size, uint32_t window, std::vector<uint32_t> &starts) {
+	starts.clear();
+	for (uint32_t s = 0; s + window <= size; s += SsimStride) starts.push_back(s);
+	if (starts.back() + window < size) starts.push_back(size - window);
+}
+
+void DecodeRow(Image_ImageHeader const *level, Row const &row, float *out) {
+	DecodePixelRunF(level, Image_CalculateIndex(level, 0, row.y, row.z, row.slice), level->width, out);
+}
+
+// squared error and max diff of a row, writing the diff row if wanted
+void ErrorRow(float const *a, float const *b, uint32_t width, float diffScale, float *diff, Sums &sums) {
+	size_t const count = (size_t) width * 4;
+	double squared[4] = {};
+	float maxDiff[4] = {};
+	// plain loops over 4 channel pixels so compilers vectorise them
+	for (size_t i = 0; i < count; i += 4) {
+		for (size_t c = 0; c < 4; ++c) {
+			float const d = a[i + c] - b[i + c];
+			squared[c] += (double) (d * d);
+			maxDiff[c] = std::fmax(maxDiff[c], std::fabs(d));
+		}
+	}
+	if (diff) {
+		for (size_t i = 0; i < count; ++i) {
+			diff[i] = std::fabs(a[i] - b[i]) * diffScale;
+		}
+	}
+	for (int c = 0; c < 4; ++c) {
+		sums.squaredError[c] += squared[c];
+		sums.maxDiff[c] = std::fmax(sums.maxDiff[c], (double) maxDiff[c]);
+	}
+}
+
+// ssim of every window starting on row y of a page
+void SsimRow(Image_ImageHeader const *a,
+						 Image_ImageHeader const *b,
+						 Row const &row,
+						 uint32_t windowW,
+						 uint32_t windowH,
+						 std::vector<uint32_t> const &xStarts,
+						 std::vector<float> &rowA,
+						 std::vector<float> &rowB,
+						 std::vector<double> &columns,
+						 Sums &sums) {
+	uint32_t const width = a->width;
+	// per column and channel sums of a, b, a^2, b^2 and ab down the window
+	columns.assign((size_t) width * 4 * 5, 0.0);
+	for (uint32_t y = 0; y < windowH; ++y) {
+		Row const r{row.level, row.y + y, row.z, row.slice};
+		DecodeRow(a, r, rowA.data());
+		DecodeRow(b, r, rowB.data());
+		for (size_t i = 0; i < (size_t) width * 4; ++i) {
+			double const va = rowA[i];
+			double const vb = rowB[i];
+			double *column = &columns[i * 5];
+			column[0] += va;
+			column[1] += vb;
+			column[2] += va * va;
+			column[3] += vb * vb;
+			column[4] += va * vb;
+		}
+	}
+
+	double const n = (double) windowW * windowH;
+	for (uint32_t x0 : xStarts) {
+		for (uint32_t c = 0; c < 4; ++c) {
+			double s[5] = {};
+			for (uint32_t x = x0; x < x0 + windowW; ++x) {
+				double const *column = &columns[(((size_t) x * 4) + c) * 5];
+				for (int k = 0; k < 5; ++k) s[k] += column[k];
+			}
+			double const meanA = s[0] / n;
+			double const meanB = s[1] / n;
+			double const varA = std::fmax(0.0, (s[2] / n) - (meanA * meanA));
+			double const varB = std::fmax(0.0, (s[3] / n) - (meanB * meanB));
+			double const covar = (s[4] / n) - (meanA * meanB);
+			sums.ssim[c] += ((2.0 * meanA * meanB + SsimC1) * (2.0 * covar + SsimC2)) /
+					((meanA * meanA + meanB * meanB + SsimC1) * (varA + varB + SsimC2));
+		}
+	}
+}
+
+} // end anonymous namespace
+
+bool Compare(Image_ImageHeader const *a,
+						 Image_ImageHeader const *b,
+						 CompareOptions const &options,
+						 CompareResult &result,
+						 char const *&error) {
+	memset(&result, 0, sizeof(result));
+
+	// compressed inputs are compared on what they decode to
+	Image_ImageHeader const *decodedA = nullptr;
+	Image_ImageHeader const *decodedB = nullptr;
+	DecompressOptions decompressOptions;
+	decompressOptions.format = TinyImageFormat_R32G32B32A32_SFLOAT;
+	decompressOptions.threadCount = options.threadCount;
+	if (TinyImageFormat_IsCompressed(a->format)) a = decodedA = Decompress(a, decompressOptions);
+	if (b && TinyImageFormat_IsCompressed(b->format)) b = decodedB = Decompress(b, decompressOptions);
+	auto const cleanup = [&]() {
+		if (decodedA) Image_Destroy(decodedA);
+		if (decodedB) Image_Destroy(decodedB);
+	};
+	if (!a || !b) {
+		cleanup();
+		error = "can't decompress image";
+		return false;
+	}
+
+	size_t const levelCount = Image_LinkedImageCountOf(a);
+	if (Image_LinkedImageCountOf(b) != levelCount) {
+		cleanup();
+		error = "images have different numbers of levels";
+		return false;
+	}
+	std::vector<Image_ImageHeader const *> levelsA(levelCount), levelsB(levelCount);
+	for (size_t i = 0; i < levelCount; ++i) {
+		levelsA[i] = Image_LinkedImageOf(a, i);
+		levelsB[i] = Image_LinkedImageOf(b, i);
+		auto const la = levelsA[i];
+		auto const lb = levelsB[i];
+		if (la->width != lb->width || la->height != lb->height || la->depth != lb->depth || la->slices != lb->slices) {
+			cleanup();
+			error = "images have different dimensions";
+			return false;
+		}
+		if (!CanAccessPixelRuns(la->format) || !CanAccessPixelRuns(lb->format)) {
+			cleanup();
+			error = "image format can't be read a row at a time";
+			return false;
+		}
+	}
+
+	std::vector<Image_ImageHeader *> diffs;
+	if (options.diff) {
+		for (size_t i = 0; i < levelCount; ++i) {
+			auto const la = levelsA[i];
+			auto const diff = (Image_ImageHeader *) Image_CreateNoClear(la->width, la->height, la->depth, la->slices,
+																																	TinyImageFormat_R32G32B32A32_SFLOAT);
+			if (!diff) {
+				for (auto d : diffs) Image_Destroy(d);
+				cleanup();
+				error = "out of memory creating diff image";
+				return false;
+			}
+			diff->flags = la->flags;
+			if (!diffs.empty()) {
+				diffs.back()->nextType = levelsA[i - 1]->nextType;
+				diffs.back()->nextImage = diff;
+			}
+			diffs.push_back(diff);
+		}
+	}
+
+	// every level counts in proportion to its pixels
+	size_t totalPixels = 0;
+	for (auto const la : levelsA) totalPixels += Image_PixelCountOf(la);
+
+	Sums total;
+	std::mutex totalMutex;
+
+	if (options.mse || options.psnr || options.maxDiff || options.diff) {
+		std::vector<Row> rows;
+		for (size_t i = 0; i < levelCount; ++i) {
+			auto const la = levelsA[i];
+			for (uint32_t s = 0; s < la->slices; ++s)
+				for (uint32_t z = 0; z < la->depth; ++z)
+					for (uint32_t y = 0; y < la->height; ++y) rows.push_back(Row{i, y, z, s});
+		}
+
+		ParallelFor(rows.size(), options.threadCount, 16, [&](size_t begin, size_t end) {
+			Sums sums;
+			std::vector<float> rowA, rowB, rowDiff;
+			for (size_t i = begin; i < end; ++i) {
+				Row const &row = rows[i];
+				auto const la = levelsA[row.level];
+				size_t const count = (size_t) la->width * 4;
+				rowA.resize(count);
+				rowB.resize(count);
+				DecodeRow(la, row, rowA.data());
+				DecodeRow(levelsB[row.level], row, rowB.data());
+				float *diff = nullptr;
+				if (options.diff) {
+					rowDiff.resize(count);
+					diff = rowDiff.data();
+				}
+				ErrorRow(rowA.data(), rowB.data(), la->width, options.diffScale, diff, sums);
+				if (diff) {
+					auto const d = diffs[row.level];
+					EncodePixelRunF(d, Image_CalculateIndex(d, 0, row.y, row.z, row.slice), la->width, diff);
+				}
+				sums.pixels += la->width;
+			}
+			std::lock_guard<std::mutex> lock(totalMutex);
+			total.Add(sums);
+		});
+	}
+
+	if (options.ssim) {
+		// ssim is averaged per level then weighted by the level's pixels
+		for (size_t i = 0; i < levelCount; ++i) {
+			auto const la = levelsA[i];
+			auto const lb = levelsB[i];
+			uint32_t const windowW = la->width < SsimWindow ? la->width : SsimWindow;
+			uint32_t const windowH = la->height < SsimWindow ? la->height : SsimWindow;
+			std::vector<uint32_t> xStarts, yStarts;
+			WindowStarts(la->width, windowW, xStarts);
+			WindowStarts(la->height, windowH, yStarts);
+
+			std::vector<Row> rows;
+			for (uint32_t s = 0; s < la->slices; ++s)
+				for (uint32_t z = 0; z < la->depth; ++z)
+					for (uint32_t y : yStarts) rows.push_back(Row{i, y, z, s});
+
+			Sums level;
+			ParallelFor(rows.size(), options.threadCount, 4, [&](size_t begin, size_t end) {
+				Sums sums;
+				std::vector<float> rowA((size_t) la->width * 4), rowB((size_t) la->width * 4);
+				std::vector<double> columns;
+				for (size_t r = begin; r < end; ++r) {
+					SsimRow(la, lb, rows[r], windowW, windowH, xStarts, rowA, rowB, columns, sums);
+				}
+				std::lock_guard<std::mutex> lock(totalMutex);
+				level.Add(sums);
+			});
+
+			double const windows = (double) rows.size() * xStarts.size();
+			double const weight = (double) Image_PixelCountOf(la) / (double) totalPixels;
+			for (int c = 0; c < 4; ++c) {
+				total.ssim[c] += (level.ssim[c] / windows) * weight;
+			}
+		}
+	}
+
+	// levels may point into the decoded images, read them before cleanup
+	result.channels = TinyImageFormat_ChannelCount(levelsA[0]->format);
+	uint32_t const channelsB = TinyImageFormat_ChannelCount(levelsB[0]->format);
+	if (channelsB > result.channels) result.channels = channelsB;
+	if (result.channels < 1) result.channels = 1;
+	if (result.channels > 4) result.channels = 4;
+
+	cleanup();
+
+	double const pixels = total.pixels > 0 ? total.pixels : 1.0;
+	double sumMse = 0, sumSsim = 0, maxAll = 0;
+	for (uint32_t c = 0; c < 4; ++c) {
+		result.mse[c] = total.squaredError[c] / pixels;
+		result.psnr[c] = result.mse[c] > 0 ? 10.0 * std::log10(1.0 / result.mse[c]) : std::numeric_limits<double>::infinity();
+		result.ssim[c] = total.ssim[c];
+		result.maxDiff[c] = total.maxDiff[c];
+		if (c < result.channels) {
+			sumMse += result.mse[c];
+			sumSsim += result.ssim[c];
+			maxAll = std::fmax(maxAll, result.maxDiff[c]);
+		}
+	}
+	result.mseAll = sumMse / result.channels;
+	result.psnrAll = result.mseAll > 0 ? 10.0 * std::log10(1.0 / result.mseAll) : std::numeric_limits<double>::infinity();
+	result.ssimAll = sumSsim / result.channels;
+	result.maxDiffAll = maxAll;
+	result.diff = diffs.empty() ? nullptr : diffs.front();
+	return true;
+}
+
+} // end namespace LuaImage
@@ -0,0 +1,48 @@
+#pragma once
+#ifndef LUA_IMAGE_COMPARE_HPP_
+#define LUA_IMAGE_COMPARE_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+
+namespace LuaImage {
+
+struct CompareOptions {
+	bool mse = true;
+	bool psnr = true;
+	bool ssim = true;
+	bool maxDiff = true;
+	// also produce an R32G32B32A32_SFLOAT chain of |a - b| * diffScale
+	bool diff = false;
+	float diffScale = 1.0f;
+	uint32_t threadCount = 0; // 0 = all hardware threads
+};
+
+// metrics of normalised channel values over every level of the chains,
+// each level weighted by its pixel count. The "all" values are over the
+// first channels channels (the most either format has)
+struct CompareResult {
+	uint32_t channels;
+	double mse[4];
+	double psnr[4]; // infinite when identical
+	double ssim[4]; // 8x8 windows at a stride of 4 over each 2D page
+	double maxDiff[4];
+	double mseAll;
+	double psnrAll;
+	double ssimAll;
+	double maxDiffAll;
+	Image_ImageHeader const *diff; // owned by the caller if requested
+};
+
+// compares two chains of the same shape, block compressed images are
+// decompressed first. Work is split across rows of every level and page.
+// false with error set if the images can't be compared
+bool Compare(Image_ImageHeader const *a,
+						 Image_ImageHeader const *b,
+						 CompareOptions const &options,
+						 CompareResult &result,
+						 char const *&error);
+
+} // end namespace LuaImage
+
+#endif
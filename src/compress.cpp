@@ -0,0 +1,178 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "gfx_image/create.h"
+#include "gfx_imagecompress/imagecompress.h"
+#include "compress.hpp"
+#include "parallel.hpp"
+#include <atomic>
+#include <vector>
+
+namespace LuaImage {
+
+namespace {
+
+struct Band {
+	size_t level;
+	uint32_t y;
+	uint32_t rows;
+	uint32_t z;
+	uint32_t slice;
+	Image_ImageHeader const *result;
+};
+
+Image_ImageHeader const *CompressBand(Image_ImageHeader const *band,
+																			CompressBC bc,
+																			CompressOptions const &options) {
+	// threading is done across bands so each band is compressed single threaded
+	Image_CompressAMDOptions amdOptions{};
+	amdOptions.disableMultiThreading = true;
+	amdOptions.numThreads = 1;
+	amdOptions.quality = options.quality;
+
+	switch (bc) {
+		case CompressBC::BC1: {
+			Image_CompressAMDBC1Options bc1Options{};
+			bc1Options.useAlpha = options.useAlpha;
+			bc1Options.alphaThreshold = options.alphaThreshold;
+			bc1Options.adaptiveWeighting = options.adaptiveWeighting;
+			bc1Options.useChannelWeighting = options.useChannelWeighting;
+			bc1Options.channelWeights[0] = options.channelWeights[0];
+			bc1Options.channelWeights[1] = options.channelWeights[1];
+			bc1Options.channelWeights[2] = options.channelWeights[2];
+			return Image_CompressAMDBC1(band, &amdOptions, &bc1Options, nullptr, nullptr);
+		}
+		case CompressBC::BC2: return Image_CompressAMDBC2(band, &amdOptions, nullptr, nullptr);
+		case CompressBC::BC3: return Image_CompressAMDBC3(band, &amdOptions, nullptr, nullptr);
+		case CompressBC::BC4: return Image_CompressAMDBC4(band, nullptr, nullptr);
+		case CompressBC::BC5: return Image_CompressAMDBC5(band, nullptr, nullptr);
+		case CompressBC::BC6H: return Image_CompressAMDBC6H(band, &amdOptions, nullptr, nullptr);
+		case CompressBC::BC7: return Image_CompressAMDBC7(band, &amdOptions, nullptr, nullptr);
+	}
+	return nullptr;
+}
+
+// copies the band rows out into its own 2D image
+Image_ImageHeader const *ExtractBand(Image_ImageHeader const *level, Band const &band) {
+	auto image = Image_Create2DNoClear(level->width, band.rows, level->format);
+	if (!image) return nullptr;
+
+	size_t const bytesPerPixel = TinyImageFormat_BitSizeOfBlock(level->format) / 8;
+	size_t const index = Image_CalculateIndex(level, 0, band.y, band.z, band.slice);
+	memcpy(Image_RawDataPtr(image),
+				 ((uint8_t const *) Image_RawDataPtr(level)) + (index * bytesPerPixel),
+				 (size_t) level->width * band.rows * bytesPerPixel);
+	return image;
+}
+
+} // end anonymous namespace
+
+Image_ImageHeader const *CompressAMD(Image_ImageHeader const *image,
+																		 CompressBC bc,
+																		 CompressOptions const &options) {
+	if (!image) return nullptr;
+
+	size_t const levelCount = Image_LinkedImageCountOf(image);
+	std::vector<Image_ImageHeader const *> levels(levelCount);
+	for (size_t i = 0; i < levelCount; ++i) {
+		levels[i] = Image_LinkedImageOf(image, i);
+		if (!levels[i]) return nullptr;
+		if (TinyImageFormat_IsCompressed(levels[i]->format)) return nullptr;
+		if ((TinyImageFormat_BitSizeOfBlock(levels[i]->format) % 8) != 0) return nullptr;
+	}
+
+	std::vector<Band> bands;
+	for (size_t i = 0; i < levelCount; ++i) {
+		auto const level = levels[i];
+		// every band apart from the last in a page must be whole block rows,
+		// clamped to the level first so rounding up can't wrap to 0
+		uint64_t const wanted = options.tileRows && options.tileRows < level->height ? options.tileRows : level->height;
+		uint64_t const rounded = (wanted + 3) & ~(uint64_t)3;
+		uint32_t const tileRows = !options.tileRows ? 4 : rounded > UINT32_MAX ? level->height : (uint32_t)rounded;
+		for (uint32_t s = 0; s < level->slices; ++s) {
+			for (uint32_t z = 0; z < level->depth; ++z) {
+				for (uint32_t y = 0; y < level->height; y += tileRows) {
+					uint32_t const rows = (level->height - y) < tileRows ? (level->height - y) : tileRows;
+					bands.push_back(Band{i, y, rows, z, s, nullptr});
+				}
+			}
+		}
+	}
+
+	if (bands.empty()) return nullptr;
+
+	std::atomic<bool> failed{false};
+	ParallelFor(bands.size(), options.threadCount, 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end && !failed; ++i) {
+			Band &band = bands[i];
+			auto const bandImage = ExtractBand(levels[band.level], band);
+			if (bandImage) {
+				band.result = CompressBand(bandImage, bc, options);
+				Image_Destroy(bandImage);
+			}
+			if (!band.result) failed = true;
+		}
+	});
+
+	std::vector<Image_ImageHeader *> results(levelCount, nullptr);
+	if (!failed) {
+		// the compressor picks the exact output format (e.g. BC1 with or without alpha)
+		TinyImageFormat const format = bands.front().result->format;
+		size_t const blockBytes = TinyImageFormat_BitSizeOfBlock(format) / 8;
+		uint32_t const blockW = TinyImageFormat_WidthOfBlock(format);
+		uint32_t const blockH = TinyImageFormat_HeightOfBlock(format);
+
+		for (size_t i = 0; i < levelCount && !failed; ++i) {
+			auto const level = levels[i];
+			results[i] = (Image_ImageHeader *) Image_CreateNoClear(level->width,
+																														 level->height,
+																														 level->depth,
+																														 level->slices,
+																														 format);
+			if (!results[i]) {
+				failed = true;
+				break;
+			}
+			results[i]->flags = level->flags;
+		}
+
+		for (auto const &band : bands) {
+			if (failed) break;
+			auto const level = levels[band.level];
+			size_t const blocksX = (level->width + blockW - 1) / blockW;
+			size_t const blocksY = (level->height + blockH - 1) / blockH;
+			size_t const rowBytes = blocksX * blockBytes;
+			size_t const pageBytes = rowBytes * blocksY;
+			size_t const page = ((size_t) band.slice * level->depth) + band.z;
+			size_t const offset = (page * pageBytes) + ((band.y / blockH) * rowBytes);
+			size_t const bandBytes = Image_ByteCountOf(band.result);
+
+			if (offset + bandBytes > Image_ByteCountOf(results[band.level])) {
+				failed = true;
+				break;
+			}
+			memcpy(((uint8_t *) Image_RawDataPtr(results[band.level])) + offset,
+						 Image_RawDataPtr(band.result),
+						 bandBytes);
+		}
+	}
+
+	for (auto &band : bands) {
+		if (band.result) Image_Destroy(band.result);
+	}
+
+	if (failed) {
+		for (auto result : results) {
+			if (result) Image_Destroy(result);
+		}
+		return nullptr;
+	}
+
+	// rebuild the chain in the same shape as the source
+	for (size_t i = 0; i + 1 < levelCount; ++i) {
+		results[i]->nextType = levels[i]->nextType;
+		results[i]->nextImage = results[i + 1];
+	}
+	return results.front();
+}
+
+} // end namespace LuaImage
@@ -0,0 +1,46 @@
+#pragma once
+#ifndef LUA_IMAGE_COMPRESS_HPP_
+#define LUA_IMAGE_COMPRESS_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+
+namespace LuaImage {
+
+enum class CompressBC {
+	BC1,
+	BC2,
+	BC3,
+	BC4,
+	BC5,
+	BC6H,
+	BC7,
+};
+
+struct CompressOptions {
+	// 0 (fastest) to 1 (best)
+	float quality = 0.05f;
+	// 0 = all hardware threads
+	uint32_t threadCount = 0;
+	// rows per tile, rounded up to a multiple of the 4 pixel block height
+	uint32_t tileRows = 64;
+
+	// BC1 only
+	bool useAlpha = false;
+	uint8_t alphaThreshold = 128;
+	bool adaptiveWeighting = false;
+	bool useChannelWeighting = false;
+	float channelWeights[3] = {0.3086f, 0.6094f, 0.0820f};
+};
+
+// Compresses every image in the linked image chain. Each 2D page of every
+// level/slice is cut into bands of whole block rows, the bands are compressed
+// on separate threads and stitched back together as BC block rows are
+// contiguous. Returns nullptr on failure
+Image_ImageHeader const *CompressAMD(Image_ImageHeader const *image,
+																		 CompressBC bc,
+																		 CompressOptions const &options);
+
+} // end namespace LuaImage
+
+#endif
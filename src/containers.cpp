@@ -0,0 +1,465 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "gfx_image/create.h"
+#include "al2o3_vfile/vfile.h"
+#include "tiny_imageformat/tinyimageformat_query.h"
+#include "tiny_imageformat/tinyimageformat_apis.h"
+#include "containers.hpp"
+#include <cstdio>
+
+namespace LuaImage {
+
+namespace {
+
+uint32_t Read32(uint8_t const *bytes, size_t offset) {
+	uint32_t value;
+	memcpy(&value, bytes + offset, sizeof(value));
+	return value;
+}
+
+uint16_t Read16(uint8_t const *bytes, size_t offset) {
+	uint16_t value;
+	memcpy(&value, bytes + offset, sizeof(value));
+	return value;
+}
+
+uint32_t Read32BE(uint8_t const *bytes, size_t offset) {
+	return ((uint32_t) bytes[offset] << 24) | ((uint32_t) bytes[offset + 1] << 16) |
+			((uint32_t) bytes[offset + 2] << 8) | (uint32_t) bytes[offset + 3];
+}
+
+uint16_t Read16BE(uint8_t const *bytes, size_t offset) {
+	return (uint16_t) (((uint32_t) bytes[offset] << 8) | (uint32_t) bytes[offset + 1]);
+}
+
+// fills in the fields shared by the single image formats
+void SetSingle(ContainerInfo &info, char const *container, TinyImageFormat format, uint32_t width, uint32_t height) {
+	info.container = container;
+	info.format = format;
+	info.width = width;
+	info.height = height;
+	info.depth = 1;
+	info.slices = 1;
+	info.levels = 1;
+	info.flags = 0;
+	info.topLevelContiguous = false;
+	info.dataOffset = 0;
+	info.dataSize = 0;
+}
+
+uint32_t LevelSize(uint32_t size, uint32_t level) {
+	uint32_t const shifted = level < 32 ? size >> level : 0;
+	return shifted ? shifted : 1;
+}
+
+constexpr uint32_t FourCC(char a, char b, char c, char d) {
+	return ((uint32_t) (uint8_t) a) | ((uint32_t) (uint8_t) b << 8) |
+			((uint32_t) (uint8_t) c << 16) | ((uint32_t) (uint8_t) d << 24);
+}
+
+size_t BytesFor(TinyImageFormat format, uint32_t w, uint32_t h, uint32_t d, uint32_t s) {
+	size_t const bw = TinyImageFormat_WidthOfBlock(format);
+	size_t const bh = TinyImageFormat_HeightOfBlock(format);
+	size_t const bd = TinyImageFormat_DepthOfBlock(format);
+	size_t const blocks = ((w + bw - 1) / bw) * ((h + bh - 1) / bh) * ((d + bd - 1) / bd);
+	return (blocks * s * TinyImageFormat_BitSizeOfBlock(format)) / 8;
+}
+
+// DDS files without a DX10 header describe formats with masks or a D3DFMT fourCC
+TinyImageFormat DDSLegacyFormat(uint8_t const *pf) {
+	enum {
+		DDPF_ALPHAPIXELS = 0x1,
+		DDPF_ALPHA = 0x2,
+		DDPF_FOURCC = 0x4,
+		DDPF_RGB = 0x40,
+		DDPF_LUMINANCE = 0x20000,
+	};
+	uint32_t const flags = Read32(pf, 4);
+	uint32_t const fourCC = Read32(pf, 8);
+	uint32_t const bits = Read32(pf, 12);
+	uint32_t const r = Read32(pf, 16);
+	uint32_t const g = Read32(pf, 20);
+	uint32_t const b = Read32(pf, 24);
+	uint32_t const a = Read32(pf, 28);
+
+	if (flags & DDPF_FOURCC) {
+		switch (fourCC) {
+			case FourCC('D', 'X', 'T', '1'): return TinyImageFormat_DXBC1_RGBA_UNORM;
+			case FourCC('D', 'X', 'T', '2'):
+			case FourCC('D', 'X', 'T', '3'): return TinyImageFormat_DXBC2_UNORM;
+			case FourCC('D', 'X', 'T', '4'):
+			case FourCC('D', 'X', 'T', '5'): return TinyImageFormat_DXBC3_UNORM;
+			case FourCC('A', 'T', 'I', '1'):
+			case FourCC('B', 'C', '4', 'U'): return TinyImageFormat_DXBC4_UNORM;
+			case FourCC('A', 'T', 'I', '2'):
+			case FourCC('B', 'C', '5', 'U'): return TinyImageFormat_DXBC5_UNORM;
+			// D3DFMT values stored directly in the fourCC
+			case 36: return TinyImageFormat_R16G16B16A16_UNORM;
+			case 111: return TinyImageFormat_R16_SFLOAT;
+			case 112: return TinyImageFormat_R16G16_SFLOAT;
+			case 113: return TinyImageFormat_R16G16B16A16_SFLOAT;
+			case 114: return TinyImageFormat_R32_SFLOAT;
+			case 115: return TinyImageFormat_R32G32_SFLOAT;
+			case 116: return TinyImageFormat_R32G32B32A32_SFLOAT;
+			default: return TinyImageFormat_UNDEFINED;
+		}
+	}
+
+	if (flags & DDPF_RGB) {
+		if (bits == 32 && r == 0x000000ff && g == 0x0000ff00 && b == 0x00ff0000) {
+			return TinyImageFormat_R8G8B8A8_UNORM;
+		}
+		if (bits == 32 && r == 0x00ff0000 && g == 0x0000ff00 && b == 0x000000ff) {
+			return (flags & DDPF_ALPHAPIXELS) && a ? TinyImageFormat_B8G8R8A8_UNORM : TinyImageFormat_B8G8R8X8_UNORM;
+		}
+		if (bits == 32 && r == 0x0000ffff && g == 0xffff0000) return TinyImageFormat_R16G16_UNORM;
+		if (bits == 16 && r == 0xf800 && g == 0x07e0 && b == 0x001f) return TinyImageFormat_B5G6R5_UNORM;
+		return TinyImageFormat_UNDEFINED;
+	}
+
+	if (flags & DDPF_LUMINANCE) {
+		if (bits == 8 && r == 0xff) return TinyImageFormat_R8_UNORM;
+		if (bits == 16 && r == 0xffff) return TinyImageFormat_R16_UNORM;
+		if (bits == 16 && r == 0x00ff && a == 0xff00) return TinyImageFormat_R8G8_UNORM;
+		return TinyImageFormat_UNDEFINED;
+	}
+
+	if ((flags & DDPF_ALPHA) && bits == 8) return TinyImageFormat_A8_UNORM;
+
+	return TinyImageFormat_UNDEFINED;
+}
+
+// KTX stores the GL sized internal format
+TinyImageFormat KTXFormat(uint32_t glInternalFormat) {
+	switch (glInternalFormat) {
+		case 0x8229: return TinyImageFormat_R8_UNORM;            // GL_R8
+		case 0x822B: return TinyImageFormat_R8G8_UNORM;          // GL_RG8
+		case 0x8058: return TinyImageFormat_R8G8B8A8_UNORM;      // GL_RGBA8
+		case 0x8C43: return TinyImageFormat_R8G8B8A8_SRGB;       // GL_SRGB8_ALPHA8
+		case 0x822A: return TinyImageFormat_R16_UNORM;           // GL_R16
+		case 0x805B: return TinyImageFormat_R16G16B16A16_UNORM;  // GL_RGBA16
+		case 0x822D: return TinyImageFormat_R16_SFLOAT;          // GL_R16F
+		case 0x822F: return TinyImageFormat_R16G16_SFLOAT;       // GL_RG16F
+		case 0x881A: return TinyImageFormat_R16G16B16A16_SFLOAT; // GL_RGBA16F
+		case 0x822E: return TinyImageFormat_R32_SFLOAT;          // GL_R32F
+		case 0x8230: return TinyImageFormat_R32G32_SFLOAT;       // GL_RG32F
+		case 0x8814: return TinyImageFormat_R32G32B32A32_SFLOAT; // GL_RGBA32F
+		case 0x83F1: return TinyImageFormat_DXBC1_RGBA_UNORM;    // GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+		case 0x83F2: return TinyImageFormat_DXBC2_UNORM;         // GL_COMPRESSED_RGBA_S3TC_DXT3_EXT
+		case 0x83F3: return TinyImageFormat_DXBC3_UNORM;         // GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+		case 0x8E8C: return TinyImageFormat_DXBC7_UNORM;         // GL_COMPRESSED_RGBA_BPTC_UNORM
+		case 0x8E8D: return TinyImageFormat_DXBC7_SRGB;          // GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM
+		default: return TinyImageFormat_UNDEFINED;
+	}
+}
+
+} // end anonymous namespace
+
+bool Container_ParseDDS(void const *data, size_t size, ContainerInfo &info) {
+	enum {
+		DDSD_DEPTH = 0x800000,
+		DDSCAPS2_CUBEMAP = 0x200,
+		DDS_RESOURCE_MISC_TEXTURECUBE = 0x4,
+		DDS_DIMENSION_TEXTURE3D = 4,
+		HeaderSize = 4 + 124,
+		DX10HeaderSize = 20,
+	};
+
+	auto const bytes = (uint8_t const *) data;
+	if (size < HeaderSize || Read32(bytes, 0) != FourCC('D', 'D', 'S', ' ')) return false;
+	if (Read32(bytes, 4) != 124) return false;
+
+	uint32_t const flags = Read32(bytes, 8);
+	info.container = "DDS";
+	info.height = Read32(bytes, 12);
+	info.width = Read32(bytes, 16);
+	info.depth = (flags & DDSD_DEPTH) ? Read32(bytes, 24) : 1;
+	info.levels = Read32(bytes, 28);
+	info.slices = 1;
+	info.flags = 0;
+	uint32_t const caps2 = Read32(bytes, 4 + 108);
+
+	uint8_t const *pf = bytes + 4 + 72;
+	size_t dataOffset = HeaderSize;
+	if ((Read32(pf, 4) & 0x4) && Read32(pf, 8) == FourCC('D', 'X', '1', '0')) {
+		if (size < HeaderSize + DX10HeaderSize) return false;
+		uint8_t const *dx10 = bytes + HeaderSize;
+		info.format = TinyImageFormat_FromDXGI_FORMAT((TinyImageFormat_DXGI_FORMAT) Read32(dx10, 0));
+		if (Read32(dx10, 4) != DDS_DIMENSION_TEXTURE3D) info.depth = 1;
+		info.slices = Read32(dx10, 12) ? Read32(dx10, 12) : 1;
+		if (Read32(dx10, 8) & DDS_RESOURCE_MISC_TEXTURECUBE) {
+			info.slices *= 6;
+			info.flags |= Image_Flag_Cubemap;
+		}
+		dataOffset += DX10HeaderSize;
+	} else {
+		info.format = DDSLegacyFormat(pf);
+		if (caps2 & DDSCAPS2_CUBEMAP) {
+			info.slices = 6;
+			info.flags |= Image_Flag_Cubemap;
+		}
+	}
+
+	if (info.format == TinyImageFormat_UNDEFINED) return false;
+	if (info.width == 0 || info.height == 0 || info.depth == 0) return false;
+	if (info.levels == 0) info.levels = 1;
+	if (info.levels > 32) return false;
+
+	// DDS stores every level of a slice before the next slice so only the top
+	// level of single slice or single level files is contiguous
+	info.dataOffset = dataOffset;
+	info.dataSize = BytesFor(info.format, info.width, info.height, info.depth, info.slices);
+	info.topLevelContiguous = (info.levels == 1 || info.slices == 1) &&
+			info.dataOffset + info.dataSize <= size;
+	return true;
+}
+
+bool Container_ParseKTX(void const *data, size_t size, ContainerInfo &info) {
+	static uint8_t const Identifier[12] = {
+			0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+	};
+	enum { HeaderSize = 64 };
+
+	auto const bytes = (uint8_t const *) data;
+	if (size < HeaderSize || memcmp(bytes, Identifier, sizeof(Identifier)) != 0) return false;
+	// only files written in our own endianness
+	if (Read32(bytes, 12) != 0x04030201) return false;
+
+	info.container = "KTX";
+	info.format = KTXFormat(Read32(bytes, 28));
+	info.width = Read32(bytes, 36);
+	info.height = Read32(bytes, 40) ? Read32(bytes, 40) : 1;
+	info.depth = Read32(bytes, 44) ? Read32(bytes, 44) : 1;
+	uint32_t const arrayElements = Read32(bytes, 48);
+	uint32_t const faces = Read32(bytes, 52) ? Read32(bytes, 52) : 1;
+	info.levels = Read32(bytes, 56) ? Read32(bytes, 56) : 1;
+	info.slices = (arrayElements ? arrayElements : 1) * faces;
+	info.flags = faces == 6 ? (uint8_t) Image_Flag_Cubemap : (uint8_t) 0;
+
+	if (info.format == TinyImageFormat_UNDEFINED || info.width == 0) return false;
+	if (info.levels > 32) return false;
+
+	// each level is a 4 byte imageSize then array elements, faces, z, rows
+	info.dataOffset = HeaderSize + (size_t) Read32(bytes, 60) + 4;
+	info.dataSize = BytesFor(info.format, info.width, info.height, info.depth, info.slices);
+
+	// rows and non array cube faces are padded to 4 bytes in the file
+	size_t const rowBytes = BytesFor(info.format, info.width, 1, 1, 1);
+	size_t const faceBytes = BytesFor(info.format, info.width, info.height, info.depth, 1);
+	bool const padded = (!TinyImageFormat_IsCompressed(info.format) && (rowBytes % 4) != 0) ||
+			(arrayElements == 0 && faces == 6 && (faceBytes % 4) != 0);
+	info.topLevelContiguous = !padded && info.dataOffset + info.dataSize <= size;
+	return true;
+}
+
+bool Container_Parse(void const *data, size_t size, ContainerInfo &info) {
+	return Container_ParseDDS(data, size, info) || Container_ParseKTX(data, size, info);
+}
+
+bool Container_ParsePNG(void const *data, size_t size, ContainerInfo &info) {
+	static uint8_t const Signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	auto const bytes = (uint8_t const *) data;
+	// signature then the IHDR chunk which must come first
+	if (size < 8 + 8 + 13 || memcmp(bytes, Signature, sizeof(Signature)) != 0) return false;
+	if (Read32BE(bytes, 8) != 13 || memcmp(bytes + 12, "IHDR", 4) != 0) return false;
+
+	uint32_t const width = Read32BE(bytes, 16);
+	uint32_t const height = Read32BE(bytes, 20);
+	uint8_t const bitDepth = bytes[24];
+	uint8_t const colourType = bytes[25];
+	bool const wide = bitDepth == 16;
+
+	TinyImageFormat format;
+	switch (colourType) {
+		case 0: format = wide ? TinyImageFormat_R16_UNORM : TinyImageFormat_R8_UNORM;
+			break;
+		case 2: format = wide ? TinyImageFormat_R16G16B16_UNORM : TinyImageFormat_R8G8B8_UNORM;
+			break;
+		case 3: format = TinyImageFormat_R8G8B8A8_UNORM; // palette entries
+			break;
+		case 4: format = wide ? TinyImageFormat_R16G16_UNORM : TinyImageFormat_R8G8_UNORM;
+			break;
+		case 6: format = wide ? TinyImageFormat_R16G16B16A16_UNORM : TinyImageFormat_R8G8B8A8_UNORM;
+			break;
+		default: return false;
+	}
+	if (width == 0 || height == 0) return false;
+
+	SetSingle(info, "PNG", format, width, height);
+	return true;
+}
+
+bool Container_ParseTGA(void const *data, size_t size, ContainerInfo &info) {
+	// TGA has no signature so be strict about the header fields
+	enum { HeaderSize = 18 };
+	auto const bytes = (uint8_t const *) data;
+	if (size < HeaderSize) return false;
+
+	uint8_t const colourMapType = bytes[1];
+	uint8_t const imageType = bytes[2];
+	uint16_t const width = Read16(bytes, 12);
+	uint16_t const height = Read16(bytes, 14);
+	uint8_t const bitsPerPixel = bytes[16];
+	if (colourMapType > 1 || width == 0 || height == 0) return false;
+
+	TinyImageFormat format;
+	switch (imageType) {
+		case 1:
+		case 9: // colour mapped
+			if (colourMapType != 1 || bitsPerPixel != 8) return false;
+			format = TinyImageFormat_B8G8R8A8_UNORM;
+			break;
+		case 2:
+		case 10: // true colour
+			if (bitsPerPixel == 16) format = TinyImageFormat_B5G5R5A1_UNORM;
+			else if (bitsPerPixel == 24) format = TinyImageFormat_B8G8R8_UNORM;
+			else if (bitsPerPixel == 32) format = TinyImageFormat_B8G8R8A8_UNORM;
+			else return false;
+			break;
+		case 3:
+		case 11: // greyscale
+			if (bitsPerPixel != 8) return false;
+			format = TinyImageFormat_R8_UNORM;
+			break;
+		default: return false;
+	}
+
+	SetSingle(info, "TGA", format, width, height);
+	return true;
+}
+
+bool Container_ParseHDR(void const *data, size_t size, ContainerInfo &info) {
+	auto const text = (char const *) data;
+	bool const radiance = size >= 10 && memcmp(text, "#?RADIANCE", 10) == 0;
+	bool const rgbe = size >= 6 && memcmp(text, "#?RGBE", 6) == 0;
+	if (!radiance && !rgbe) return false;
+
+	// header lines end with an empty line then the resolution line
+	size_t pos = 0;
+	bool blank = false;
+	while (pos < size && !blank) {
+		size_t const start = pos;
+		while (pos < size && text[pos] != '\n') pos++;
+		blank = (pos == start);
+		pos++;
+	}
+	if (!blank || pos >= size) return false;
+
+	char line[64];
+	size_t length = 0;
+	while (pos + length < size && text[pos + length] != '\n' && length < sizeof(line) - 1) {
+		line[length] = text[pos + length];
+		length++;
+	}
+	line[length] = 0;
+
+	char yAxis[3], xAxis[3];
+	unsigned int height, width;
+	if (sscanf(line, "%2s %u %2s %u", yAxis, &height, xAxis, &width) != 4) return false;
+	// the axes can be swapped for rotated images
+	if (yAxis[1] == 'X') {
+		unsigned int const swap = height;
+		height = width;
+		width = swap;
+	}
+	if (width == 0 || height == 0) return false;
+
+	SetSingle(info, "HDR", TinyImageFormat_R32G32B32_SFLOAT, width, height);
+	return true;
+}
+
+bool Container_ParseJPG(VFile_Handle file, ContainerInfo &info) {
+	uint8_t marker[4];
+	if (!VFile_Seek(file, 0, VFile_SD_Begin)) return false;
+	if (VFile_Read(file, marker, 2) != 2 || marker[0] != 0xFF || marker[1] != 0xD8) return false;
+
+	for (;;) {
+		if (VFile_Read(file, marker, 4) != 4 || marker[0] != 0xFF) return false;
+		// fill bytes
+		while (marker[1] == 0xFF) {
+			marker[1] = marker[2];
+			marker[2] = marker[3];
+			if (VFile_Read(file, marker + 3, 1) != 1) return false;
+		}
+
+		uint8_t const type = marker[1];
+		uint16_t const length = Read16BE(marker, 2);
+		if (length < 2) return false;
+
+		// every start of frame apart from DHT (C4), JPG (C8) and DAC (CC)
+		bool const startOfFrame = type >= 0xC0 && type <= 0xCF &&
+				type != 0xC4 && type != 0xC8 && type != 0xCC;
+		if (startOfFrame) {
+			uint8_t frame[6];
+			if (length < 2 + sizeof(frame) || VFile_Read(file, frame, sizeof(frame)) != sizeof(frame)) return false;
+			uint16_t const height = Read16BE(frame, 1);
+			uint16_t const width = Read16BE(frame, 3);
+			uint8_t const components = frame[5];
+			if (width == 0 || height == 0) return false;
+			if (components != 1 && components != 3) return false;
+
+			SetSingle(info, "JPG", components == 1 ? TinyImageFormat_R8_UNORM : TinyImageFormat_R8G8B8_UNORM,
+								width, height);
+			return true;
+		}
+		// start of scan without a frame or end of image
+		if (type == 0xDA || type == 0xD9) return false;
+
+		if (!VFile_Seek(file, length - 2, VFile_SD_Current)) return false;
+	}
+}
+
+bool Container_Probe(VFile_Handle file, ContainerInfo &info) {
+	// enough for any of the fixed headers and the usual HDR header lines
+	uint8_t prefix[4096];
+	size_t const size = VFile_Read(file, prefix, sizeof(prefix));
+
+	if (Container_Parse(prefix, size, info)) return true;
+	if (Container_ParsePNG(prefix, size, info)) return true;
+	if (Container_ParseHDR(prefix, size, info)) return true;
+	if (size >= 2 && prefix[0] == 0xFF && prefix[1] == 0xD8) return Container_ParseJPG(file, info);
+	return Container_ParseTGA(prefix, size, info);
+}
+
+Image_ImageHeader const *Container_CreateHeaderOnly(ContainerInfo const &info) {
+	Image_ImageHeader const *top = nullptr;
+	Image_ImageHeader *last = nullptr;
+	for (uint32_t level = 0; level < info.levels; ++level) {
+		auto const image = (Image_ImageHeader *) Image_CreateHeaderOnly(LevelSize(info.width, level),
+																																		LevelSize(info.height, level),
+																																		LevelSize(info.depth, level),
+																																		info.slices,
+																																		info.format);
+		if (!image) {
+			if (top) Image_Destroy(top);
+			return nullptr;
+		}
+		image->flags |= info.flags;
+		if (last) {
+			last->nextType = Image_NT_MipMap;
+			last->nextImage = image;
+		} else {
+			top = image;
+		}
+		last = image;
+	}
+	return top;
+}
+
+size_t Container_ByteCountOf(ContainerInfo const &info) {
+	return BytesFor(info.format, info.width, info.height, info.depth, info.slices);
+}
+
+size_t Container_ByteCountOfChain(ContainerInfo const &info) {
+	size_t bytes = 0;
+	for (uint32_t level = 0; level < info.levels; ++level) {
+		bytes += BytesFor(info.format,
+											LevelSize(info.width, level),
+											LevelSize(info.height, level),
+											LevelSize(info.depth, level),
+											info.slices);
+	}
+	return bytes;
+}
+
+} // end namespace LuaImage
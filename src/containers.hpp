@@ -0,0 +1,60 @@
+#pragma once
+#ifndef LUA_IMAGE_CONTAINERS_HPP_
+#define LUA_IMAGE_CONTAINERS_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "al2o3_vfile/vfile.h"
+
+namespace LuaImage {
+
+// What an image file's header says about it, read without touching the
+// pixel data
+struct ContainerInfo {
+	char const *container; // "DDS", "KTX", "PNG", "JPG", "TGA" or "HDR"
+	TinyImageFormat format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	uint32_t slices;
+	uint32_t levels;
+	uint8_t flags; // Image_Flag_*
+
+	// true if the top level's pixels sit in the file exactly as an image of
+	// this shape lays them out in memory, dataOffset and dataSize locate them
+	bool topLevelContiguous;
+	size_t dataOffset;
+	size_t dataSize;
+};
+
+// parse a DDS or KTX (1.1) header from the start of a file. false if data
+// isn't that container or uses something we don't understand
+bool Container_ParseDDS(void const *data, size_t size, ContainerInfo &info);
+bool Container_ParseKTX(void const *data, size_t size, ContainerInfo &info);
+
+// tries the DDS and KTX parsers
+bool Container_Parse(void const *data, size_t size, ContainerInfo &info);
+
+// parse the header of PNG, TGA or Radiance HDR files from the start of a
+// file. These report the pixel format stored in the file
+bool Container_ParsePNG(void const *data, size_t size, ContainerInfo &info);
+bool Container_ParseTGA(void const *data, size_t size, ContainerInfo &info);
+bool Container_ParseHDR(void const *data, size_t size, ContainerInfo &info);
+
+// JPEG frame headers can be behind large metadata segments so this walks
+// the file's markers seeking past segments rather than reading them
+bool Container_ParseJPG(VFile_Handle file, ContainerInfo &info);
+
+// reads just enough of file to fill in info for any of the containers above
+bool Container_Probe(VFile_Handle file, ContainerInfo &info);
+
+// a header only image (chain if the file has mip maps) describing info
+Image_ImageHeader const *Container_CreateHeaderOnly(ContainerInfo const &info);
+
+// bytes of the top level and of every level of info
+size_t Container_ByteCountOf(ContainerInfo const &info);
+size_t Container_ByteCountOfChain(ContainerInfo const &info);
+
+} // end namespace LuaImage
+
+#endif
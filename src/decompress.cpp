@@ -0,0 +1,176 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "gfx_image/create.h"
+#include "gfx_imagedecompress/imagedecompress.h"
+#include "decompress.hpp"
+#include "parallel.hpp"
+#include "pixelrows.hpp"
+#include <atomic>
+#include <vector>
+
+namespace LuaImage {
+
+namespace {
+
+struct Band {
+	size_t level;
+	uint32_t y;
+	uint32_t rows;
+	uint32_t z;
+	uint32_t slice;
+	Image_ImageHeader const *result;
+};
+
+// copies the band's block rows out into its own compressed 2D image
+Image_ImageHeader const *ExtractBand(Image_ImageHeader const *level, Band const &band) {
+	auto image = Image_CreateNoClear(level->width, band.rows, 1, 1, level->format);
+	if (!image) return nullptr;
+
+	TinyImageFormat const format = level->format;
+	size_t const blockBytes = TinyImageFormat_BitSizeOfBlock(format) / 8;
+	uint32_t const blockW = TinyImageFormat_WidthOfBlock(format);
+	uint32_t const blockH = TinyImageFormat_HeightOfBlock(format);
+	size_t const blocksX = (level->width + blockW - 1) / blockW;
+	size_t const blocksY = (level->height + blockH - 1) / blockH;
+	size_t const rowBytes = blocksX * blockBytes;
+	size_t const page = ((size_t) band.slice * level->depth) + band.z;
+	size_t const offset = (page * rowBytes * blocksY) + ((band.y / blockH) * rowBytes);
+	size_t const bandBytes = Image_ByteCountOf(image);
+	if (offset + bandBytes > Image_ByteCountOf(level)) {
+		Image_Destroy(image);
+		return nullptr;
+	}
+
+	memcpy(Image_RawDataPtr(image), ((uint8_t const *) Image_RawDataPtr(level)) + offset, bandBytes);
+	return image;
+}
+
+// writes the decoded band into its rows of dst, converting if the formats differ
+bool PlaceBand(Image_ImageHeader const *dst, Band const &band) {
+	auto const src = band.result;
+	if (src->width != dst->width || src->height != band.rows) return false;
+
+	size_t const dstIndex = Image_CalculateIndex(dst, 0, band.y, band.z, band.slice);
+	size_t const pixels = (size_t) src->width * band.rows;
+	if (src->format == dst->format) {
+		size_t const bytesPerPixel = TinyImageFormat_BitSizeOfBlock(dst->format) / 8;
+		memcpy(((uint8_t *) Image_RawDataPtr(dst)) + (dstIndex * bytesPerPixel),
+					 Image_RawDataPtr(src),
+					 pixels * bytesPerPixel);
+		return true;
+	}
+
+	static uint32_t const RunLength = 1024;
+	double run[RunLength * 4];
+	for (size_t index = 0; index < pixels; index += RunLength) {
+		uint32_t const count = (pixels - index) < RunLength ? (uint32_t) (pixels - index) : RunLength;
+		DecodePixelRunD(src, index, count, run);
+		EncodePixelRunD(dst, dstIndex + index, count, run);
+	}
+	return true;
+}
+
+} // end anonymous namespace
+
+Image_ImageHeader const *Decompress(Image_ImageHeader const *image, DecompressOptions const &options) {
+	if (!image) return nullptr;
+
+	size_t const levelCount = Image_LinkedImageCountOf(image);
+	std::vector<Image_ImageHeader const *> levels(levelCount);
+	for (size_t i = 0; i < levelCount; ++i) {
+		levels[i] = Image_LinkedImageOf(image, i);
+		if (!levels[i]) return nullptr;
+		if (!TinyImageFormat_IsCompressed(levels[i]->format)) return nullptr;
+		// 3D blocks span pages so can't be cut into bands
+		if (TinyImageFormat_DepthOfBlock(levels[i]->format) != 1) return nullptr;
+	}
+	if (options.format != TinyImageFormat_UNDEFINED &&
+			(TinyImageFormat_IsCompressed(options.format) || !CanAccessPixelRuns(options.format))) {
+		return nullptr;
+	}
+
+	std::vector<Band> bands;
+	for (size_t i = 0; i < levelCount; ++i) {
+		auto const level = levels[i];
+		uint32_t const blockH = TinyImageFormat_HeightOfBlock(level->format);
+		// clamped to the level first so rounding up to whole blocks can't wrap to 0
+		uint64_t const wanted = options.tileRows && options.tileRows < level->height ? options.tileRows : level->height;
+		uint64_t const rounded = ((wanted + blockH - 1) / blockH) * blockH;
+		uint32_t const tileRows = !options.tileRows ? blockH : rounded > UINT32_MAX ? level->height : (uint32_t)rounded;
+		for (uint32_t s = 0; s < level->slices; ++s) {
+			for (uint32_t z = 0; z < level->depth; ++z) {
+				for (uint32_t y = 0; y < level->height; y += tileRows) {
+					uint32_t const rows = (level->height - y) < tileRows ? (level->height - y) : tileRows;
+					bands.push_back(Band{i, y, rows, z, s, nullptr});
+				}
+			}
+		}
+	}
+
+	if (bands.empty()) return nullptr;
+
+	std::atomic<bool> failed{false};
+	ParallelFor(bands.size(), options.threadCount, 1, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end && !failed; ++i) {
+			Band &band = bands[i];
+			auto const bandImage = ExtractBand(levels[band.level], band);
+			if (bandImage) {
+				band.result = Image_Decompress(bandImage);
+				Image_Destroy(bandImage);
+			}
+			if (!band.result) failed = true;
+		}
+	});
+
+	std::vector<Image_ImageHeader *> results(levelCount, nullptr);
+	if (!failed) {
+		// the decoder picks its output format (e.g. floats for BC6H)
+		TinyImageFormat const decoded = bands.front().result->format;
+		TinyImageFormat const format = options.format != TinyImageFormat_UNDEFINED ? options.format : decoded;
+		for (auto const &band : bands) {
+			if (band.result->format != format && !CanAccessPixelRuns(band.result->format)) failed = true;
+		}
+
+		for (size_t i = 0; i < levelCount && !failed; ++i) {
+			auto const level = levels[i];
+			results[i] = (Image_ImageHeader *) Image_CreateNoClear(level->width,
+																														 level->height,
+																														 level->depth,
+																														 level->slices,
+																														 format);
+			if (!results[i]) {
+				failed = true;
+				break;
+			}
+			results[i]->flags = level->flags;
+		}
+
+		if (!failed) {
+			ParallelFor(bands.size(), options.threadCount, 1, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i) {
+					if (!PlaceBand(results[bands[i].level], bands[i])) failed = true;
+				}
+			});
+		}
+	}
+
+	for (auto &band : bands) {
+		if (band.result) Image_Destroy(band.result);
+	}
+
+	if (failed) {
+		for (auto result : results) {
+			if (result) Image_Destroy(result);
+		}
+		return nullptr;
+	}
+
+	// rebuild the chain in the same shape as the source
+	for (size_t i = 0; i + 1 < levelCount; ++i) {
+		results[i]->nextType = levels[i]->nextType;
+		results[i]->nextImage = results[i + 1];
+	}
+	return results.front();
+}
+
+} // end namespace LuaImage
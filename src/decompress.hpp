@@ -0,0 +1,29 @@
+#pragma once
+#ifndef LUA_IMAGE_DECOMPRESS_HPP_
+#define LUA_IMAGE_DECOMPRESS_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+
+namespace LuaImage {
+
+struct DecompressOptions {
+	// output format, UNDEFINED keeps whatever the decoder produces
+	TinyImageFormat format = TinyImageFormat_UNDEFINED;
+	// 0 = all hardware threads
+	uint32_t threadCount = 0;
+	// rows per band, rounded up to a multiple of the block height
+	uint32_t tileRows = 64;
+};
+
+// Decompresses every image in the linked image chain with the library's
+// decoders (every block compressed format it supports). Like CompressAMD
+// each 2D page of every level/slice is cut into bands of whole block rows
+// that decode on separate threads, then land in the output converted to
+// options.format if set. Returns nullptr if the image isn't compressed or
+// can't be decoded
+Image_ImageHeader const *Decompress(Image_ImageHeader const *image, DecompressOptions const &options);
+
+} // end namespace LuaImage
+
+#endif
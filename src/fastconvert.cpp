@@ -0,0 +1,558 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "gfx_image/create.h"
+#include "tiny_imageformat/tinyimageformat_query.h"
+#include "fastconvert.hpp"
+#include "parallel.hpp"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define LUA_IMAGE_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define LUA_IMAGE_TARGET(isa)
+#else
+#include <cpuid.h>
+#define LUA_IMAGE_TARGET(isa) __attribute__((target(isa)))
+#endif
+#define LUA_IMAGE_X86_KERNEL(kernel) &kernel
+#else
+#define LUA_IMAGE_X86 0
+#define LUA_IMAGE_X86_KERNEL(kernel) nullptr
+#endif
+
+namespace LuaImage {
+
+namespace {
+
+// converts count pixels, src and dst may be the same for same sized pairs
+typedef void (*RowKernel)(uint8_t const *src, uint8_t *dst, size_t count);
+
+// at least this many pixels per thread, below that threads cost more than they save
+size_t const MinPixelsPerThread = 64 * 1024;
+
+enum class Isa {
+	Scalar,
+	Sse41,
+	Avx2, // with F16C
+};
+
+// half <-> float round to nearest even, matching F16C
+uint16_t FloatToHalf(float value) {
+	uint32_t const f32Infinity = 255u << 23;
+	uint32_t const f16Max = (127u + 16u) << 23;
+	uint32_t const denormMagicBits = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+	uint32_t f;
+	memcpy(&f, &value, sizeof(f));
+	uint32_t const sign = f & 0x80000000u;
+	f ^= sign;
+
+	uint16_t half;
+	if (f >= f16Max) {
+		// overflow to infinity, NaN stays NaN
+		half = f > f32Infinity ? 0x7e00 : 0x7c00;
+	} else if (f < (113u << 23)) {
+		// subnormal or zero, let the FPU round
+		float denormMagic;
+		memcpy(&denormMagic, &denormMagicBits, sizeof(denormMagic));
+		float magnitude;
+		memcpy(&magnitude, &f, sizeof(magnitude));
+		magnitude += denormMagic;
+		uint32_t bits;
+		memcpy(&bits, &magnitude, sizeof(bits));
+		half = (uint16_t) (bits - denormMagicBits);
+	} else {
+		uint32_t const mantissaOdd = (f >> 13) & 1;
+		f += ((uint32_t) (15 - 127) << 23) + 0xfff;
+		f += mantissaOdd;
+		half = (uint16_t) (f >> 13);
+	}
+	return (uint16_t) (half | (sign >> 16));
+}
+
+float HalfToFloat(uint16_t half) {
+	uint32_t const magicBits = 113u << 23;
+	uint32_t const shiftedExponent = 0x7c00u << 13;
+
+	uint32_t bits = (uint32_t) (half & 0x7fff) << 13;
+	uint32_t const exponent = shiftedExponent & bits;
+	bits += (127u - 15u) << 23;
+	if (exponent == shiftedExponent) {
+		// infinity or NaN
+		bits += (128u - 16u) << 23;
+	} else if (exponent == 0) {
+		// subnormal, renormalise through the FPU
+		bits += 1u << 23;
+		float value, magic;
+		memcpy(&value, &bits, sizeof(value));
+		memcpy(&magic, &magicBits, sizeof(magic));
+		value -= magic;
+		memcpy(&bits, &value, sizeof(bits));
+	}
+	bits |= (uint32_t) (half & 0x8000) << 16;
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+// clamps to [0, 1] (NaN to 0) then rounds, the SIMD kernels do the same steps
+uint8_t FloatToUnorm8(float value) {
+	value = value > 0.0f ? value : 0.0f;
+	value = value < 1.0f ? value : 1.0f;
+	return (uint8_t) (value * 255.0f + 0.5f);
+}
+
+struct SrgbTables {
+	SrgbTables() {
+		for (int i = 0; i < 256; ++i) {
+			double const v = i / 255.0;
+			double const srgb = v <= 0.0031308 ? v * 12.92 : 1.055 * pow(v, 1.0 / 2.4) - 0.055;
+			double const linear = v <= 0.04045 ? v / 12.92 : pow((v + 0.055) / 1.055, 2.4);
+			toSrgb[i] = (uint8_t) (srgb * 255.0 + 0.5);
+			toLinear[i] = (uint8_t) (linear * 255.0 + 0.5);
+		}
+	}
+	uint8_t toSrgb[256];
+	uint8_t toLinear[256];
+};
+
+SrgbTables const &Srgb() {
+	static SrgbTables const tables;
+	return tables;
+}
+
+// scalar kernels
+
+void Swizzle8888(uint8_t const *src, uint8_t *dst, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		uint8_t const r = src[i * 4 + 0];
+		uint8_t const g = src[i * 4 + 1];
+		uint8_t const b = src[i * 4 + 2];
+		uint8_t const a = src[i * 4 + 3];
+		dst[i * 4 + 0] = b;
+		dst[i * 4 + 1] = g;
+		dst[i * 4 + 2] = r;
+		dst[i * 4 + 3] = a;
+	}
+}
+
+template<bool ToSrgb>
+void SrgbLut8888(uint8_t const *src, uint8_t *dst, size_t count) {
+	uint8_t const *table = ToSrgb ? Srgb().toSrgb : Srgb().toLinear;
+	for (size_t i = 0; i < count; ++i) {
+		dst[i * 4 + 0] = table[src[i * 4 + 0]];
+		dst[i * 4 + 1] = table[src[i * 4 + 1]];
+		dst[i * 4 + 2] = table[src[i * 4 + 2]];
+		dst[i * 4 + 3] = src[i * 4 + 3];
+	}
+}
+
+// Swap reads or writes the 8 bit side as BGRA
+template<bool Swap>
+void Unorm8ToFloat(uint8_t const *src, uint8_t *dst, size_t count) {
+	auto out = (float *) dst;
+	for (size_t i = 0; i < count; ++i) {
+		out[i * 4 + 0] = src[i * 4 + (Swap ? 2 : 0)] / 255.0f;
+		out[i * 4 + 1] = src[i * 4 + 1] / 255.0f;
+		out[i * 4 + 2] = src[i * 4 + (Swap ? 0 : 2)] / 255.0f;
+		out[i * 4 + 3] = src[i * 4 + 3] / 255.0f;
+	}
+}
+
+template<bool Swap>
+void FloatToUnorm8(uint8_t const *src, uint8_t *dst, size_t count) {
+	auto in = (float const *) src;
+	for (size_t i = 0; i < count; ++i) {
+		dst[i * 4 + (Swap ? 2 : 0)] = FloatToUnorm8(in[i * 4 + 0]);
+		dst[i * 4 + 1] = FloatToUnorm8(in[i * 4 + 1]);
+		dst[i * 4 + (Swap ? 0 : 2)] = FloatToUnorm8(in[i * 4 + 2]);
+		dst[i * 4 + 3] = FloatToUnorm8(in[i * 4 + 3]);
+	}
+}
+
+void Unorm8ToHalf(uint8_t const *src, uint8_t *dst, size_t count) {
+	auto out = (uint16_t *) dst;
+	for (size_t i = 0; i < count * 4; ++i) {
+		out[i] = FloatToHalf(src[i] / 255.0f);
+	}
+}
+
+void HalfToUnorm8(uint8_t const *src, uint8_t *dst, size_t count) {
+	auto in = (uint16_t const *) src;
+	for (size_t i = 0; i < count * 4; ++i) {
+		dst[i] = FloatToUnorm8(HalfToFloat(in[i]));
+	}
+}
+
+void HalfToFloat(uint8_t const *src, uint8_t *dst, size_t count) {
+	auto in = (uint16_t const *) src;
+	auto out = (float *) dst;
+	for (size_t i = 0; i < count * 4; ++i) {
+		out[i] = HalfToFloat(in[i]);
+	}
+}
+
+void FloatToHalf(uint8_t const *src, uint8_t *dst, size_t count) {
+	auto in = (float const *) src;
+	auto out = (uint16_t *) dst;
+	for (size_t i = 0; i < count * 4; ++i) {
+		out[i] = FloatToHalf(in[i]);
+	}
+}
+
+// RGB -> RGBA with opaque alpha and back, T is the channel type
+template<typename T>
+void Expand3To4(uint8_t const *src, uint8_t *dst, size_t count) {
+	T const one = std::is_floating_point<T>::value ? (T) 1 : std::numeric_limits<T>::max();
+	auto in = (T const *) src;
+	auto out = (T *) dst;
+	for (size_t i = 0; i < count; ++i) {
+		out[i * 4 + 0] = in[i * 3 + 0];
+		out[i * 4 + 1] = in[i * 3 + 1];
+		out[i * 4 + 2] = in[i * 3 + 2];
+		out[i * 4 + 3] = one;
+	}
+}
+
+template<typename T>
+void Drop4To3(uint8_t const *src, uint8_t *dst, size_t count) {
+	auto in = (T const *) src;
+	auto out = (T *) dst;
+	for (size_t i = 0; i < count; ++i) {
+		out[i * 3 + 0] = in[i * 4 + 0];
+		out[i * 3 + 1] = in[i * 4 + 1];
+		out[i * 3 + 2] = in[i * 4 + 2];
+	}
+}
+
+#if LUA_IMAGE_X86
+
+// SSE4.1 kernels (SSSE3 shuffles included)
+
+LUA_IMAGE_TARGET("sse4.1")
+void Swizzle8888Sse41(uint8_t const *src, uint8_t *dst, size_t count) {
+	__m128i const mask = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i const v = _mm_loadu_si128((__m128i const *) (src + i * 4));
+		_mm_storeu_si128((__m128i *) (dst + i * 4), _mm_shuffle_epi8(v, mask));
+	}
+	Swizzle8888(src + i * 4, dst + i * 4, count - i);
+}
+
+template<bool Swap>
+LUA_IMAGE_TARGET("sse4.1")
+void Unorm8ToFloatSse41(uint8_t const *src, uint8_t *dst, size_t count) {
+	__m128i const mask = Swap ? _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15) :
+											 _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m128 const scale = _mm_set1_ps(255.0f);
+	auto out = (float *) dst;
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i const v = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *) (src + i * 4)), mask);
+		_mm_storeu_ps(out + i * 4 + 0, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(v)), scale));
+		_mm_storeu_ps(out + i * 4 + 4, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 4))), scale));
+		_mm_storeu_ps(out + i * 4 + 8, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 8))), scale));
+		_mm_storeu_ps(out + i * 4 + 12, _mm_div_ps(_mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(v, 12))), scale));
+	}
+	Unorm8ToFloat<Swap>(src + i * 4, dst + i * 16, count - i);
+}
+
+// 4 pixels of floats to 16 bytes, same steps as FloatToUnorm8
+LUA_IMAGE_TARGET("sse4.1")
+inline __m128i PackUnorm8(__m128 a, __m128 b, __m128 c, __m128 d) {
+	__m128 const zero = _mm_setzero_ps();
+	__m128 const one = _mm_set1_ps(1.0f);
+	__m128 const scale = _mm_set1_ps(255.0f);
+	__m128 const half = _mm_set1_ps(0.5f);
+	// max returns its second operand for NaN so they become 0
+	auto const convert = [&](__m128 v) {
+		v = _mm_min_ps(_mm_max_ps(v, zero), one);
+		return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(v, scale), half));
+	};
+	__m128i const ab = _mm_packs_epi32(convert(a), convert(b));
+	__m128i const cd = _mm_packs_epi32(convert(c), convert(d));
+	return _mm_packus_epi16(ab, cd);
+}
+
+template<bool Swap>
+LUA_IMAGE_TARGET("sse4.1")
+void FloatToUnorm8Sse41(uint8_t const *src, uint8_t *dst, size_t count) {
+	__m128i const mask = Swap ? _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15) :
+											 _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	auto in = (float const *) src;
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i const v = PackUnorm8(_mm_loadu_ps(in + i * 4 + 0), _mm_loadu_ps(in + i * 4 + 4),
+																 _mm_loadu_ps(in + i * 4 + 8), _mm_loadu_ps(in + i * 4 + 12));
+		_mm_storeu_si128((__m128i *) (dst + i * 4), _mm_shuffle_epi8(v, mask));
+	}
+	FloatToUnorm8<Swap>(src + i * 16, dst + i * 4, count - i);
+}
+
+// reads 16 bytes for 4 pixels, so stops while at least 6 pixels are left
+LUA_IMAGE_TARGET("sse4.1")
+void Expand888To8888Sse41(uint8_t const *src, uint8_t *dst, size_t count) {
+	__m128i const mask = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	__m128i const alpha = _mm_set1_epi32((int) 0xff000000);
+	size_t i = 0;
+	for (; i + 6 <= count; i += 4) {
+		__m128i const v = _mm_loadu_si128((__m128i const *) (src + i * 3));
+		_mm_storeu_si128((__m128i *) (dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(v, mask), alpha));
+	}
+	Expand3To4<uint8_t>(src + i * 3, dst + i * 4, count - i);
+}
+
+// writes 16 bytes for 4 pixels (the next 4 overwrite the spare 4 bytes)
+LUA_IMAGE_TARGET("sse4.1")
+void Drop8888To888Sse41(uint8_t const *src, uint8_t *dst, size_t count) {
+	__m128i const mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	size_t i = 0;
+	for (; i + 6 <= count; i += 4) {
+		__m128i const v = _mm_loadu_si128((__m128i const *) (src + i * 4));
+		_mm_storeu_si128((__m128i *) (dst + i * 3), _mm_shuffle_epi8(v, mask));
+	}
+	Drop4To3<uint8_t>(src + i * 4, dst + i * 3, count - i);
+}
+
+// AVX2 kernels, F16C for the half ones
+
+LUA_IMAGE_TARGET("avx2")
+void Swizzle8888Avx2(uint8_t const *src, uint8_t *dst, size_t count) {
+	__m256i const mask = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+																				2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256i const v = _mm256_loadu_si256((__m256i const *) (src + i * 4));
+		_mm256_storeu_si256((__m256i *) (dst + i * 4), _mm256_shuffle_epi8(v, mask));
+	}
+	Swizzle8888Sse41(src + i * 4, dst + i * 4, count - i);
+}
+
+template<bool Swap>
+LUA_IMAGE_TARGET("avx2")
+void Unorm8ToFloatAvx2(uint8_t const *src, uint8_t *dst, size_t count) {
+	__m128i const mask = Swap ? _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15) :
+											 _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m256 const scale = _mm256_set1_ps(255.0f);
+	auto out = (float *) dst;
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i const v = _mm_shuffle_epi8(_mm_loadu_si128((__m128i const *) (src + i * 4)), mask);
+		_mm256_storeu_ps(out + i * 4 + 0, _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v)), scale));
+		_mm256_storeu_ps(out + i * 4 + 8,
+										 _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_srli_si128(v, 8))), scale));
+	}
+	Unorm8ToFloat<Swap>(src + i * 4, dst + i * 16, count - i);
+}
+
+LUA_IMAGE_TARGET("avx2,f16c")
+void Unorm8ToHalfAvx2(uint8_t const *src, uint8_t *dst, size_t count) {
+	__m256 const scale = _mm256_set1_ps(255.0f);
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		__m128i const v = _mm_loadl_epi64((__m128i const *) (src + i * 4));
+		__m256 const f = _mm256_div_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(v)), scale);
+		_mm_storeu_si128((__m128i *) (dst + i * 8), _mm256_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT));
+	}
+	Unorm8ToHalf(src + i * 4, dst + i * 8, count - i);
+}
+
+LUA_IMAGE_TARGET("avx2,f16c")
+void HalfToUnorm8Avx2(uint8_t const *src, uint8_t *dst, size_t count) {
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m256 const ab = _mm256_cvtph_ps(_mm_loadu_si128((__m128i const *) (src + i * 8 + 0)));
+		__m256 const cd = _mm256_cvtph_ps(_mm_loadu_si128((__m128i const *) (src + i * 8 + 16)));
+		__m128i const v = PackUnorm8(_mm256_castps256_ps128(ab), _mm256_extractf128_ps(ab, 1),
+																 _mm256_castps256_ps128(cd), _mm256_extractf128_ps(cd, 1));
+		_mm_storeu_si128((__m128i *) (dst + i * 4), v);
+	}
+	HalfToUnorm8(src + i * 8, dst + i * 4, count - i);
+}
+
+LUA_IMAGE_TARGET("avx2,f16c")
+void HalfToFloatAvx2(uint8_t const *src, uint8_t *dst, size_t count) {
+	auto out = (float *) dst;
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		_mm256_storeu_ps(out + i * 4, _mm256_cvtph_ps(_mm_loadu_si128((__m128i const *) (src + i * 8))));
+	}
+	HalfToFloat(src + i * 8, dst + i * 16, count - i);
+}
+
+LUA_IMAGE_TARGET("avx2,f16c")
+void FloatToHalfAvx2(uint8_t const *src, uint8_t *dst, size_t count) {
+	auto in = (float const *) src;
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		_mm_storeu_si128((__m128i *) (dst + i * 8), _mm256_cvtps_ph(_mm256_loadu_ps(in + i * 4), _MM_FROUND_TO_NEAREST_INT));
+	}
+	FloatToHalf(src + i * 16, dst + i * 8, count - i);
+}
+
+uint64_t XGetBv() {
+#if defined(_MSC_VER) && !defined(__clang__)
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((uint64_t) edx << 32) | eax;
+#endif
+}
+
+#endif // LUA_IMAGE_X86
+
+Isa DetectIsa() {
+#if LUA_IMAGE_X86
+	uint32_t leaf1Ecx = 0;
+	uint32_t leaf7Ebx = 0;
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 0);
+	int const maxLeaf = info[0];
+	__cpuid(info, 1);
+	leaf1Ecx = (uint32_t) info[2];
+	if (maxLeaf >= 7) {
+		__cpuidex(info, 7, 0);
+		leaf7Ebx = (uint32_t) info[1];
+	}
+#else
+	unsigned int a, b, c, d;
+	if (__get_cpuid(1, &a, &b, &c, &d)) leaf1Ecx = c;
+	if (__get_cpuid_count(7, 0, &a, &b, &c, &d)) leaf7Ebx = b;
+#endif
+	bool const sse41 = (leaf1Ecx & (1u << 19)) != 0;
+	bool const osxsave = (leaf1Ecx & (1u << 27)) != 0;
+	bool const avx = (leaf1Ecx & (1u << 28)) != 0;
+	bool const f16c = (leaf1Ecx & (1u << 29)) != 0;
+	bool const avx2 = (leaf7Ebx & (1u << 5)) != 0;
+	// the OS must save the ymm registers too
+	if (sse41 && osxsave && avx && f16c && avx2 && (XGetBv() & 6) == 6) return Isa::Avx2;
+	if (sse41) return Isa::Sse41;
+#endif
+	return Isa::Scalar;
+}
+
+struct Pair {
+	TinyImageFormat from;
+	TinyImageFormat to;
+	RowKernel scalar;
+	RowKernel sse41; // nullptr = scalar
+	RowKernel avx2;  // nullptr = sse41
+	bool exact;
+};
+
+Pair const Pairs[] = {
+		{TinyImageFormat_R8G8B8A8_UNORM, TinyImageFormat_B8G8R8A8_UNORM, &Swizzle8888, LUA_IMAGE_X86_KERNEL(Swizzle8888Sse41), LUA_IMAGE_X86_KERNEL(Swizzle8888Avx2), true},
+		{TinyImageFormat_B8G8R8A8_UNORM, TinyImageFormat_R8G8B8A8_UNORM, &Swizzle8888, LUA_IMAGE_X86_KERNEL(Swizzle8888Sse41), LUA_IMAGE_X86_KERNEL(Swizzle8888Avx2), true},
+		{TinyImageFormat_R8G8B8A8_SRGB, TinyImageFormat_B8G8R8A8_SRGB, &Swizzle8888, LUA_IMAGE_X86_KERNEL(Swizzle8888Sse41), LUA_IMAGE_X86_KERNEL(Swizzle8888Avx2), true},
+		{TinyImageFormat_B8G8R8A8_SRGB, TinyImageFormat_R8G8B8A8_SRGB, &Swizzle8888, LUA_IMAGE_X86_KERNEL(Swizzle8888Sse41), LUA_IMAGE_X86_KERNEL(Swizzle8888Avx2), true},
+
+		{TinyImageFormat_R8G8B8A8_UNORM, TinyImageFormat_R8G8B8A8_SRGB, &SrgbLut8888<true>, nullptr, nullptr, false},
+		{TinyImageFormat_B8G8R8A8_UNORM, TinyImageFormat_B8G8R8A8_SRGB, &SrgbLut8888<true>, nullptr, nullptr, false},
+		{TinyImageFormat_R8G8B8A8_SRGB, TinyImageFormat_R8G8B8A8_UNORM, &SrgbLut8888<false>, nullptr, nullptr, false},
+		{TinyImageFormat_B8G8R8A8_SRGB, TinyImageFormat_B8G8R8A8_UNORM, &SrgbLut8888<false>, nullptr, nullptr, false},
+
+		{TinyImageFormat_R8G8B8A8_UNORM, TinyImageFormat_R32G32B32A32_SFLOAT, &Unorm8ToFloat<false>, LUA_IMAGE_X86_KERNEL(Unorm8ToFloatSse41<false>), LUA_IMAGE_X86_KERNEL(Unorm8ToFloatAvx2<false>), true},
+		{TinyImageFormat_B8G8R8A8_UNORM, TinyImageFormat_R32G32B32A32_SFLOAT, &Unorm8ToFloat<true>, LUA_IMAGE_X86_KERNEL(Unorm8ToFloatSse41<true>), LUA_IMAGE_X86_KERNEL(Unorm8ToFloatAvx2<true>), true},
+		{TinyImageFormat_R32G32B32A32_SFLOAT, TinyImageFormat_R8G8B8A8_UNORM, &FloatToUnorm8<false>, LUA_IMAGE_X86_KERNEL(FloatToUnorm8Sse41<false>), nullptr, false},
+		{TinyImageFormat_R32G32B32A32_SFLOAT, TinyImageFormat_B8G8R8A8_UNORM, &FloatToUnorm8<true>, LUA_IMAGE_X86_KERNEL(FloatToUnorm8Sse41<true>), nullptr, false},
+
+		{TinyImageFormat_R8G8B8A8_UNORM, TinyImageFormat_R16G16B16A16_SFLOAT, &Unorm8ToHalf, nullptr, LUA_IMAGE_X86_KERNEL(Unorm8ToHalfAvx2), false},
+		{TinyImageFormat_R16G16B16A16_SFLOAT, TinyImageFormat_R8G8B8A8_UNORM, &HalfToUnorm8, nullptr, LUA_IMAGE_X86_KERNEL(HalfToUnorm8Avx2), false},
+		{TinyImageFormat_R16G16B16A16_SFLOAT, TinyImageFormat_R32G32B32A32_SFLOAT, &HalfToFloat, nullptr, LUA_IMAGE_X86_KERNEL(HalfToFloatAvx2), true},
+		{TinyImageFormat_R32G32B32A32_SFLOAT, TinyImageFormat_R16G16B16A16_SFLOAT, &FloatToHalf, nullptr, LUA_IMAGE_X86_KERNEL(FloatToHalfAvx2), false},
+
+		{TinyImageFormat_R8G8B8_UNORM, TinyImageFormat_R8G8B8A8_UNORM, &Expand3To4<uint8_t>, LUA_IMAGE_X86_KERNEL(Expand888To8888Sse41), nullptr, true},
+		{TinyImageFormat_R8G8B8_SRGB, TinyImageFormat_R8G8B8A8_SRGB, &Expand3To4<uint8_t>, LUA_IMAGE_X86_KERNEL(Expand888To8888Sse41), nullptr, true},
+		{TinyImageFormat_B8G8R8_UNORM, TinyImageFormat_B8G8R8A8_UNORM, &Expand3To4<uint8_t>, LUA_IMAGE_X86_KERNEL(Expand888To8888Sse41), nullptr, true},
+		{TinyImageFormat_R8G8B8A8_UNORM, TinyImageFormat_R8G8B8_UNORM, &Drop4To3<uint8_t>, LUA_IMAGE_X86_KERNEL(Drop8888To888Sse41), nullptr, true},
+		{TinyImageFormat_R8G8B8A8_SRGB, TinyImageFormat_R8G8B8_SRGB, &Drop4To3<uint8_t>, LUA_IMAGE_X86_KERNEL(Drop8888To888Sse41), nullptr, true},
+		{TinyImageFormat_B8G8R8A8_UNORM, TinyImageFormat_B8G8R8_UNORM, &Drop4To3<uint8_t>, LUA_IMAGE_X86_KERNEL(Drop8888To888Sse41), nullptr, true},
+		{TinyImageFormat_R32G32B32_SFLOAT, TinyImageFormat_R32G32B32A32_SFLOAT, &Expand3To4<float>, nullptr, nullptr, true},
+		{TinyImageFormat_R32G32B32A32_SFLOAT, TinyImageFormat_R32G32B32_SFLOAT, &Drop4To3<float>, nullptr, nullptr, true},
+};
+
+Pair const *FindPair(TinyImageFormat from, TinyImageFormat to, bool exactOnly) {
+	for (auto const &pair : Pairs) {
+		if (pair.from == from && pair.to == to) return (!exactOnly || pair.exact) ? &pair : nullptr;
+	}
+	return nullptr;
+}
+
+RowKernel KernelFor(Pair const &pair) {
+	static Isa const isa = DetectIsa();
+	if (isa == Isa::Avx2 && pair.avx2) return pair.avx2;
+	if (isa != Isa::Scalar && pair.sse41) return pair.sse41;
+	return pair.scalar;
+}
+
+void ConvertLevel(Image_ImageHeader const *src, Image_ImageHeader const *dst, RowKernel kernel, uint32_t threadCount) {
+	size_t const srcBytes = TinyImageFormat_BitSizeOfBlock(src->format) / 8;
+	size_t const dstBytes = TinyImageFormat_BitSizeOfBlock(dst->format) / 8;
+	auto const srcPixels = (uint8_t const *) Image_RawDataPtr(src);
+	auto const dstPixels = (uint8_t *) Image_RawDataPtr(dst);
+
+	// whole rows per thread, every level is contiguous so a range is one run
+	size_t const width = src->width;
+	size_t const rows = (size_t) src->height * src->depth * src->slices;
+	size_t const minRows = (MinPixelsPerThread + width - 1) / width;
+	ParallelFor(rows, threadCount, minRows, [&](size_t begin, size_t end) {
+		kernel(srcPixels + begin * width * srcBytes, dstPixels + begin * width * dstBytes, (end - begin) * width);
+	});
+}
+
+} // end anonymous namespace
+
+bool FastConvert_Supported(TinyImageFormat from, TinyImageFormat to, bool exactOnly) {
+	return FindPair(from, to, exactOnly) != nullptr;
+}
+
+Image_ImageHeader const *FastConvert(Image_ImageHeader const *image,
+																		 TinyImageFormat format,
+																		 FastConvertOptions const &options) {
+	// every level of a chain shares the top level's format
+	auto const pair = FindPair(image->format, format, options.exactOnly);
+	if (!pair) return nullptr;
+	RowKernel const kernel = KernelFor(*pair);
+
+	bool const sameSize = TinyImageFormat_BitSizeOfBlock(image->format) == TinyImageFormat_BitSizeOfBlock(format);
+	if (options.allowInPlace && sameSize) {
+		for (size_t i = 0; i < Image_LinkedImageCountOf(image); ++i) {
+			auto const level = (Image_ImageHeader *) Image_LinkedImageOf(image, i);
+			ConvertLevel(level, level, kernel, options.threadCount);
+			level->format = format;
+		}
+		return image;
+	}
+
+	Image_ImageHeader *first = nullptr;
+	Image_ImageHeader *previous = nullptr;
+	for (size_t i = 0; i < Image_LinkedImageCountOf(image); ++i) {
+		auto const level = Image_LinkedImageOf(image, i);
+		auto const converted = (Image_ImageHeader *) Image_CreateNoClear(level->width, level->height, level->depth,
+																																		 level->slices, format);
+		if (!converted) {
+			if (first) Image_Destroy(first);
+			return nullptr;
+		}
+		converted->flags = level->flags;
+		if (previous) {
+			previous->nextType = Image_LinkedImageOf(image, i - 1)->nextType;
+			previous->nextImage = converted;
+		} else {
+			first = converted;
+		}
+		previous = converted;
+		ConvertLevel(level, converted, kernel, options.threadCount);
+	}
+	return first;
+}
+
+} // end namespace LuaImage
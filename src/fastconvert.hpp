@@ -0,0 +1,38 @@
+#pragma once
+#ifndef LUA_IMAGE_FASTCONVERT_HPP_
+#define LUA_IMAGE_FASTCONVERT_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+
+namespace LuaImage {
+
+// Conversion kernels for the format pairs that come up all the time: RGBA8
+// <-> BGRA8 swizzles, UNORM8 <-> SRGB8 through a table, RGBA8 <-> RGBA16F /
+// RGBA32F, RGBA16F <-> RGBA32F and RGB <-> RGBA. Each pair has a scalar
+// kernel and SSE4.1 / AVX2 ones where they help, picked once at runtime for
+// the CPU. Rows are split across threads. Other pairs aren't handled
+
+struct FastConvertOptions {
+	// convert in the image's own memory if the pair has the same pixel size
+	bool allowInPlace = false;
+	// only pairs giving exactly what a decode/encode through doubles would
+	// (swizzles, RGB <-> RGBA and 8 bit to float)
+	bool exactOnly = false;
+	uint32_t threadCount = 0; // 0 = all hardware threads
+};
+
+// true if there is a kernel for the pair
+bool FastConvert_Supported(TinyImageFormat from, TinyImageFormat to, bool exactOnly);
+
+// every level of the chain converted. Returns image itself (with its format
+// changed) if converted in place, nullptr if the pair has no kernel. In place
+// converts image and every level after it, so image must be the top of a
+// chain nothing else is looking into
+Image_ImageHeader const *FastConvert(Image_ImageHeader const *image,
+																		 TinyImageFormat format,
+																		 FastConvertOptions const &options);
+
+} // end namespace LuaImage
+
+#endif
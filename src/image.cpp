@@ -7,64 +7,790 @@
 #include "gfx_imagecompress/imagecompress.h"
 #include "lua_base5.3/lua.hpp"
 #include "lua_base5.3/utils.h"
+#include "pixelrows.hpp"
+#include "kernel.hpp"
+#include "compress.hpp"
+#include "decompress.hpp"
+#include "autocompress.hpp"
+#include "jobs.hpp"
+#include "pool.hpp"
+#include "mapped.hpp"
+#include "containers.hpp"
+#include "parallel.hpp"
+#include "tiled.hpp"
+#include "mips.hpp"
+#include "blit.hpp"
+#include "atlas.hpp"
+#include "cache.hpp"
+#include "compare.hpp"
+#include "stats.hpp"
+#include "pipeline.hpp"
+#include "shared.hpp"
+#include "lazy.hpp"
+#include "fastconvert.hpp"
+#include <new>
+#include <atomic>
+#include <climits>
+#include <string>
+#include <vector>
 
 static char const MetaName[] = "Al2o3.Image";
+static char const KernelMetaName[] = "Al2o3.ImageKernel";
+static char const KernelCacheName[] = "Al2o3.ImageKernelCache";
+static char const JobMetaName[] = "Al2o3.ImageJob";
+static char const TiledMetaName[] = "Al2o3.TiledImage";
+static char const RegionMetaName[] = "Al2o3.ImageRegion";
+static char const LazyMetaName[] = "Al2o3.LazyImage";
+// registry tables built once at open: name -> format, format -> name and
+// format (and name) -> info table
+static char const FormatsName[] = "Al2o3.ImageFormats";
+static char const FormatNamesName[] = "Al2o3.ImageFormatNames";
+static char const FormatInfoName[] = "Al2o3.ImageFormatInfo";
+
+// image userdata, image must stay the first member as the bindings access
+// it through a Image_ImageHeader const** cast
+struct ImageUd {
+	Image_ImageHeader const* image;
+	// bytes this userdata added to MemoryStats.liveBytes
+	size_t accountedBytes;
+	// set if image lives in a file mapping (loadMapped)
+	LuaImage::MappedFile mapped;
+	// set for views, the userdata that owns image (kept alive by the uservalue)
+	struct ImageUd* root;
+	// views and regions currently borrowing from this (owning) userdata
+	uint32_t borrowers;
+	// set if image is shared, the image and its memory belong to it
+	LuaImage::SharedImage* shared;
+	// async jobs still using image, dropped by the worker when each finishes
+	std::atomic<uint32_t> jobs;
+	// of those, jobs replacing the image's chain (mip maps). Nothing may read
+	// the image until they finish
+	std::atomic<uint32_t> chainJobs;
+};
+
+// module wide native image memory counters
+static struct {
+	std::atomic<size_t> liveBytes;
+	std::atomic<size_t> peakBytes;
+	std::atomic<size_t> liveImages;
+	std::atomic<size_t> budget; // 0 = unlimited
+	std::atomic<size_t> budgetCollections;
+	std::atomic<size_t> budgetFailures;
+	// growth not yet reported to the collector
+	std::atomic<size_t> gcDebt;
+	// held for async jobs whose results haven't been taken yet
+	std::atomic<size_t> reservedBytes;
+} MemoryStats;
+
+// growth reported to the collector in steps of at least this, so small
+// images don't each cost a collector step
+static size_t const GcStepBytes = 1024 * 1024;
+
+static size_t imageBytesFor(int64_t w, int64_t h, int64_t d, int64_t s, TinyImageFormat fmt) {
+	if (w <= 0 || h <= 0 || d <= 0 || s <= 0) return 0;
+	size_t const bw = TinyImageFormat_WidthOfBlock(fmt);
+	size_t const bh = TinyImageFormat_HeightOfBlock(fmt);
+	size_t const bd = TinyImageFormat_DepthOfBlock(fmt);
+	size_t const blocks = (((size_t)w + bw - 1) / bw) * (((size_t)h + bh - 1) / bh) * (((size_t)d + bd - 1) / bd);
+	return (blocks * (size_t)s * TinyImageFormat_BitSizeOfBlock(fmt)) / 8;
+}
 
 // create the null image user data return on the lua state
 static Image_ImageHeader const** imageud_create(lua_State *L) {
 	// allocate a pointer and push it onto the stack
-	auto ud = (Image_ImageHeader const**)lua_newuserdata(L, sizeof(Image_ImageHeader*));
+	auto ud = (ImageUd*)lua_newuserdata(L, sizeof(ImageUd));
 	if(ud == nullptr) return nullptr;
 
-	*ud = nullptr;
+	ud->image = nullptr;
+	ud->accountedBytes = 0;
+	ud->mapped.base = nullptr;
+	ud->mapped.size = 0;
+	ud->root = nullptr;
+	ud->borrowers = 0;
+	ud->shared = nullptr;
+	new(&ud->jobs) std::atomic<uint32_t>(0);
+	new(&ud->chainJobs) std::atomic<uint32_t>(0);
 	luaL_getmetatable(L, MetaName);
 	lua_setmetatable(L, -2);
+	return &ud->image;
+}
+
+// brings the userdata's accounted bytes up to date with its image chain
+static void imageud_account(lua_State *L, Image_ImageHeader const** image) {
+	auto ud = (ImageUd*)image;
+	// shared images and views are accounted for by whoever owns the memory
+	if (ud->shared || ud->root) return;
+	// header only images (probe) have no pixel memory to account for
+	bool const hasData = ud->image && !(ud->image->flags & Image_Flag_HeaderOnly);
+	size_t const bytes = hasData ? Image_ByteCountOfImageChainOf(ud->image) : 0;
+	if (bytes == ud->accountedBytes) return;
+
+	if (bytes > ud->accountedBytes) {
+		size_t const grown = bytes - ud->accountedBytes;
+		size_t const live = MemoryStats.liveBytes.fetch_add(grown) + grown;
+		size_t peak = MemoryStats.peakBytes;
+		while (live > peak && !MemoryStats.peakBytes.compare_exchange_weak(peak, live)) {}
+
+		// lua only sees the userdata, tell the collector about the native
+		// memory so it runs as if the image had been allocated by lua. Only
+		// the growth is reported, batched up to GcStepBytes
+		size_t const debt = MemoryStats.gcDebt.fetch_add(grown) + grown;
+		if (debt >= GcStepBytes) {
+			size_t const kb = MemoryStats.gcDebt.exchange(0) / 1024;
+			lua_gc(L, LUA_GCSTEP, kb > INT_MAX ? INT_MAX : (int)kb);
+		}
+	} else {
+		MemoryStats.liveBytes -= ud->accountedBytes - bytes;
+	}
+	ud->accountedBytes = bytes;
+}
+
+// sets the image of a newly created userdata and accounts for its memory
+static void imageud_set(lua_State *L, Image_ImageHeader const** ud, Image_ImageHeader const* image) {
+	*ud = image;
+	if (image) MemoryStats.liveImages++;
+	imageud_account(L, ud);
+}
+
+// frees an owned image and its accounted memory
+static void imageud_free(Image_ImageHeader const* image, LuaImage::MappedFile& mapped, size_t accountedBytes) {
+	if (mapped.base) {
+		LuaImage::Cache_ReleaseMapped(image, mapped);
+		MemoryStats.liveImages--;
+	} else if (image) {
+		if (!LuaImage::Pool_Recycle(image)) Image_Destroy(image);
+		MemoryStats.liveImages--;
+	}
+	MemoryStats.liveBytes -= accountedBytes;
+}
+
+// drops a reference to a shared image, freeing it if it was the last
+static void imageud_dropshared(LuaImage::SharedImage* shared) {
+	Image_ImageHeader const* image = nullptr;
+	LuaImage::MappedFile mapped{nullptr, 0};
+	size_t accountedBytes = 0;
+	if (LuaImage::Shared_Release(shared, image, mapped, accountedBytes)) {
+		imageud_free(image, mapped, accountedBytes);
+	}
+}
+
+// frees the image now rather than when the userdata is collected
+static void imageud_release(Image_ImageHeader const** image) {
+	auto ud = (ImageUd*)image;
+	if (ud->root) {
+		// views never own their image
+		ud->root->borrowers--;
+		ud->root = nullptr;
+		ud->image = nullptr;
+		return;
+	}
+	if (ud->shared) {
+		imageud_dropshared(ud->shared);
+		ud->shared = nullptr;
+	} else {
+		imageud_free(ud->image, ud->mapped, ud->accountedBytes);
+	}
+	ud->image = nullptr;
+	ud->accountedBytes = 0;
+}
+
+// checks bytes more fit in the memory budget, running a full collection to
+// free unreachable images if needed. false if still over budget
+static bool imageud_reserve(lua_State *L, size_t bytes) {
+	size_t const budget = MemoryStats.budget;
+	if (budget == 0) return true;
+	// pooled images still hold memory so count towards the budget
+	auto const used = [bytes]() {
+		return MemoryStats.liveBytes + MemoryStats.reservedBytes + LuaImage::Pool_Stats().pooledBytes + bytes;
+	};
+	if (used() <= budget) return true;
+
+	MemoryStats.budgetCollections++;
+	lua_gc(L, LUA_GCCOLLECT, 0);
+	if (used() <= budget) return true;
+	LuaImage::Pool_Trim();
+	if (used() <= budget) return true;
+
+	MemoryStats.budgetFailures++;
+	return false;
+}
+
+// like imageud_reserve but holds the bytes until an async job's result is
+// taken, so queued jobs can't all pass the budget before any finishes
+static bool imageud_reserveasync(lua_State *L, size_t bytes) {
+	if (!imageud_reserve(L, bytes)) return false;
+	MemoryStats.reservedBytes += bytes;
+	return true;
+}
+
+// return for a create that failed the memory budget
+static int imageud_budgetfail(lua_State *L) {
+	lua_pushnil(L);
+	lua_pushboolean(L, false);
+	lua_pushstring(L, "image memory budget exceeded");
+	return 3;
+}
+
+// the userdata owning the image of the image userdata at index
+static ImageUd* imageud_owner(lua_State *L, int index) {
+	auto ud = (ImageUd*)luaL_checkudata(L, index, MetaName);
+	return ud->root ? ud->root : ud;
+}
+
+// the image of the image userdata at index, checked not to be having its
+// chain replaced by an async job
+static Image_ImageHeader const* imageud_check(lua_State *L, int index) {
+	auto ud = (ImageUd*)luaL_checkudata(L, index, MetaName);
+	LUA_ASSERT(ud->image, L, "image is NIL");
+	auto owner = ud->root ? ud->root : ud;
+	LUA_ASSERT(owner->chainJobs == 0, L, "image is in use by an async job");
+	return ud->image;
+}
+
+// the image of the image userdata at index, checked to have pixels. Header
+// only images (probe) describe a file but hold none
+static Image_ImageHeader const* imageud_checkdata(lua_State *L, int index) {
+	auto image = imageud_check(L, index);
+	LUA_ASSERT(!(image->flags & Image_Flag_HeaderOnly), L, "image is header only");
+	return image;
+}
+
+// held by an async job for as long as it uses the image of the image
+// userdata at index. The job's userdata pins the image userdata and its
+// __gc waits for the job, so the counters outlive the worker's use of them
+struct ImageJobUse {
+	ImageJobUse(ImageUd* owner_, bool replacesChain_) : owner(owner_), replacesChain(replacesChain_) {}
+	~ImageJobUse() {
+		if (replacesChain) owner->chainJobs--;
+		owner->jobs--;
+	}
+	ImageUd* owner;
+	bool replacesChain;
+};
+
+static ImageUd* imageud_jobstart(lua_State *L, int index, bool replacesChain) {
+	auto owner = imageud_owner(L, index);
+	owner->jobs++;
+	if (replacesChain) owner->chainJobs++;
+	return owner;
+}
+
+// pushes a view of image, which must belong to the image userdata at index.
+// The view pins that userdata through its uservalue so the owner outlives it
+static Image_ImageHeader const** imageud_borrow(lua_State *L, int index, Image_ImageHeader const* image) {
+	index = lua_absindex(L, index);
+	auto owner = imageud_owner(L, index);
+	auto ud = imageud_create(L);
+	*ud = image;
+	((ImageUd*)ud)->root = owner;
+	owner->borrowers++;
+	lua_pushvalue(L, index);
+	lua_setuservalue(L, -2);
 	return ud;
 }
 
+// makes the image of an owning userdata shared, if it isn't already
+static LuaImage::SharedImage* imageud_share(ImageUd* ud) {
+	if (!ud->shared && ud->image) {
+		ud->shared = LuaImage::Shared_Create(ud->image, ud->mapped, ud->accountedBytes);
+		ud->mapped = LuaImage::MappedFile{nullptr, 0};
+		ud->accountedBytes = 0;
+	}
+	return ud->shared;
+}
+
+// takes back a shared image if owner holds its last reference, false if
+// others still hold it. Frozen images are never taken back
+static bool imageud_unshare(lua_State *L, ImageUd* owner) {
+	if (!owner->shared) return true;
+	LUA_ASSERT(!LuaImage::Shared_IsFrozen(owner->shared), L, "image is frozen");
+	// only handles create references, with none left nobody can add one
+	if (LuaImage::Shared_RefCount(owner->shared) != 1) return false;
+
+	Image_ImageHeader const* image = nullptr;
+	size_t accountedBytes = 0;
+	LuaImage::Shared_Release(owner->shared, image, owner->mapped, accountedBytes);
+	owner->shared = nullptr;
+	owner->accountedBytes = accountedBytes;
+	return true;
+}
+
+// the image of the image userdata at index, ready to be written. Shared
+// images are copied first if anyone else holds them (copy on write), frozen
+// ones can't be written at all
+static Image_ImageHeader const* imageud_writable(lua_State *L, int index) {
+	imageud_checkdata(L, index);
+	auto ud = (ImageUd*)lua_touserdata(L, index);
+	auto owner = ud->root ? ud->root : ud;
+	LUA_ASSERT(owner->jobs == 0, L, "image is in use by an async job");
+	if (imageud_unshare(L, owner)) return ud->image;
+
+	// the copy is a new chain, views would be left reading the shared one
+	LUA_ASSERT(ud == owner && ud->borrowers == 0, L, "shared image has live views");
+	auto shared = ud->shared;
+	LUA_ASSERT(imageud_reserve(L, Image_ByteCountOfImageChainOf(ud->image)), L, "image memory budget exceeded");
+	auto copy = LuaImage::CloneChain(ud->image);
+	LUA_ASSERT(copy, L, "can't copy shared image");
+	ud->shared = nullptr;
+	imageud_dropshared(shared);
+	imageud_set(L, &ud->image, copy);
+	return copy;
+}
+
+// the image of the image userdata at index, ready to have its format or
+// chain changed in place. Views and regions share the owner's headers, so
+// neither a view nor an owner with live views can be changed this way
+static Image_ImageHeader const* imageud_reshapable(lua_State *L, int index) {
+	auto ud = (ImageUd*)luaL_checkudata(L, index, MetaName);
+	LUA_ASSERT(!ud->root, L, "views can't be changed in place");
+	LUA_ASSERT(ud->borrowers == 0, L, "image has live views");
+	return imageud_writable(L, index);
+}
+
 static int imageud_gc (lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	if (image) Image_Destroy(image);
+	auto ud = (Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
+	imageud_release(ud);
+
+	return 0;
+}
+
+static int release(lua_State *L) {
+	auto ud = (Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
+	LUA_ASSERT(((ImageUd*)ud)->borrowers == 0, L, "image has live views");
+	LUA_ASSERT(imageud_owner(L, 1)->jobs == 0, L, "image is in use by an async job");
+	imageud_release(ud);
+
+	return 0;
+}
+
+// export() shares the image and returns a handle any lua state can import
+// it by, without copying. The handle holds a reference until unexported
+static int exportImage(lua_State *L) {
+	imageud_check(L, 1);
+	auto ud = (ImageUd*)lua_touserdata(L, 1);
+	LUA_ASSERT(!ud->root, L, "views can't be exported");
+	lua_pushinteger(L, (lua_Integer)LuaImage::Shared_Export(imageud_share(ud)));
+	return 1;
+}
+
+// freeze() makes the image read only for good, so every state and thread
+// holding it can read it at once. Writes then raise an error
+static int freeze(lua_State *L) {
+	imageud_check(L, 1);
+	auto ud = imageud_owner(L, 1);
+	LuaImage::Shared_Freeze(imageud_share(ud));
+	return 0;
+}
+
+static int isFrozen(lua_State *L) {
+	auto ud = imageud_owner(L, 1);
+	lua_pushboolean(L, ud->shared && LuaImage::Shared_IsFrozen(ud->shared));
+	return 1;
+}
+
+static int isShared(lua_State *L) {
+	auto ud = imageud_owner(L, 1);
+	lua_pushboolean(L, ud->shared != nullptr);
+	return 1;
+}
+
+// import(handle) returns a new reference to an exported image
+static int importImage(lua_State *L) {
+	int64_t handle = luaL_checkinteger(L, 1);
+	auto shared = LuaImage::Shared_Import((uint64_t)handle);
+	auto ud = imageud_create(L);
+	if (shared) {
+		((ImageUd*)ud)->shared = shared;
+		*ud = LuaImage::Shared_Image(shared);
+	}
+	lua_pushboolean(L, *ud != nullptr);
+	return 2;
+}
+
+// unexport(handle) drops the handle, images already imported are unaffected
+static int unexportImage(lua_State *L) {
+	int64_t handle = luaL_checkinteger(L, 1);
+	auto shared = LuaImage::Shared_Unexport((uint64_t)handle);
+	if (shared) imageud_dropshared(shared);
+	lua_pushboolean(L, shared != nullptr);
+	return 1;
+}
+
+// setMemoryBudget(bytes) 0 or nil for no budget
+static int setMemoryBudget(lua_State *L) {
+	int64_t budget = luaL_optinteger(L, 1, 0);
+	LUA_ASSERT(budget >= 0, L, "budget must be >= 0");
+	MemoryStats.budget = (size_t)budget;
+	return 0;
+}
+
+static int memoryStats(lua_State *L) {
+	lua_createtable(L, 0, 7);
+	lua_pushinteger(L, (lua_Integer)MemoryStats.liveBytes);
+	lua_setfield(L, -2, "liveBytes");
+	lua_pushinteger(L, (lua_Integer)MemoryStats.reservedBytes);
+	lua_setfield(L, -2, "reservedBytes");
+	lua_pushinteger(L, (lua_Integer)MemoryStats.peakBytes);
+	lua_setfield(L, -2, "peakBytes");
+	lua_pushinteger(L, (lua_Integer)MemoryStats.liveImages);
+	lua_setfield(L, -2, "liveImages");
+	lua_pushinteger(L, (lua_Integer)MemoryStats.budget);
+	lua_setfield(L, -2, "budget");
+	lua_pushinteger(L, (lua_Integer)MemoryStats.budgetCollections);
+	lua_setfield(L, -2, "budgetCollections");
+	lua_pushinteger(L, (lua_Integer)MemoryStats.budgetFailures);
+	lua_setfield(L, -2, "budgetFailures");
+	return 1;
+}
+
+static float optNumberField(lua_State *L, int index, char const* name, float def) {
+	if (!lua_istable(L, index)) return def;
+	lua_getfield(L, index, name);
+	float const ret = lua_isnil(L, -1) ? def : (float)luaL_checknumber(L, -1);
+	lua_pop(L, 1);
+	return ret;
+}
+
+static int64_t optIntegerField(lua_State *L, int index, char const* name, int64_t def) {
+	if (!lua_istable(L, index)) return def;
+	lua_getfield(L, index, name);
+	int64_t const ret = lua_isnil(L, -1) ? def : luaL_checkinteger(L, -1);
+	lua_pop(L, 1);
+	return ret;
+}
+
+static bool optBoolField(lua_State *L, int index, char const* name, bool def) {
+	if (!lua_istable(L, index)) return def;
+	lua_getfield(L, index, name);
+	bool const ret = lua_isnil(L, -1) ? def : (bool)lua_toboolean(L, -1);
+	lua_pop(L, 1);
+	return ret;
+}
+
+// a recycled image of this shape from the pool (cleared if asked) or nullptr
+static Image_ImageHeader const* poolAcquire(int64_t w, int64_t h, int64_t d, int64_t s,
+																						TinyImageFormat format, uint8_t flags, bool clear) {
+	if (w <= 0 || h <= 0 || d <= 0 || s <= 0) return nullptr;
+	auto image = LuaImage::Pool_Acquire((uint32_t)w, (uint32_t)h, (uint32_t)d, (uint32_t)s, format, flags);
+	if (image && clear) memset(Image_RawDataPtr(image), 0, Image_ByteCountOf(image));
+	return image;
+}
+
+// a pooled image the same shape as a single (unlinked) image in format
+static Image_ImageHeader const* poolAcquireLike(Image_ImageHeader const* image, TinyImageFormat format) {
+	if (image->nextImage != nullptr) return nullptr;
+	return poolAcquire(image->width, image->height, image->depth, image->slices, format, image->flags, false);
+}
+
+// key of operation on image when the result cache is open, 0 if it isn't
+static uint64_t cacheKey(Image_ImageHeader const* image, bool wholeChain, char const* operation) {
+	return LuaImage::Cache_IsOpen() ? LuaImage::Cache_Key(image, wholeChain, operation) : 0;
+}
+
+// pushes a new userdata holding the cached result for key, nullptr (and
+// nothing pushed) on a miss or if the entry isn't of shape
+static Image_ImageHeader const** cachePush(lua_State *L, uint64_t key, LuaImage::CacheShape const& shape) {
+	if (!key) return nullptr;
+	LuaImage::MappedFile mapped;
+	auto image = LuaImage::Cache_Find(key, shape, mapped);
+	if (!image) return nullptr;
+
+	auto ud = imageud_create(L);
+	((ImageUd*)ud)->mapped = mapped;
+	imageud_set(L, ud, image);
+	return ud;
+}
+
+// replaces image's mip maps with those of the cached chain for key
+static bool cacheAttachMips(Image_ImageHeader const* image, uint64_t key) {
+	if (!key) return false;
+	LuaImage::MappedFile mapped;
+	LuaImage::CacheShape const shape{image->width, image->height, image->depth, image->slices, image->format, 0};
+	auto cached = (Image_ImageHeader*)LuaImage::Cache_Find(key, shape, mapped);
+	if (!cached) return false;
+	if (mapped.base || !cached->nextImage) {
+		if (mapped.base) LuaImage::Cache_ReleaseMapped(cached, mapped);
+		else Image_Destroy(cached);
+		return false;
+	}
+
+	auto top = (Image_ImageHeader*)image;
+	if (top->nextImage) Image_Destroy(top->nextImage);
+	top->nextType = cached->nextType;
+	top->nextImage = cached->nextImage;
+	cached->nextType = Image_NT_None;
+	cached->nextImage = nullptr;
+	Image_Destroy(cached);
+	return true;
+}
+
+// converts into a pooled image if one of the right shape is available
+static Image_ImageHeader const* poolConvert(Image_ImageHeader const* image, TinyImageFormat format) {
+	if (format == image->format) return nullptr;
+	if (!LuaImage::CanAccessPixelRuns(image->format) || !LuaImage::CanAccessPixelRuns(format)) return nullptr;
+
+	auto dst = poolAcquireLike(image, format);
+	if (!dst) return nullptr;
+
+	// pixel indices are linear through the whole image so convert in runs
+	static uint32_t const RunLength = 1024;
+	double pixels[RunLength * 4];
+	size_t const count = Image_PixelCountOf(image);
+	for (size_t index = 0; index < count; index += RunLength) {
+		uint32_t const run = (count - index) < RunLength ? (uint32_t)(count - index) : RunLength;
+		LuaImage::DecodePixelRunD(image, index, run, pixels);
+		LuaImage::EncodePixelRunD(dst, index, run, pixels);
+	}
+	return dst;
+}
+
+// setPoolLimit(bytes) max bytes of released images kept for reuse, 0 disables
+static int setPoolLimit(lua_State *L) {
+	int64_t limit = luaL_checkinteger(L, 1);
+	LUA_ASSERT(limit >= 0, L, "pool limit must be >= 0");
+	LuaImage::Pool_SetLimit((size_t)limit);
+	return 0;
+}
 
+static int poolTrim(lua_State *L) {
+	(void)L;
+	LuaImage::Pool_Trim();
 	return 0;
 }
 
+static int poolStats(lua_State *L) {
+	LuaImage::PoolStats const stats = LuaImage::Pool_Stats();
+	lua_createtable(L, 0, 7);
+	lua_pushinteger(L, (lua_Integer)stats.hits);
+	lua_setfield(L, -2, "hits");
+	lua_pushinteger(L, (lua_Integer)stats.misses);
+	lua_setfield(L, -2, "misses");
+	lua_pushinteger(L, (lua_Integer)stats.recycled);
+	lua_setfield(L, -2, "recycled");
+	lua_pushinteger(L, (lua_Integer)stats.evictions);
+	lua_setfield(L, -2, "evictions");
+	lua_pushinteger(L, (lua_Integer)stats.pooledBytes);
+	lua_setfield(L, -2, "pooledBytes");
+	lua_pushinteger(L, (lua_Integer)stats.pooledImages);
+	lua_setfield(L, -2, "pooledImages");
+	lua_pushinteger(L, (lua_Integer)stats.limit);
+	lua_setfield(L, -2, "limit");
+	return 1;
+}
+
+// setCache(directory [, limitBytes = 0 (unlimited)]) caches the results of
+// preciseConvert, compressAMD* and createMipMapChain in directory keyed by
+// the source pixels and parameters, setCache(nil) stops caching.
+// returns false if directory can't be read
+static int setCache(lua_State *L) {
+	if (lua_isnoneornil(L, 1)) {
+		LuaImage::Cache_Close();
+		lua_pushboolean(L, true);
+		return 1;
+	}
+	char const* directory = luaL_checkstring(L, 1);
+	int64_t limit = luaL_optinteger(L, 2, 0);
+	LUA_ASSERT(limit >= 0, L, "cache limit must be >= 0");
+	lua_pushboolean(L, LuaImage::Cache_Open(directory, (size_t)limit));
+	return 1;
+}
+
+// setCacheLimit(bytes) evicts least recently used entries over bytes, 0 = unlimited
+static int setCacheLimit(lua_State *L) {
+	int64_t limit = luaL_checkinteger(L, 1);
+	LUA_ASSERT(limit >= 0, L, "cache limit must be >= 0");
+	LuaImage::Cache_SetLimit((size_t)limit);
+	return 0;
+}
+
+// cacheTrim([bytes = 0]) evicts least recently used entries down to bytes
+static int cacheTrim(lua_State *L) {
+	int64_t bytes = luaL_optinteger(L, 1, 0);
+	LUA_ASSERT(bytes >= 0, L, "cache trim bytes must be >= 0");
+	LuaImage::Cache_Trim((size_t)bytes);
+	return 0;
+}
+
+static int cacheStats(lua_State *L) {
+	LuaImage::CacheStats const stats = LuaImage::Cache_Stats();
+	lua_createtable(L, 0, 7);
+	lua_pushinteger(L, (lua_Integer)stats.hits);
+	lua_setfield(L, -2, "hits");
+	lua_pushinteger(L, (lua_Integer)stats.misses);
+	lua_setfield(L, -2, "misses");
+	lua_pushinteger(L, (lua_Integer)stats.stores);
+	lua_setfield(L, -2, "stores");
+	lua_pushinteger(L, (lua_Integer)stats.evictions);
+	lua_setfield(L, -2, "evictions");
+	lua_pushinteger(L, (lua_Integer)stats.bytes);
+	lua_setfield(L, -2, "bytes");
+	lua_pushinteger(L, (lua_Integer)stats.entries);
+	lua_setfield(L, -2, "entries");
+	lua_pushinteger(L, (lua_Integer)stats.limit);
+	lua_setfield(L, -2, "limit");
+	return 1;
+}
+
+// a format argument, either a constant from image.formats or a format name.
+// Names are looked up in the interned table, unknown ones fall back to
+// TinyImageFormat_FromName (which returns UNDEFINED)
+static TinyImageFormat checkformat(lua_State *L, int index) {
+	if (lua_type(L, index) == LUA_TNUMBER) {
+		lua_Integer const format = luaL_checkinteger(L, index);
+		LUA_ASSERT(format >= 0 && format < TinyImageFormat_Count, L, "unknown format");
+		return (TinyImageFormat)format;
+	}
+	index = lua_absindex(L, index);
+	char const* name = luaL_checkstring(L, index);
+	lua_getfield(L, LUA_REGISTRYINDEX, FormatsName);
+	lua_pushvalue(L, index);
+	lua_rawget(L, -2);
+	TinyImageFormat const format = lua_isinteger(L, -1) ? (TinyImageFormat)lua_tointeger(L, -1) :
+																 TinyImageFormat_FromName(name);
+	lua_pop(L, 2);
+	return format;
+}
+
+// pushes the format's name, interned once at open rather than per call
+static void pushformat(lua_State *L, TinyImageFormat format) {
+	lua_getfield(L, LUA_REGISTRYINDEX, FormatNamesName);
+	if (lua_rawgeti(L, -1, (lua_Integer)format) != LUA_TSTRING) {
+		lua_pop(L, 1);
+		lua_pushstring(L, TinyImageFormat_Name(format));
+	}
+	lua_remove(L, -2);
+}
+
+// pushes the format's cached info table
+static void pushformatinfo(lua_State *L, TinyImageFormat format) {
+	lua_getfield(L, LUA_REGISTRYINDEX, FormatInfoName);
+	lua_rawgeti(L, -1, (lua_Integer)format);
+	lua_remove(L, -2);
+}
+
+static void formatinfo_create(lua_State *L, TinyImageFormat format) {
+	uint32_t const blockWidth = TinyImageFormat_WidthOfBlock(format);
+	uint32_t const blockHeight = TinyImageFormat_HeightOfBlock(format);
+	uint32_t const blockDepth = TinyImageFormat_DepthOfBlock(format);
+	uint32_t const blockBits = TinyImageFormat_BitSizeOfBlock(format);
+	uint32_t const blockPixels = blockWidth * blockHeight * blockDepth;
+
+	lua_createtable(L, 0, 11);
+	lua_pushstring(L, TinyImageFormat_Name(format));
+	lua_setfield(L, -2, "name");
+	lua_pushinteger(L, (lua_Integer)format);
+	lua_setfield(L, -2, "id");
+	// fractional for some compressed formats (ASTC 5x4 is 6.4)
+	lua_pushnumber(L, blockPixels ? (double)blockBits / blockPixels : 0.0);
+	lua_setfield(L, -2, "bitsPerPixel");
+	lua_pushinteger(L, blockBits);
+	lua_setfield(L, -2, "bitsPerBlock");
+	lua_pushinteger(L, TinyImageFormat_ChannelCount(format));
+	lua_setfield(L, -2, "channels");
+	lua_pushinteger(L, blockWidth);
+	lua_setfield(L, -2, "blockWidth");
+	lua_pushinteger(L, blockHeight);
+	lua_setfield(L, -2, "blockHeight");
+	lua_pushinteger(L, blockDepth);
+	lua_setfield(L, -2, "blockDepth");
+	lua_pushboolean(L, TinyImageFormat_IsCompressed(format));
+	lua_setfield(L, -2, "compressed");
+	lua_pushboolean(L, TinyImageFormat_IsSRGB(format));
+	lua_setfield(L, -2, "srgb");
+	lua_pushboolean(L, TinyImageFormat_IsFloat(format));
+	lua_setfield(L, -2, "float");
+}
+
+// builds the registry format tables and pushes the public image.formats and
+// image.formatInfo tables. The public ones are separate so scripts can't
+// break lookups by writing to them, the info tables themselves are shared
+static void formattables_create(lua_State *L) {
+	lua_createtable(L, 0, TinyImageFormat_Count);
+	lua_createtable(L, TinyImageFormat_Count, 0);
+	lua_createtable(L, TinyImageFormat_Count, TinyImageFormat_Count);
+	lua_createtable(L, 0, TinyImageFormat_Count);
+	lua_createtable(L, TinyImageFormat_Count, TinyImageFormat_Count);
+	int const publicInfos = lua_gettop(L);
+	int const publicFormats = publicInfos - 1;
+	int const infos = publicInfos - 2;
+	int const names = publicInfos - 3;
+	int const formats = publicInfos - 4;
+
+	for (int i = 0; i < TinyImageFormat_Count; ++i) {
+		auto const format = (TinyImageFormat)i;
+		lua_pushstring(L, TinyImageFormat_Name(format));
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, names, i);
+		lua_pushvalue(L, -1);
+		lua_pushinteger(L, i);
+		lua_rawset(L, formats);
+		lua_pushvalue(L, -1);
+		lua_pushinteger(L, i);
+		lua_rawset(L, publicFormats);
+
+		// info by name and by format
+		formatinfo_create(L, format);
+		lua_pushvalue(L, -2);
+		lua_pushvalue(L, -2);
+		lua_rawset(L, infos);
+		lua_pushvalue(L, -2);
+		lua_pushvalue(L, -2);
+		lua_rawset(L, publicInfos);
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, infos, i);
+		lua_rawseti(L, publicInfos, i);
+		lua_pop(L, 1);
+	}
+
+	lua_pushvalue(L, formats);
+	lua_setfield(L, LUA_REGISTRYINDEX, FormatsName);
+	lua_pushvalue(L, names);
+	lua_setfield(L, LUA_REGISTRYINDEX, FormatNamesName);
+	lua_pushvalue(L, infos);
+	lua_setfield(L, LUA_REGISTRYINDEX, FormatInfoName);
+	lua_remove(L, formats);
+	lua_remove(L, formats);
+	lua_remove(L, formats);
+}
+
 static int width(lua_State * L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushinteger(L, image->width);
 	return 1;
 }
 
 static int height(lua_State * L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushinteger(L, image->height);
 	return 1;
 }
 static int depth(lua_State * L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushinteger(L, image->depth);
 	return 1;
 }
 static int slices(lua_State * L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushinteger(L, image->slices);
 	return 1;
 }
 
 static int format(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
-	lua_pushstring(L, TinyImageFormat_Name(image->format));
+	auto image = imageud_check(L, 1);
+	pushformat(L, image->format);
+	return 1;
+}
+
+// formatInfo() the cached info table of the image's format, the same table
+// as image.formatInfo[format] holds
+static int formatInfo(lua_State *L) {
+	auto image = imageud_check(L, 1);
+	pushformatinfo(L, image->format);
 	return 1;
 }
 
 static int flags(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_createtable(L, 0, 2);
 	lua_pushboolean(L, image->flags & Image_Flag_Cubemap);
 	lua_setfield(L, -2, "Cubemap");
@@ -73,8 +799,7 @@ static int flags(lua_State *L) {
 	return 1;
 }
 static int dimensions(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 
 	lua_pushinteger(L, image->width);
 	lua_pushinteger(L, image->height);
@@ -84,8 +809,7 @@ static int dimensions(lua_State *L) {
 }
 
 static int getPixelAt(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_checkdata(L, 1);
 	int64_t index = luaL_checkinteger(L, 2);
 	double pixel[4];
 	Image_GetPixelAtD(image, (double*)&pixel, index);
@@ -99,8 +823,7 @@ static int getPixelAt(lua_State *L) {
 }
 
 static int setPixelAt(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_writable(L, 1);
 	int64_t index = luaL_checkinteger(L, 2);
 
 	double pixel[4];
@@ -114,30 +837,275 @@ static int setPixelAt(lua_State *L) {
 	return 0;
 }
 
+static bool regionInside(Image_ImageHeader const *image,
+												 int64_t x, int64_t y, int64_t z, int64_t s,
+												 int64_t w, int64_t h, int64_t d) {
+	if (x < 0 || y < 0 || z < 0 || s < 0) return false;
+	if (w <= 0 || h <= 0 || d <= 0) return false;
+	return	(x + w) <= image->width &&
+					(y + h) <= image->height &&
+					(z + d) <= image->depth &&
+					s < image->slices;
+}
+
+// getRegion(x, y, z, s, w, h [, d [, packed]])
+// returns a flat rgba array of w*h*d pixels or if packed a string of 32 bit floats
+static int getRegion(lua_State *L) {
+	auto image = imageud_checkdata(L, 1);
+	int64_t x = luaL_checkinteger(L, 2);
+	int64_t y = luaL_checkinteger(L, 3);
+	int64_t z = luaL_checkinteger(L, 4);
+	int64_t s = luaL_checkinteger(L, 5);
+	int64_t w = luaL_checkinteger(L, 6);
+	int64_t h = luaL_checkinteger(L, 7);
+	int64_t d = luaL_optinteger(L, 8, 1);
+	bool packed = lua_toboolean(L, 9);
+	LUA_ASSERT(regionInside(image, x, y, z, s, w, h, d), L, "region outside image");
+
+	size_t const rowCount = (size_t)w * 4;
+	size_t const count = rowCount * (size_t)h * (size_t)d;
+
+	if(packed) {
+		luaL_Buffer buffer;
+		auto out = (float*)luaL_buffinitsize(L, &buffer, count * sizeof(float));
+		for (int64_t iz = 0; iz < d; ++iz) {
+			for (int64_t iy = 0; iy < h; ++iy) {
+				size_t index = Image_CalculateIndex(image, (uint32_t)x, (uint32_t)(y + iy), (uint32_t)(z + iz), (uint32_t)s);
+				LuaImage::DecodePixelRunF(image, index, (uint32_t)w, out);
+				out += rowCount;
+			}
+		}
+		luaL_pushresultsize(&buffer, count * sizeof(float));
+		return 1;
+	}
+
+	// tables can't size their array part past an int
+	LUA_ASSERT(count <= (size_t)INT_MAX, L, "region too large for a table, use packed");
+	std::vector<double> row(rowCount);
+	lua_createtable(L, (int)count, 0);
+	lua_Integer luaIndex = 1;
+	for (int64_t iz = 0; iz < d; ++iz) {
+		for (int64_t iy = 0; iy < h; ++iy) {
+			size_t index = Image_CalculateIndex(image, (uint32_t)x, (uint32_t)(y + iy), (uint32_t)(z + iz), (uint32_t)s);
+			LuaImage::DecodePixelRunD(image, index, (uint32_t)w, row.data());
+			for (size_t i = 0; i < rowCount; ++i) {
+				lua_pushnumber(L, row[i]);
+				lua_rawseti(L, -2, luaIndex++);
+			}
+		}
+	}
+	return 1;
+}
+
+// setRegion(x, y, z, s, w, h, d, data)
+// data is a flat rgba array or a string of packed 32 bit floats as returned by getRegion
+static int setRegion(lua_State *L) {
+	auto image = imageud_writable(L, 1);
+	int64_t x = luaL_checkinteger(L, 2);
+	int64_t y = luaL_checkinteger(L, 3);
+	int64_t z = luaL_checkinteger(L, 4);
+	int64_t s = luaL_checkinteger(L, 5);
+	int64_t w = luaL_checkinteger(L, 6);
+	int64_t h = luaL_checkinteger(L, 7);
+	int64_t d = luaL_optinteger(L, 8, 1);
+	LUA_ASSERT(regionInside(image, x, y, z, s, w, h, d), L, "region outside image");
+
+	size_t const rowCount = (size_t)w * 4;
+	size_t const count = rowCount * (size_t)h * (size_t)d;
+
+	if (lua_type(L, 9) == LUA_TSTRING) {
+		size_t len = 0;
+		auto in = (float const*)lua_tolstring(L, 9, &len);
+		LUA_ASSERT(len >= count * sizeof(float), L, "packed data is smaller than the region");
+		for (int64_t iz = 0; iz < d; ++iz) {
+			for (int64_t iy = 0; iy < h; ++iy) {
+				size_t index = Image_CalculateIndex(image, (uint32_t)x, (uint32_t)(y + iy), (uint32_t)(z + iz), (uint32_t)s);
+				LuaImage::EncodePixelRunF(image, index, (uint32_t)w, in);
+				in += rowCount;
+			}
+		}
+		return 0;
+	}
+
+	luaL_checktype(L, 9, LUA_TTABLE);
+	LUA_ASSERT(lua_rawlen(L, 9) >= count, L, "data table is smaller than the region");
+
+	std::vector<double> row(rowCount);
+	lua_Integer luaIndex = 1;
+	for (int64_t iz = 0; iz < d; ++iz) {
+		for (int64_t iy = 0; iy < h; ++iy) {
+			for (size_t i = 0; i < rowCount; ++i) {
+				lua_rawgeti(L, 9, luaIndex++);
+				row[i] = lua_tonumber(L, -1);
+				lua_pop(L, 1);
+			}
+			size_t index = Image_CalculateIndex(image, (uint32_t)x, (uint32_t)(y + iy), (uint32_t)(z + iz), (uint32_t)s);
+			LuaImage::EncodePixelRunD(image, index, (uint32_t)w, row.data());
+		}
+	}
+	return 0;
+}
+
+static LuaImage::Kernel** kernelud_create(lua_State *L) {
+	auto ud = (LuaImage::Kernel**)lua_newuserdata(L, sizeof(LuaImage::Kernel*));
+	if(ud == nullptr) return nullptr;
+
+	*ud = nullptr;
+	luaL_getmetatable(L, KernelMetaName);
+	lua_setmetatable(L, -2);
+	return ud;
+}
+
+static int kernelud_gc (lua_State *L) {
+	auto kernel = *(LuaImage::Kernel**)luaL_checkudata(L, 1, KernelMetaName);
+	if (kernel) LuaImage::Kernel_Destroy(kernel);
+
+	return 0;
+}
+
+// compiles the source at index (a string or an array of strings to fuse)
+// pushes the kernel userdata or nil and an error message
+static bool kernelud_compile(lua_State *L, int index) {
+	std::string error;
+	LuaImage::Kernel* kernel = nullptr;
+
+	if (lua_type(L, index) == LUA_TTABLE) {
+		lua_Integer const count = (lua_Integer)lua_rawlen(L, index);
+		for (lua_Integer i = 1; i <= count && error.empty(); ++i) {
+			lua_rawgeti(L, index, i);
+			char const* source = lua_tostring(L, -1);
+			LuaImage::Kernel* pass = source ? LuaImage::Kernel_Compile(source, error) : nullptr;
+			if (source == nullptr) error = "kernel table entries must be strings";
+			lua_pop(L, 1);
+			if (pass == nullptr) break;
+
+			if (kernel) {
+				LuaImage::Kernel_Append(kernel, pass);
+				LuaImage::Kernel_Destroy(pass);
+			} else {
+				kernel = pass;
+			}
+		}
+		if (kernel == nullptr && error.empty()) error = "empty kernel table";
+	} else {
+		kernel = LuaImage::Kernel_Compile(luaL_checkstring(L, index), error);
+	}
+
+	if (!error.empty()) {
+		if (kernel) LuaImage::Kernel_Destroy(kernel);
+		lua_pushnil(L);
+		lua_pushstring(L, error.c_str());
+		return false;
+	}
+
+	auto ud = kernelud_create(L);
+	*ud = kernel;
+	return true;
+}
+
+// string kernels are compiled once and cached by source, the kernel
+// userdata is left on the stack so it stays alive whilst in use
+static LuaImage::Kernel const* kernelud_checkorcompile(lua_State *L, int index) {
+	if (lua_type(L, index) != LUA_TSTRING) {
+		auto kernel = *(LuaImage::Kernel const**)luaL_checkudata(L, index, KernelMetaName);
+		lua_pushvalue(L, index);
+		return kernel;
+	}
+
+	if (luaL_getsubtable(L, LUA_REGISTRYINDEX, KernelCacheName) == 0) {
+		// weak values, unused kernels get recompiled after a collection
+		lua_createtable(L, 0, 1);
+		lua_pushstring(L, "v");
+		lua_setfield(L, -2, "__mode");
+		lua_setmetatable(L, -2);
+	}
+	lua_pushvalue(L, index);
+	if (lua_rawget(L, -2) == LUA_TUSERDATA) {
+		auto kernel = *(LuaImage::Kernel const**)lua_touserdata(L, -1);
+		lua_remove(L, -2);
+		return kernel;
+	}
+	lua_pop(L, 1);
+
+	if (!kernelud_compile(L, index)) {
+		lua_error(L); // error message is on the top of the stack
+	}
+	auto kernel = *(LuaImage::Kernel const**)lua_touserdata(L, -1);
+	lua_pushvalue(L, index);
+	lua_pushvalue(L, -2);
+	lua_rawset(L, -4);
+	lua_remove(L, -2);
+	return kernel;
+}
+
+static int compileKernel(lua_State *L) {
+	return kernelud_compile(L, 1) ? 1 : 2;
+}
+
+static int kernelAppend(lua_State *L) {
+	auto kernel = *(LuaImage::Kernel**)luaL_checkudata(L, 1, KernelMetaName);
+	auto other = *(LuaImage::Kernel const**)luaL_checkudata(L, 2, KernelMetaName);
+	LUA_ASSERT(kernel, L, "kernel is NIL");
+	LUA_ASSERT(other, L, "kernel is NIL");
+	LuaImage::Kernel_Append(kernel, other);
+	lua_settop(L, 1);
+	return 1;
+}
+
+static int kernelInputCount(lua_State *L) {
+	auto kernel = *(LuaImage::Kernel const**)luaL_checkudata(L, 1, KernelMetaName);
+	LUA_ASSERT(kernel, L, "kernel is NIL");
+	lua_pushinteger(L, LuaImage::Kernel_InputCount(kernel));
+	return 1;
+}
+
+// apply(kernel, [input1, input2, ...])
+// kernel is a compiled kernel or kernel source, runs it over every pixel in place
+static int apply(lua_State *L) {
+	auto image = imageud_writable(L, 1);
+	LUA_ASSERT(!TinyImageFormat_IsCompressed(image->format), L, "apply can't write compressed images");
+	int const inputCount = lua_gettop(L) - 2;
+	LUA_ASSERT(inputCount <= 255, L, "too many kernel inputs");
+
+	Image_ImageHeader const* inputs[255];
+	for (int i = 0; i < inputCount; ++i) {
+		auto input = imageud_checkdata(L, 3 + i);
+		LUA_ASSERT(	input->width == image->width &&
+								input->height == image->height &&
+								input->depth == image->depth &&
+								input->slices == image->slices, L, "kernel inputs must be the same dimensions");
+		LUA_ASSERT(!TinyImageFormat_IsCompressed(input->format), L, "apply can't read compressed images");
+		inputs[i] = input;
+	}
+
+	auto kernel = kernelud_checkorcompile(L, 2);
+	LUA_ASSERT(kernel, L, "kernel is NIL");
+	LUA_ASSERT(LuaImage::Kernel_InputCount(kernel) <= (uint32_t)inputCount, L, "kernel uses more inputs than were passed");
+
+	LuaImage::Kernel_Run(kernel, image, inputs, (uint32_t)inputCount, 0);
+	return 0;
+}
+
 static int is1D(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushboolean(L, Image_Is1D(image));
 	return 1;
 }
 
 static int is2D(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushboolean(L, Image_Is2D(image));
 	return 1;
 }
 
 static int is3D(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushboolean(L, Image_Is3D(image));
 	return 1;
 }
 
 static int isArray(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushboolean(L, Image_IsArray(image));
 	return 1;
 }
@@ -150,79 +1118,150 @@ static int isCubemap(lua_State *L) {
 }
 
 static int pixelCount(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushinteger(L, Image_PixelCountOf(image));
 	return 1;
 }
 static int pixelCountPerSlice(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushinteger(L, Image_PixelCountPerSliceOf(image));
 	return 1;
 }
 
 static int pixelCountPerPage(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushinteger(L, Image_PixelCountPerPageOf(image));
 	return 1;
 }
 
 static int pixelCountPerRow(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushinteger(L, Image_PixelCountPerRowOf(image));
 	return 1;
 }
 
+static void pushChannelNumbers(lua_State *L, double const* values, char const* name) {
+	lua_createtable(L, 4, 0);
+	for (int c = 0; c < 4; ++c) {
+		lua_pushnumber(L, values[c]);
+		lua_rawseti(L, -2, c + 1);
+	}
+	lua_setfield(L, -2, name);
+}
+
+static void pushChannelCounts(lua_State *L, size_t const* values, char const* name) {
+	lua_createtable(L, 4, 0);
+	for (int c = 0; c < 4; ++c) {
+		lua_pushinteger(L, (lua_Integer)values[c]);
+		lua_rawseti(L, -2, c + 1);
+	}
+	lua_setfield(L, -2, name);
+}
+
+// stats([options]) per channel (r, g, b, a) statistics of one linked image in
+// one pass, options {histogramBins = 0, histogramMin, histogramMax, level = 0, threads = n}.
+// returns {pixels, min, max, mean, variance, nan, inf, constant = {bools},
+// isConstant, alphaOpaque, histogram = {{counts}...}, histogramMin, histogramMax}
+static int stats(lua_State *L) {
+	auto image = imageud_checkdata(L, 1);
+
+	LuaImage::StatsOptions options;
+	options.histogramBins = (uint32_t)optIntegerField(L, 2, "histogramBins", options.histogramBins);
+	options.histogramMin = optNumberField(L, 2, "histogramMin", options.histogramMin);
+	options.histogramMax = optNumberField(L, 2, "histogramMax", options.histogramMax);
+	options.threadCount = (uint32_t)optIntegerField(L, 2, "threads", options.threadCount);
+	int64_t level = optIntegerField(L, 2, "level", 0);
+	LUA_ASSERT(level >= 0 && (size_t)level < Image_LinkedImageCountOf(image), L, "level out of range");
+	image = Image_LinkedImageOf(image, (size_t)level);
+
+	LuaImage::ImageStats result;
+	if (!LuaImage::CollectStats(image, options, result)) {
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lua_createtable(L, 0, 14);
+	lua_pushinteger(L, (lua_Integer)result.pixels);
+	lua_setfield(L, -2, "pixels");
+	pushChannelNumbers(L, result.min, "min");
+	pushChannelNumbers(L, result.max, "max");
+	pushChannelNumbers(L, result.mean, "mean");
+	pushChannelNumbers(L, result.variance, "variance");
+	pushChannelCounts(L, result.nanCount, "nan");
+	pushChannelCounts(L, result.infCount, "inf");
+
+	bool allConstant = true;
+	lua_createtable(L, 4, 0);
+	for (int c = 0; c < 4; ++c) {
+		allConstant = allConstant && result.constant[c];
+		lua_pushboolean(L, result.constant[c]);
+		lua_rawseti(L, -2, c + 1);
+	}
+	lua_setfield(L, -2, "constant");
+	lua_pushboolean(L, allConstant);
+	lua_setfield(L, -2, "isConstant");
+	lua_pushboolean(L, result.alphaOpaque);
+	lua_setfield(L, -2, "alphaOpaque");
+
+	if (options.histogramBins) {
+		lua_createtable(L, 4, 0);
+		for (int c = 0; c < 4; ++c) {
+			lua_createtable(L, (int)options.histogramBins, 0);
+			for (size_t b = 0; b < result.histogram[c].size(); ++b) {
+				lua_pushinteger(L, (lua_Integer)result.histogram[c][b]);
+				lua_rawseti(L, -2, (lua_Integer)b + 1);
+			}
+			lua_rawseti(L, -2, c + 1);
+		}
+		lua_setfield(L, -2, "histogram");
+		lua_pushnumber(L, result.histogramMin);
+		lua_setfield(L, -2, "histogramMin");
+		lua_pushnumber(L, result.histogramMax);
+		lua_setfield(L, -2, "histogramMax");
+	}
+	return 1;
+}
+
 static int byteCount(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushinteger(L, Image_ByteCountOf(image));
 	return 1;
 }
 
 static int byteCountPerSlice(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushinteger(L, Image_ByteCountPerSliceOf(image));
 	return 1;
 }
 
 
 static int byteCountPerPage(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushinteger(L, Image_ByteCountPerPageOf(image));
 	return 1;
 }
 
 
 static int byteCountPerRow(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushinteger(L, Image_ByteCountPerRowOf(image));
 	return 1;
 }
 
 static int byteCountOfImageChain(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushinteger(L, Image_ByteCountOfImageChainOf(image));
 	return 1;
 }
 
 static int bytesRequiredForMipMaps(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushinteger(L, Image_BytesRequiredForMipMapsOf(image));
 	return 1;
 }
 
 static int calculateIndex(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	int64_t x = luaL_checkinteger(L, 2);
 	int64_t y = luaL_checkinteger(L, 3);
 	int64_t z = luaL_checkinteger(L, 4);
@@ -233,136 +1272,590 @@ static int calculateIndex(lua_State *L) {
 }
 
 static int copy(lua_State *L) {
-	auto src = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	auto dst = *(Image_ImageHeader const**)luaL_checkudata(L, 2, MetaName);
-	LUA_ASSERT(src, L, "image is NIL");
-	LUA_ASSERT(dst, L, "image is NIL");
+	// dst first, a copy on write must happen before src is read
+	auto dst = imageud_writable(L, 2);
+	auto src = imageud_checkdata(L, 1);
 
 	Image_CopyImage(src, dst);
 	return 0;
 }
 
 static int copySlice(lua_State *L) {
-	auto src = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
+	auto dst = imageud_writable(L, 3);
+	auto src = imageud_checkdata(L, 1);
 	int64_t sw = luaL_checkinteger(L, 2);
-	auto dst = *(Image_ImageHeader const**)luaL_checkudata(L, 3, MetaName);
 	int64_t dw = luaL_checkinteger(L, 4);
-	LUA_ASSERT(src, L, "image is NIL");
-	LUA_ASSERT(dst, L, "image is NIL");
 
 	Image_CopySlice(src, (uint32_t)sw, dst, (uint32_t)dw);
 	return 0;
 }
 
 static int copyPage(lua_State *L) {
-	auto src = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
+	auto dst = imageud_writable(L, 4);
+	auto src = imageud_checkdata(L, 1);
 	int64_t sz = luaL_checkinteger(L, 2);
 	int64_t sw = luaL_checkinteger(L, 3);
-	auto dst = *(Image_ImageHeader const**)luaL_checkudata(L, 4, MetaName);
 	int64_t dz = luaL_checkinteger(L, 5);
 	int64_t dw = luaL_checkinteger(L, 6);
-	LUA_ASSERT(src, L, "image is NIL");
-	LUA_ASSERT(dst, L, "image is NIL");
 
 	Image_CopyPage(src, (uint32_t)sz, (uint32_t)sw, dst, (uint32_t)dz, (uint32_t)dw);
 	return 0;
 }
 
 static int copyRow(lua_State *L) {
-	auto src = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
+	auto dst = imageud_writable(L, 5);
+	auto src = imageud_checkdata(L, 1);
 	int64_t sy = luaL_checkinteger(L, 2);
 	int64_t sz = luaL_checkinteger(L, 3);
 	int64_t sw = luaL_checkinteger(L, 4);
-	auto dst = *(Image_ImageHeader const**)luaL_checkudata(L, 5, MetaName);
 	int64_t dy = luaL_checkinteger(L, 6);
 	int64_t dz = luaL_checkinteger(L, 7);
 	int64_t dw = luaL_checkinteger(L, 8);
 
-	LUA_ASSERT(src, L, "image is NIL");
-	LUA_ASSERT(dst, L, "image is NIL");
 
 	Image_CopyRow(src, (uint32_t)sy, (uint32_t)sz, (uint32_t)sw, dst, (uint32_t)dy, (uint32_t)dz, (uint32_t)dw);
 	return 0;
 }
 
+// fills blit options from an optional {blend, opacity, threads} table
+static void blitOptions(lua_State *L, int index, LuaImage::BlitOptions& options) {
+	static char const* const blends[] = { "none", "alpha", "premultiplied", "additive", nullptr };
+	static LuaImage::BlitBlend const blendValues[] = {
+			LuaImage::BlitBlend::None,
+			LuaImage::BlitBlend::Alpha,
+			LuaImage::BlitBlend::Premultiplied,
+			LuaImage::BlitBlend::Additive,
+	};
+
+	if (!lua_istable(L, index)) return;
+	lua_getfield(L, index, "blend");
+	if (!lua_isnil(L, -1)) options.blend = blendValues[luaL_checkoption(L, -1, nullptr, blends)];
+	lua_pop(L, 1);
+	options.opacity = optNumberField(L, index, "opacity", options.opacity);
+	options.threadCount = (uint32_t)optIntegerField(L, index, "threads", options.threadCount);
+}
+
+// blit(src, sx, sy, sz, ss, w, h, d, dx, dy, dz, ds [, options]) copies a box of
+// src into this image converting format as needed,
+// options {blend = "none"|"alpha"|"premultiplied"|"additive", opacity = 0..1, threads = n}
+static int blit(lua_State *L) {
+	auto dst = imageud_writable(L, 1);
+	auto src = imageud_checkdata(L, 2);
+	int64_t sx = luaL_checkinteger(L, 3);
+	int64_t sy = luaL_checkinteger(L, 4);
+	int64_t sz = luaL_checkinteger(L, 5);
+	int64_t ss = luaL_checkinteger(L, 6);
+	int64_t w = luaL_checkinteger(L, 7);
+	int64_t h = luaL_checkinteger(L, 8);
+	int64_t d = luaL_checkinteger(L, 9);
+	int64_t dx = luaL_checkinteger(L, 10);
+	int64_t dy = luaL_checkinteger(L, 11);
+	int64_t dz = luaL_checkinteger(L, 12);
+	int64_t ds = luaL_checkinteger(L, 13);
+	LUA_ASSERT(regionInside(src, sx, sy, sz, ss, w, h, d), L, "source region outside image");
+	LUA_ASSERT(regionInside(dst, dx, dy, dz, ds, w, h, d), L, "destination region outside image");
+
+	LuaImage::BlitOptions options;
+	blitOptions(L, 14, options);
+
+	LuaImage::BlitBox const srcBox{(uint32_t)sx, (uint32_t)sy, (uint32_t)sz, (uint32_t)ss};
+	LuaImage::BlitBox const dstBox{(uint32_t)dx, (uint32_t)dy, (uint32_t)dz, (uint32_t)ds};
+	lua_pushboolean(L, LuaImage::Blit(dst, dstBox, src, srcBox, (uint32_t)w, (uint32_t)h, (uint32_t)d, options));
+	return 1;
+}
+
+// packAtlas(images [, options]) packs the top level of every image into atlas
+// pages, returns an array of atlas images (or one 2D array image) and a table
+// per input image {page, x, y, width, height, u0, v0, u1, v1} in input order.
+// options {maxWidth = 4096, maxHeight = 4096, padding = 2, extrude = true,
+// powerOfTwo = true, array = false, format = format or name, threads = n}
+// returns nil, error if the images can't be packed
+static int packAtlas(lua_State *L) {
+	luaL_checktype(L, 1, LUA_TTABLE);
+	size_t const count = lua_rawlen(L, 1);
+	LUA_ASSERT(count > 0, L, "no images to pack");
+
+	std::vector<Image_ImageHeader const*> images(count);
+	for (size_t i = 0; i < count; ++i) {
+		lua_rawgeti(L, 1, (lua_Integer)i + 1);
+		images[i] = imageud_checkdata(L, -1);
+		lua_pop(L, 1);
+	}
+
+	LuaImage::AtlasOptions options;
+	options.maxWidth = (uint32_t)optIntegerField(L, 2, "maxWidth", options.maxWidth);
+	options.maxHeight = (uint32_t)optIntegerField(L, 2, "maxHeight", options.maxHeight);
+	options.padding = (uint32_t)optIntegerField(L, 2, "padding", options.padding);
+	options.extrude = optBoolField(L, 2, "extrude", options.extrude);
+	options.powerOfTwo = optBoolField(L, 2, "powerOfTwo", options.powerOfTwo);
+	options.array = optBoolField(L, 2, "array", options.array);
+	options.threadCount = (uint32_t)optIntegerField(L, 2, "threads", options.threadCount);
+	if (lua_istable(L, 2)) {
+		lua_getfield(L, 2, "format");
+		if (!lua_isnil(L, -1)) {
+			options.format = checkformat(L, -1);
+			LUA_ASSERT(options.format != TinyImageFormat_UNDEFINED, L, "unknown format");
+		}
+		lua_pop(L, 1);
+	}
+
+	// the packed area is a lower bound on what the pages will need
+	TinyImageFormat const format = options.format != TinyImageFormat_UNDEFINED ? options.format : images[0]->format;
+	size_t packedBytes = 0;
+	for (auto image : images) {
+		packedBytes += imageBytesFor(image->width + (options.padding * 2), image->height + (options.padding * 2), 1, 1, format);
+	}
+	if (!imageud_reserve(L, packedBytes)) return imageud_budgetfail(L);
+
+	LuaImage::AtlasResult result;
+	char const* error = nullptr;
+	if (!LuaImage::Atlas_Pack(images.data(), count, options, result, error)) {
+		lua_pushnil(L);
+		lua_pushstring(L, error);
+		return 2;
+	}
+
+	lua_createtable(L, (int)result.images.size(), 0);
+	for (size_t i = 0; i < result.images.size(); ++i) {
+		auto ud = imageud_create(L);
+		imageud_set(L, ud, result.images[i]);
+		lua_rawseti(L, -2, (lua_Integer)i + 1);
+	}
+
+	lua_Number const pageWidth = (lua_Number)result.pageWidth;
+	lua_Number const pageHeight = (lua_Number)result.pageHeight;
+	lua_createtable(L, (int)count, 0);
+	for (size_t i = 0; i < count; ++i) {
+		auto const& placement = result.placements[i];
+		lua_createtable(L, 0, 9);
+		lua_pushinteger(L, placement.page + 1);
+		lua_setfield(L, -2, "page");
+		lua_pushinteger(L, placement.x);
+		lua_setfield(L, -2, "x");
+		lua_pushinteger(L, placement.y);
+		lua_setfield(L, -2, "y");
+		lua_pushinteger(L, placement.width);
+		lua_setfield(L, -2, "width");
+		lua_pushinteger(L, placement.height);
+		lua_setfield(L, -2, "height");
+		lua_pushnumber(L, placement.x / pageWidth);
+		lua_setfield(L, -2, "u0");
+		lua_pushnumber(L, placement.y / pageHeight);
+		lua_setfield(L, -2, "v0");
+		lua_pushnumber(L, (placement.x + placement.width) / pageWidth);
+		lua_setfield(L, -2, "u1");
+		lua_pushnumber(L, (placement.y + placement.height) / pageHeight);
+		lua_setfield(L, -2, "v1");
+		lua_rawseti(L, -2, (lua_Integer)i + 1);
+	}
+	return 2;
+}
+
+// compare(a, b [, options]) error metrics between two images of the same
+// shape over every level, options {metrics = {"mse", "psnr", "ssim", "maxdiff"},
+// perChannel = bool, diff = bool, diffScale = n, threads = n}. Returns a table
+// of the metrics (plus perChannel = {metric = {c1, c2...}}) and the diff image
+// if asked for, or nil, error
+static int compare(lua_State *L) {
+	static char const* const metrics[] = { "mse", "psnr", "ssim", "maxdiff", nullptr };
+
+	auto a = imageud_checkdata(L, 1);
+	auto b = imageud_checkdata(L, 2);
+
+	LuaImage::CompareOptions options;
+	bool perChannel = false;
+	if (lua_istable(L, 3)) {
+		lua_getfield(L, 3, "metrics");
+		if (lua_istable(L, -1)) {
+			bool* const wanted[] = { &options.mse, &options.psnr, &options.ssim, &options.maxDiff };
+			for (auto w : wanted) *w = false;
+			for (lua_Integer i = 1; i <= (lua_Integer)lua_rawlen(L, -1); ++i) {
+				lua_rawgeti(L, -1, i);
+				*wanted[luaL_checkoption(L, -1, nullptr, metrics)] = true;
+				lua_pop(L, 1);
+			}
+		}
+		lua_pop(L, 1);
+		perChannel = optBoolField(L, 3, "perChannel", perChannel);
+		options.diff = optBoolField(L, 3, "diff", options.diff);
+		options.diffScale = optNumberField(L, 3, "diffScale", options.diffScale);
+		options.threadCount = (uint32_t)optIntegerField(L, 3, "threads", options.threadCount);
+	}
+
+	if (options.diff) {
+		size_t bytes = 0;
+		for (size_t i = 0; i < Image_LinkedImageCountOf(a); ++i) {
+			bytes += Image_PixelCountOf(Image_LinkedImageOf(a, i)) * 16;
+		}
+		if (!imageud_reserve(L, bytes)) return imageud_budgetfail(L);
+	}
+
+	LuaImage::CompareResult result;
+	char const* error = nullptr;
+	if (!LuaImage::Compare(a, b, options, result, error)) {
+		lua_pushnil(L);
+		lua_pushstring(L, error);
+		return 2;
+	}
+
+	bool const wanted[] = { options.mse, options.psnr, options.ssim, options.maxDiff };
+	double const all[] = { result.mseAll, result.psnrAll, result.ssimAll, result.maxDiffAll };
+	double const* const channels[] = { result.mse, result.psnr, result.ssim, result.maxDiff };
+
+	lua_createtable(L, 0, 6);
+	lua_pushinteger(L, result.channels);
+	lua_setfield(L, -2, "channels");
+	for (int m = 0; m < 4; ++m) {
+		if (!wanted[m]) continue;
+		lua_pushnumber(L, all[m]);
+		lua_setfield(L, -2, metrics[m]);
+	}
+	if (perChannel) {
+		lua_createtable(L, 0, 4);
+		for (int m = 0; m < 4; ++m) {
+			if (!wanted[m]) continue;
+			lua_createtable(L, (int)result.channels, 0);
+			for (uint32_t c = 0; c < result.channels; ++c) {
+				lua_pushnumber(L, channels[m][c]);
+				lua_rawseti(L, -2, c + 1);
+			}
+			lua_setfield(L, -2, metrics[m]);
+		}
+		lua_setfield(L, -2, "perChannel");
+	}
+
+	if (!result.diff) return 1;
+	auto ud = imageud_create(L);
+	imageud_set(L, ud, result.diff);
+	return 2;
+}
+
 static int copyPixel(lua_State *L) {
-	auto src = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
+	auto dst = imageud_writable(L, 6);
+	auto src = imageud_checkdata(L, 1);
 	int64_t sx = luaL_checkinteger(L, 2);
 	int64_t sy = luaL_checkinteger(L, 3);
 	int64_t sz = luaL_checkinteger(L, 4);
 	int64_t sw = luaL_checkinteger(L, 5);
-	auto dst = *(Image_ImageHeader const**)luaL_checkudata(L, 6, MetaName);
 	int64_t dx = luaL_checkinteger(L, 7);
 	int64_t dy = luaL_checkinteger(L, 8);
 	int64_t dz = luaL_checkinteger(L, 9);
 	int64_t dw = luaL_checkinteger(L, 10);
 
-	LUA_ASSERT(src, L, "image is NIL");
-	LUA_ASSERT(dst, L, "image is NIL");
 
 	Image_CopyPixel(src, (uint32_t)sx, (uint32_t)sy, (uint32_t)sz, (uint32_t)sw, dst, (uint32_t)dx, (uint32_t)dy, (uint32_t)dz, (uint32_t)dw);
 	return 0;
 }
 
 static int linkedImageCount(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	lua_pushinteger(L, Image_LinkedImageCountOf(image));
 	return 1;
 }
 
 static int linkedImage(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
 	int64_t index = luaL_checkinteger(L, 2);
-	auto ud = imageud_create(L);
-	*ud = Image_LinkedImageOf(image, index);
+	// linked images belong to the chain, hand out a view rather than an owner
+	auto linked = Image_LinkedImageOf(image, index);
+	auto ud = linked ? imageud_borrow(L, 1, linked) : imageud_create(L);
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
 
-static int create(lua_State *L) {
-	int64_t w = luaL_checkinteger(L, 1);
-	int64_t h = luaL_checkinteger(L, 2);
-	int64_t d = luaL_checkinteger(L, 3);
-	int64_t s = luaL_checkinteger(L, 4);
-	char const* fmt = luaL_checkstring(L, 5);
+// view([level = 0]) a zero copy image of a level of the chain that keeps the
+// chain alive, usable anywhere an image is
+static int view(lua_State *L) {
+	auto image = imageud_check(L, 1);
+	int64_t level = luaL_optinteger(L, 2, 0);
+	LUA_ASSERT(level >= 0 && (size_t)level < Image_LinkedImageCountOf(image), L, "level out of range");
+	imageud_borrow(L, 1, Image_LinkedImageOf(image, level));
+	return 1;
+}
 
-	auto ud = imageud_create(L);
-	*ud = Image_Create((uint32_t)w, (uint32_t)h, (uint32_t)d, (uint32_t)s, TinyImageFormat_FromName(fmt));
-	lua_pushboolean(L, *ud != nullptr);
-	return 2;
+// a box of one slice of an image, pixels stay in the viewed image
+struct RegionUd {
+	Image_ImageHeader const* image;
+	// owner of image, its borrowers count includes this region
+	ImageUd* root;
+	LuaImage::BlitBox box;
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+};
+
+static RegionUd* regionud_check(lua_State *L, int index) {
+	auto region = (RegionUd*)luaL_checkudata(L, index, RegionMetaName);
+	LUA_ASSERT(region->image, L, "region is NIL");
+	return region;
+}
+
+// a region's pixels can only be written while its image isn't shared with
+// anyone else, copying would leave the region on the shared image
+static RegionUd* regionud_writable(lua_State *L, int index) {
+	auto region = regionud_check(L, index);
+	LUA_ASSERT(region->root->jobs == 0, L, "image is in use by an async job");
+	LUA_ASSERT(imageud_unshare(L, region->root), L, "shared image has live views");
+	return region;
+}
+
+static int regionud_gc(lua_State *L) {
+	auto region = (RegionUd*)luaL_checkudata(L, 1, RegionMetaName);
+	if (region->root) region->root->borrowers--;
+	region->root = nullptr;
+	region->image = nullptr;
+	return 0;
 }
 
-static int createNoClear(lua_State *L) {
-	int64_t w = luaL_checkinteger(L, 1);
+// region(x, y, z, s, w, h [, d = 1]) a zero copy view of a box of the image
+static int region(lua_State *L) {
+	auto image = imageud_checkdata(L, 1);
+	int64_t x = luaL_checkinteger(L, 2);
+	int64_t y = luaL_checkinteger(L, 3);
+	int64_t z = luaL_checkinteger(L, 4);
+	int64_t s = luaL_checkinteger(L, 5);
+	int64_t w = luaL_checkinteger(L, 6);
+	int64_t h = luaL_checkinteger(L, 7);
+	int64_t d = luaL_optinteger(L, 8, 1);
+	LUA_ASSERT(regionInside(image, x, y, z, s, w, h, d), L, "region outside image");
+
+	auto owner = imageud_owner(L, 1);
+	auto ud = (RegionUd*)lua_newuserdata(L, sizeof(RegionUd));
+	ud->image = image;
+	ud->root = owner;
+	ud->box = LuaImage::BlitBox{(uint32_t)x, (uint32_t)y, (uint32_t)z, (uint32_t)s};
+	ud->width = (uint32_t)w;
+	ud->height = (uint32_t)h;
+	ud->depth = (uint32_t)d;
+	owner->borrowers++;
+	luaL_getmetatable(L, RegionMetaName);
+	lua_setmetatable(L, -2);
+	lua_pushvalue(L, 1);
+	lua_setuservalue(L, -2);
+	return 1;
+}
+
+// resolves an image or region at index and a box relative to it into an
+// image and an absolute box, false if w x h x d at the box doesn't fit.
+// Destinations (writable) go through the same copy on write / frozen checks
+// as every other writer
+static bool blitTarget(lua_State *L, int index, int64_t x, int64_t y, int64_t z, int64_t s,
+											 int64_t w, int64_t h, int64_t d, bool writable,
+											 Image_ImageHeader const*& image, LuaImage::BlitBox& box) {
+	auto region = (RegionUd*)luaL_testudata(L, index, RegionMetaName);
+	if (region) {
+		if (writable) regionud_writable(L, index);
+		LUA_ASSERT(region->image, L, "region is NIL");
+		if (x < 0 || y < 0 || z < 0 || s != 0) return false;
+		if (x + w > region->width || y + h > region->height || z + d > region->depth) return false;
+		image = region->image;
+		box = LuaImage::BlitBox{region->box.x + (uint32_t)x, region->box.y + (uint32_t)y,
+														region->box.z + (uint32_t)z, region->box.slice};
+		return true;
+	}
+	if (writable) {
+		image = imageud_writable(L, index);
+	} else {
+		image = imageud_checkdata(L, index);
+	}
+	if (!regionInside(image, x, y, z, s, w, h, d)) return false;
+	box = LuaImage::BlitBox{(uint32_t)x, (uint32_t)y, (uint32_t)z, (uint32_t)s};
+	return true;
+}
+
+static int regionWidth(lua_State *L) {
+	lua_pushinteger(L, regionud_check(L, 1)->width);
+	return 1;
+}
+
+static int regionHeight(lua_State *L) {
+	lua_pushinteger(L, regionud_check(L, 1)->height);
+	return 1;
+}
+
+static int regionDepth(lua_State *L) {
+	lua_pushinteger(L, regionud_check(L, 1)->depth);
+	return 1;
+}
+
+static int regionDimensions(lua_State *L) {
+	auto region = regionud_check(L, 1);
+	lua_pushinteger(L, region->width);
+	lua_pushinteger(L, region->height);
+	lua_pushinteger(L, region->depth);
+	lua_pushinteger(L, 1);
+	return 4;
+}
+
+static int regionFormat(lua_State *L) {
+	pushformat(L, regionud_check(L, 1)->image->format);
+	return 1;
+}
+
+// offset() returns x, y, z, s of the region in its image
+static int regionOffset(lua_State *L) {
+	auto region = regionud_check(L, 1);
+	lua_pushinteger(L, region->box.x);
+	lua_pushinteger(L, region->box.y);
+	lua_pushinteger(L, region->box.z);
+	lua_pushinteger(L, region->box.slice);
+	return 4;
+}
+
+// parent() returns the image the region views
+static int regionParent(lua_State *L) {
+	regionud_check(L, 1);
+	lua_getuservalue(L, 1);
+	return 1;
+}
+
+static uint64_t regionIndex(lua_State *L, RegionUd const* region) {
+	int64_t x = luaL_checkinteger(L, 2);
+	int64_t y = luaL_checkinteger(L, 3);
+	int64_t z = luaL_checkinteger(L, 4);
+	LUA_ASSERT(x >= 0 && y >= 0 && z >= 0 && x < region->width && y < region->height && z < region->depth,
+						 L, "pixel outside region");
+	return Image_CalculateIndex(region->image, region->box.x + (uint32_t)x, region->box.y + (uint32_t)y,
+															region->box.z + (uint32_t)z, region->box.slice);
+}
+
+// getPixelAt(x, y, z) returns r, g, b, a
+static int regionGetPixelAt(lua_State *L) {
+	auto region = regionud_check(L, 1);
+	double pixel[4];
+	Image_GetPixelAtD(region->image, pixel, regionIndex(L, region));
+	lua_pushnumber(L, pixel[0]); // r
+	lua_pushnumber(L, pixel[1]); // g
+	lua_pushnumber(L, pixel[2]); // b
+	lua_pushnumber(L, pixel[3]); // a
+	return 4;
+}
+
+// setPixelAt(x, y, z, r, g, b, a)
+static int regionSetPixelAt(lua_State *L) {
+	auto region = regionud_writable(L, 1);
+	double pixel[4];
+	pixel[0] = luaL_checknumber(L, 5); // r
+	pixel[1] = luaL_checknumber(L, 6); // g
+	pixel[2] = luaL_checknumber(L, 7); // b
+	pixel[3] = luaL_checknumber(L, 8); // a
+	Image_SetPixelAtD(region->image, pixel, regionIndex(L, region));
+	return 0;
+}
+
+// copyTo(dst, x, y, z, s [, {blend, opacity, threads}]) blits the whole region
+// into an image or region, converting format as needed
+static int regionCopyTo(lua_State *L) {
+	auto region = regionud_check(L, 1);
+	int64_t x = luaL_checkinteger(L, 3);
+	int64_t y = luaL_checkinteger(L, 4);
+	int64_t z = luaL_checkinteger(L, 5);
+	int64_t s = luaL_checkinteger(L, 6);
+	Image_ImageHeader const* dst;
+	LuaImage::BlitBox dstBox;
+	LUA_ASSERT(blitTarget(L, 2, x, y, z, s, region->width, region->height, region->depth, true, dst, dstBox),
+						 L, "destination region outside image");
+
+	LuaImage::BlitOptions options;
+	blitOptions(L, 7, options);
+	lua_pushboolean(L, LuaImage::Blit(dst, dstBox, region->image, region->box,
+																		region->width, region->height, region->depth, options));
+	return 1;
+}
+
+// copyFrom(src, x, y, z, s [, {blend, opacity, threads}]) fills the whole region
+// from an image or region, converting format as needed
+static int regionCopyFrom(lua_State *L) {
+	auto region = regionud_writable(L, 1);
+	int64_t x = luaL_checkinteger(L, 3);
+	int64_t y = luaL_checkinteger(L, 4);
+	int64_t z = luaL_checkinteger(L, 5);
+	int64_t s = luaL_checkinteger(L, 6);
+	Image_ImageHeader const* src;
+	LuaImage::BlitBox srcBox;
+	LUA_ASSERT(blitTarget(L, 2, x, y, z, s, region->width, region->height, region->depth, false, src, srcBox),
+						 L, "source region outside image");
+
+	LuaImage::BlitOptions options;
+	blitOptions(L, 7, options);
+	lua_pushboolean(L, LuaImage::Blit(region->image, region->box, src, srcBox,
+																		region->width, region->height, region->depth, options));
+	return 1;
+}
+
+// toImage([format]) copies the region into a new image in one pass, for
+// saving or handing to APIs that need a whole image
+static int regionToImage(lua_State *L) {
+	auto region = regionud_check(L, 1);
+	TinyImageFormat const format = lua_isnoneornil(L, 2) ? region->image->format :
+																 checkformat(L, 2);
+	LUA_ASSERT(format != TinyImageFormat_UNDEFINED, L, "unknown format");
+	if (!imageud_reserve(L, imageBytesFor(region->width, region->height, region->depth, 1, format))) return imageud_budgetfail(L);
+
+	auto image = poolAcquire(region->width, region->height, region->depth, 1, format, 0, false);
+	if (!image) image = Image_CreateNoClear(region->width, region->height, region->depth, 1, format);
+	if (image && !LuaImage::Blit(image, LuaImage::BlitBox{0, 0, 0, 0}, region->image, region->box,
+															 region->width, region->height, region->depth, LuaImage::BlitOptions())) {
+		if (!LuaImage::Pool_Recycle(image)) Image_Destroy(image);
+		image = nullptr;
+	}
+
+	auto ud = imageud_create(L);
+	imageud_set(L, ud, image);
+	lua_pushboolean(L, *ud != nullptr);
+	return 2;
+}
+
+static int create(lua_State *L) {
+	int64_t w = luaL_checkinteger(L, 1);
+	int64_t h = luaL_checkinteger(L, 2);
+	int64_t d = luaL_checkinteger(L, 3);
+	int64_t s = luaL_checkinteger(L, 4);
+	TinyImageFormat const format = checkformat(L, 5);
+	if (!imageud_reserve(L, imageBytesFor(w, h, d, s, format))) return imageud_budgetfail(L);
+
+	auto ud = imageud_create(L);
+	auto image = poolAcquire(w, h, d, s, format, 0, true);
+	imageud_set(L, ud, image ? image : Image_Create((uint32_t)w, (uint32_t)h, (uint32_t)d, (uint32_t)s, format));
+	lua_pushboolean(L, *ud != nullptr);
+	return 2;
+}
+
+static int createNoClear(lua_State *L) {
+	int64_t w = luaL_checkinteger(L, 1);
 	int64_t h = luaL_checkinteger(L, 2);
 	int64_t d = luaL_checkinteger(L, 3);
 	int64_t s = luaL_checkinteger(L, 4);
-	char const* fmt = luaL_checkstring(L, 5);
+	TinyImageFormat const format = checkformat(L, 5);
+	if (!imageud_reserve(L, imageBytesFor(w, h, d, s, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_CreateNoClear((uint32_t)w, (uint32_t)h, (uint32_t)d, (uint32_t)s, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, h, d, s, format, 0, false);
+	imageud_set(L, ud, image ? image : Image_CreateNoClear((uint32_t)w, (uint32_t)h, (uint32_t)d, (uint32_t)s, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
 
 static int create1D(lua_State *L) {
 	int64_t w = luaL_checkinteger(L, 1);
-	char const* fmt = luaL_checkstring(L, 2);
+	TinyImageFormat const format = checkformat(L, 2);
+	if (!imageud_reserve(L, imageBytesFor(w, 1, 1, 1, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_Create1D((uint32_t)w,TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, 1, 1, 1, format, 0, true);
+	imageud_set(L, ud, image ? image : Image_Create1D((uint32_t)w,format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
 
 static int create1DNoClear(lua_State *L) {
 	int64_t w = luaL_checkinteger(L, 1);
-	char const* fmt = luaL_checkstring(L, 2);
+	TinyImageFormat const format = checkformat(L, 2);
+	if (!imageud_reserve(L, imageBytesFor(w, 1, 1, 1, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_Create1DNoClear((uint32_t)w, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, 1, 1, 1, format, 0, false);
+	imageud_set(L, ud, image ? image : Image_Create1DNoClear((uint32_t)w, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
@@ -370,10 +1863,12 @@ static int create1DNoClear(lua_State *L) {
 static int create1DArray(lua_State *L) {
 	int64_t w = luaL_checkinteger(L, 1);
 	int64_t s = luaL_checkinteger(L, 2);
-	char const* fmt = luaL_checkstring(L, 3);
+	TinyImageFormat const format = checkformat(L, 3);
+	if (!imageud_reserve(L, imageBytesFor(w, 1, 1, s, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_Create1DArray((uint32_t)w, (uint32_t)s, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, 1, 1, s, format, 0, true);
+	imageud_set(L, ud, image ? image : Image_Create1DArray((uint32_t)w, (uint32_t)s, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
@@ -381,10 +1876,12 @@ static int create1DArray(lua_State *L) {
 static int create1DArrayNoClear(lua_State *L) {
 	int64_t w = luaL_checkinteger(L, 1);
 	int64_t s = luaL_checkinteger(L, 2);
-	char const* fmt = luaL_checkstring(L, 3);
+	TinyImageFormat const format = checkformat(L, 3);
+	if (!imageud_reserve(L, imageBytesFor(w, 1, 1, s, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_Create1DArrayNoClear((uint32_t)w, (uint32_t)s, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, 1, 1, s, format, 0, false);
+	imageud_set(L, ud, image ? image : Image_Create1DArrayNoClear((uint32_t)w, (uint32_t)s, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
@@ -392,20 +1889,24 @@ static int create1DArrayNoClear(lua_State *L) {
 static int create2D(lua_State *L) {
 	int64_t w = luaL_checkinteger(L, 1);
 	int64_t h = luaL_checkinteger(L, 2);
-	char const* fmt = luaL_checkstring(L, 3);
+	TinyImageFormat const format = checkformat(L, 3);
+	if (!imageud_reserve(L, imageBytesFor(w, h, 1, 1, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_Create2D((uint32_t)w, (uint32_t)h, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, h, 1, 1, format, 0, true);
+	imageud_set(L, ud, image ? image : Image_Create2D((uint32_t)w, (uint32_t)h, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
 static int create2DNoClear(lua_State *L) {
 	int64_t w = luaL_checkinteger(L, 1);
 	int64_t h = luaL_checkinteger(L, 2);
-	char const* fmt = luaL_checkstring(L, 3);
+	TinyImageFormat const format = checkformat(L, 3);
+	if (!imageud_reserve(L, imageBytesFor(w, h, 1, 1, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_Create2DNoClear((uint32_t)w, (uint32_t)h, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, h, 1, 1, format, 0, false);
+	imageud_set(L, ud, image ? image : Image_Create2DNoClear((uint32_t)w, (uint32_t)h, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
@@ -414,10 +1915,12 @@ static int create2DArray(lua_State *L) {
 	int64_t w = luaL_checkinteger(L, 1);
 	int64_t h = luaL_checkinteger(L, 2);
 	int64_t s = luaL_checkinteger(L, 3);
-	char const* fmt = luaL_checkstring(L, 4);
+	TinyImageFormat const format = checkformat(L, 4);
+	if (!imageud_reserve(L, imageBytesFor(w, h, 1, s, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_Create2DArray((uint32_t)w, (uint32_t)h, (uint32_t)s, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, h, 1, s, format, 0, true);
+	imageud_set(L, ud, image ? image : Image_Create2DArray((uint32_t)w, (uint32_t)h, (uint32_t)s, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
@@ -426,10 +1929,12 @@ static int create2DArrayNoClear(lua_State *L) {
 	int64_t w = luaL_checkinteger(L, 1);
 	int64_t h = luaL_checkinteger(L, 2);
 	int64_t s = luaL_checkinteger(L, 3);
-	char const* fmt = luaL_checkstring(L, 4);
+	TinyImageFormat const format = checkformat(L, 4);
+	if (!imageud_reserve(L, imageBytesFor(w, h, 1, s, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_Create2DArrayNoClear((uint32_t)w, (uint32_t)h, (uint32_t)s, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, h, 1, s, format, 0, false);
+	imageud_set(L, ud, image ? image : Image_Create2DArrayNoClear((uint32_t)w, (uint32_t)h, (uint32_t)s, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
@@ -438,10 +1943,12 @@ static int create3D(lua_State *L) {
 	int64_t w = luaL_checkinteger(L, 1);
 	int64_t h = luaL_checkinteger(L, 2);
 	int64_t d = luaL_checkinteger(L, 3);
-	char const* fmt = luaL_checkstring(L, 4);
+	TinyImageFormat const format = checkformat(L, 4);
+	if (!imageud_reserve(L, imageBytesFor(w, h, d, 1, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_Create3D((uint32_t)w, (uint32_t)h, (uint32_t)d, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, h, d, 1, format, 0, true);
+	imageud_set(L, ud, image ? image : Image_Create3D((uint32_t)w, (uint32_t)h, (uint32_t)d, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
@@ -450,10 +1957,12 @@ static int create3DNoClear(lua_State *L) {
 	int64_t w = luaL_checkinteger(L, 1);
 	int64_t h = luaL_checkinteger(L, 2);
 	int64_t d = luaL_checkinteger(L, 3);
-	char const* fmt = luaL_checkstring(L, 4);
+	TinyImageFormat const format = checkformat(L, 4);
+	if (!imageud_reserve(L, imageBytesFor(w, h, d, 1, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_Create3DNoClear((uint32_t)w, (uint32_t)h, (uint32_t)d, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, h, d, 1, format, 0, false);
+	imageud_set(L, ud, image ? image : Image_Create3DNoClear((uint32_t)w, (uint32_t)h, (uint32_t)d, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
@@ -463,10 +1972,12 @@ static int create3DArray(lua_State *L) {
 	int64_t h = luaL_checkinteger(L, 2);
 	int64_t d = luaL_checkinteger(L, 3);
 	int64_t s = luaL_checkinteger(L, 4);
-	char const* fmt = luaL_checkstring(L, 5);
+	TinyImageFormat const format = checkformat(L, 5);
+	if (!imageud_reserve(L, imageBytesFor(w, h, d, s, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_Create3DArray((uint32_t)w, (uint32_t)h, (uint32_t)d, (uint32_t)s, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, h, d, s, format, 0, true);
+	imageud_set(L, ud, image ? image : Image_Create3DArray((uint32_t)w, (uint32_t)h, (uint32_t)d, (uint32_t)s, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
@@ -475,20 +1986,24 @@ static int create3DArrayNoClear(lua_State *L) {
 	int64_t h = luaL_checkinteger(L, 2);
 	int64_t d = luaL_checkinteger(L, 3);
 	int64_t s = luaL_checkinteger(L, 4);
-	char const* fmt = luaL_checkstring(L, 5);
+	TinyImageFormat const format = checkformat(L, 5);
+	if (!imageud_reserve(L, imageBytesFor(w, h, d, s, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_Create3DArrayNoClear((uint32_t)w, (uint32_t)h, (uint32_t)d, (uint32_t)s, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, h, d, s, format, 0, false);
+	imageud_set(L, ud, image ? image : Image_Create3DArrayNoClear((uint32_t)w, (uint32_t)h, (uint32_t)d, (uint32_t)s, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
 static int createCubemap(lua_State *L) {
 	int64_t w = luaL_checkinteger(L, 1);
 	int64_t h = luaL_checkinteger(L, 2);
-	char const* fmt = luaL_checkstring(L, 3);
+	TinyImageFormat const format = checkformat(L, 3);
+	if (!imageud_reserve(L, imageBytesFor(w, h, 1, 6, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_CreateCubemap((uint32_t)w, (uint32_t)h, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, h, 1, 6, format, Image_Flag_Cubemap, true);
+	imageud_set(L, ud, image ? image : Image_CreateCubemap((uint32_t)w, (uint32_t)h, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
@@ -496,10 +2011,12 @@ static int createCubemap(lua_State *L) {
 static int createCubemapNoClear(lua_State *L) {
 	int64_t w = luaL_checkinteger(L, 1);
 	int64_t h = luaL_checkinteger(L, 2);
-	char const* fmt = luaL_checkstring(L, 3);
+	TinyImageFormat const format = checkformat(L, 3);
+	if (!imageud_reserve(L, imageBytesFor(w, h, 1, 6, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_CreateCubemapNoClear((uint32_t)w, (uint32_t)h, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, h, 1, 6, format, Image_Flag_Cubemap, false);
+	imageud_set(L, ud, image ? image : Image_CreateCubemapNoClear((uint32_t)w, (uint32_t)h, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
@@ -508,10 +2025,12 @@ static int createCubemapArray(lua_State *L) {
 	int64_t w = luaL_checkinteger(L, 1);
 	int64_t h = luaL_checkinteger(L, 2);
 	int64_t s = luaL_checkinteger(L, 3);
-	char const* fmt = luaL_checkstring(L, 4);
+	TinyImageFormat const format = checkformat(L, 4);
+	if (!imageud_reserve(L, imageBytesFor(w, h, 1, 6 * s, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_CreateCubemapArray((uint32_t)w, (uint32_t)h, (uint32_t)s, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, h, 1, 6 * s, format, Image_Flag_Cubemap, true);
+	imageud_set(L, ud, image ? image : Image_CreateCubemapArray((uint32_t)w, (uint32_t)h, (uint32_t)s, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
@@ -520,155 +2039,806 @@ static int createCubemapArrayNoClear(lua_State *L) {
 	int64_t w = luaL_checkinteger(L, 1);
 	int64_t h = luaL_checkinteger(L, 2);
 	int64_t s = luaL_checkinteger(L, 3);
-	char const* fmt = luaL_checkstring(L, 4);
+	TinyImageFormat const format = checkformat(L, 4);
+	if (!imageud_reserve(L, imageBytesFor(w, h, 1, 6 * s, format))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_CreateCubemapArrayNoClear((uint32_t)w, (uint32_t)h, (uint32_t)s, TinyImageFormat_FromName(fmt));
+	auto image = poolAcquire(w, h, 1, 6 * s, format, Image_Flag_Cubemap, false);
+	imageud_set(L, ud, image ? image : Image_CreateCubemapArrayNoClear((uint32_t)w, (uint32_t)h, (uint32_t)s, format));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
 
+// field name of the options table at index as a resample filter
+static LuaImage::ResampleFilter resampleFilterField(lua_State *L, int index, LuaImage::ResampleFilter def) {
+	static char const* const filters[] = { "point", "box", "triangle", "kaiser", "lanczos", nullptr };
+	static LuaImage::ResampleFilter const filterValues[] = {
+			LuaImage::ResampleFilter::Point,
+			LuaImage::ResampleFilter::Box,
+			LuaImage::ResampleFilter::Triangle,
+			LuaImage::ResampleFilter::Kaiser,
+			LuaImage::ResampleFilter::Lanczos,
+	};
+	if (!lua_istable(L, index)) return def;
+
+	lua_getfield(L, index, "filter");
+	LuaImage::ResampleFilter const filter = lua_isnil(L, -1) ? def : filterValues[luaL_checkoption(L, -1, nullptr, filters)];
+	lua_pop(L, 1);
+	return filter;
+}
+
+// options table {filter = "box"|"triangle"|"kaiser"|"lanczos", srgb = bool,
+//   alphaCoverage = 0..1, cubeSeams = bool, threads = n}
+static void mipOptions(lua_State *L, int index, LuaImage::MipOptions& options) {
+	if (!lua_istable(L, index)) return;
+
+	options.filter = resampleFilterField(L, index, options.filter);
+	options.srgb = optBoolField(L, index, "srgb", options.srgb);
+	options.alphaCoverage = optNumberField(L, index, "alphaCoverage", options.alphaCoverage);
+	options.cubeSeams = optBoolField(L, index, "cubeSeams", options.cubeSeams);
+	options.threadCount = (uint32_t)optIntegerField(L, index, "threads", options.threadCount);
+}
+
+// createMipMapChain([generateFromImage = true]) or createMipMapChain(options)
+// which filters every level itself and returns true if it could
 static int createMipMapChain(lua_State * L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	// replacing the chain would pull levels out from under views
+	auto image = imageud_reshapable(L, 1);
+	if (lua_istable(L, 2)) {
+		LuaImage::MipOptions options;
+		mipOptions(L, 2, options);
+		char operation[128];
+		snprintf(operation, sizeof(operation), "mips filter=%d srgb=%d coverage=%g seams=%d",
+						 (int)options.filter, (int)options.srgb, (double)options.alphaCoverage, (int)options.cubeSeams);
+		uint64_t const key = cacheKey(image, false, operation);
+		bool ok = cacheAttachMips(image, key);
+		if (!ok) {
+			ok = LuaImage::GenerateMipMaps(image, options);
+			if (ok && key && image->nextImage) LuaImage::Cache_Store(key, image);
+		}
+		imageud_account(L, (Image_ImageHeader const**)lua_touserdata(L, 1));
+		lua_pushboolean(L, ok);
+		return 1;
+	}
 	bool generateFromImage = lua_isnil(L, 2) ? true : (bool)lua_toboolean(L, 2);
-	Image_CreateMipMapChain(image,generateFromImage);
+	uint64_t const key = generateFromImage ? cacheKey(image, false, "mips library") : 0;
+	if (!cacheAttachMips(image, key)) {
+		Image_CreateMipMapChain(image,generateFromImage);
+		if (key && image->nextImage) LuaImage::Cache_Store(key, image);
+	}
+	imageud_account(L, (Image_ImageHeader const**)lua_touserdata(L, 1));
 	return 0;
 }
 
+// resize(w, h [, d] [, options]) a new image of the top level resized,
+// options {filter = "point"|"box"|"triangle"|"kaiser"|"lanczos", srgb = bool, threads = n}
+static int resize(lua_State *L) {
+	auto image = imageud_checkdata(L, 1);
+	int64_t w = luaL_checkinteger(L, 2);
+	int64_t h = luaL_checkinteger(L, 3);
+	int const optionsIndex = lua_istable(L, 4) ? 4 : 5;
+	int64_t d = optionsIndex == 4 ? image->depth : luaL_optinteger(L, 4, image->depth);
+	LUA_ASSERT(w > 0 && h > 0 && d > 0, L, "dimensions must be > 0");
+	LUA_ASSERT(w <= UINT32_MAX && h <= UINT32_MAX && d <= UINT32_MAX, L, "dimensions too large");
+
+	LuaImage::ResizeOptions options;
+	options.filter = resampleFilterField(L, optionsIndex, options.filter);
+	options.srgb = optBoolField(L, optionsIndex, "srgb", options.srgb);
+	options.threadCount = (uint32_t)optIntegerField(L, optionsIndex, "threads", options.threadCount);
+	if (!imageud_reserve(L, imageBytesFor(w, h, d, image->slices, image->format))) return imageud_budgetfail(L);
+
+	auto ud = imageud_create(L);
+	imageud_set(L, ud, LuaImage::Resample_Resize(image, (uint32_t)w, (uint32_t)h, (uint32_t)d, options));
+	lua_pushboolean(L, *ud != nullptr);
+	return 2;
+}
+
 static int clone(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_checkdata(L, 1);
+	if (!imageud_reserve(L, Image_ByteCountOfImageChainOf(image))) return imageud_budgetfail(L);
 	auto ud = imageud_create(L);
-	*ud = Image_Clone(image);
+	auto copy = poolAcquireLike(image, image->format);
+	if (copy) memcpy(Image_RawDataPtr(copy), Image_RawDataPtr(image), Image_ByteCountOf(image));
+	imageud_set(L, ud, copy ? copy : Image_Clone(image));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
 
 static int cloneStructure(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_check(L, 1);
+	if (!imageud_reserve(L, Image_ByteCountOfImageChainOf(image))) return imageud_budgetfail(L);
 	auto ud = imageud_create(L);
-	*ud = Image_CloneStructure(image);
+	auto copy = poolAcquireLike(image, image->format);
+	imageud_set(L, ud, copy ? copy : Image_CloneStructure(image));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
 
 static int preciseConvert(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
+	auto image = imageud_checkdata(L, 1);
+	TinyImageFormat const format = checkformat(L, 2);
+	if (!imageud_reserve(L, imageBytesFor(image->width, image->height, image->depth, image->slices, format))) return imageud_budgetfail(L);
+	char operation[64];
+	snprintf(operation, sizeof(operation), "preciseConvert %d", (int)format);
+	uint64_t const key = cacheKey(image, false, operation);
+	LuaImage::CacheShape const shape{image->width, image->height, image->depth, image->slices, format, 1};
+	if (cachePush(L, key, shape)) {
+		lua_pushboolean(L, true);
+		return 2;
+	}
+	// only kernels matching the library's precise results bit for bit
+	LuaImage::FastConvertOptions options;
+	options.exactOnly = true;
+	auto converted = LuaImage::FastConvert(image, format, options);
 	auto ud = imageud_create(L);
-	*ud = Image_PreciseConvert(image, TinyImageFormat_FromName(luaL_checkstring(L,2)) );
+	imageud_set(L, ud, converted ? converted : Image_PreciseConvert(image, format));
+	if (key && *ud) LuaImage::Cache_Store(key, *ud);
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
 
+// fastConvert(format [, allowInPlace]) converted in place returns the image
+// itself, otherwise a new one
 static int fastConvert(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
-	bool allowInPlace = lua_isnil(L, 2) ? false : (bool)lua_toboolean(L, 3);
+	auto image = imageud_checkdata(L, 1);
+	TinyImageFormat const format = checkformat(L, 2);
+	bool const allowInPlace = (bool)lua_toboolean(L, 3);
+	// in place rewrites every later level too, views share those headers
+	if (allowInPlace) image = imageud_reshapable(L, 1);
+	if (!imageud_reserve(L, imageBytesFor(image->width, image->height, image->depth, image->slices, format))) return imageud_budgetfail(L);
+
+	LuaImage::FastConvertOptions options;
+	options.allowInPlace = allowInPlace;
+	auto converted = LuaImage::FastConvert(image, format, options);
+	if (!converted && !allowInPlace) converted = poolConvert(image, format);
+	if (!converted) converted = Image_FastConvert(image, format, allowInPlace);
+
+	// the same image, one userdata must stay its only owner
+	if (converted == image) {
+		imageud_account(L, (Image_ImageHeader const**)lua_touserdata(L, 1));
+		lua_pushvalue(L, 1);
+		lua_pushboolean(L, true);
+		return 2;
+	}
 	auto ud = imageud_create(L);
-	*ud = Image_FastConvert(image, TinyImageFormat_FromName(luaL_checkstring(L,2)), allowInPlace);
+	imageud_set(L, ud, converted);
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
 
-static int compressAMDBC1(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
-	bool allowInPlace = lua_isnil(L, 2) ? false : (bool)lua_toboolean(L, 3);
+// tileRows = 1..65536 option field, bands are clamped to the image anyway
+static uint32_t optTileRowsField(lua_State *L, int index, uint32_t def) {
+	int64_t const rows = optIntegerField(L, index, "tileRows", def);
+	LUA_ASSERT(rows > 0 && rows <= 65536, L, "tileRows must be 1 to 65536");
+	return (uint32_t)rows;
+}
+
+// options table {quality = 0..1, threads = n, tileRows = n,
+//   BC1 only: alpha = bool, alphaThreshold = 0..255, adaptiveWeighting = bool, channelWeights = {r, g, b} }
+static void compressOptions(lua_State *L, int index, LuaImage::CompressOptions& options) {
+	if (!lua_istable(L, index)) return;
+
+	options.quality = optNumberField(L, index, "quality", options.quality);
+	options.threadCount = (uint32_t)optIntegerField(L, index, "threads", options.threadCount);
+	options.tileRows = optTileRowsField(L, index, options.tileRows);
+	options.useAlpha = optBoolField(L, index, "alpha", options.useAlpha);
+	options.alphaThreshold = (uint8_t)optIntegerField(L, index, "alphaThreshold", options.alphaThreshold);
+	options.adaptiveWeighting = optBoolField(L, index, "adaptiveWeighting", options.adaptiveWeighting);
+
+	lua_getfield(L, index, "channelWeights");
+	if (lua_istable(L, -1)) {
+		options.useChannelWeighting = true;
+		for (int i = 0; i < 3; ++i) {
+			lua_rawgeti(L, -1, i + 1);
+			options.channelWeights[i] = (float)luaL_optnumber(L, -1, options.channelWeights[i]);
+			lua_pop(L, 1);
+		}
+	}
+	lua_pop(L, 1);
+}
+
+// bytes the whole chain takes compressed as bc, 8 or 16 bytes a 4x4 block
+static size_t compressBytesFor(Image_ImageHeader const* image, LuaImage::CompressBC bc) {
+	size_t const blockBytes = (bc == LuaImage::CompressBC::BC1 || bc == LuaImage::CompressBC::BC4) ? 8 : 16;
+	size_t bytes = 0;
+	for (size_t i = 0; i < Image_LinkedImageCountOf(image); ++i) {
+		auto const level = Image_LinkedImageOf(image, i);
+		size_t const blocks = (((size_t)level->width + 3) / 4) * (((size_t)level->height + 3) / 4);
+		bytes += blocks * level->depth * level->slices * blockBytes;
+	}
+	return bytes;
+}
+
+static int compressAMD(lua_State *L, LuaImage::CompressBC bc) {
+	auto image = imageud_checkdata(L, 1);
+	LuaImage::CompressOptions options;
+	compressOptions(L, 2, options);
+	// threads and tileRows don't change the blocks so aren't part of the key
+	char operation[192];
+	snprintf(operation, sizeof(operation), "compressAMD bc=%d quality=%g alpha=%d threshold=%d adaptive=%d weights=%d %g %g %g",
+					 (int)bc, (double)options.quality, (int)options.useAlpha, (int)options.alphaThreshold,
+					 (int)options.adaptiveWeighting, (int)options.useChannelWeighting,
+					 (double)options.channelWeights[0], (double)options.channelWeights[1], (double)options.channelWeights[2]);
+	uint64_t const key = cacheKey(image, true, operation);
+	LuaImage::CacheShape const shape{image->width, image->height, image->depth, image->slices,
+																	 TinyImageFormat_UNDEFINED, (uint32_t)Image_LinkedImageCountOf(image)};
+	if (cachePush(L, key, shape)) {
+		lua_pushboolean(L, true);
+		return 2;
+	}
+	if (!imageud_reserve(L, compressBytesFor(image, bc))) return imageud_budgetfail(L);
 	auto ud = imageud_create(L);
-	*ud = Image_CompressAMDBC1(image, nullptr, nullptr, nullptr, nullptr);
+	imageud_set(L, ud, LuaImage::CompressAMD(image, bc, options));
+	if (key && *ud) LuaImage::Cache_Store(key, *ud);
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
 
+static int compressAMDBC1(lua_State *L) {
+	return compressAMD(L, LuaImage::CompressBC::BC1);
+}
+
 static int compressAMDBC2(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
-	bool allowInPlace = lua_isnil(L, 2) ? false : (bool)lua_toboolean(L, 3);
-	auto ud = imageud_create(L);
-	*ud = Image_CompressAMDBC2(image, nullptr, nullptr, nullptr);
-	lua_pushboolean(L, *ud != nullptr);
-	return 2;
+	return compressAMD(L, LuaImage::CompressBC::BC2);
 }
 
 static int compressAMDBC3(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
-	bool allowInPlace = lua_isnil(L, 2) ? false : (bool)lua_toboolean(L, 3);
-	auto ud = imageud_create(L);
-	*ud = Image_CompressAMDBC3(image, nullptr, nullptr, nullptr);
-	lua_pushboolean(L, *ud != nullptr);
-	return 2;
+	return compressAMD(L, LuaImage::CompressBC::BC3);
 }
 
 static int compressAMDBC4(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
-	bool allowInPlace = lua_isnil(L, 2) ? false : (bool)lua_toboolean(L, 3);
+	return compressAMD(L, LuaImage::CompressBC::BC4);
+}
+
+static int compressAMDBC5(lua_State *L) {
+	return compressAMD(L, LuaImage::CompressBC::BC5);
+}
+
+static int compressAMDBC6H(lua_State *L) {
+	return compressAMD(L, LuaImage::CompressBC::BC6H);
+}
+
+static int compressAMDBC7(lua_State *L) {
+	return compressAMD(L, LuaImage::CompressBC::BC7);
+}
+
+// decompress([format] [, options]) decodes a block compressed image (whole
+// chain) into format or the decoder's own, options {threads = n, tileRows = n}
+static int decompress(lua_State *L) {
+	auto image = imageud_checkdata(L, 1);
+	int const optionsIndex = lua_istable(L, 2) ? 2 : 3;
+	LuaImage::DecompressOptions options;
+	if (optionsIndex == 3 && !lua_isnoneornil(L, 2)) {
+		options.format = checkformat(L, 2);
+		LUA_ASSERT(options.format != TinyImageFormat_UNDEFINED, L, "unknown format");
+	}
+	options.threadCount = (uint32_t)optIntegerField(L, optionsIndex, "threads", options.threadCount);
+	options.tileRows = optTileRowsField(L, optionsIndex, options.tileRows);
+
+	// decoders produce at least 4 bytes a pixel
+	size_t bytes = 0;
+	for (size_t i = 0; i < Image_LinkedImageCountOf(image); ++i) {
+		auto const level = Image_LinkedImageOf(image, i);
+		bytes += options.format != TinyImageFormat_UNDEFINED ?
+				imageBytesFor(level->width, level->height, level->depth, level->slices, options.format) :
+				Image_PixelCountOf(level) * 4;
+	}
+	if (!imageud_reserve(L, bytes)) return imageud_budgetfail(L);
+
 	auto ud = imageud_create(L);
-	*ud = Image_CompressAMDBC4(image, nullptr, nullptr);
+	imageud_set(L, ud, LuaImage::Decompress(image, options));
 	lua_pushboolean(L, *ud != nullptr);
 	return 2;
 }
 
-static int compressAMDBC5(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
-	bool allowInPlace = lua_isnil(L, 2) ? false : (bool)lua_toboolean(L, 3);
+static char const* const AlphaUsages[] = { "auto", "none", "binary", "full", nullptr };
+
+// options table {maxError = 0.02, metric = "rmse"|"maxdiff", candidates = {"BC1", "BC7",
+//   format names...}, alpha = "auto"|"none"|"binary"|"full", trialTiles = 16,
+//   tileSize = 64, greyAsRed = false} plus the compressAMD options (alpha is
+//   decided here). greyAsRed lets grey textures use BC4 / single channel
+//   formats, for shaders that replicate red
+static void autoCompressOptions(lua_State *L, int index, LuaImage::AutoCompressOptions& options) {
+	static LuaImage::AlphaUsage const alphaValues[] = {
+			LuaImage::AlphaUsage::Auto,
+			LuaImage::AlphaUsage::None,
+			LuaImage::AlphaUsage::Binary,
+			LuaImage::AlphaUsage::Full,
+	};
+	static char const* const metrics[] = { "rmse", "maxdiff", nullptr };
+	if (!lua_istable(L, index)) return;
+
+	compressOptions(L, index, options.compress);
+	options.maxError = optNumberField(L, index, "maxError", options.maxError);
+	options.trialTiles = (uint32_t)optIntegerField(L, index, "trialTiles", options.trialTiles);
+	options.tileSize = (uint32_t)optIntegerField(L, index, "tileSize", options.tileSize);
+	options.greyAsRed = optBoolField(L, index, "greyAsRed", options.greyAsRed);
+
+	lua_getfield(L, index, "metric");
+	if (!lua_isnil(L, -1)) options.metric = (LuaImage::AutoMetric)luaL_checkoption(L, -1, nullptr, metrics);
+	lua_pop(L, 1);
+
+	lua_getfield(L, index, "alpha");
+	if (lua_isstring(L, -1)) options.alpha = alphaValues[luaL_checkoption(L, -1, nullptr, AlphaUsages)];
+	lua_pop(L, 1);
+
+	lua_getfield(L, index, "candidates");
+	if (lua_istable(L, -1)) {
+		for (lua_Integer i = 1; i <= (lua_Integer)lua_rawlen(L, -1); ++i) {
+			lua_rawgeti(L, -1, i);
+			LuaImage::AutoCandidate candidate;
+			// uncompressed candidates may be format constants too
+			char const* name = lua_type(L, -1) == LUA_TNUMBER ? TinyImageFormat_Name(checkformat(L, -1)) : luaL_checkstring(L, -1);
+			LUA_ASSERT(LuaImage::AutoCandidate_FromName(name, candidate), L, "unknown candidate");
+			options.candidates.push_back(candidate);
+			lua_pop(L, 1);
+		}
+	}
+	lua_pop(L, 1);
+}
+
+// compressAuto([options]) analyses the image, trials candidates in parallel on
+// a sample of tiles and compresses the chain with the cheapest within budget.
+// returns image, ok, {candidate, error, alpha, channels, grey, hdr, trials = {{candidate, error}...}}
+static int compressAuto(lua_State *L) {
+	auto image = imageud_checkdata(L, 1);
+
+	LuaImage::AutoCompressOptions options;
+	autoCompressOptions(L, 2, options);
+	if (!imageud_reserve(L, Image_ByteCountOfImageChainOf(image))) return imageud_budgetfail(L);
+
+	LuaImage::AutoCompressResult result;
+	bool const ok = LuaImage::CompressAuto(image, options, result);
+	auto ud = imageud_create(L);
+	imageud_set(L, ud, result.image);
+	lua_pushboolean(L, ok);
+
+	lua_createtable(L, 0, 6);
+	if (ok) {
+		auto const& chosen = result.trials[result.chosen];
+		lua_pushstring(L, LuaImage::AutoCandidate_Name(chosen.candidate));
+		lua_setfield(L, -2, "candidate");
+		lua_pushnumber(L, chosen.error);
+		lua_setfield(L, -2, "error");
+	}
+	lua_pushstring(L, AlphaUsages[(int)result.analysis.alpha]);
+	lua_setfield(L, -2, "alpha");
+	lua_pushinteger(L, result.analysis.channels);
+	lua_setfield(L, -2, "channels");
+	lua_pushboolean(L, result.analysis.grey);
+	lua_setfield(L, -2, "grey");
+	lua_pushboolean(L, result.analysis.hdr);
+	lua_setfield(L, -2, "hdr");
+	lua_createtable(L, (int)result.trials.size(), 0);
+	int trialIndex = 1;
+	for (auto const& trial : result.trials) {
+		if (!trial.tried) continue;
+		lua_createtable(L, 0, 2);
+		lua_pushstring(L, LuaImage::AutoCandidate_Name(trial.candidate));
+		lua_setfield(L, -2, "candidate");
+		lua_pushnumber(L, trial.error);
+		lua_setfield(L, -2, "error");
+		lua_rawseti(L, -2, trialIndex++);
+	}
+	lua_setfield(L, -2, "trials");
+	return 3;
+}
+
+// bytes the file will decode to going by its header, 0 if the header isn't
+// one we know. Leaves the file at its start for the loader
+static size_t loadBytesOf(VFile::ScopedFile& file) {
+	LuaImage::ContainerInfo info;
+	bool const known = LuaImage::Container_Probe(file, info);
+	file->Seek(0, VFile_SD_Begin);
+	return known ? LuaImage::Container_ByteCountOfChain(info) : 0;
+}
+
+static int load(lua_State * L) {
+	char const* filename = luaL_checkstring(L, 1);
+
+	VFile::ScopedFile file = VFile::File::FromFile(filename, Os_FM_ReadBinary);
+	if(!file) {
+		lua_pushnil(L);
+		lua_pushboolean(L, false);
+		return 2;
+	}
+	if (!imageud_reserve(L, loadBytesOf(file))) return imageud_budgetfail(L);
+
 	auto ud = imageud_create(L);
-	*ud = Image_CompressAMDBC5(image, nullptr, nullptr);
+	imageud_set(L, ud, Image_Load(file));
 	lua_pushboolean(L, *ud != nullptr);
+
 	return 2;
 }
 
-static int compressAMDBC6H(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
-	bool allowInPlace = lua_isnil(L, 2) ? false : (bool)lua_toboolean(L, 3);
+// loadMapped(filename) like load but if the file's layout matches an
+// image's the pixels are the file's pages, copied only when written to.
+// returns image, ok, mapped
+static int loadMapped(lua_State * L) {
+	char const* filename = luaL_checkstring(L, 1);
+
 	auto ud = imageud_create(L);
-	*ud = Image_CompressAMDBC6H(image, nullptr, nullptr, nullptr);
+	auto imageUd = (ImageUd*)ud;
+	auto image = LuaImage::Mapped_Load(filename, imageUd->mapped);
+	if (!image) {
+		VFile::ScopedFile file = VFile::File::FromFile(filename, Os_FM_ReadBinary);
+		if(!file) {
+			lua_pushnil(L);
+			lua_pushboolean(L, false);
+			lua_pushboolean(L, false);
+			return 3;
+		}
+		size_t const bytes = loadBytesOf(file);
+		if (!imageud_reserve(L, bytes)) return imageud_budgetfail(L);
+		image = Image_Load(file);
+	} else if (!imageud_reserve(L, Image_ByteCountOfImageChainOf(image))) {
+		// mapping only reserves address space, give it back before failing
+		LuaImage::Mapped_Release(image, imageUd->mapped);
+		imageUd->mapped = LuaImage::MappedFile{nullptr, 0};
+		return imageud_budgetfail(L);
+	}
+	imageud_set(L, ud, image);
 	lua_pushboolean(L, *ud != nullptr);
-	return 2;
+	lua_pushboolean(L, imageUd->mapped.base != nullptr);
+
+	return 3;
 }
 
-static int compressAMDBC7(lua_State *L) {
-	auto image = *(Image_ImageHeader const**)luaL_checkudata(L, 1, MetaName);
-	LUA_ASSERT(image, L, "image is NIL");
-	bool allowInPlace = lua_isnil(L, 2) ? false : (bool)lua_toboolean(L, 3);
+// probe(filename) reads only the file's header, returns a header only image
+// (with a header only mip chain if the file has mip maps) and true
+static int probe(lua_State * L) {
+	char const* filename = luaL_checkstring(L, 1);
+
+	LuaImage::ContainerInfo info;
+	VFile::ScopedFile file = VFile::File::FromFile(filename, Os_FM_ReadBinary);
+	if(!file || !LuaImage::Container_Probe(file, info)) {
+		lua_pushnil(L);
+		lua_pushboolean(L, false);
+		return 2;
+	}
+
 	auto ud = imageud_create(L);
-	*ud = Image_CompressAMDBC7(image, nullptr, nullptr, nullptr);
+	imageud_set(L, ud, LuaImage::Container_CreateHeaderOnly(info));
 	lua_pushboolean(L, *ud != nullptr);
+
 	return 2;
 }
 
+static void pushContainerInfo(lua_State *L, LuaImage::ContainerInfo const& info) {
+	lua_createtable(L, 0, 10);
+	lua_pushstring(L, info.container);
+	lua_setfield(L, -2, "container");
+	pushformat(L, info.format);
+	lua_setfield(L, -2, "format");
+	lua_pushinteger(L, info.width);
+	lua_setfield(L, -2, "width");
+	lua_pushinteger(L, info.height);
+	lua_setfield(L, -2, "height");
+	lua_pushinteger(L, info.depth);
+	lua_setfield(L, -2, "depth");
+	lua_pushinteger(L, info.slices);
+	lua_setfield(L, -2, "slices");
+	lua_pushinteger(L, info.levels);
+	lua_setfield(L, -2, "linkedImageCount");
+	lua_pushboolean(L, info.flags & Image_Flag_Cubemap);
+	lua_setfield(L, -2, "cubemap");
+	lua_pushinteger(L, (lua_Integer)LuaImage::Container_ByteCountOf(info));
+	lua_setfield(L, -2, "byteCount");
+	lua_pushinteger(L, (lua_Integer)LuaImage::Container_ByteCountOfChain(info));
+	lua_setfield(L, -2, "byteCountOfImageChain");
+}
+
+// probeMany(filenames [, threads]) probes an array of files in parallel,
+// returns an array of plain info tables with false for unreadable files
+static int probeMany(lua_State * L) {
+	luaL_checktype(L, 1, LUA_TTABLE);
+	int64_t threads = luaL_optinteger(L, 2, 0);
+	LUA_ASSERT(threads >= 0, L, "threads must be >= 0");
+
+	size_t const count = lua_rawlen(L, 1);
+	std::vector<std::string> filenames(count);
+	for (size_t i = 0; i < count; ++i) {
+		lua_rawgeti(L, 1, (lua_Integer)i + 1);
+		size_t length;
+		char const* filename = lua_tolstring(L, -1, &length);
+		LUA_ASSERT(filename, L, "filenames must be strings");
+		filenames[i].assign(filename, length);
+		lua_pop(L, 1);
+	}
 
-static int load(lua_State * L) {
-	char const* filename = luaL_checkstring(L, 1);
+	// scanning is mostly waiting on file opens so use plenty of threads
+	std::vector<LuaImage::ContainerInfo> infos(count);
+	std::vector<char> found(count, 0);
+	uint32_t const threadCount = threads ? (uint32_t)threads : LuaImage::HardwareThreadCount() * 2;
+	LuaImage::ParallelFor(count, threadCount, 16, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			VFile::ScopedFile file = VFile::File::FromFile(filenames[i].c_str(), Os_FM_ReadBinary);
+			found[i] = file && LuaImage::Container_Probe(file, infos[i]);
+		}
+	});
+
+	lua_createtable(L, (int)count, 0);
+	for (size_t i = 0; i < count; ++i) {
+		if (found[i]) {
+			pushContainerInfo(L, infos[i]);
+		} else {
+			lua_pushboolean(L, false);
+		}
+		lua_rawseti(L, -2, (lua_Integer)i + 1);
+	}
+	return 1;
+}
 
-	VFile::ScopedFile file = VFile::File::FromFile(filename, Os_FM_ReadBinary);
+// loadFromMemory(bytes) like load but decodes a string holding a file's contents
+static int loadFromMemory(lua_State * L) {
+	size_t size;
+	char const* data = luaL_checklstring(L, 1, &size);
+
+	// the string outlives the read only file so doesn't need copying
+	VFile::ScopedFile file = VFile::File::FromMemory((void*)data, size, false);
 	if(!file) {
 		lua_pushnil(L);
 		lua_pushboolean(L, false);
 		return 2;
 	}
+	if (!imageud_reserve(L, loadBytesOf(file))) return imageud_budgetfail(L);
 
 	auto ud = imageud_create(L);
-	*ud = Image_Load(file);
+	imageud_set(L, ud, Image_Load(file));
 	lua_pushboolean(L, *ud != nullptr);
 
 	return 2;
 }
 
+typedef bool (*SaveFunc)(Image_ImageHeader const*, VFile_Handle);
+static char const* const SaveKinds[] = { "DDS", "TGA", "BMP", "PNG", "JPG", "KTX", "HDR", nullptr };
+static SaveFunc const SaveFuncs[] = {
+		&Image_SaveAsDDS,
+		&Image_SaveAsTGA,
+		&Image_SaveAsBMP,
+		&Image_SaveAsPNG,
+		&Image_SaveAsJPG,
+		&Image_SaveAsKTX,
+		&Image_SaveAsHDR,
+};
+
+typedef bool (*CanSaveFunc)(Image_ImageHeader const*);
+static CanSaveFunc const CanSaveFuncs[] = {
+		&Image_CanSaveAsDDS,
+		&Image_CanSaveAsTGA,
+		&Image_CanSaveAsBMP,
+		&Image_CanSaveAsPNG,
+		&Image_CanSaveAsJPG,
+		&Image_CanSaveAsKTX,
+		&Image_CanSaveAsHDR,
+};
+// container savers may seek back to patch a header, the others only append
+static bool const SaveSeeks[] = { true, false, false, false, false, true, false };
+
+// saves into a memory file over buffer and sets written to the bytes the file
+// holds. For savers that seek back that's the furthest byte written rather
+// than the final position, found from what changed in buffer pre-filled with
+// fill. Any byte written after the last one differing from fill must equal
+// fill, so callers take the larger result of two different fills
+static bool encodeInto(SaveFunc save, bool seeks, Image_ImageHeader const* image,
+											 void* buffer, size_t capacity, uint8_t fill, size_t& written) {
+	if (seeks) memset(buffer, fill, capacity);
+	VFile::ScopedFile file = VFile::File::FromMemory(buffer, capacity, false);
+	if (!file || !save(image, file)) return false;
+	int64_t const tell = file->Tell();
+	size_t end = 0;
+	if (seeks) {
+		auto const bytes = (uint8_t const*)buffer;
+		end = capacity;
+		while (end > 0 && bytes[end - 1] == fill) --end;
+	}
+	written = tell > (int64_t)end ? (size_t)tell : end;
+	return written > 0;
+}
+
+// encode("DDS"|"TGA"|"BMP"|"PNG"|"JPG"|"KTX"|"HDR") returns the file's
+// bytes as a string or nil if the image can't be saved in that format
+static int encode(lua_State * L) {
+	auto image = imageud_checkdata(L, 1);
+	int const kind = luaL_checkoption(L, 2, nullptr, SaveKinds);
+	if (!CanSaveFuncs[kind](image)) {
+		lua_pushnil(L);
+		return 1;
+	}
+	SaveFunc const save = SaveFuncs[kind];
+	bool const seeks = SaveSeeks[kind];
+
+	// memory files don't grow, so start with room for the whole chain at up
+	// to 8 bytes a pixel plus headers and retry bigger if that wasn't enough
+	size_t pixels = 0;
+	for (size_t i = 0; i < Image_LinkedImageCountOf(image); ++i) {
+		pixels += Image_PixelCountOf(Image_LinkedImageOf(image, i));
+	}
+	size_t capacity = Image_ByteCountOfImageChainOf(image) + (pixels * 8) + (64 * 1024);
+
+	for (int attempt = 0; attempt < 2; ++attempt, capacity *= 2) {
+		void* buffer = MEMORY_MALLOC(capacity);
+		if (!buffer) break;
+
+		size_t written = 0;
+		bool ok = encodeInto(save, seeks, image, buffer, capacity, 0x00, written);
+		if (ok && seeks) {
+			// savers are deterministic, the second pass rewrites the same bytes
+			size_t again = 0;
+			ok = encodeInto(save, seeks, image, buffer, capacity, 0xff, again);
+			if (again > written) written = again;
+		}
+		if (ok) {
+			lua_pushlstring(L, (char const*)buffer, written);
+			MEMORY_FREE(buffer);
+			return 1;
+		}
+		MEMORY_FREE(buffer);
+	}
+
+	lua_pushnil(L);
+	return 1;
+}
+
+// step table {op = "convert", format = name} | {op = "resize", width, height,
+//   filter, srgb} | {op = "mips", mip options...} | {op = "compress", bc = "BC1".."BC7",
+//   compress options...} | {op = "compressAuto", compressAuto options...} |
+//   {op = "decompress" [, format = name]}
+static void pipelineStep(lua_State *L, int index, LuaImage::PipelineStep& step) {
+	static char const* const ops[] = { "convert", "resize", "mips", "compress", "compressAuto", "decompress", nullptr };
+	luaL_checktype(L, index, LUA_TTABLE);
+
+	lua_getfield(L, index, "op");
+	step.op = (LuaImage::PipelineOp)luaL_checkoption(L, -1, nullptr, ops);
+	lua_pop(L, 1);
+
+	lua_getfield(L, index, "format");
+	if (!lua_isnil(L, -1)) {
+		step.format = checkformat(L, -1);
+		LUA_ASSERT(step.format != TinyImageFormat_UNDEFINED, L, "unknown format");
+	}
+	lua_pop(L, 1);
+
+	switch (step.op) {
+		case LuaImage::PipelineOp::Convert:
+			LUA_ASSERT(step.format != TinyImageFormat_UNDEFINED, L, "convert step needs a format");
+			break;
+		case LuaImage::PipelineOp::Resize:
+			step.width = (uint32_t)optIntegerField(L, index, "width", 0);
+			step.height = (uint32_t)optIntegerField(L, index, "height", 0);
+			LUA_ASSERT(step.width > 0 && step.height > 0, L, "resize step needs a width and height");
+			step.resize.filter = resampleFilterField(L, index, step.resize.filter);
+			step.resize.srgb = optBoolField(L, index, "srgb", step.resize.srgb);
+			break;
+		case LuaImage::PipelineOp::Mips:
+			mipOptions(L, index, step.mips);
+			break;
+		case LuaImage::PipelineOp::Compress: {
+			LuaImage::AutoCandidate candidate;
+			lua_getfield(L, index, "bc");
+			LUA_ASSERT(LuaImage::AutoCandidate_FromName(luaL_checkstring(L, -1), candidate) && candidate.compressed, L, "unknown bc format");
+			lua_pop(L, 1);
+			step.bc = candidate.bc;
+			compressOptions(L, index, step.compress);
+			break;
+		}
+		case LuaImage::PipelineOp::CompressAuto:
+			autoCompressOptions(L, index, step.autoCompress);
+			break;
+		case LuaImage::PipelineOp::Decompress:
+			break;
+	}
+}
+
+// pipeline{inputs = {paths} or "dir/*.png", steps = {step tables}, output = "out/{name}.dds",
+//   kind = "DDS"|"TGA"|... (default from output's extension), threads = n, ioThreads = 1,
+//   queueDepth = 4} reads, decodes, processes and writes every input as overlapped
+// stages. returns {processed, failed, seconds, stages = {read, decode, process, write =
+// {items, bytes, busySeconds, waitSeconds, workers}}, failures = {{input, stage, error}...}}
+static int pipeline(lua_State *L) {
+	static char const* const stageNames[] = { "read", "decode", "process", "write" };
+	luaL_checktype(L, 1, LUA_TTABLE);
+
+	std::vector<std::string> inputs;
+	lua_getfield(L, 1, "inputs");
+	if (lua_isstring(L, -1)) {
+		LUA_ASSERT(LuaImage::Pipeline_Glob(lua_tostring(L, -1), inputs), L, "can't read inputs directory");
+	} else {
+		luaL_checktype(L, -1, LUA_TTABLE);
+		for (lua_Integer i = 1; i <= (lua_Integer)lua_rawlen(L, -1); ++i) {
+			lua_rawgeti(L, -1, i);
+			inputs.emplace_back(luaL_checkstring(L, -1));
+			lua_pop(L, 1);
+		}
+	}
+	lua_pop(L, 1);
+
+	LuaImage::PipelineOptions options;
+	lua_getfield(L, 1, "output");
+	options.output = luaL_checkstring(L, -1);
+	lua_pop(L, 1);
+
+	lua_getfield(L, 1, "kind");
+	if (lua_isnil(L, -1)) {
+		// the output's extension upper cased
+		lua_pop(L, 1);
+		size_t const dot = options.output.find_last_of('.');
+		std::string kind = dot == std::string::npos ? "" : options.output.substr(dot + 1);
+		for (auto& c : kind) c = (char)toupper((unsigned char)c);
+		lua_pushstring(L, kind.c_str());
+	}
+	options.save = SaveFuncs[luaL_checkoption(L, -1, nullptr, SaveKinds)];
+	lua_pop(L, 1);
+
+	lua_getfield(L, 1, "steps");
+	if (lua_istable(L, -1)) {
+		int const steps = lua_gettop(L);
+		for (lua_Integer i = 1; i <= (lua_Integer)lua_rawlen(L, steps); ++i) {
+			lua_rawgeti(L, steps, i);
+			LuaImage::PipelineStep step;
+			pipelineStep(L, lua_gettop(L), step);
+			options.steps.push_back(step);
+			lua_pop(L, 1);
+		}
+	}
+	lua_pop(L, 1);
+
+	options.processThreads = (uint32_t)optIntegerField(L, 1, "threads", options.processThreads);
+	options.ioThreads = (uint32_t)optIntegerField(L, 1, "ioThreads", options.ioThreads);
+	options.queueDepth = (uint32_t)optIntegerField(L, 1, "queueDepth", options.queueDepth);
+
+	LuaImage::PipelineStats stats;
+	LuaImage::Pipeline_Run(inputs, options, stats);
+
+	lua_createtable(L, 0, 5);
+	lua_pushinteger(L, (lua_Integer)stats.processed);
+	lua_setfield(L, -2, "processed");
+	lua_pushinteger(L, (lua_Integer)stats.failures.size());
+	lua_setfield(L, -2, "failed");
+	lua_pushnumber(L, stats.seconds);
+	lua_setfield(L, -2, "seconds");
+
+	lua_createtable(L, 0, LuaImage::PipelineStage_Count);
+	for (int i = 0; i < LuaImage::PipelineStage_Count; ++i) {
+		auto const& stage = stats.stages[i];
+		lua_createtable(L, 0, 5);
+		lua_pushinteger(L, (lua_Integer)stage.items);
+		lua_setfield(L, -2, "items");
+		lua_pushinteger(L, (lua_Integer)stage.bytes);
+		lua_setfield(L, -2, "bytes");
+		lua_pushnumber(L, stage.busySeconds);
+		lua_setfield(L, -2, "busySeconds");
+		lua_pushnumber(L, stage.waitSeconds);
+		lua_setfield(L, -2, "waitSeconds");
+		lua_pushinteger(L, stage.workers);
+		lua_setfield(L, -2, "workers");
+		lua_setfield(L, -2, stageNames[i]);
+	}
+	lua_setfield(L, -2, "stages");
+
+	lua_createtable(L, (int)stats.failures.size(), 0);
+	for (size_t i = 0; i < stats.failures.size(); ++i) {
+		auto const& failure = stats.failures[i];
+		lua_createtable(L, 0, 3);
+		lua_pushstring(L, failure.input.c_str());
+		lua_setfield(L, -2, "input");
+		lua_pushstring(L, stageNames[failure.stage]);
+		lua_setfield(L, -2, "stage");
+		lua_pushstring(L, failure.error.c_str());
+		lua_setfield(L, -2, "error");
+		lua_rawseti(L, -2, (lua_Integer)i + 1);
+	}
+	lua_setfield(L, -2, "failures");
+	return 1;
+}
+
 static int saveAsDDS(lua_State * L) {
-	void* ud = luaL_checkudata(L, 1, MetaName);
+	auto image = imageud_checkdata(L, 1);
 	char const* filename = luaL_checkstring(L, 2);
 	VFile::ScopedFile file = VFile::File::FromFile(filename, Os_FM_WriteBinary);
 	if(!file) {
 		return 0;
 	}
-	Image_ImageHeader* image = *(Image_ImageHeader**)ud;
 	bool ret = Image_SaveAsDDS(image, file);
 
 	lua_pushboolean(L, ret);
@@ -676,76 +2846,70 @@ static int saveAsDDS(lua_State * L) {
 }
 
 static int saveAsTGA(lua_State * L) {
-	void* ud = luaL_checkudata(L, 1, MetaName);
+	auto image = imageud_checkdata(L, 1);
 	char const* filename = luaL_checkstring(L, 2);
 	VFile::ScopedFile file = VFile::File::FromFile(filename, Os_FM_WriteBinary);
 	if(!file) {
 		return 0;
 	}
-	Image_ImageHeader* image = *(Image_ImageHeader**)ud;
 	bool ret = Image_SaveAsTGA(image, file);
 	lua_pushboolean(L, ret);
 	return 1;
 }
 static int saveAsBMP(lua_State * L) {
-	void* ud = luaL_checkudata(L, 1, MetaName);
+	auto image = imageud_checkdata(L, 1);
 	char const* filename = luaL_checkstring(L, 2);
 	VFile::ScopedFile file = VFile::File::FromFile(filename, Os_FM_WriteBinary);
 	if(!file) {
 		return 0;
 	}
-	auto image = *(Image_ImageHeader const**)ud;
 	bool ret = Image_SaveAsBMP(image, file);
 	lua_pushboolean(L, ret);
 	return 1;
 }
 static int saveAsPNG(lua_State * L) {
-	void* ud = luaL_checkudata(L, 1, MetaName);
+	auto image = imageud_checkdata(L, 1);
 	char const* filename = luaL_checkstring(L, 2);
 	VFile::ScopedFile file = VFile::File::FromFile(filename, Os_FM_WriteBinary);
 	if(!file) {
 		return 0;
 	}
-	auto image = *(Image_ImageHeader const**)ud;
 	bool ret = Image_SaveAsPNG(image, file);
 	lua_pushboolean(L, ret);
 	return 1;
 }
 
 static int saveAsJPG(lua_State * L) {
-	void* ud = luaL_checkudata(L, 1, MetaName);
+	auto image = imageud_checkdata(L, 1);
 	char const* filename = luaL_checkstring(L, 2);
 	VFile::ScopedFile file = VFile::File::FromFile(filename, Os_FM_WriteBinary);
 	if(!file) {
 		return 0;
 	}
-	auto image = *(Image_ImageHeader const**)ud;
 	bool ret = Image_SaveAsJPG(image, file);
 	lua_pushboolean(L, ret);
 	return 1;
 }
 
 static int saveAsKTX(lua_State * L) {
-	void* ud = luaL_checkudata(L, 1, MetaName);
+	auto image = imageud_checkdata(L, 1);
 	char const* filename = luaL_checkstring(L, 2);
 	VFile::ScopedFile file = VFile::File::FromFile(filename, Os_FM_WriteBinary);
 	if(!file) {
 		return 0;
 	}
-	auto image = *(Image_ImageHeader const**)ud;
 	bool ret = Image_SaveAsKTX(image, file);
 	lua_pushboolean(L, ret);
 	return 1;
 }
 
 static int saveAsHDR(lua_State * L) {
-	void* ud = luaL_checkudata(L, 1, MetaName);
+	auto image = imageud_checkdata(L, 1);
 	char const* filename = luaL_checkstring(L, 2);
 	VFile::ScopedFile file = VFile::File::FromFile(filename, Os_FM_WriteBinary);
 	if(!file) {
 		return 0;
 	}
-	auto image = *(Image_ImageHeader const**)ud;
 	bool ret = Image_SaveAsHDR(image, file);
 	lua_pushboolean(L, ret);
 	return 1;
@@ -806,6 +2970,804 @@ static int canSaveAsHDR(lua_State * L) {
 	return 1;
 }
 
+static LuaImage::JobPtr* jobud_check(lua_State *L, int index) {
+	return (LuaImage::JobPtr*)luaL_checkudata(L, index, JobMetaName);
+}
+
+// pushes a job userdata, the value at pinIndex (if not 0) is kept alive
+// until the job userdata is collected as the job reads it. reservedBytes
+// (from imageud_reserveasync) are given back once the job is finished with
+static void jobud_create(lua_State *L, LuaImage::JobPtr const& job, int pinIndex, size_t reservedBytes) {
+	if (pinIndex) pinIndex = lua_absindex(L, pinIndex);
+
+	auto ud = (LuaImage::JobPtr*)lua_newuserdata(L, sizeof(LuaImage::JobPtr));
+	new(ud) LuaImage::JobPtr(job);
+	luaL_getmetatable(L, JobMetaName);
+	lua_setmetatable(L, -2);
+
+	lua_createtable(L, 0, 2);
+	if (pinIndex) {
+		lua_pushvalue(L, pinIndex);
+		lua_setfield(L, -2, "source");
+	}
+	if (reservedBytes) {
+		lua_pushinteger(L, (lua_Integer)reservedBytes);
+		lua_setfield(L, -2, "reserved");
+	}
+	lua_setuservalue(L, -2);
+}
+
+// gives back the budget reserved for the job at index's result
+static void jobud_unreserve(lua_State *L, int index) {
+	lua_getuservalue(L, index);
+	if (lua_getfield(L, -1, "reserved") == LUA_TNUMBER) {
+		MemoryStats.reservedBytes -= (size_t)lua_tointeger(L, -1);
+		lua_pushnil(L);
+		lua_setfield(L, -3, "reserved");
+	}
+	lua_pop(L, 2);
+}
+
+static int jobud_gc(lua_State *L) {
+	auto ud = jobud_check(L, 1);
+	// the job may still be reading its pinned source
+	LuaImage::Job_Wait(ud->get());
+	jobud_unreserve(L, 1);
+	using LuaImage::JobPtr;
+	ud->~JobPtr();
+	return 0;
+}
+
+// pushes the results of a finished job in the same form as the synchronous
+// binding, image results are wrapped once and cached in the uservalue
+static int jobud_results(lua_State *L, int index) {
+	index = lua_absindex(L, index);
+	auto job = jobud_check(L, index)->get();
+	// the result (if any) is accounted for as it's wrapped below
+	jobud_unreserve(L, index);
+	lua_getuservalue(L, index);
+	if (!job->producesImage) {
+		// in place jobs may have grown their source (e.g. mip maps)
+		if (lua_getfield(L, -1, "source") == LUA_TUSERDATA) {
+			imageud_account(L, (Image_ImageHeader const**)lua_touserdata(L, -1));
+		}
+		lua_pop(L, 2);
+		lua_pushboolean(L, job->ok);
+		return 1;
+	}
+
+	if (lua_getfield(L, -1, "result") == LUA_TNIL) {
+		lua_pop(L, 1);
+		auto ud = imageud_create(L);
+		imageud_set(L, ud, LuaImage::Job_TakeResult(job));
+		lua_pushvalue(L, -1);
+		lua_setfield(L, -3, "result");
+	}
+	lua_remove(L, -2);
+	lua_pushboolean(L, *(Image_ImageHeader const**)lua_touserdata(L, -1) != nullptr);
+	return 2;
+}
+
+static int jobDone(lua_State *L) {
+	auto job = jobud_check(L, 1)->get();
+	lua_pushboolean(L, job->done);
+	return 1;
+}
+
+// blocks the calling thread until the job is done
+static int jobWait(lua_State *L) {
+	auto job = jobud_check(L, 1)->get();
+	LuaImage::Job_Wait(job);
+	return jobud_results(L, 1);
+}
+
+static int jobAwaitK(lua_State *L, int status, lua_KContext ctx) {
+	// resumed with nothing to carry over, the job is still at 1
+	(void)status;
+	(void)ctx;
+	auto job = jobud_check(L, 1)->get();
+	if (!job->done && lua_isyieldable(L)) {
+		// hand the job to whoever resumes us so a scheduler can poll it
+		lua_settop(L, 1);
+		lua_pushvalue(L, 1);
+		return lua_yieldk(L, 1, 0, &jobAwaitK);
+	}
+	LuaImage::Job_Wait(job);
+	return jobud_results(L, 1);
+}
+
+// inside a coroutine yields the job until it is done, otherwise waits
+static int jobAwait(lua_State *L) {
+	return jobAwaitK(L, LUA_OK, 0);
+}
+
+// checks the array of jobs at index and returns how many there are
+static size_t jobArrayCheck(lua_State *L, int index) {
+	luaL_checktype(L, index, LUA_TTABLE);
+	size_t const count = lua_rawlen(L, index);
+	for (size_t i = 0; i < count; ++i) {
+		lua_rawgeti(L, index, (lua_Integer)i + 1);
+		jobud_check(L, -1);
+		lua_pop(L, 1);
+	}
+	return count;
+}
+
+static void jobArrayGather(lua_State *L, int index, std::vector<LuaImage::Job const*>& jobs) {
+	for (size_t i = 0; i < jobs.size(); ++i) {
+		lua_rawgeti(L, index, (lua_Integer)i + 1);
+		jobs[i] = ((LuaImage::JobPtr*)lua_touserdata(L, -1))->get();
+		lua_pop(L, 1);
+	}
+}
+
+// waitAll({jobs}) blocks until every job is done
+static int waitAll(lua_State *L) {
+	size_t const count = jobArrayCheck(L, 1);
+	for (size_t i = 0; i < count; ++i) {
+		lua_rawgeti(L, 1, (lua_Integer)i + 1);
+		LuaImage::Job_Wait(((LuaImage::JobPtr*)lua_touserdata(L, -1))->get());
+		lua_pop(L, 1);
+	}
+	return 0;
+}
+
+// waitAny({jobs}) blocks until a job is done, returns its array index and the job
+static int waitAny(lua_State *L) {
+	size_t const count = jobArrayCheck(L, 1);
+	if (count == 0) return 0;
+
+	size_t index;
+	{
+		std::vector<LuaImage::Job const*> jobs(count);
+		jobArrayGather(L, 1, jobs);
+		index = LuaImage::Job_WaitAny(jobs.data(), count);
+	}
+	lua_pushinteger(L, (lua_Integer)index + 1);
+	lua_rawgeti(L, 1, (lua_Integer)index + 1);
+	return 2;
+}
+
+static int setJobThreads(lua_State *L) {
+	int64_t count = luaL_checkinteger(L, 1);
+	LUA_ASSERT(count >= 0, L, "thread count must be >= 0");
+	LuaImage::Job_SetThreadCount((uint32_t)count);
+	return 0;
+}
+
+static int loadAsync(lua_State *L) {
+	std::string filename = luaL_checkstring(L, 1);
+	size_t bytes = 0;
+	{
+		VFile::ScopedFile file = VFile::File::FromFile(filename.c_str(), Os_FM_ReadBinary);
+		if (file) bytes = loadBytesOf(file);
+	}
+	if (!imageud_reserveasync(L, bytes)) return imageud_budgetfail(L);
+
+	auto job = LuaImage::Job_Submit(true, [filename](LuaImage::Job& job) {
+		VFile::ScopedFile file = VFile::File::FromFile(filename.c_str(), Os_FM_ReadBinary);
+		if(!file) return;
+		job.result = Image_Load(file);
+		job.ok = job.result != nullptr;
+	});
+	jobud_create(L, job, 0, bytes);
+	return 1;
+}
+
+static int preciseConvertAsync(lua_State *L) {
+	auto image = imageud_checkdata(L, 1);
+	TinyImageFormat const fmt = checkformat(L, 2);
+	size_t const bytes = imageBytesFor(image->width, image->height, image->depth, image->slices, fmt);
+	if (!imageud_reserveasync(L, bytes)) return imageud_budgetfail(L);
+
+	auto const owner = imageud_jobstart(L, 1, false);
+	auto job = LuaImage::Job_Submit(true, [image, fmt, owner](LuaImage::Job& job) {
+		ImageJobUse const use(owner, false);
+		// the job is already on a worker, don't fan out further
+		LuaImage::FastConvertOptions options;
+		options.exactOnly = true;
+		options.threadCount = 1;
+		job.result = LuaImage::FastConvert(image, fmt, options);
+		if (!job.result) job.result = Image_PreciseConvert(image, fmt);
+		job.ok = job.result != nullptr;
+	});
+	jobud_create(L, job, 1, bytes);
+	return 1;
+}
+
+// never in place, the source may still be used by the script
+static int fastConvertAsync(lua_State *L) {
+	auto image = imageud_checkdata(L, 1);
+	TinyImageFormat const fmt = checkformat(L, 2);
+	size_t const bytes = imageBytesFor(image->width, image->height, image->depth, image->slices, fmt);
+	if (!imageud_reserveasync(L, bytes)) return imageud_budgetfail(L);
+
+	auto const owner = imageud_jobstart(L, 1, false);
+	auto job = LuaImage::Job_Submit(true, [image, fmt, owner](LuaImage::Job& job) {
+		ImageJobUse const use(owner, false);
+		LuaImage::FastConvertOptions options;
+		options.threadCount = 1;
+		job.result = LuaImage::FastConvert(image, fmt, options);
+		if (!job.result) job.result = Image_FastConvert(image, fmt, false);
+		job.ok = job.result != nullptr;
+	});
+	jobud_create(L, job, 1, bytes);
+	return 1;
+}
+
+// reading the image raises an error until the job is done
+static int createMipMapChainAsync(lua_State *L) {
+	auto image = imageud_reshapable(L, 1);
+	if (lua_istable(L, 2)) {
+		// the job is already on a worker, only fan out further if asked to
+		LuaImage::MipOptions options;
+		options.threadCount = 1;
+		mipOptions(L, 2, options);
+		auto const owner = imageud_jobstart(L, 1, true);
+		auto job = LuaImage::Job_Submit(false, [image, options, owner](LuaImage::Job& job) {
+			ImageJobUse const use(owner, true);
+			job.ok = LuaImage::GenerateMipMaps(image, options);
+		});
+		jobud_create(L, job, 1, 0);
+		return 1;
+	}
+	bool generateFromImage = lua_isnil(L, 2) ? true : (bool)lua_toboolean(L, 2);
+
+	auto const owner = imageud_jobstart(L, 1, true);
+	auto job = LuaImage::Job_Submit(false, [image, generateFromImage, owner](LuaImage::Job& job) {
+		ImageJobUse const use(owner, true);
+		Image_CreateMipMapChain(image, generateFromImage);
+		job.ok = true;
+	});
+	jobud_create(L, job, 1, 0);
+	return 1;
+}
+
+// compressAsync("BC1".."BC7", [options])
+static int compressAsync(lua_State *L) {
+	static char const* const kinds[] = { "BC1", "BC2", "BC3", "BC4", "BC5", "BC6H", "BC7", nullptr };
+	static LuaImage::CompressBC const bcs[] = {
+			LuaImage::CompressBC::BC1,
+			LuaImage::CompressBC::BC2,
+			LuaImage::CompressBC::BC3,
+			LuaImage::CompressBC::BC4,
+			LuaImage::CompressBC::BC5,
+			LuaImage::CompressBC::BC6H,
+			LuaImage::CompressBC::BC7,
+	};
+
+	auto image = imageud_checkdata(L, 1);
+	LuaImage::CompressBC const bc = bcs[luaL_checkoption(L, 2, nullptr, kinds)];
+	// the job is already on a worker, only fan out further if asked to
+	LuaImage::CompressOptions options;
+	options.threadCount = 1;
+	compressOptions(L, 3, options);
+	size_t const bytes = compressBytesFor(image, bc);
+	if (!imageud_reserveasync(L, bytes)) return imageud_budgetfail(L);
+
+	auto const owner = imageud_jobstart(L, 1, false);
+	auto job = LuaImage::Job_Submit(true, [image, bc, options, owner](LuaImage::Job& job) {
+		ImageJobUse const use(owner, false);
+		job.result = LuaImage::CompressAMD(image, bc, options);
+		job.ok = job.result != nullptr;
+	});
+	jobud_create(L, job, 1, bytes);
+	return 1;
+}
+
+// saveAsync("DDS"|"TGA"|"BMP"|"PNG"|"JPG"|"KTX"|"HDR", filename)
+static int saveAsync(lua_State *L) {
+	auto image = imageud_checkdata(L, 1);
+	SaveFunc const save = SaveFuncs[luaL_checkoption(L, 2, nullptr, SaveKinds)];
+	std::string filename = luaL_checkstring(L, 3);
+
+	auto const owner = imageud_jobstart(L, 1, false);
+	auto job = LuaImage::Job_Submit(false, [image, save, filename, owner](LuaImage::Job& job) {
+		ImageJobUse const use(owner, false);
+		VFile::ScopedFile file = VFile::File::FromFile(filename.c_str(), Os_FM_WriteBinary);
+		if(!file) return;
+		job.ok = save(image, file);
+	});
+	jobud_create(L, job, 1, 0);
+	return 1;
+}
+
+static LuaImage::LazyNodePtr const& lazyud_check(lua_State *L, int index) {
+	return *(LuaImage::LazyNodePtr*)luaL_checkudata(L, index, LazyMetaName);
+}
+
+// pushes a lazy image userdata, the value at pinIndex is kept alive with it
+// (the input node's userdata or the source image)
+static void lazyud_create(lua_State *L, LuaImage::LazyNodePtr const& node, int pinIndex) {
+	pinIndex = lua_absindex(L, pinIndex);
+
+	auto ud = (LuaImage::LazyNodePtr*)lua_newuserdata(L, sizeof(LuaImage::LazyNodePtr));
+	new(ud) LuaImage::LazyNodePtr(node);
+	luaL_getmetatable(L, LazyMetaName);
+	lua_setmetatable(L, -2);
+
+	lua_createtable(L, 0, 2);
+	lua_pushvalue(L, pinIndex);
+	lua_setfield(L, -2, "source");
+	lua_setuservalue(L, -2);
+}
+
+static int lazyud_gc(lua_State *L) {
+	auto ud = (LuaImage::LazyNodePtr*)luaL_checkudata(L, 1, LazyMetaName);
+	using LuaImage::LazyNodePtr;
+	ud->~LazyNodePtr();
+	return 0;
+}
+
+// lazy() starts a deferred graph on the image as it is now. The graph holds a
+// shared reference so later writes to the image copy it first
+static int lazy(lua_State *L) {
+	imageud_checkdata(L, 1);
+	auto ud = (ImageUd*)lua_touserdata(L, 1);
+	auto shared = imageud_share(ud->root ? ud->root : ud);
+	LuaImage::Shared_Retain(shared);
+	auto holder = (ImageUd*)imageud_create(L);
+	holder->shared = shared;
+	holder->image = LuaImage::Shared_Image(shared);
+	lazyud_create(L, LuaImage::Lazy_Source(ud->image), -1);
+	return 1;
+}
+
+// pushes the node of step applied to the lazy image at index 1
+static int lazyApply(lua_State *L, LuaImage::PipelineStep const& step) {
+	lazyud_create(L, LuaImage::Lazy_Apply(lazyud_check(L, 1), step), 1);
+	return 1;
+}
+
+static int lazyConvert(lua_State *L) {
+	LuaImage::PipelineStep step;
+	step.op = LuaImage::PipelineOp::Convert;
+	step.format = checkformat(L, 2);
+	LUA_ASSERT(step.format != TinyImageFormat_UNDEFINED, L, "unknown format");
+	return lazyApply(L, step);
+}
+
+// createMipMapChain([generateFromImage = true]) or createMipMapChain(options),
+// the same filtering as the eager one with the same arguments
+static int lazyCreateMipMapChain(lua_State *L) {
+	LuaImage::PipelineStep step;
+	step.op = LuaImage::PipelineOp::Mips;
+	if (lua_istable(L, 2)) {
+		mipOptions(L, 2, step.mips);
+	} else {
+		step.libraryMips = true;
+		step.libraryMipsFromImage = lua_isnil(L, 2) ? true : (bool)lua_toboolean(L, 2);
+	}
+	return lazyApply(L, step);
+}
+
+static int lazyResize(lua_State *L) {
+	LuaImage::PipelineStep step;
+	step.op = LuaImage::PipelineOp::Resize;
+	int64_t w = luaL_checkinteger(L, 2);
+	int64_t h = luaL_checkinteger(L, 3);
+	LUA_ASSERT(w > 0 && h > 0, L, "dimensions must be > 0");
+	LUA_ASSERT(w <= UINT32_MAX && h <= UINT32_MAX, L, "dimensions too large");
+	step.width = (uint32_t)w;
+	step.height = (uint32_t)h;
+	step.resize.filter = resampleFilterField(L, 4, step.resize.filter);
+	step.resize.srgb = optBoolField(L, 4, "srgb", step.resize.srgb);
+	return lazyApply(L, step);
+}
+
+static int lazyCompress(lua_State *L, LuaImage::CompressBC bc) {
+	LuaImage::PipelineStep step;
+	step.op = LuaImage::PipelineOp::Compress;
+	step.bc = bc;
+	compressOptions(L, 2, step.compress);
+	return lazyApply(L, step);
+}
+static int lazyCompressBC1(lua_State *L) { return lazyCompress(L, LuaImage::CompressBC::BC1); }
+static int lazyCompressBC2(lua_State *L) { return lazyCompress(L, LuaImage::CompressBC::BC2); }
+static int lazyCompressBC3(lua_State *L) { return lazyCompress(L, LuaImage::CompressBC::BC3); }
+static int lazyCompressBC4(lua_State *L) { return lazyCompress(L, LuaImage::CompressBC::BC4); }
+static int lazyCompressBC5(lua_State *L) { return lazyCompress(L, LuaImage::CompressBC::BC5); }
+static int lazyCompressBC6H(lua_State *L) { return lazyCompress(L, LuaImage::CompressBC::BC6H); }
+static int lazyCompressBC7(lua_State *L) { return lazyCompress(L, LuaImage::CompressBC::BC7); }
+
+static int lazyCompressAuto(lua_State *L) {
+	LuaImage::PipelineStep step;
+	step.op = LuaImage::PipelineOp::CompressAuto;
+	autoCompressOptions(L, 2, step.autoCompress);
+	return lazyApply(L, step);
+}
+
+static int lazyDecompress(lua_State *L) {
+	LuaImage::PipelineStep step;
+	step.op = LuaImage::PipelineOp::Decompress;
+	if (!lua_isnoneornil(L, 2)) {
+		step.format = checkformat(L, 2);
+		LUA_ASSERT(step.format != TinyImageFormat_UNDEFINED, L, "unknown format");
+	}
+	return lazyApply(L, step);
+}
+
+// pushes the realised image of the lazy image at index, the same image every
+// time once realised. false and an error message if a step failed
+static bool lazyud_realize(lua_State *L, int index, uint32_t threadCount, char const*& error) {
+	index = lua_absindex(L, index);
+	auto const& node = lazyud_check(L, index);
+	lua_getuservalue(L, index);
+	if (LuaImage::Lazy_IsSource(node)) {
+		lua_getfield(L, -1, "source");
+		lua_remove(L, -2);
+		return true;
+	}
+	if (lua_getfield(L, -1, "image") != LUA_TNIL) {
+		lua_remove(L, -2);
+		return true;
+	}
+	lua_pop(L, 2);
+
+	if (!LuaImage::Lazy_Realize(node, threadCount, error)) return false;
+	// the graph's intermediates aren't accounted, the result is from here on
+	if (!imageud_reserve(L, LuaImage::Lazy_ResultBytes(node))) {
+		error = "image memory budget exceeded";
+		return false;
+	}
+	lua_getuservalue(L, index);
+	auto ud = imageud_create(L);
+	imageud_set(L, ud, LuaImage::Lazy_Take(node));
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -3, "image");
+	lua_remove(L, -2);
+	return true;
+}
+
+// realize([{threads}]) runs the graph up to this node, returns image, ok
+// (or nil, false, error). If nodes built on this one haven't run yet the
+// image is a copy of the result they still need, realise them first to
+// avoid holding it twice
+static int lazyRealize(lua_State *L) {
+	char const* error = nullptr;
+	uint32_t const threadCount = (uint32_t)optIntegerField(L, 2, "threads", 0);
+	if (!lazyud_realize(L, 1, threadCount, error)) {
+		lua_pushnil(L);
+		lua_pushboolean(L, false);
+		lua_pushstring(L, error);
+		return 3;
+	}
+	lua_pushboolean(L, *(Image_ImageHeader const**)lua_touserdata(L, -1) != nullptr);
+	return 2;
+}
+
+// the image method named by upvalue 1 called on the realised image
+static int lazyForward(lua_State *L) {
+	char const* error = nullptr;
+	if (!lazyud_realize(L, 1, 0, error)) return luaL_error(L, "%s", error);
+	lua_replace(L, 1);
+	LUA_ASSERT(luaL_getmetafield(L, 1, lua_tostring(L, lua_upvalueindex(1))) != LUA_TNIL, L, "no such image method");
+	lua_insert(L, 1);
+	lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+	return lua_gettop(L);
+}
+
+static size_t const TiledDefaultCacheBytes = 256 * 1024 * 1024;
+
+static LuaImage::TiledImage** tiledud_create(lua_State *L) {
+	auto ud = (LuaImage::TiledImage**)lua_newuserdata(L, sizeof(LuaImage::TiledImage*));
+	if(ud == nullptr) return nullptr;
+
+	*ud = nullptr;
+	luaL_getmetatable(L, TiledMetaName);
+	lua_setmetatable(L, -2);
+	return ud;
+}
+
+static LuaImage::TiledImage* tiledud_check(lua_State *L, int index) {
+	auto tiled = *(LuaImage::TiledImage**)luaL_checkudata(L, index, TiledMetaName);
+	LUA_ASSERT(tiled, L, "tiled image is NIL");
+	return tiled;
+}
+
+static int tiledud_gc (lua_State *L) {
+	auto ud = (LuaImage::TiledImage**)luaL_checkudata(L, 1, TiledMetaName);
+	if (*ud) LuaImage::Tiled_Destroy(*ud);
+	*ud = nullptr;
+	return 0;
+}
+
+static size_t tiledCacheBytesCheck(lua_State *L, int index) {
+	int64_t cacheBytes = luaL_optinteger(L, index, (lua_Integer)TiledDefaultCacheBytes);
+	LUA_ASSERT(cacheBytes > 0, L, "cache size must be > 0");
+	return (size_t)cacheBytes;
+}
+
+// createTiled(path, w, h, d, s, format [, tileSize = 256] [, cacheBytes = 256MB])
+static int createTiled(lua_State *L) {
+	char const* path = luaL_checkstring(L, 1);
+	int64_t w = luaL_checkinteger(L, 2);
+	int64_t h = luaL_checkinteger(L, 3);
+	int64_t d = luaL_checkinteger(L, 4);
+	int64_t s = luaL_checkinteger(L, 5);
+	TinyImageFormat const format = checkformat(L, 6);
+	int64_t tileSize = luaL_optinteger(L, 7, 256);
+	size_t const cacheBytes = tiledCacheBytesCheck(L, 8);
+	LUA_ASSERT(w > 0 && h > 0 && d > 0 && s > 0, L, "dimensions must be > 0");
+	LUA_ASSERT(w <= UINT32_MAX && h <= UINT32_MAX && d <= UINT32_MAX && s <= UINT32_MAX, L, "dimensions too large");
+	LUA_ASSERT(tileSize > 0 && tileSize <= 16384, L, "tile size must be 1 to 16384");
+
+	auto ud = tiledud_create(L);
+	*ud = LuaImage::Tiled_Create(path, (uint32_t)w, (uint32_t)h, (uint32_t)d, (uint32_t)s,
+															 format, (uint32_t)tileSize, cacheBytes);
+	lua_pushboolean(L, *ud != nullptr);
+	return 2;
+}
+
+// openTiled(path [, cacheBytes = 256MB])
+static int openTiled(lua_State *L) {
+	char const* path = luaL_checkstring(L, 1);
+	size_t const cacheBytes = tiledCacheBytesCheck(L, 2);
+
+	auto ud = tiledud_create(L);
+	*ud = LuaImage::Tiled_Open(path, cacheBytes);
+	lua_pushboolean(L, *ud != nullptr);
+	return 2;
+}
+
+static int tiledWidth(lua_State *L) {
+	lua_pushinteger(L, LuaImage::Tiled_Info(tiledud_check(L, 1)).width);
+	return 1;
+}
+
+static int tiledHeight(lua_State *L) {
+	lua_pushinteger(L, LuaImage::Tiled_Info(tiledud_check(L, 1)).height);
+	return 1;
+}
+
+static int tiledDepth(lua_State *L) {
+	lua_pushinteger(L, LuaImage::Tiled_Info(tiledud_check(L, 1)).depth);
+	return 1;
+}
+
+static int tiledSlices(lua_State *L) {
+	lua_pushinteger(L, LuaImage::Tiled_Info(tiledud_check(L, 1)).slices);
+	return 1;
+}
+
+static int tiledDimensions(lua_State *L) {
+	auto const& info = LuaImage::Tiled_Info(tiledud_check(L, 1));
+	lua_pushinteger(L, info.width);
+	lua_pushinteger(L, info.height);
+	lua_pushinteger(L, info.depth);
+	lua_pushinteger(L, info.slices);
+	return 4;
+}
+
+static int tiledFormat(lua_State *L) {
+	pushformat(L, LuaImage::Tiled_Info(tiledud_check(L, 1)).format);
+	return 1;
+}
+
+static int tiledTileSize(lua_State *L) {
+	lua_pushinteger(L, LuaImage::Tiled_Info(tiledud_check(L, 1)).tileSize);
+	return 1;
+}
+
+static bool tiledInside(LuaImage::TiledInfo const& info, int64_t x, int64_t y, int64_t z, int64_t s,
+												int64_t w, int64_t h, int64_t d) {
+	if (x < 0 || y < 0 || z < 0 || s < 0 || w <= 0 || h <= 0 || d <= 0) return false;
+	return x + w <= info.width && y + h <= info.height && z + d <= info.depth && s < info.slices;
+}
+
+// getPixelAt(x, y, z, s) returns r, g, b, a
+static int tiledGetPixelAt(lua_State *L) {
+	auto tiled = tiledud_check(L, 1);
+	int64_t x = luaL_checkinteger(L, 2);
+	int64_t y = luaL_checkinteger(L, 3);
+	int64_t z = luaL_checkinteger(L, 4);
+	int64_t s = luaL_checkinteger(L, 5);
+	LUA_ASSERT(tiledInside(LuaImage::Tiled_Info(tiled), x, y, z, s, 1, 1, 1), L, "pixel outside image");
+
+	double pixel[4];
+	LUA_ASSERT(LuaImage::Tiled_ReadRun(tiled, (uint32_t)x, (uint32_t)y, (uint32_t)z, (uint32_t)s, 1, pixel), L, "tile read failed");
+	lua_pushnumber(L, pixel[0]); // r
+	lua_pushnumber(L, pixel[1]); // g
+	lua_pushnumber(L, pixel[2]); // b
+	lua_pushnumber(L, pixel[3]); // a
+	return 4;
+}
+
+// setPixelAt(x, y, z, s, r, g, b, a)
+static int tiledSetPixelAt(lua_State *L) {
+	auto tiled = tiledud_check(L, 1);
+	int64_t x = luaL_checkinteger(L, 2);
+	int64_t y = luaL_checkinteger(L, 3);
+	int64_t z = luaL_checkinteger(L, 4);
+	int64_t s = luaL_checkinteger(L, 5);
+	LUA_ASSERT(tiledInside(LuaImage::Tiled_Info(tiled), x, y, z, s, 1, 1, 1), L, "pixel outside image");
+
+	double pixel[4];
+	pixel[0] = luaL_checknumber(L, 6); // r
+	pixel[1] = luaL_checknumber(L, 7); // g
+	pixel[2] = luaL_checknumber(L, 8); // b
+	pixel[3] = luaL_checknumber(L, 9); // a
+	LUA_ASSERT(LuaImage::Tiled_WriteRun(tiled, (uint32_t)x, (uint32_t)y, (uint32_t)z, (uint32_t)s, 1, pixel), L, "tile write failed");
+	return 0;
+}
+
+// readRegion(x, y, z, s, w, h [, d = 1]) returns a resident image of the region
+static int tiledReadRegion(lua_State *L) {
+	auto tiled = tiledud_check(L, 1);
+	int64_t x = luaL_checkinteger(L, 2);
+	int64_t y = luaL_checkinteger(L, 3);
+	int64_t z = luaL_checkinteger(L, 4);
+	int64_t s = luaL_checkinteger(L, 5);
+	int64_t w = luaL_checkinteger(L, 6);
+	int64_t h = luaL_checkinteger(L, 7);
+	int64_t d = luaL_optinteger(L, 8, 1);
+	auto const& info = LuaImage::Tiled_Info(tiled);
+	LUA_ASSERT(tiledInside(info, x, y, z, s, w, h, d), L, "region outside image");
+	if (!imageud_reserve(L, imageBytesFor(w, h, d, 1, info.format))) return imageud_budgetfail(L);
+
+	auto image = Image_CreateNoClear((uint32_t)w, (uint32_t)h, (uint32_t)d, 1, info.format);
+	bool ok = image != nullptr;
+	std::vector<double> row((size_t)w * 4);
+	for (int64_t iz = 0; iz < d && ok; ++iz) {
+		for (int64_t iy = 0; iy < h && ok; ++iy) {
+			ok = LuaImage::Tiled_ReadRun(tiled, (uint32_t)x, (uint32_t)(y + iy), (uint32_t)(z + iz), (uint32_t)s, (uint32_t)w, row.data());
+			if (ok) LuaImage::EncodePixelRunD(image, Image_CalculateIndex(image, 0, (uint32_t)iy, (uint32_t)iz, 0), (uint32_t)w, row.data());
+		}
+	}
+	if (!ok && image) {
+		Image_Destroy(image);
+		image = nullptr;
+	}
+
+	auto ud = imageud_create(L);
+	imageud_set(L, ud, image);
+	lua_pushboolean(L, *ud != nullptr);
+	return 2;
+}
+
+// writeRegion(image, x, y, z, s) writes slice 0 of image (all its pages) at x, y, z, s
+static int tiledWriteRegion(lua_State *L) {
+	auto tiled = tiledud_check(L, 1);
+	auto image = imageud_checkdata(L, 2);
+	LUA_ASSERT(LuaImage::CanAccessPixelRuns(image->format), L, "image format can't be read a row at a time");
+	int64_t x = luaL_checkinteger(L, 3);
+	int64_t y = luaL_checkinteger(L, 4);
+	int64_t z = luaL_checkinteger(L, 5);
+	int64_t s = luaL_checkinteger(L, 6);
+	LUA_ASSERT(tiledInside(LuaImage::Tiled_Info(tiled), x, y, z, s, image->width, image->height, image->depth), L, "region outside image");
+
+	bool ok = true;
+	std::vector<double> row((size_t)image->width * 4);
+	for (uint32_t iz = 0; iz < image->depth && ok; ++iz) {
+		for (uint32_t iy = 0; iy < image->height && ok; ++iy) {
+			LuaImage::DecodePixelRunD(image, Image_CalculateIndex(image, 0, iy, iz, 0), image->width, row.data());
+			ok = LuaImage::Tiled_WriteRun(tiled, (uint32_t)x, (uint32_t)y + iy, (uint32_t)z + iz, (uint32_t)s, image->width, row.data());
+		}
+	}
+	lua_pushboolean(L, ok);
+	return 1;
+}
+
+// copies whole rows from a tiled image to an image or tiled image of the
+// same width. rows is the number of rows starting at sy/dy
+static bool tiledCopyRows(lua_State *L, LuaImage::TiledImage* src, uint32_t sy, uint32_t sz, uint32_t sw,
+													int dstIndex, uint32_t dy, uint32_t dz, uint32_t dw, uint32_t rows) {
+	auto const& info = LuaImage::Tiled_Info(src);
+	LUA_ASSERT(tiledInside(info, 0, sy, sz, sw, info.width, rows, 1), L, "source row outside image");
+	std::vector<double> row((size_t)info.width * 4);
+
+	if (luaL_testudata(L, dstIndex, MetaName)) {
+		auto image = imageud_writable(L, dstIndex);
+		LUA_ASSERT(LuaImage::CanAccessPixelRuns(image->format), L, "image format can't be written a row at a time");
+		LUA_ASSERT(image->width == info.width, L, "widths don't match");
+		LUA_ASSERT(dy + rows <= image->height && dz < image->depth && dw < image->slices, L, "destination row outside image");
+		for (uint32_t i = 0; i < rows; ++i) {
+			if (!LuaImage::Tiled_ReadRun(src, 0, sy + i, sz, sw, info.width, row.data())) return false;
+			LuaImage::EncodePixelRunD(image, Image_CalculateIndex(image, 0, dy + i, dz, dw), info.width, row.data());
+		}
+		return true;
+	}
+
+	auto dst = tiledud_check(L, dstIndex);
+	auto const& dstInfo = LuaImage::Tiled_Info(dst);
+	LUA_ASSERT(dstInfo.width == info.width, L, "widths don't match");
+	LUA_ASSERT(tiledInside(dstInfo, 0, dy, dz, dw, dstInfo.width, rows, 1), L, "destination row outside image");
+	for (uint32_t i = 0; i < rows; ++i) {
+		if (!LuaImage::Tiled_ReadRun(src, 0, sy + i, sz, sw, info.width, row.data())) return false;
+		if (!LuaImage::Tiled_WriteRun(dst, 0, dy + i, dz, dw, info.width, row.data())) return false;
+	}
+	return true;
+}
+
+// copyRow(sy, sz, sw, dst, dy, dz, dw) dst is an image or tiled image
+static int tiledCopyRow(lua_State *L) {
+	auto src = tiledud_check(L, 1);
+	int64_t sy = luaL_checkinteger(L, 2);
+	int64_t sz = luaL_checkinteger(L, 3);
+	int64_t sw = luaL_checkinteger(L, 4);
+	int64_t dy = luaL_checkinteger(L, 6);
+	int64_t dz = luaL_checkinteger(L, 7);
+	int64_t dw = luaL_checkinteger(L, 8);
+	LUA_ASSERT(sy >= 0 && sz >= 0 && sw >= 0 && dy >= 0 && dz >= 0 && dw >= 0, L, "coordinates must be >= 0");
+
+	lua_pushboolean(L, tiledCopyRows(L, src, (uint32_t)sy, (uint32_t)sz, (uint32_t)sw, 5,
+																	 (uint32_t)dy, (uint32_t)dz, (uint32_t)dw, 1));
+	return 1;
+}
+
+// copyPage(sz, sw, dst, dz, dw) dst is an image or tiled image
+static int tiledCopyPage(lua_State *L) {
+	auto src = tiledud_check(L, 1);
+	int64_t sz = luaL_checkinteger(L, 2);
+	int64_t sw = luaL_checkinteger(L, 3);
+	int64_t dz = luaL_checkinteger(L, 5);
+	int64_t dw = luaL_checkinteger(L, 6);
+	LUA_ASSERT(sz >= 0 && sw >= 0 && dz >= 0 && dw >= 0, L, "coordinates must be >= 0");
+
+	lua_pushboolean(L, tiledCopyRows(L, src, 0, (uint32_t)sz, (uint32_t)sw, 4,
+																	 0, (uint32_t)dz, (uint32_t)dw, LuaImage::Tiled_Info(src).height));
+	return 1;
+}
+
+// convert(path, format [, cacheBytes]) a new tiled image, converted tile by tile
+static int tiledConvert(lua_State *L) {
+	auto src = tiledud_check(L, 1);
+	char const* path = luaL_checkstring(L, 2);
+	TinyImageFormat const format = checkformat(L, 3);
+	size_t const cacheBytes = tiledCacheBytesCheck(L, 4);
+
+	LUA_ASSERT(!LuaImage::Tiled_IsFile(src, path), L, "destination is the source's tile file");
+
+	auto ud = tiledud_create(L);
+	*ud = LuaImage::Tiled_Convert(src, path, format, cacheBytes);
+	lua_pushboolean(L, *ud != nullptr);
+	return 2;
+}
+
+// createMipMap(path [, cacheBytes]) the next (half size) level as a new tiled image
+static int tiledCreateMipMap(lua_State *L) {
+	auto src = tiledud_check(L, 1);
+	char const* path = luaL_checkstring(L, 2);
+	size_t const cacheBytes = tiledCacheBytesCheck(L, 3);
+
+	LUA_ASSERT(!LuaImage::Tiled_IsFile(src, path), L, "destination is the source's tile file");
+
+	auto ud = tiledud_create(L);
+	*ud = LuaImage::Tiled_CreateMipMap(src, path, cacheBytes);
+	lua_pushboolean(L, *ud != nullptr);
+	return 2;
+}
+
+static int tiledFlush(lua_State *L) {
+	lua_pushboolean(L, LuaImage::Tiled_Flush(tiledud_check(L, 1)));
+	return 1;
+}
+
+// setCacheSize(bytes) returns false if evicting couldn't write back a dirty tile
+static int tiledSetCacheSize(lua_State *L) {
+	auto tiled = tiledud_check(L, 1);
+	lua_pushboolean(L, LuaImage::Tiled_SetCacheBytes(tiled, tiledCacheBytesCheck(L, 2)));
+	return 1;
+}
+
+static int tiledCacheStats(lua_State *L) {
+	LuaImage::TiledStats const stats = LuaImage::Tiled_Stats(tiledud_check(L, 1));
+	lua_createtable(L, 0, 6);
+	lua_pushinteger(L, (lua_Integer)stats.hits);
+	lua_setfield(L, -2, "hits");
+	lua_pushinteger(L, (lua_Integer)stats.misses);
+	lua_setfield(L, -2, "misses");
+	lua_pushinteger(L, (lua_Integer)stats.writes);
+	lua_setfield(L, -2, "writes");
+	lua_pushinteger(L, (lua_Integer)stats.evictions);
+	lua_setfield(L, -2, "evictions");
+	lua_pushinteger(L, (lua_Integer)stats.residentBytes);
+	lua_setfield(L, -2, "residentBytes");
+	lua_pushinteger(L, (lua_Integer)stats.cacheBytes);
+	lua_setfield(L, -2, "cacheBytes");
+	return 1;
+}
+
 AL2O3_EXTERN_C int LuaImage_Open(lua_State* L) {
 	static const struct luaL_Reg imageObj [] = {
 			{"width", &width},
@@ -815,16 +3777,21 @@ AL2O3_EXTERN_C int LuaImage_Open(lua_State* L) {
 			{"dimensions", &dimensions},
 
 			{"format", &format},
+			{"formatInfo", &formatInfo},
 			{"flags", &flags},
 
 			{"getPixelAt", &getPixelAt},
 			{"setPixelAt", &setPixelAt},
+			{"getRegion", &getRegion},
+			{"setRegion", &setRegion},
+			{"apply", &apply},
 
 			{"copy", &copy},
 			{"copySlice", &copySlice},
 			{"copyPage", &copyPage},
 			{"copyRow", &copyRow},
 			{"copyPixel", &copyPixel},
+			{"blit", &blit},
 
 			{"is1D", &is1D},
 			{"is2D", &is2D},
@@ -838,6 +3805,7 @@ AL2O3_EXTERN_C int LuaImage_Open(lua_State* L) {
 			{"pixelCountPerSlice", &pixelCountPerSlice },
 			{"pixelCountPerPage", &pixelCountPerPage },
 			{"pixelCountPerRow", &pixelCountPerRow },
+			{"stats", &stats },
 
 			{"byteCount", &byteCount },
 			{"byteCountPerSlice", &byteCountPerSlice },
@@ -846,11 +3814,14 @@ AL2O3_EXTERN_C int LuaImage_Open(lua_State* L) {
 
 			{"linkedImageCount", &linkedImageCount},
 			{"linkedImage", &linkedImage},
+			{"view", &view},
+			{"region", &region},
 
 			{"byteCountOfImageChain", &byteCountOfImageChain},
 			{"bytesRequiredForMipMaps", &bytesRequiredForMipMaps},
 
 			{"createMipMapChain", &createMipMapChain},
+			{"resize", &resize},
 			{"clone", &clone},
 			{"cloneStructure", &cloneStructure},
 			{"preciseConvert", &preciseConvert},
@@ -863,6 +3834,14 @@ AL2O3_EXTERN_C int LuaImage_Open(lua_State* L) {
 			{"compressAMDBC5", &compressAMDBC5},
 			{"compressAMDBC6H", &compressAMDBC6H},
 			{"compressAMDBC7", &compressAMDBC7},
+			{"compressAuto", &compressAuto},
+			{"decompress", &decompress},
+
+			{"preciseConvertAsync", &preciseConvertAsync},
+			{"fastConvertAsync", &fastConvertAsync},
+			{"createMipMapChainAsync", &createMipMapChainAsync},
+			{"compressAsync", &compressAsync},
+			{"saveAsync", &saveAsync},
 
 			{"saveAsTGA", &saveAsTGA},
 			{"saveAsBMP", &saveAsBMP},
@@ -871,6 +3850,7 @@ AL2O3_EXTERN_C int LuaImage_Open(lua_State* L) {
 			{"saveAsHDR", &saveAsHDR},
 			{"saveAsKTX", &saveAsKTX},
 			{"saveAsDDS", &saveAsDDS},
+			{"encode", &encode},
 
 			{"canSaveAsTGA", &canSaveAsTGA},
 			{"canSaveAsBMP", &canSaveAsBMP},
@@ -879,6 +3859,14 @@ AL2O3_EXTERN_C int LuaImage_Open(lua_State* L) {
 			{"canSaveAsHDR", &canSaveAsHDR},
 			{"canSaveAsKTX", &canSaveAsKTX},
 			{"canSaveAsDDS", &canSaveAsDDS},
+			{"lazy", &lazy},
+
+			{"export", &exportImage},
+			{"freeze", &freeze},
+			{"isFrozen", &isFrozen},
+			{"isShared", &isShared},
+
+			{"release", &release},
 			{"__gc", &imageud_gc },
 			{nullptr, nullptr}  /* sentinel */
 	};
@@ -908,9 +3896,130 @@ AL2O3_EXTERN_C int LuaImage_Open(lua_State* L) {
 			{"createCubemapArrayNoClear", &createCubemapArrayNoClear},
 
 			{"load", &load},
+			{"loadMapped", &loadMapped},
+			{"loadFromMemory", &loadFromMemory},
+			{"probe", &probe},
+			{"probeMany", &probeMany},
+
+			{"compileKernel", &compileKernel},
+
+			{"loadAsync", &loadAsync},
+			{"waitAll", &waitAll},
+			{"waitAny", &waitAny},
+			{"setJobThreads", &setJobThreads},
+
+			{"import", &importImage},
+			{"unexport", &unexportImage},
+
+			{"setMemoryBudget", &setMemoryBudget},
+			{"memoryStats", &memoryStats},
+
+			{"setPoolLimit", &setPoolLimit},
+			{"poolTrim", &poolTrim},
+			{"poolStats", &poolStats},
+
+			{"setCache", &setCache},
+			{"setCacheLimit", &setCacheLimit},
+			{"cacheTrim", &cacheTrim},
+			{"cacheStats", &cacheStats},
+
+			{"createTiled", &createTiled},
+			{"openTiled", &openTiled},
+
+			{"packAtlas", &packAtlas},
+			{"compare", &compare},
+			{"pipeline", &pipeline},
 			{nullptr, nullptr}  /* sentinel */
 	};
 
+	static const struct luaL_Reg jobObj [] = {
+			{"done", &jobDone},
+			{"wait", &jobWait},
+			{"await", &jobAwait},
+			{"__gc", &jobud_gc },
+			{nullptr, nullptr}  /* sentinel */
+	};
+
+	static const struct luaL_Reg kernelObj [] = {
+			{"append", &kernelAppend},
+			{"inputCount", &kernelInputCount},
+			{"__gc", &kernelud_gc },
+			{nullptr, nullptr}  /* sentinel */
+	};
+
+	static const struct luaL_Reg tiledObj [] = {
+			{"width", &tiledWidth},
+			{"height", &tiledHeight},
+			{"depth", &tiledDepth},
+			{"slices", &tiledSlices},
+			{"dimensions", &tiledDimensions},
+			{"format", &tiledFormat},
+			{"tileSize", &tiledTileSize},
+
+			{"getPixelAt", &tiledGetPixelAt},
+			{"setPixelAt", &tiledSetPixelAt},
+			{"readRegion", &tiledReadRegion},
+			{"writeRegion", &tiledWriteRegion},
+			{"copyRow", &tiledCopyRow},
+			{"copyPage", &tiledCopyPage},
+
+			{"convert", &tiledConvert},
+			{"createMipMap", &tiledCreateMipMap},
+
+			{"flush", &tiledFlush},
+			{"setCacheSize", &tiledSetCacheSize},
+			{"cacheStats", &tiledCacheStats},
+			{"close", &tiledud_gc},
+			{"__gc", &tiledud_gc },
+			{nullptr, nullptr}  /* sentinel */
+	};
+
+	static const struct luaL_Reg regionObj [] = {
+			{"width", &regionWidth},
+			{"height", &regionHeight},
+			{"depth", &regionDepth},
+			{"dimensions", &regionDimensions},
+			{"format", &regionFormat},
+			{"offset", &regionOffset},
+			{"parent", &regionParent},
+
+			{"getPixelAt", &regionGetPixelAt},
+			{"setPixelAt", &regionSetPixelAt},
+			{"copyTo", &regionCopyTo},
+			{"copyFrom", &regionCopyFrom},
+			{"toImage", &regionToImage},
+
+			{"__gc", &regionud_gc },
+			{nullptr, nullptr}  /* sentinel */
+	};
+
+	static const struct luaL_Reg lazyObj [] = {
+			{"fastConvert", &lazyConvert},
+			{"preciseConvert", &lazyConvert},
+			{"createMipMapChain", &lazyCreateMipMapChain},
+			{"resize", &lazyResize},
+			{"compressAMDBC1", &lazyCompressBC1},
+			{"compressAMDBC2", &lazyCompressBC2},
+			{"compressAMDBC3", &lazyCompressBC3},
+			{"compressAMDBC4", &lazyCompressBC4},
+			{"compressAMDBC5", &lazyCompressBC5},
+			{"compressAMDBC6H", &lazyCompressBC6H},
+			{"compressAMDBC7", &lazyCompressBC7},
+			{"compressAuto", &lazyCompressAuto},
+			{"decompress", &lazyDecompress},
+
+			{"realize", &lazyRealize},
+			{"__gc", &lazyud_gc },
+			{nullptr, nullptr}  /* sentinel */
+	};
+	// realise the graph then call the image method of the same name
+	static char const* const lazyForwards[] = {
+			"width", "height", "depth", "slices", "dimensions", "format", "formatInfo",
+			"getPixelAt", "getRegion", "stats",
+			"saveAsTGA", "saveAsBMP", "saveAsPNG", "saveAsJPG", "saveAsHDR", "saveAsKTX", "saveAsDDS", "encode",
+			nullptr
+	};
+
 	luaL_newmetatable(L, MetaName);
 	/* metatable.__index = metatable */
 	lua_pushvalue(L, -1);
@@ -919,6 +4028,39 @@ AL2O3_EXTERN_C int LuaImage_Open(lua_State* L) {
 	/* register methods */
 	luaL_setfuncs(L, imageObj, 0);
 
+	luaL_newmetatable(L, KernelMetaName);
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	luaL_setfuncs(L, kernelObj, 0);
+
+	luaL_newmetatable(L, JobMetaName);
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	luaL_setfuncs(L, jobObj, 0);
+
+	luaL_newmetatable(L, TiledMetaName);
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	luaL_setfuncs(L, tiledObj, 0);
+
+	luaL_newmetatable(L, RegionMetaName);
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	luaL_setfuncs(L, regionObj, 0);
+
+	luaL_newmetatable(L, LazyMetaName);
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	luaL_setfuncs(L, lazyObj, 0);
+	for (int i = 0; lazyForwards[i]; ++i) {
+		lua_pushstring(L, lazyForwards[i]);
+		lua_pushcclosure(L, &lazyForward, 1);
+		lua_setfield(L, -2, lazyForwards[i]);
+	}
+
 	luaL_newlib(L, imageLib);
+	formattables_create(L);
+	lua_setfield(L, -3, "formatInfo");
+	lua_setfield(L, -2, "formats");
 	return 1;
 }
\ No newline at end of file
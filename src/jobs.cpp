@@ -0,0 +1,151 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "jobs.hpp"
+#include "parallel.hpp"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace LuaImage {
+
+namespace {
+
+class JobSystem {
+public:
+	~JobSystem() {
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			quit = true;
+		}
+		queueCv.notify_all();
+		for (auto &worker : workers) {
+			worker.join();
+		}
+	}
+
+	void SetThreadCount(uint32_t count) {
+		std::lock_guard<std::mutex> lock(queueMutex);
+		if (workers.empty()) threadCount = count;
+	}
+
+	void Submit(JobPtr const &job, std::function<void(Job &)> &&work) {
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			if (workers.empty()) StartWorkers();
+			queue.emplace_back(Task{job, std::move(work)});
+		}
+		queueCv.notify_one();
+	}
+
+	void Wait(Job const *job) {
+		if (job->done) return;
+		std::unique_lock<std::mutex> lock(doneMutex);
+		doneCv.wait(lock, [job]() { return job->done.load(); });
+	}
+
+	size_t WaitAny(Job const *const *jobs, size_t count) {
+		size_t index = count;
+		auto const anyDone = [&]() {
+			for (size_t i = 0; i < count; ++i) {
+				if (jobs[i]->done) {
+					index = i;
+					return true;
+				}
+			}
+			return false;
+		};
+		if (anyDone()) return index;
+
+		std::unique_lock<std::mutex> lock(doneMutex);
+		doneCv.wait(lock, anyDone);
+		return index;
+	}
+
+private:
+	struct Task {
+		JobPtr job;
+		std::function<void(Job &)> work;
+	};
+
+	// queueMutex must be held
+	void StartWorkers() {
+		uint32_t const count = threadCount ? threadCount : HardwareThreadCount();
+		for (uint32_t i = 0; i < count; ++i) {
+			workers.emplace_back([this]() { Worker(); });
+		}
+	}
+
+	void Worker() {
+		for (;;) {
+			Task task;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				queueCv.wait(lock, [this]() { return quit || !queue.empty(); });
+				if (quit) return;
+				task = std::move(queue.front());
+				queue.pop_front();
+			}
+
+			task.work(*task.job);
+
+			{
+				std::lock_guard<std::mutex> lock(doneMutex);
+				task.job->done = true;
+			}
+			doneCv.notify_all();
+		}
+	}
+
+	std::mutex queueMutex;
+	std::condition_variable queueCv;
+	std::deque<Task> queue;
+	std::vector<std::thread> workers;
+	uint32_t threadCount = 0;
+	bool quit = false;
+
+	// all job completions are signalled through one condition so waiting
+	// on any of several jobs is cheap
+	std::mutex doneMutex;
+	std::condition_variable doneCv;
+};
+
+JobSystem &System() {
+	static JobSystem system;
+	return system;
+}
+
+} // end anonymous namespace
+
+Job::~Job() {
+	if (result) Image_Destroy(result);
+}
+
+void Job_SetThreadCount(uint32_t count) {
+	System().SetThreadCount(count);
+}
+
+JobPtr Job_Submit(bool producesImage, std::function<void(Job &job)> work) {
+	auto job = std::make_shared<Job>();
+	job->producesImage = producesImage;
+	System().Submit(job, std::move(work));
+	return job;
+}
+
+void Job_Wait(Job const *job) {
+	System().Wait(job);
+}
+
+size_t Job_WaitAny(Job const *const *jobs, size_t count) {
+	if (count == 0) return 0;
+	return System().WaitAny(jobs, count);
+}
+
+Image_ImageHeader const *Job_TakeResult(Job *job) {
+	auto const result = job->result;
+	job->result = nullptr;
+	return result;
+}
+
+} // end namespace LuaImage
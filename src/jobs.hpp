@@ -0,0 +1,44 @@
+#pragma once
+#ifndef LUA_IMAGE_JOBS_HPP_
+#define LUA_IMAGE_JOBS_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+
+namespace LuaImage {
+
+// A job runs on a worker thread and optionally produces an image and a
+// success flag. Workers never touch a lua_State
+struct Job {
+	~Job();
+
+	std::atomic<bool> done{false};
+	bool ok = false;
+	// set if the job produces an image, owned by the job until taken
+	bool producesImage = false;
+	Image_ImageHeader const *result = nullptr;
+};
+
+typedef std::shared_ptr<Job> JobPtr;
+
+// sets the worker count, only has an effect before the first job is submitted
+void Job_SetThreadCount(uint32_t count);
+
+// queue work to run on a worker thread, work fills in ok and result
+JobPtr Job_Submit(bool producesImage, std::function<void(Job &job)> work);
+
+// blocks until the job is done
+void Job_Wait(Job const *job);
+
+// blocks until at least one of the jobs is done, returns its index
+size_t Job_WaitAny(Job const *const *jobs, size_t count);
+
+// transfers ownership of the result image to the caller
+Image_ImageHeader const *Job_TakeResult(Job *job);
+
+} // end namespace LuaImage
+
+#endif
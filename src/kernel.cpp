@@ -0,0 +1,671 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "kernel.hpp"
+#include "parallel.hpp"
+#include "pixelrows.hpp"
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+
+namespace LuaImage {
+
+namespace {
+
+enum class Op : uint8_t {
+	PushState,  // a = channel
+	PushInput,  // a = input (1 based), b = channel
+	PushConst,  // value
+	PushCoord,  // a = axis x y z s
+	PushDim,    // a = axis width height depth slices
+
+	Neg, Not, Abs, Sqrt, Floor, Ceil, Fract, Exp, Log, Sin, Cos, Saturate,
+
+	Add, Sub, Mul, Div, Mod, Pow, Min, Max, Step,
+	Lt, Gt, Le, Ge, Eq, Ne, And, Or,
+
+	Clamp, Mix, SmoothStep, Select,
+
+	Store,      // a = number of outputs popped into state channels 0..a-1
+};
+
+struct Instruction {
+	Op op;
+	uint8_t a;
+	uint8_t b;
+	float value;
+};
+
+struct FunctionDesc {
+	char const *name;
+	uint32_t argCount;
+	Op op;
+};
+
+FunctionDesc const Functions[] = {
+		{"abs", 1, Op::Abs},
+		{"sqrt", 1, Op::Sqrt},
+		{"floor", 1, Op::Floor},
+		{"ceil", 1, Op::Ceil},
+		{"fract", 1, Op::Fract},
+		{"exp", 1, Op::Exp},
+		{"log", 1, Op::Log},
+		{"sin", 1, Op::Sin},
+		{"cos", 1, Op::Cos},
+		{"saturate", 1, Op::Saturate},
+		{"min", 2, Op::Min},
+		{"max", 2, Op::Max},
+		{"pow", 2, Op::Pow},
+		{"step", 2, Op::Step},
+		{"clamp", 3, Op::Clamp},
+		{"mix", 3, Op::Mix},
+		{"lerp", 3, Op::Mix},
+		{"smoothstep", 3, Op::SmoothStep},
+		{"select", 3, Op::Select},
+};
+
+uint32_t ArgCountOf(Op op) {
+	switch (op) {
+		case Op::PushState:
+		case Op::PushInput:
+		case Op::PushConst:
+		case Op::PushCoord:
+		case Op::PushDim: return 0;
+		case Op::Neg:
+		case Op::Not:
+		case Op::Abs:
+		case Op::Sqrt:
+		case Op::Floor:
+		case Op::Ceil:
+		case Op::Fract:
+		case Op::Exp:
+		case Op::Log:
+		case Op::Sin:
+		case Op::Cos:
+		case Op::Saturate: return 1;
+		case Op::Clamp:
+		case Op::Mix:
+		case Op::SmoothStep:
+		case Op::Select: return 3;
+		case Op::Store: return 0;
+		default: return 2;
+	}
+}
+
+enum class Token : uint8_t {
+	End, Number, Ident, Op, Error
+};
+
+// recursive descent compiler straight to the stack machine
+class Compiler {
+public:
+	Compiler(char const *source, std::vector<Instruction> &code) :
+			cur(source), code(code) {}
+
+	bool Compile(std::string &errorOut) {
+		Next();
+		do {
+			uint32_t outputs = 0;
+			do {
+				if (outputs == 4) return Fail("a pass has more than 4 outputs", errorOut);
+				if (!Expression()) return Fail(error.c_str(), errorOut);
+				outputs++;
+			} while (Accept(","));
+			Emit(Op::Store, (uint8_t) outputs);
+			depth -= outputs;
+		} while (Accept(";") && tokenType != Token::End);
+
+		if (tokenType != Token::End) {
+			return Fail(("unexpected '" + tokenText + "'").c_str(), errorOut);
+		}
+		return true;
+	}
+
+	uint32_t maxDepth = 0;
+	uint32_t maxInput = 0;
+	bool readsState = false;
+
+private:
+	bool Fail(char const *msg, std::string &errorOut) {
+		errorOut = msg;
+		return false;
+	}
+
+	void Next() {
+		while (isspace((unsigned char) *cur)) cur++;
+		tokenText.clear();
+		if (*cur == 0) {
+			tokenType = Token::End;
+			return;
+		}
+
+		if (isdigit((unsigned char) *cur) || (*cur == '.' && isdigit((unsigned char) cur[1]))) {
+			char *end = nullptr;
+			tokenNumber = strtod(cur, &end);
+			tokenText.assign(cur, (size_t) (end - cur));
+			cur = end;
+			tokenType = Token::Number;
+			return;
+		}
+
+		if (isalpha((unsigned char) *cur) || *cur == '_') {
+			char const *start = cur;
+			while (isalnum((unsigned char) *cur) || *cur == '_') cur++;
+			tokenText.assign(start, cur);
+			// word operators
+			tokenType = (tokenText == "and" || tokenText == "or" || tokenText == "not") ? Token::Op : Token::Ident;
+			return;
+		}
+
+		static char const *const twoCharOps[] = {"<=", ">=", "==", "~=", "!=", "&&", "||"};
+		for (auto op : twoCharOps) {
+			if (cur[0] == op[0] && cur[1] == op[1]) {
+				tokenText.assign(cur, 2);
+				cur += 2;
+				tokenType = Token::Op;
+				return;
+			}
+		}
+		if (strchr("+-*/%^<>!?:,;()", *cur)) {
+			tokenText.assign(cur, 1);
+			cur++;
+			tokenType = Token::Op;
+			return;
+		}
+
+		tokenText.assign(cur, 1);
+		tokenType = Token::Error;
+	}
+
+	bool Peek(char const *op) const {
+		return tokenType == Token::Op && tokenText == op;
+	}
+
+	bool Accept(char const *op) {
+		if (!Peek(op)) return false;
+		Next();
+		return true;
+	}
+
+	bool Expect(char const *op) {
+		if (Accept(op)) return true;
+		error = std::string("expected '") + op + "' but found '" + tokenText + "'";
+		return false;
+	}
+
+	void Emit(Op op, uint8_t a = 0, uint8_t b = 0, float value = 0.0f) {
+		code.push_back(Instruction{op, a, b, value});
+		if (op == Op::Store) return;
+
+		// every op pushes 1 result after popping its arguments
+		depth = depth - ArgCountOf(op) + 1;
+		if (depth > maxDepth) maxDepth = depth;
+	}
+
+	bool Expression() {
+		if (!Or()) return false;
+		if (Accept("?")) {
+			if (!Expression()) return false;
+			if (!Expect(":")) return false;
+			if (!Expression()) return false;
+			Emit(Op::Select);
+		}
+		return true;
+	}
+
+	bool Or() {
+		if (!And()) return false;
+		while (Accept("or") || Accept("||")) {
+			if (!And()) return false;
+			Emit(Op::Or);
+		}
+		return true;
+	}
+
+	bool And() {
+		if (!Compare()) return false;
+		while (Accept("and") || Accept("&&")) {
+			if (!Compare()) return false;
+			Emit(Op::And);
+		}
+		return true;
+	}
+
+	bool Compare() {
+		if (!Additive()) return false;
+		static struct {
+			char const *text;
+			Op op;
+		} const compares[] = {
+				{"<=", Op::Le}, {">=", Op::Ge}, {"<", Op::Lt}, {">", Op::Gt},
+				{"==", Op::Eq}, {"~=", Op::Ne}, {"!=", Op::Ne},
+		};
+		for (auto const &cmp : compares) {
+			if (Accept(cmp.text)) {
+				if (!Additive()) return false;
+				Emit(cmp.op);
+				break;
+			}
+		}
+		return true;
+	}
+
+	bool Additive() {
+		if (!Multiplicative()) return false;
+		for (;;) {
+			if (Accept("+")) {
+				if (!Multiplicative()) return false;
+				Emit(Op::Add);
+			} else if (Accept("-")) {
+				if (!Multiplicative()) return false;
+				Emit(Op::Sub);
+			} else {
+				return true;
+			}
+		}
+	}
+
+	bool Multiplicative() {
+		if (!Unary()) return false;
+		for (;;) {
+			if (Accept("*")) {
+				if (!Unary()) return false;
+				Emit(Op::Mul);
+			} else if (Accept("/")) {
+				if (!Unary()) return false;
+				Emit(Op::Div);
+			} else if (Accept("%")) {
+				if (!Unary()) return false;
+				Emit(Op::Mod);
+			} else {
+				return true;
+			}
+		}
+	}
+
+	bool Unary() {
+		if (Accept("-")) {
+			if (!Unary()) return false;
+			Emit(Op::Neg);
+			return true;
+		}
+		if (Accept("not") || Accept("!")) {
+			if (!Unary()) return false;
+			Emit(Op::Not);
+			return true;
+		}
+		return Power();
+	}
+
+	bool Power() {
+		if (!Primary()) return false;
+		if (Accept("^")) {
+			// right associative and binds tighter than unary minus on the left
+			if (!Unary()) return false;
+			Emit(Op::Pow);
+		}
+		return true;
+	}
+
+	bool Primary() {
+		if (tokenType == Token::Number) {
+			Emit(Op::PushConst, 0, 0, (float) tokenNumber);
+			Next();
+			return true;
+		}
+		if (Accept("(")) {
+			if (!Expression()) return false;
+			return Expect(")");
+		}
+		if (tokenType != Token::Ident) {
+			error = tokenType == Token::End ? "unexpected end of kernel" : "unexpected '" + tokenText + "'";
+			return false;
+		}
+
+		std::string const name = tokenText;
+		Next();
+
+		if (Peek("(")) return Call(name);
+		return Variable(name);
+	}
+
+	bool Call(std::string const &name) {
+		for (auto const &func : Functions) {
+			if (name != func.name) continue;
+			Expect("(");
+			for (uint32_t i = 0; i < func.argCount; ++i) {
+				if (i != 0 && !Expect(",")) return false;
+				if (!Expression()) return false;
+			}
+			if (!Expect(")")) return false;
+			Emit(func.op);
+			return true;
+		}
+		error = "unknown function '" + name + "'";
+		return false;
+	}
+
+	bool Variable(std::string const &name) {
+		static char const channels[] = "rgba";
+		static char const coords[] = "xyzs";
+		static char const *const dims[] = {"width", "height", "depth", "slices"};
+
+		if (name == "pi") {
+			Emit(Op::PushConst, 0, 0, 3.14159265358979f);
+			return true;
+		}
+
+		for (uint8_t i = 0; i < 4; ++i) {
+			if (name == dims[i]) {
+				Emit(Op::PushDim, i);
+				return true;
+			}
+		}
+
+		if (name.size() == 1) {
+			for (uint8_t i = 0; i < 4; ++i) {
+				if (name[0] == channels[i]) {
+					readsState = true;
+					Emit(Op::PushState, i);
+					return true;
+				}
+				if (name[0] == coords[i]) {
+					Emit(Op::PushCoord, i);
+					return true;
+				}
+			}
+		}
+
+		// rN gN bN aN
+		char const *chan = strchr(channels, name[0]);
+		if (chan && name.size() > 1) {
+			char *end = nullptr;
+			long const input = strtol(name.c_str() + 1, &end, 10);
+			if (*end == 0 && input >= 1 && input <= 255) {
+				if ((uint32_t) input > maxInput) maxInput = (uint32_t) input;
+				Emit(Op::PushInput, (uint8_t) input, (uint8_t) (chan - channels));
+				return true;
+			}
+		}
+
+		error = "unknown variable '" + name + "'";
+		return false;
+	}
+
+	char const *cur;
+	std::vector<Instruction> &code;
+	uint32_t depth = 0;
+
+	Token tokenType = Token::End;
+	std::string tokenText;
+	double tokenNumber = 0.0;
+	std::string error;
+};
+
+// structure of arrays buffers for a single row
+struct RowScratch {
+	explicit RowScratch(uint32_t width, uint32_t stackDepth, uint32_t inputCount) :
+			width(width),
+			interleaved((size_t) width * 4),
+			state((size_t) width * 4),
+			stack((size_t) width * (stackDepth ? stackDepth : 1)),
+			inputs((size_t) width * 4 * inputCount),
+			coord(width) {}
+
+	float *State(uint32_t channel) { return state.data() + ((size_t) channel * width); }
+	float *Stack(uint32_t slot) { return stack.data() + ((size_t) slot * width); }
+	float *Input(uint32_t input, uint32_t channel) {
+		return inputs.data() + (((size_t) (input - 1) * 4) + channel) * width;
+	}
+
+	void Deinterleave(float *r, float *g, float *b, float *a) {
+		for (uint32_t i = 0; i < width; ++i) {
+			r[i] = interleaved[(i * 4) + 0];
+			g[i] = interleaved[(i * 4) + 1];
+			b[i] = interleaved[(i * 4) + 2];
+			a[i] = interleaved[(i * 4) + 3];
+		}
+	}
+
+	void Interleave(float const *r, float const *g, float const *b, float const *a) {
+		for (uint32_t i = 0; i < width; ++i) {
+			interleaved[(i * 4) + 0] = r[i];
+			interleaved[(i * 4) + 1] = g[i];
+			interleaved[(i * 4) + 2] = b[i];
+			interleaved[(i * 4) + 3] = a[i];
+		}
+	}
+
+	uint32_t width;
+	std::vector<float> interleaved;
+	std::vector<float> state;
+	std::vector<float> stack;
+	std::vector<float> inputs;
+	std::vector<float> coord;
+};
+
+template<typename F>
+inline void Unary(float *v, uint32_t n, F func) {
+	for (uint32_t i = 0; i < n; ++i) v[i] = func(v[i]);
+}
+
+template<typename F>
+inline void Binary(float *v0, float const *v1, uint32_t n, F func) {
+	for (uint32_t i = 0; i < n; ++i) v0[i] = func(v0[i], v1[i]);
+}
+
+template<typename F>
+inline void Ternary(float *v0, float const *v1, float const *v2, uint32_t n, F func) {
+	for (uint32_t i = 0; i < n; ++i) v0[i] = func(v0[i], v1[i], v2[i]);
+}
+
+inline float Sat(float v) { return v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v); }
+
+} // end anonymous namespace
+
+struct Kernel {
+	std::vector<Instruction> code;
+	uint32_t maxDepth;
+	uint32_t maxInput;
+	bool readsState;
+	bool fullFirstStore;
+};
+
+Kernel *Kernel_Compile(char const *source, std::string &error) {
+	auto kernel = new Kernel();
+	Compiler compiler(source, kernel->code);
+	if (!compiler.Compile(error)) {
+		delete kernel;
+		return nullptr;
+	}
+	kernel->maxDepth = compiler.maxDepth;
+	kernel->maxInput = compiler.maxInput;
+	kernel->readsState = compiler.readsState;
+
+	// if nothing reads the destination and the first pass writes all channels
+	// the destination doesn't need decoding
+	kernel->fullFirstStore = false;
+	for (auto const &inst : kernel->code) {
+		if (inst.op == Op::Store) {
+			kernel->fullFirstStore = inst.a == 4;
+			break;
+		}
+	}
+	return kernel;
+}
+
+void Kernel_Append(Kernel *dst, Kernel const *src) {
+	// copied first, inserting a vector's own range into itself is undefined
+	auto const code = src->code;
+	dst->code.insert(dst->code.end(), code.begin(), code.end());
+	if (src->maxDepth > dst->maxDepth) dst->maxDepth = src->maxDepth;
+	if (src->maxInput > dst->maxInput) dst->maxInput = src->maxInput;
+	dst->readsState = dst->readsState || src->readsState;
+}
+
+void Kernel_Destroy(Kernel *kernel) {
+	delete kernel;
+}
+
+uint32_t Kernel_InputCount(Kernel const *kernel) {
+	return kernel->maxInput;
+}
+
+static void RunRow(Kernel const *kernel,
+									 RowScratch &scratch,
+									 Image_ImageHeader const *dst,
+									 Image_ImageHeader const *const *inputs,
+									 uint32_t y, uint32_t z, uint32_t s) {
+	uint32_t const n = scratch.width;
+	size_t const index = Image_CalculateIndex(dst, 0, y, z, s);
+
+	if (kernel->readsState || !kernel->fullFirstStore) {
+		DecodePixelRunF(dst, index, n, scratch.interleaved.data());
+		scratch.Deinterleave(scratch.State(0), scratch.State(1), scratch.State(2), scratch.State(3));
+	}
+
+	for (uint32_t i = 1; i <= kernel->maxInput; ++i) {
+		DecodePixelRunF(inputs[i - 1], index, n, scratch.interleaved.data());
+		scratch.Deinterleave(scratch.Input(i, 0), scratch.Input(i, 1), scratch.Input(i, 2), scratch.Input(i, 3));
+	}
+
+	uint32_t const coords[4] = {0, y, z, s};
+	uint32_t const dims[4] = {dst->width, dst->height, dst->depth, dst->slices};
+
+	uint32_t sp = 0;
+	for (auto const &inst : kernel->code) {
+		uint32_t const argCount = ArgCountOf(inst.op);
+		// operands start at the first popped slot, results land in the same slot
+		float *v0 = scratch.Stack(sp - argCount);
+		float const *v1 = argCount > 1 ? scratch.Stack(sp - argCount + 1) : nullptr;
+		float const *v2 = argCount > 2 ? scratch.Stack(sp - argCount + 2) : nullptr;
+
+		switch (inst.op) {
+			case Op::PushState: memcpy(v0, scratch.State(inst.a), n * sizeof(float));
+				break;
+			case Op::PushInput: memcpy(v0, scratch.Input(inst.a, inst.b), n * sizeof(float));
+				break;
+			case Op::PushConst:
+				for (uint32_t i = 0; i < n; ++i) v0[i] = inst.value;
+				break;
+			case Op::PushCoord:
+				if (inst.a == 0) {
+					for (uint32_t i = 0; i < n; ++i) v0[i] = (float) i;
+				} else {
+					for (uint32_t i = 0; i < n; ++i) v0[i] = (float) coords[inst.a];
+				}
+				break;
+			case Op::PushDim:
+				for (uint32_t i = 0; i < n; ++i) v0[i] = (float) dims[inst.a];
+				break;
+
+			case Op::Neg: Unary(v0, n, [](float a) { return -a; });
+				break;
+			case Op::Not: Unary(v0, n, [](float a) { return a == 0.0f ? 1.0f : 0.0f; });
+				break;
+			case Op::Abs: Unary(v0, n, [](float a) { return fabsf(a); });
+				break;
+			case Op::Sqrt: Unary(v0, n, [](float a) { return sqrtf(a); });
+				break;
+			case Op::Floor: Unary(v0, n, [](float a) { return floorf(a); });
+				break;
+			case Op::Ceil: Unary(v0, n, [](float a) { return ceilf(a); });
+				break;
+			case Op::Fract: Unary(v0, n, [](float a) { return a - floorf(a); });
+				break;
+			case Op::Exp: Unary(v0, n, [](float a) { return expf(a); });
+				break;
+			case Op::Log: Unary(v0, n, [](float a) { return logf(a); });
+				break;
+			case Op::Sin: Unary(v0, n, [](float a) { return sinf(a); });
+				break;
+			case Op::Cos: Unary(v0, n, [](float a) { return cosf(a); });
+				break;
+			case Op::Saturate: Unary(v0, n, [](float a) { return Sat(a); });
+				break;
+
+			case Op::Add: Binary(v0, v1, n, [](float a, float b) { return a + b; });
+				break;
+			case Op::Sub: Binary(v0, v1, n, [](float a, float b) { return a - b; });
+				break;
+			case Op::Mul: Binary(v0, v1, n, [](float a, float b) { return a * b; });
+				break;
+			case Op::Div: Binary(v0, v1, n, [](float a, float b) { return a / b; });
+				break;
+			case Op::Mod: Binary(v0, v1, n, [](float a, float b) { return a - floorf(a / b) * b; });
+				break;
+			case Op::Pow: Binary(v0, v1, n, [](float a, float b) { return powf(a, b); });
+				break;
+			case Op::Min: Binary(v0, v1, n, [](float a, float b) { return a < b ? a : b; });
+				break;
+			case Op::Max: Binary(v0, v1, n, [](float a, float b) { return a > b ? a : b; });
+				break;
+			case Op::Step: Binary(v0, v1, n, [](float edge, float x) { return x >= edge ? 1.0f : 0.0f; });
+				break;
+			case Op::Lt: Binary(v0, v1, n, [](float a, float b) { return a < b ? 1.0f : 0.0f; });
+				break;
+			case Op::Gt: Binary(v0, v1, n, [](float a, float b) { return a > b ? 1.0f : 0.0f; });
+				break;
+			case Op::Le: Binary(v0, v1, n, [](float a, float b) { return a <= b ? 1.0f : 0.0f; });
+				break;
+			case Op::Ge: Binary(v0, v1, n, [](float a, float b) { return a >= b ? 1.0f : 0.0f; });
+				break;
+			case Op::Eq: Binary(v0, v1, n, [](float a, float b) { return a == b ? 1.0f : 0.0f; });
+				break;
+			case Op::Ne: Binary(v0, v1, n, [](float a, float b) { return a != b ? 1.0f : 0.0f; });
+				break;
+			case Op::And: Binary(v0, v1, n, [](float a, float b) { return (a != 0.0f && b != 0.0f) ? 1.0f : 0.0f; });
+				break;
+			case Op::Or: Binary(v0, v1, n, [](float a, float b) { return (a != 0.0f || b != 0.0f) ? 1.0f : 0.0f; });
+				break;
+
+			case Op::Clamp: Ternary(v0, v1, v2, n, [](float x, float lo, float hi) { return x < lo ? lo : (x > hi ? hi : x); });
+				break;
+			case Op::Mix: Ternary(v0, v1, v2, n, [](float a, float b, float t) { return a + (b - a) * t; });
+				break;
+			case Op::SmoothStep:
+				Ternary(v0, v1, v2, n, [](float e0, float e1, float x) {
+					float const t = Sat((x - e0) / (e1 - e0));
+					return t * t * (3.0f - 2.0f * t);
+				});
+				break;
+			case Op::Select: Ternary(v0, v1, v2, n, [](float c, float a, float b) { return c != 0.0f ? a : b; });
+				break;
+
+			case Op::Store:
+				// outputs are the top inst.a slots in channel order
+				for (uint32_t c = 0; c < inst.a; ++c) {
+					memcpy(scratch.State(c), scratch.Stack(sp - inst.a + c), n * sizeof(float));
+				}
+				sp -= inst.a;
+				continue;
+		}
+		sp = sp - argCount + 1;
+	}
+
+	scratch.Interleave(scratch.State(0), scratch.State(1), scratch.State(2), scratch.State(3));
+	EncodePixelRunF(dst, index, n, scratch.interleaved.data());
+}
+
+void Kernel_Run(Kernel const *kernel,
+								Image_ImageHeader const *dst,
+								Image_ImageHeader const *const *inputs,
+								uint32_t inputCount,
+								uint32_t threadCount) {
+	ASSERT(inputCount >= kernel->maxInput);
+	(void)inputCount; // only checked in debug builds
+	uint32_t const rowsPerPage = dst->height;
+	uint32_t const rowsPerSlice = dst->height * dst->depth;
+	size_t const rowCount = (size_t) rowsPerSlice * dst->slices;
+
+	ParallelFor(rowCount, threadCount, 16, [&](size_t begin, size_t end) {
+		RowScratch scratch(dst->width, kernel->maxDepth, kernel->maxInput);
+		for (size_t row = begin; row < end; ++row) {
+			uint32_t const y = (uint32_t) (row % rowsPerPage);
+			uint32_t const z = (uint32_t) ((row / rowsPerPage) % dst->depth);
+			uint32_t const s = (uint32_t) (row / rowsPerSlice);
+			RunRow(kernel, scratch, dst, inputs, y, z, s);
+		}
+	});
+}
+
+} // end namespace LuaImage
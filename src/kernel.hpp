@@ -0,0 +1,47 @@
+#pragma once
+#ifndef LUA_IMAGE_KERNEL_HPP_
+#define LUA_IMAGE_KERNEL_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include <string>
+#include <vector>
+
+namespace LuaImage {
+
+// A pixel kernel is one or more passes separated by ';' each pass being up to
+// 4 comma separated expressions that replace r, g, b and a in turn.
+// e.g. "r*0.5+g, g, b, 1-a; mix(r, r1, a2)"
+// Variables are
+//   r g b a       the destination pixel (as modified by earlier passes)
+//   rN gN bN aN   pixel from input image N (1 based)
+//   x y z s       pixel coordinate, width height depth slices of the image
+//   pi
+// Functions are abs sqrt floor ceil fract exp log sin cos saturate
+//   min max pow step clamp mix lerp smoothstep select
+// Operators are + - * / % ^ < > <= >= == ~= != and or not ?: with the usual
+// precedence. Comparisons produce 1 or 0.
+// All passes are fused, each row is decoded once, runs every pass then is
+// encoded once.
+struct Kernel;
+
+// returns nullptr and fills error on failure
+Kernel *Kernel_Compile(char const *source, std::string &error);
+// appends all of src's passes to dst so they run fused in the same sweep
+void Kernel_Append(Kernel *dst, Kernel const *src);
+void Kernel_Destroy(Kernel *kernel);
+
+// highest input image index used by the kernel (0 if it only reads r g b a)
+uint32_t Kernel_InputCount(Kernel const *kernel);
+
+// runs the kernel over every pixel in dst. inputs must have the same
+// dimensions as dst and there must be at least Kernel_InputCount of them
+void Kernel_Run(Kernel const *kernel,
+								Image_ImageHeader const *dst,
+								Image_ImageHeader const *const *inputs,
+								uint32_t inputCount,
+								uint32_t threadCount);
+
+} // end namespace LuaImage
+
+#endif
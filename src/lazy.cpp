@@ -0,0 +1,350 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "gfx_image/create.h"
+#include "gfx_image/utils.h"
+#include "tiny_imageformat/tinyimageformat_query.h"
+#include "lazy.hpp"
+#include "blit.hpp"
+#include "decompress.hpp"
+#include "fastconvert.hpp"
+#include "parallel.hpp"
+#include "pixelrows.hpp"
+#include <atomic>
+#include <vector>
+
+namespace LuaImage {
+
+struct LazyNode {
+	~LazyNode();
+
+	// null for sources
+	LazyNodePtr input;
+	PipelineStep step;
+	// sources only, borrowed
+	Image_ImageHeader const *source = nullptr;
+	// owned, null until realised or once every consumer has run
+	Image_ImageHeader const *result = nullptr;
+	// nodes built on this one that haven't run yet
+	uint32_t pending = 0;
+	// set once this node has run from input (or been dropped), so input's
+	// pending count is only ever decremented once for it
+	bool inputDone = false;
+	std::vector<std::weak_ptr<LazyNode>> children;
+};
+
+namespace {
+
+// rows converted per thread at least, a row of each intermediate is cheap
+size_t const MinRowsPerThread = 16;
+
+Image_ImageHeader const *NodeImage(LazyNode const *node) {
+	return node->source ? node->source : node->result;
+}
+
+bool SameStep(PipelineStep const &a, PipelineStep const &b) {
+	if (a.op != b.op || a.format != b.format) return false;
+	switch (a.op) {
+		case PipelineOp::Convert:
+		case PipelineOp::Decompress:
+			return true;
+		case PipelineOp::Resize:
+			return a.width == b.width && a.height == b.height &&
+					a.resize.filter == b.resize.filter && a.resize.srgb == b.resize.srgb;
+		case PipelineOp::Mips:
+			if (a.libraryMips || b.libraryMips) {
+				return a.libraryMips == b.libraryMips && a.libraryMipsFromImage == b.libraryMipsFromImage;
+			}
+			return a.mips.filter == b.mips.filter && a.mips.srgb == b.mips.srgb &&
+					a.mips.alphaCoverage == b.mips.alphaCoverage && a.mips.cubeSeams == b.mips.cubeSeams;
+		case PipelineOp::Compress:
+			return a.bc == b.bc &&
+					a.compress.quality == b.compress.quality &&
+					a.compress.useAlpha == b.compress.useAlpha &&
+					a.compress.alphaThreshold == b.compress.alphaThreshold &&
+					a.compress.adaptiveWeighting == b.compress.adaptiveWeighting &&
+					a.compress.useChannelWeighting == b.compress.useChannelWeighting &&
+					a.compress.channelWeights[0] == b.compress.channelWeights[0] &&
+					a.compress.channelWeights[1] == b.compress.channelWeights[1] &&
+					a.compress.channelWeights[2] == b.compress.channelWeights[2];
+		case PipelineOp::CompressAuto:
+			// candidate lists aren't worth comparing, never shared
+			return false;
+	}
+	return false;
+}
+
+// node has finished with its input's result, frees it if nothing else needs it
+void InputDone(LazyNode *node) {
+	auto const input = node->input.get();
+	if (!input || node->inputDone) return;
+	node->inputDone = true;
+	input->pending--;
+	if (input->pending == 0 && input->result) {
+		Image_Destroy(input->result);
+		input->result = nullptr;
+	}
+}
+
+// image to run an in place step on, input's own result if node is the last
+// thing that needs it otherwise a copy
+Image_ImageHeader const *OwnInput(LazyNode *node) {
+	auto const input = node->input.get();
+	if (!input->source && input->pending == 1 && !node->inputDone) {
+		auto const image = input->result;
+		input->result = nullptr;
+		InputDone(node);
+		return image;
+	}
+	auto const copy = CloneChain(NodeImage(input));
+	InputDone(node);
+	return copy;
+}
+
+// converts every level of image through each of formats in turn a row at a
+// time, so each row is quantised exactly as separate conversions would but
+// no intermediate image is made. nullptr if a format has no pixel runs or
+// an allocation fails
+Image_ImageHeader const *ConvertThrough(Image_ImageHeader const *image,
+																				std::vector<TinyImageFormat> const &formats,
+																				uint32_t threadCount) {
+	if (!CanAccessPixelRuns(image->format)) return nullptr;
+	for (auto const format : formats) {
+		if (!CanAccessPixelRuns(format)) return nullptr;
+	}
+	TinyImageFormat const format = formats.back();
+
+	Image_ImageHeader *first = nullptr;
+	Image_ImageHeader *previous = nullptr;
+	for (size_t i = 0; i < Image_LinkedImageCountOf(image); ++i) {
+		auto const level = Image_LinkedImageOf(image, i);
+		auto const converted = (Image_ImageHeader *) Image_CreateNoClear(level->width, level->height, level->depth,
+																																		 level->slices, format);
+		if (!converted) {
+			if (first) Image_Destroy(first);
+			return nullptr;
+		}
+		converted->flags = level->flags;
+		if (previous) {
+			previous->nextType = Image_LinkedImageOf(image, i - 1)->nextType;
+			previous->nextImage = converted;
+		} else {
+			first = converted;
+		}
+		previous = converted;
+
+		std::atomic<bool> failed{false};
+		uint32_t const width = level->width;
+		size_t const rows = (size_t) level->height * level->depth * level->slices;
+		ParallelFor(rows, threadCount, MinRowsPerThread, [&](size_t begin, size_t end) {
+			// a row of each intermediate format to round trip through
+			std::vector<Image_ImageHeader const *> scratch;
+			for (size_t f = 0; f + 1 < formats.size(); ++f) {
+				auto const intermediate = Image_CreateNoClear(width, 1, 1, 1, formats[f]);
+				if (!intermediate) {
+					for (auto const made : scratch) {
+						Image_Destroy(made);
+					}
+					failed = true;
+					return;
+				}
+				scratch.push_back(intermediate);
+			}
+			std::vector<double> row((size_t) width * 4);
+			for (size_t r = begin; r < end; ++r) {
+				uint32_t const y = (uint32_t) (r % level->height);
+				uint32_t const z = (uint32_t) ((r / level->height) % level->depth);
+				uint32_t const s = (uint32_t) (r / ((size_t) level->height * level->depth));
+				DecodePixelRunD(level, Image_CalculateIndex(level, 0, y, z, s), width, row.data());
+				for (auto const intermediate : scratch) {
+					EncodePixelRunD(intermediate, 0, width, row.data());
+					DecodePixelRunD(intermediate, 0, width, row.data());
+				}
+				EncodePixelRunD(converted, Image_CalculateIndex(converted, 0, y, z, s), width, row.data());
+			}
+			for (auto const intermediate : scratch) {
+				Image_Destroy(intermediate);
+			}
+		});
+		if (failed) {
+			Image_Destroy(first);
+			return nullptr;
+		}
+	}
+	return first;
+}
+
+bool Realize(LazyNode *node, uint32_t threadCount, char const *&error);
+
+// realises a run of conversions ending at node in one pass
+bool RealizeConvert(LazyNode *node, uint32_t threadCount, char const *&error) {
+	// walk back over conversions nothing else needs the result of
+	std::vector<LazyNode *> run{node};
+	while (true) {
+		auto const input = run.back()->input.get();
+		if (input->source || input->result) break;
+		if (input->step.op != PipelineOp::Convert || input->pending != 1) break;
+		run.push_back(input);
+	}
+	auto const base = run.back()->input.get();
+	if (!Realize(base, threadCount, error)) return false;
+
+	// the formats to convert through in order, repeats are no-ops
+	std::vector<TinyImageFormat> formats;
+	for (auto it = run.rbegin(); it != run.rend(); ++it) {
+		if (formats.empty() || formats.back() != (*it)->step.format) formats.push_back((*it)->step.format);
+	}
+
+	auto const image = NodeImage(base);
+	if (formats.size() == 1) {
+		FastConvertOptions fast;
+		fast.exactOnly = true;
+		fast.threadCount = threadCount;
+		node->result = FastConvert(image, formats[0], fast);
+	}
+	if (!node->result) node->result = ConvertThrough(image, formats, threadCount);
+	if (!node->result) {
+		// a format without pixel runs (compressed), one conversion at a time
+		Image_ImageHeader const *current = image;
+		for (auto const format : formats) {
+			auto const converted = Image_PreciseConvert(current, format);
+			if (current != image) Image_Destroy(current);
+			current = converted;
+			if (!current) break;
+		}
+		node->result = current;
+	}
+	for (auto it = run.rbegin(); it != run.rend(); ++it) {
+		InputDone(*it);
+	}
+	error = "convert failed";
+	return node->result != nullptr;
+}
+
+bool Realize(LazyNode *node, uint32_t threadCount, char const *&error) {
+	if (NodeImage(node)) return true;
+	if (node->step.op == PipelineOp::Convert) return RealizeConvert(node, threadCount, error);
+
+	auto const input = node->input.get();
+	if (!Realize(input, threadCount, error)) return false;
+	auto const image = NodeImage(input);
+
+	switch (node->step.op) {
+		case PipelineOp::Convert:
+			break;
+		case PipelineOp::Resize: {
+			ResizeOptions resize = node->step.resize;
+			resize.threadCount = threadCount;
+			node->result = Resample_Resize(image, node->step.width, node->step.height, image->depth, resize);
+			InputDone(node);
+			error = "resize failed";
+			break;
+		}
+		case PipelineOp::Mips: {
+			MipOptions mips = node->step.mips;
+			mips.threadCount = threadCount;
+			auto const owned = OwnInput(node);
+			if (owned && node->step.libraryMips) {
+				Image_CreateMipMapChain(owned, node->step.libraryMipsFromImage);
+				node->result = owned;
+			} else if (owned && !GenerateMipMaps(owned, mips)) {
+				Image_Destroy(owned);
+			} else {
+				node->result = owned;
+			}
+			error = "mip generation failed";
+			break;
+		}
+		case PipelineOp::Compress: {
+			CompressOptions compress = node->step.compress;
+			compress.threadCount = threadCount;
+			node->result = CompressAMD(image, node->step.bc, compress);
+			InputDone(node);
+			error = "compress failed";
+			break;
+		}
+		case PipelineOp::CompressAuto: {
+			AutoCompressOptions autoCompress = node->step.autoCompress;
+			autoCompress.compress.threadCount = threadCount;
+			AutoCompressResult autoResult;
+			if (CompressAuto(image, autoCompress, autoResult)) {
+				node->result = autoResult.image;
+			} else if (autoResult.image) {
+				Image_Destroy(autoResult.image);
+			}
+			InputDone(node);
+			error = "compressAuto failed";
+			break;
+		}
+		case PipelineOp::Decompress: {
+			if (TinyImageFormat_IsCompressed(image->format)) {
+				DecompressOptions decompress;
+				decompress.format = node->step.format;
+				decompress.threadCount = threadCount;
+				node->result = Decompress(image, decompress);
+				InputDone(node);
+			} else {
+				node->result = OwnInput(node);
+			}
+			error = "decompress failed";
+			break;
+		}
+	}
+	return node->result != nullptr;
+}
+
+} // end anonymous namespace
+
+LazyNode::~LazyNode() {
+	// a node dropped before it ran no longer holds its input's result
+	InputDone(this);
+	if (result) Image_Destroy(result);
+}
+
+LazyNodePtr Lazy_Source(Image_ImageHeader const *image) {
+	auto node = std::make_shared<LazyNode>();
+	node->source = image;
+	return node;
+}
+
+LazyNodePtr Lazy_Apply(LazyNodePtr const &input, PipelineStep const &step) {
+	auto &children = input->children;
+	for (size_t i = 0; i < children.size();) {
+		auto child = children[i].lock();
+		if (!child) {
+			children.erase(children.begin() + i);
+			continue;
+		}
+		if (SameStep(child->step, step)) return child;
+		++i;
+	}
+
+	auto node = std::make_shared<LazyNode>();
+	node->input = input;
+	node->step = step;
+	input->pending++;
+	children.push_back(node);
+	return node;
+}
+
+bool Lazy_IsSource(LazyNodePtr const &node) {
+	return node->source != nullptr;
+}
+
+bool Lazy_Realize(LazyNodePtr const &node, uint32_t threadCount, char const *&error) {
+	error = nullptr;
+	return Realize(node.get(), threadCount, error);
+}
+
+size_t Lazy_ResultBytes(LazyNodePtr const &node) {
+	return node->result ? Image_ByteCountOfImageChainOf(node->result) : 0;
+}
+
+Image_ImageHeader const *Lazy_Take(LazyNodePtr const &node) {
+	if (!node->result) return nullptr;
+	if (node->pending != 0) return CloneChain(node->result);
+	auto const image = node->result;
+	node->result = nullptr;
+	return image;
+}
+
+} // end namespace LuaImage
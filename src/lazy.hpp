@@ -0,0 +1,45 @@
+#pragma once
+#ifndef LUA_IMAGE_LAZY_HPP_
+#define LUA_IMAGE_LAZY_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "pipeline.hpp"
+#include <memory>
+
+namespace LuaImage {
+
+// A deferred operation graph. Steps (see PipelineStep) applied to a node
+// only record a new node, nothing runs until a node is realised. Then
+// - a run of conversions becomes one pass over each row, converting through
+//   every intermediate format on a row at a time rather than whole images
+// - the same step applied twice to one node gives the same node, so shared
+//   subexpressions run once
+// - a result is kept only until every node built on it has run, in place
+//   steps (mips) take over their input's result when nothing else needs it
+// Single threaded use only, each step is threaded on its own
+struct LazyNode;
+typedef std::shared_ptr<LazyNode> LazyNodePtr;
+
+// image is borrowed and must not change or go away while the graph is alive
+LazyNodePtr Lazy_Source(Image_ImageHeader const *image);
+
+// the node for step applied to input
+LazyNodePtr Lazy_Apply(LazyNodePtr const &input, PipelineStep const &step);
+
+bool Lazy_IsSource(LazyNodePtr const &node);
+
+// runs whatever the node still needs, false with error set if a step failed
+bool Lazy_Realize(LazyNodePtr const &node, uint32_t threadCount, char const *&error);
+
+// bytes of a realised (non source) node's result, 0 if there isn't one
+size_t Lazy_ResultBytes(LazyNodePtr const &node);
+
+// a realised (non source) node's result for the caller to own. Moved out if
+// no other node still needs it, otherwise a copy, so taking a result other
+// nodes still need briefly holds it twice. Realise those first to avoid it
+Image_ImageHeader const *Lazy_Take(LazyNodePtr const &node);
+
+} // end namespace LuaImage
+
+#endif
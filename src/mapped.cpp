@@ -0,0 +1,131 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "gfx_image/create.h"
+#include "containers.hpp"
+#include "mapped.hpp"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace LuaImage {
+
+#if defined(_WIN32)
+
+bool MappedFile_Open(char const *filename, MappedFile &file) {
+	file.base = nullptr;
+	file.size = 0;
+
+	HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+															OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(handle, &size) || size.QuadPart == 0) {
+		CloseHandle(handle);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+	CloseHandle(handle);
+	if (!mapping) return false;
+
+	// the view keeps the mapping object alive
+	file.base = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+	CloseHandle(mapping);
+	if (!file.base) return false;
+
+	file.size = (size_t) size.QuadPart;
+	return true;
+}
+
+void MappedFile_Close(MappedFile &file) {
+	if (file.base) UnmapViewOfFile(file.base);
+	file.base = nullptr;
+	file.size = 0;
+}
+
+#else
+
+bool MappedFile_Open(char const *filename, MappedFile &file) {
+	file.base = nullptr;
+	file.size = 0;
+
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+
+	void *base = mmap(nullptr, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) return false;
+
+	file.base = base;
+	file.size = (size_t) st.st_size;
+	return true;
+}
+
+void MappedFile_Close(MappedFile &file) {
+	if (file.base) munmap(file.base, file.size);
+	file.base = nullptr;
+	file.size = 0;
+}
+
+#endif
+
+Image_ImageHeader const *Mapped_Load(char const *filename, MappedFile &file) {
+	if (!MappedFile_Open(filename, file)) return nullptr;
+
+	ContainerInfo info;
+	if (!Container_Parse(file.base, file.size, info) || !info.topLevelContiguous ||
+			info.dataOffset < sizeof(Image_ImageHeader)) {
+		MappedFile_Close(file);
+		return nullptr;
+	}
+
+	// the header must be properly aligned where it lands, i.e. a DX10 DDS
+	// header leaves the payload 4 bytes off
+	size_t const headerOffset = info.dataOffset - sizeof(Image_ImageHeader);
+	if ((headerOffset % alignof(Image_ImageHeader)) != 0) {
+		MappedFile_Close(file);
+		return nullptr;
+	}
+
+	// let the library fill in the header, then move it next to the pixels
+	auto const proto = Image_CreateHeaderOnly(info.width, info.height, info.depth, info.slices, info.format);
+	if (!proto) {
+		MappedFile_Close(file);
+		return nullptr;
+	}
+	auto image = (Image_ImageHeader *) (((uint8_t *) file.base) + headerOffset);
+	memcpy(image, proto, sizeof(Image_ImageHeader));
+	Image_Destroy(proto);
+	image->flags = info.flags;
+	image->nextType = Image_NT_None;
+	image->nextImage = nullptr;
+
+	if (Image_RawDataPtr(image) != ((uint8_t *) file.base) + info.dataOffset ||
+			Image_ByteCountOf(image) != info.dataSize) {
+		MappedFile_Close(file);
+		return nullptr;
+	}
+	return image;
+}
+
+void Mapped_Release(Image_ImageHeader const *image, MappedFile &file) {
+	// only the top level lives in the mapping
+	if (image && image->nextImage) Image_Destroy(image->nextImage);
+	MappedFile_Close(file);
+}
+
+} // end namespace LuaImage
@@ -0,0 +1,31 @@
+#pragma once
+#ifndef LUA_IMAGE_MAPPED_HPP_
+#define LUA_IMAGE_MAPPED_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+
+namespace LuaImage {
+
+// A private copy-on-write mapping of a whole file. Writes through it touch
+// only our copy of the written pages, never the file
+struct MappedFile {
+	void *base;
+	size_t size;
+};
+
+bool MappedFile_Open(char const *filename, MappedFile &file);
+void MappedFile_Close(MappedFile &file);
+
+// maps a DDS or KTX file and returns an image whose pixels are the file's
+// pages, its header is written into the mapping just in front of them.
+// nullptr (and nothing left mapped) if the file's layout doesn't allow it,
+// otherwise the image must be released with Mapped_Release not Image_Destroy
+Image_ImageHeader const *Mapped_Load(char const *filename, MappedFile &file);
+
+// frees anything linked onto a mapped image (e.g. mip maps) and unmaps it
+void Mapped_Release(Image_ImageHeader const *image, MappedFile &file);
+
+} // end namespace LuaImage
+
+#endif
@@ -0,0 +1,195 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "gfx_image/utils.h"
+#include "tiny_imageformat/tinyimageformat_query.h"
+#include "mips.hpp"
+#include "pixelrows.hpp"
+#include <cmath>
+#include <vector>
+
+namespace LuaImage {
+
+namespace {
+
+inline uint32_t Clamp(int32_t i, uint32_t size) {
+	return i < 0 ? 0 : ((uint32_t) i >= size ? size - 1 : (uint32_t) i);
+}
+
+// direction through texel coordinates u, v (-1 to 1) of a cube face in
+// +X -X +Y -Y +Z -Z order
+void CubeDirection(uint32_t face, float u, float v, float dir[3]) {
+	switch (face) {
+		case 0: dir[0] = 1.0f; dir[1] = -v; dir[2] = -u; break;
+		case 1: dir[0] = -1.0f; dir[1] = -v; dir[2] = u; break;
+		case 2: dir[0] = u; dir[1] = 1.0f; dir[2] = v; break;
+		case 3: dir[0] = u; dir[1] = -1.0f; dir[2] = -v; break;
+		case 4: dir[0] = u; dir[1] = -v; dir[2] = 1.0f; break;
+		default: dir[0] = -u; dir[1] = -v; dir[2] = -1.0f; break;
+	}
+}
+
+void CubeFaceCoords(uint32_t face, float const dir[3], float &u, float &v) {
+	float const m = fabsf(dir[face / 2]);
+	switch (face) {
+		case 0: u = -dir[2] / m; v = -dir[1] / m; break;
+		case 1: u = dir[2] / m; v = -dir[1] / m; break;
+		case 2: u = dir[0] / m; v = dir[2] / m; break;
+		case 3: u = dir[0] / m; v = -dir[2] / m; break;
+		case 4: u = dir[0] / m; v = -dir[1] / m; break;
+		default: u = -dir[0] / m; v = -dir[1] / m; break;
+	}
+}
+
+// the texel on the next face over, across edge (0 left, 1 right, 2 top, 3 bottom)
+size_t CubeNeighbour(uint32_t face, uint32_t size, uint32_t x, uint32_t y, int edge) {
+	float u = ((2.0f * (x + 0.5f)) / size) - 1.0f;
+	float v = ((2.0f * (y + 0.5f)) / size) - 1.0f;
+	if (edge == 0) u = -1.0f;
+	if (edge == 1) u = 1.0f;
+	if (edge == 2) v = -1.0f;
+	if (edge == 3) v = 1.0f;
+
+	float dir[3];
+	CubeDirection(face, u, v, dir);
+
+	// on the edge the other face's axis is as long as this face's
+	uint32_t axis = (face / 2 + 1) % 3;
+	uint32_t const other = (face / 2 + 2) % 3;
+	if (fabsf(dir[other]) > fabsf(dir[axis])) axis = other;
+	uint32_t const neighbour = (axis * 2) + (dir[axis] < 0.0f ? 1 : 0);
+
+	float nu, nv;
+	CubeFaceCoords(neighbour, dir, nu, nv);
+	uint32_t const nx = Clamp((int32_t) floorf(((nu + 1.0f) * 0.5f) * size), size);
+	uint32_t const ny = Clamp((int32_t) floorf(((nv + 1.0f) * 0.5f) * size), size);
+	return ((size_t) neighbour * size * size) + ((size_t) ny * size) + nx;
+}
+
+// averages every edge texel with the texels touching it on neighbouring faces
+void FixCubeSeams(ResamplePlane &plane, ResampleShape const &shape) {
+	uint32_t const size = shape.width;
+	size_t const faceTexels = (size_t) size * size;
+
+	struct Fix {
+		size_t index;
+		float value[4];
+	};
+	std::vector<Fix> fixes;
+	for (uint32_t cube = 0; cube < shape.slices / 6; ++cube) {
+		float *texels = plane.data() + ((size_t) cube * 6 * faceTexels * 4);
+		fixes.clear();
+		for (uint32_t face = 0; face < 6; ++face) {
+			for (uint32_t y = 0; y < size; ++y) {
+				for (uint32_t x = 0; x < size; ++x) {
+					bool const edges[4] = {x == 0, x == size - 1, y == 0, y == size - 1};
+					if (!edges[0] && !edges[1] && !edges[2] && !edges[3]) continue;
+
+					size_t const index = (face * faceTexels) + ((size_t) y * size) + x;
+					Fix fix{index, {0, 0, 0, 0}};
+					uint32_t count = 0;
+					auto const add = [&](size_t i) {
+						for (int c = 0; c < 4; ++c) {
+							fix.value[c] += texels[(i * 4) + c];
+						}
+						count++;
+					};
+					add(index);
+					for (int edge = 0; edge < 4; ++edge) {
+						if (edges[edge]) add(CubeNeighbour(face, size, x, y, edge));
+					}
+					for (float &value : fix.value) {
+						value /= (float) count;
+					}
+					fixes.push_back(fix);
+				}
+			}
+		}
+		for (auto const &fix : fixes) {
+			memcpy(texels + (fix.index * 4), fix.value, sizeof(fix.value));
+		}
+	}
+}
+
+float AlphaCoverage(float const *pixels, size_t count, float reference, float scale) {
+	size_t covered = 0;
+	for (size_t i = 0; i < count; ++i) {
+		float const alpha = pixels[(i * 4) + 3] * scale;
+		covered += alpha > reference ? 1 : 0;
+	}
+	return count ? (float) covered / (float) count : 0.0f;
+}
+
+// alpha scale that gives this level the target coverage
+float AlphaCoverageScale(float const *pixels, size_t count, float reference, float target) {
+	// coverage with threshold t is monotonic so binary search the threshold
+	// that hits the target then scale alpha so that threshold maps to reference
+	float lo = 0.0f;
+	float hi = 1.0f;
+	float threshold = reference;
+	for (int i = 0; i < 16; ++i) {
+		threshold = (lo + hi) * 0.5f;
+		float const coverage = AlphaCoverage(pixels, count, threshold, 1.0f);
+		if (coverage > target) {
+			lo = threshold;
+		} else {
+			hi = threshold;
+		}
+	}
+	return threshold > 0.0f ? reference / threshold : 1.0f;
+}
+
+} // end anonymous namespace
+
+bool GenerateMipMaps(Image_ImageHeader const *image, MipOptions const &options) {
+	if (!image || !CanAccessPixelRuns(image->format)) return false;
+
+	if (image->nextImage == nullptr) {
+		Image_CreateMipMapChain(image, false);
+	}
+	if (image->nextType != Image_NT_MipMap) return false;
+
+	uint32_t const threads = options.threadCount;
+	bool const srgb = options.srgb && !TinyImageFormat_IsSRGB(image->format);
+	bool const cube = options.cubeSeams && Image_IsCubemap(image) &&
+			image->width == image->height && (image->slices % 6) == 0;
+	bool const coverage = options.alphaCoverage >= 0.0f;
+
+	ResamplePlane current;
+	Resample_Decode(image, current, srgb, threads);
+	ResampleShape shape{image->width, image->height, image->depth, image->slices};
+
+	std::vector<float> targetCoverage;
+	if (coverage) {
+		size_t const slicePixels = (size_t) shape.width * shape.height * shape.depth;
+		for (uint32_t s = 0; s < shape.slices; ++s) {
+			targetCoverage.push_back(AlphaCoverage(current.data() + (s * slicePixels * 4), slicePixels,
+																						 options.alphaCoverage, 1.0f));
+		}
+	}
+
+	size_t const levelCount = Image_LinkedImageCountOf(image);
+	for (size_t i = 1; i < levelCount; ++i) {
+		auto const level = Image_LinkedImageOf(image, i);
+		if (!level || level->format != image->format || level->slices != shape.slices) return false;
+
+		Resample_Plane(current, shape, level->width, level->height, level->depth, options.filter, threads);
+
+		if (cube && shape.depth == 1) FixCubeSeams(current, shape);
+
+		std::vector<float> alphaScales;
+		if (coverage) {
+			size_t const slicePixels = (size_t) shape.width * shape.height * shape.depth;
+			for (uint32_t s = 0; s < shape.slices; ++s) {
+				alphaScales.push_back(AlphaCoverageScale(current.data() + (s * slicePixels * 4), slicePixels,
+																								 options.alphaCoverage, targetCoverage[s]));
+			}
+		}
+
+		// the next level is filtered from this one before alpha scaling and
+		// quantisation so errors don't build up down the chain
+		Resample_Encode(current, level, srgb, alphaScales, threads);
+	}
+	return true;
+}
+
+} // end namespace LuaImage
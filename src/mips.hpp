@@ -0,0 +1,32 @@
+#pragma once
+#ifndef LUA_IMAGE_MIPS_HPP_
+#define LUA_IMAGE_MIPS_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "resample.hpp"
+
+namespace LuaImage {
+
+struct MipOptions {
+	ResampleFilter filter = ResampleFilter::Box;
+	// filter colour in linear space for formats holding sRGB data that
+	// aren't _SRGB formats (those are linearised by the codec already)
+	bool srgb = false;
+	// if >= 0 scale each level's alpha so the fraction of pixels with alpha
+	// above this matches the top level (for alpha tested foliage etc.)
+	float alphaCoverage = -1.0f;
+	// average texels along cube face edges so every level is seamless
+	bool cubeSeams = false;
+	uint32_t threadCount = 0; // 0 = all hardware threads
+};
+
+// creates the mip chain of image if it doesn't have one and fills every
+// level from the top level. Each level is resampled (see Resample_Plane)
+// from the previous unquantised level. false if the format can't be
+// filtered this way
+bool GenerateMipMaps(Image_ImageHeader const *image, MipOptions const &options);
+
+} // end namespace LuaImage
+
+#endif
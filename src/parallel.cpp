@@ -0,0 +1,45 @@
+#include "al2o3_platform/platform.h"
+#include "parallel.hpp"
+#include <thread>
+#include <vector>
+
+namespace LuaImage {
+
+uint32_t HardwareThreadCount() {
+	uint32_t const count = std::thread::hardware_concurrency();
+	return count ? count : 1;
+}
+
+void ParallelFor(size_t count,
+								 uint32_t threadCount,
+								 size_t minPerThread,
+								 std::function<void(size_t begin, size_t end)> const &func) {
+	if (count == 0) return;
+
+	if (threadCount == 0) threadCount = HardwareThreadCount();
+	if (minPerThread == 0) minPerThread = 1;
+
+	size_t chunks = count / minPerThread;
+	if (chunks > threadCount) chunks = threadCount;
+	if (chunks <= 1) {
+		func(0, count);
+		return;
+	}
+
+	size_t const perChunk = (count + chunks - 1) / chunks;
+
+	// the calling thread does the first range itself
+	std::vector<std::thread> threads;
+	threads.reserve(chunks - 1);
+	for (size_t begin = perChunk; begin < count; begin += perChunk) {
+		size_t const end = (begin + perChunk) < count ? (begin + perChunk) : count;
+		threads.emplace_back([&func, begin, end]() { func(begin, end); });
+	}
+	func(0, perChunk);
+
+	for (auto &thread : threads) {
+		thread.join();
+	}
+}
+
+} // end namespace LuaImage
@@ -0,0 +1,23 @@
+#pragma once
+#ifndef LUA_IMAGE_PARALLEL_HPP_
+#define LUA_IMAGE_PARALLEL_HPP_
+
+#include "al2o3_platform/platform.h"
+#include <functional>
+
+namespace LuaImage {
+
+// number of hardware threads, never less than 1
+uint32_t HardwareThreadCount();
+
+// splits [0, count) into contiguous ranges and calls func(begin, end) for each
+// on up to threadCount threads (0 = all hardware threads), returning when all
+// ranges are done. Ranges are never smaller than minPerThread items
+void ParallelFor(size_t count,
+								 uint32_t threadCount,
+								 size_t minPerThread,
+								 std::function<void(size_t begin, size_t end)> const &func);
+
+} // end namespace LuaImage
+
+#endif
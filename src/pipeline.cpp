@@ -0,0 +1,449 @@
+#include "al2o3_platform/platform.h"
+#include "al2o3_vfile/vfile.hpp"
+#include "gfx_image/image.h"
+#include "gfx_image/utils.h"
+#include "gfx_imageio/io.h"
+#include "pipeline.hpp"
+#include "blit.hpp"
+#include "decompress.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <thread>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+namespace LuaImage {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double SecondsSince(Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+struct Item {
+	~Item() {
+		if (image) Image_Destroy(image);
+	}
+
+	size_t index = 0;
+	std::vector<uint8_t> bytes;
+	Image_ImageHeader const *image = nullptr;
+};
+
+// blocks pushers while full and poppers while empty until closed
+template<typename T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t capacity) : capacity(capacity ? capacity : 1) {}
+
+	void Push(T &&value) {
+		std::unique_lock<std::mutex> lock(mutex);
+		notFull.wait(lock, [this]() { return items.size() < capacity; });
+		items.push_back(std::move(value));
+		notEmpty.notify_one();
+	}
+
+	// false once closed and drained
+	bool Pop(T &value) {
+		std::unique_lock<std::mutex> lock(mutex);
+		notEmpty.wait(lock, [this]() { return closed || !items.empty(); });
+		if (items.empty()) return false;
+		value = std::move(items.front());
+		items.pop_front();
+		notFull.notify_one();
+		return true;
+	}
+
+	void Close() {
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		notEmpty.notify_all();
+	}
+
+private:
+	size_t const capacity;
+	std::mutex mutex;
+	std::condition_variable notFull;
+	std::condition_variable notEmpty;
+	std::deque<T> items;
+	bool closed = false;
+};
+
+typedef std::unique_ptr<Item> ItemPtr;
+typedef BoundedQueue<ItemPtr> ItemQueue;
+
+bool Match(char const *pattern, char const *name) {
+	if (*pattern == 0) return *name == 0;
+	if (*pattern == '*') {
+		for (char const *n = name;; ++n) {
+			if (Match(pattern + 1, n)) return true;
+			if (*n == 0) return false;
+		}
+	}
+	if (*name == 0) return false;
+	return (*pattern == '?' || *pattern == *name) && Match(pattern + 1, name + 1);
+}
+
+bool ListDirectory(std::string const &directory, std::vector<std::string> &names) {
+#if defined(_WIN32)
+	WIN32_FIND_DATAA data;
+	HANDLE find = FindFirstFileA((directory + "/*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE) return false;
+	do {
+		if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) names.emplace_back(data.cFileName);
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+#else
+	DIR *dir = opendir(directory.c_str());
+	if (!dir) return false;
+	while (struct dirent *ent = readdir(dir)) {
+		if (ent->d_type == DT_DIR || strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) continue;
+		names.emplace_back(ent->d_name);
+	}
+	closedir(dir);
+#endif
+	return true;
+}
+
+// splits a path into directory (no trailing separator), name and extension
+void SplitPath(std::string const &path, std::string &dir, std::string &name, std::string &ext) {
+	size_t const slash = path.find_last_of("/\\");
+	dir = slash == std::string::npos ? "." : path.substr(0, slash);
+	std::string const file = slash == std::string::npos ? path : path.substr(slash + 1);
+	size_t const dot = file.find_last_of('.');
+	name = dot == std::string::npos ? file : file.substr(0, dot);
+	ext = dot == std::string::npos ? "" : file.substr(dot + 1);
+}
+
+// a temporary name next to path no other writer uses
+std::string TempPathOf(std::string const &path) {
+	static std::atomic<uint64_t> counter{0};
+#if defined(_WIN32)
+	unsigned long const pid = (unsigned long) GetCurrentProcessId();
+#else
+	unsigned long const pid = (unsigned long) getpid();
+#endif
+	char suffix[64];
+	snprintf(suffix, sizeof(suffix), ".%lu-%llu.tmp", pid, (unsigned long long) counter++);
+	return path + suffix;
+}
+
+bool MoveOver(std::string const &temp, std::string const &path) {
+#if defined(_WIN32)
+	return MoveFileExA(temp.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(temp.c_str(), path.c_str()) == 0;
+#endif
+}
+
+// runs one step, returns the image to carry on with (which may be image
+// itself) or nullptr with error set. image is consumed either way
+Image_ImageHeader const *RunStep(Image_ImageHeader const *image, PipelineStep const &step, char const *&error) {
+	Image_ImageHeader const *result = nullptr;
+	switch (step.op) {
+		case PipelineOp::Convert:
+			result = image->format == step.format ? image : ConvertChain(image, step.format, 1);
+			error = "convert failed";
+			break;
+		case PipelineOp::Resize: {
+			ResizeOptions resize = step.resize;
+			resize.threadCount = 1;
+			result = Resample_Resize(image, step.width, step.height, image->depth, resize);
+			error = "resize failed";
+			break;
+		}
+		case PipelineOp::Mips: {
+			MipOptions mips = step.mips;
+			mips.threadCount = 1;
+			if (step.libraryMips) {
+				Image_CreateMipMapChain(image, step.libraryMipsFromImage);
+				result = image;
+			} else {
+				result = GenerateMipMaps(image, mips) ? image : nullptr;
+			}
+			error = "mip generation failed";
+			break;
+		}
+		case PipelineOp::Compress: {
+			CompressOptions compress = step.compress;
+			compress.threadCount = 1;
+			result = CompressAMD(image, step.bc, compress);
+			error = "compress failed";
+			break;
+		}
+		case PipelineOp::CompressAuto: {
+			AutoCompressOptions autoCompress = step.autoCompress;
+			autoCompress.compress.threadCount = 1;
+			AutoCompressResult autoResult;
+			result = CompressAuto(image, autoCompress, autoResult) ? autoResult.image : nullptr;
+			if (!result && autoResult.image) Image_Destroy(autoResult.image);
+			error = "compressAuto failed";
+			break;
+		}
+		case PipelineOp::Decompress: {
+			DecompressOptions decompress;
+			decompress.format = step.format;
+			decompress.threadCount = 1;
+			result = TinyImageFormat_IsCompressed(image->format) ? Decompress(image, decompress) : image;
+			error = "decompress failed";
+			break;
+		}
+	}
+	if (result != image) Image_Destroy(image);
+	return result;
+}
+
+class Pipeline {
+public:
+	Pipeline(std::vector<std::string> const &inputs, PipelineOptions const &options, PipelineStats &stats) :
+			inputs(inputs), options(options), stats(stats),
+			decodeQueue(options.queueDepth), processQueue(options.queueDepth), writeQueue(options.queueDepth) {}
+
+	void Run() {
+		uint32_t const ioThreads = options.ioThreads ? options.ioThreads : 1;
+		uint32_t const cpuThreads = options.processThreads ? options.processThreads : HardwareThreadCount();
+		uint32_t const workers[PipelineStage_Count] = {ioThreads, cpuThreads, cpuThreads, ioThreads};
+
+		auto const start = Clock::now();
+		FindOutputs();
+
+		std::vector<std::thread> threads;
+		for (int stage = 0; stage < PipelineStage_Count; ++stage) {
+			stats.stages[stage] = PipelineStageStats{0, 0, 0.0, 0.0, workers[stage]};
+			remaining[stage] = workers[stage];
+			for (uint32_t i = 0; i < workers[stage]; ++i) {
+				threads.emplace_back([this, stage]() { Worker((PipelineStage) stage); });
+			}
+		}
+		for (auto &thread : threads) thread.join();
+
+		stats.seconds = SecondsSince(start);
+		stats.processed = stats.stages[PipelineStage_Write].items;
+	}
+
+private:
+	void Worker(PipelineStage stage) {
+		PipelineStageStats local{0, 0, 0.0, 0.0, 0};
+		switch (stage) {
+			case PipelineStage_Read: ReadWorker(local); break;
+			case PipelineStage_Decode: Stage(local, stage, decodeQueue, &processQueue); break;
+			case PipelineStage_Process: Stage(local, stage, processQueue, &writeQueue); break;
+			case PipelineStage_Write: Stage(local, stage, writeQueue, nullptr); break;
+			default: break;
+		}
+
+		std::lock_guard<std::mutex> lock(statsMutex);
+		auto &total = stats.stages[stage];
+		total.items += local.items;
+		total.bytes += local.bytes;
+		total.busySeconds += local.busySeconds;
+		total.waitSeconds += local.waitSeconds;
+
+		// the last worker out closes the stage's output
+		if (--remaining[stage] == 0) {
+			if (stage == PipelineStage_Read) decodeQueue.Close();
+			if (stage == PipelineStage_Decode) processQueue.Close();
+			if (stage == PipelineStage_Process) writeQueue.Close();
+		}
+	}
+
+	// inputs sharing an output path would overwrite each other, so none
+	// of them are run
+	void FindOutputs() {
+		outputs.clear();
+		std::unordered_map<std::string, size_t> users;
+		for (auto const &input : inputs) {
+			outputs.push_back(Pipeline_OutputPath(options.output, input));
+			users[outputs.back()]++;
+		}
+		clashes.assign(inputs.size(), false);
+		for (size_t i = 0; i < inputs.size(); ++i) {
+			if (users[outputs[i]] < 2) continue;
+			clashes[i] = true;
+			Fail(i, PipelineStage_Write, "output path is shared with another input");
+		}
+	}
+
+	void ReadWorker(PipelineStageStats &local) {
+		for (;;) {
+			size_t const index = nextInput++;
+			if (index >= inputs.size()) return;
+			if (clashes[index]) continue;
+
+			auto const busy = Clock::now();
+			ItemPtr item(new Item);
+			item->index = index;
+			bool ok = false;
+			{
+				VFile::ScopedFile file = VFile::File::FromFile(inputs[index].c_str(), Os_FM_ReadBinary);
+				if (file) {
+					item->bytes.resize(VFile_Size(file));
+					ok = !item->bytes.empty() &&
+							VFile_Read(file, item->bytes.data(), item->bytes.size()) == item->bytes.size();
+				}
+			}
+			local.busySeconds += SecondsSince(busy);
+			if (!ok) {
+				Fail(index, PipelineStage_Read, "can't read file");
+				continue;
+			}
+			local.items++;
+			local.bytes += item->bytes.size();
+
+			auto const wait = Clock::now();
+			decodeQueue.Push(std::move(item));
+			local.waitSeconds += SecondsSince(wait);
+		}
+	}
+
+	void Stage(PipelineStageStats &local, PipelineStage stage, ItemQueue &in, ItemQueue *out) {
+		for (;;) {
+			ItemPtr item;
+			auto wait = Clock::now();
+			if (!in.Pop(item)) return;
+			local.waitSeconds += SecondsSince(wait);
+
+			auto const busy = Clock::now();
+			char const *error = nullptr;
+			switch (stage) {
+				case PipelineStage_Decode: error = Decode(*item); break;
+				case PipelineStage_Process: error = Process(*item); break;
+				case PipelineStage_Write: error = Write(*item, local.bytes); break;
+				default: break;
+			}
+			local.busySeconds += SecondsSince(busy);
+			if (error) {
+				Fail(item->index, stage, error);
+				continue;
+			}
+			local.items++;
+
+			if (out) {
+				wait = Clock::now();
+				out->Push(std::move(item));
+				local.waitSeconds += SecondsSince(wait);
+			}
+		}
+	}
+
+	char const *Decode(Item &item) {
+		VFile::ScopedFile file = VFile::File::FromMemory(item.bytes.data(), item.bytes.size(), false);
+		if (file) item.image = Image_Load(file);
+		std::vector<uint8_t>().swap(item.bytes);
+		return item.image ? nullptr : "can't decode image";
+	}
+
+	char const *Process(Item &item) {
+		for (auto const &step : options.steps) {
+			char const *error = nullptr;
+			item.image = RunStep(item.image, step, error);
+			if (!item.image) return error;
+		}
+		return nullptr;
+	}
+
+	char const *Write(Item &item, size_t &bytes) {
+		// written under a temporary name so a failed save leaves no partial file
+		std::string const &path = outputs[item.index];
+		std::string const temp = TempPathOf(path);
+		char const *error = nullptr;
+		size_t written = 0;
+		{
+			VFile::ScopedFile file = VFile::File::FromFile(temp.c_str(), Os_FM_WriteBinary);
+			if (!file) return "can't create output file";
+			if (options.save(item.image, file)) written = (size_t) VFile_Tell(file);
+			else error = "can't save image";
+		}
+		if (!error && !MoveOver(temp, path)) error = "can't replace output file";
+		if (error) {
+			remove(temp.c_str());
+			return error;
+		}
+		bytes += written;
+		return nullptr;
+	}
+
+	void Fail(size_t index, PipelineStage stage, char const *error) {
+		std::lock_guard<std::mutex> lock(statsMutex);
+		stats.failures.push_back(PipelineFailure{inputs[index], stage, error});
+	}
+
+	std::vector<std::string> const &inputs;
+	PipelineOptions const &options;
+	PipelineStats &stats;
+
+	std::vector<std::string> outputs;
+	std::vector<bool> clashes;
+
+	std::atomic<size_t> nextInput{0};
+	ItemQueue decodeQueue;
+	ItemQueue processQueue;
+	ItemQueue writeQueue;
+
+	std::mutex statsMutex;
+	uint32_t remaining[PipelineStage_Count];
+};
+
+} // end anonymous namespace
+
+bool Pipeline_Glob(char const *pattern, std::vector<std::string> &paths) {
+	std::string dir, name, ext;
+	SplitPath(pattern, dir, name, ext);
+	std::string const filePattern = ext.empty() ? name : name + "." + ext;
+
+	std::vector<std::string> names;
+	if (!ListDirectory(dir, names)) return false;
+	std::sort(names.begin(), names.end());
+	for (auto const &file : names) {
+		if (Match(filePattern.c_str(), file.c_str())) paths.push_back(dir + "/" + file);
+	}
+	return true;
+}
+
+std::string Pipeline_OutputPath(std::string const &pattern, std::string const &input) {
+	std::string dir, name, ext;
+	SplitPath(input, dir, name, ext);
+
+	std::string path;
+	for (size_t i = 0; i < pattern.size(); ++i) {
+		if (pattern.compare(i, 5, "{dir}") == 0) {
+			path += dir;
+			i += 4;
+		} else if (pattern.compare(i, 6, "{name}") == 0) {
+			path += name;
+			i += 5;
+		} else if (pattern.compare(i, 5, "{ext}") == 0) {
+			path += ext;
+			i += 4;
+		} else {
+			path += pattern[i];
+		}
+	}
+	return path;
+}
+
+void Pipeline_Run(std::vector<std::string> const &inputs, PipelineOptions const &options, PipelineStats &stats) {
+	stats.processed = 0;
+	stats.seconds = 0.0;
+	stats.failures.clear();
+	Pipeline pipeline(inputs, options, stats);
+	pipeline.Run();
+}
+
+} // end namespace LuaImage
@@ -0,0 +1,102 @@
+#pragma once
+#ifndef LUA_IMAGE_PIPELINE_HPP_
+#define LUA_IMAGE_PIPELINE_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "al2o3_vfile/vfile.h"
+#include "autocompress.hpp"
+#include "compress.hpp"
+#include "mips.hpp"
+#include "resample.hpp"
+#include <string>
+#include <vector>
+
+namespace LuaImage {
+
+// Batch file processing as four overlapped stages connected by bounded
+// queues: read (file bytes), decode, process (the steps) and write
+// (encode and save). Each file moves through the stages on its own so
+// disk and CPU work overlap. Workers never touch a lua_State
+
+enum class PipelineOp {
+	Convert,      // format
+	Resize,       // width, height, resize
+	Mips,         // mips or libraryMips
+	Compress,     // bc, compress
+	CompressAuto, // autoCompress
+	Decompress,   // format (UNDEFINED = decoder's own)
+};
+
+struct PipelineStep {
+	PipelineOp op;
+	TinyImageFormat format = TinyImageFormat_UNDEFINED;
+	uint32_t width = 0;
+	uint32_t height = 0;
+	ResizeOptions resize;
+	MipOptions mips;
+	// mips through the library's Image_CreateMipMapChain (as createMipMapChain
+	// without options) rather than GenerateMipMaps, filling the levels only
+	// if libraryMipsFromImage
+	bool libraryMips = false;
+	bool libraryMipsFromImage = true;
+	CompressBC bc = CompressBC::BC7;
+	CompressOptions compress;
+	AutoCompressOptions autoCompress;
+};
+
+typedef bool (*PipelineSaveFunc)(Image_ImageHeader const *image, VFile_Handle handle);
+
+struct PipelineOptions {
+	std::vector<PipelineStep> steps;
+	// {dir}, {name} and {ext} are replaced by the input's directory,
+	// file name without extension and extension. inputs that expand to the
+	// same path fail without being written
+	std::string output;
+	PipelineSaveFunc save = nullptr;
+	uint32_t ioThreads = 1;      // readers and writers each
+	uint32_t processThreads = 0; // decoders and processors each, 0 = all hardware threads
+	uint32_t queueDepth = 4;     // files waiting between two stages
+};
+
+enum PipelineStage {
+	PipelineStage_Read,
+	PipelineStage_Decode,
+	PipelineStage_Process,
+	PipelineStage_Write,
+	PipelineStage_Count,
+};
+
+struct PipelineStageStats {
+	size_t items;
+	size_t bytes;       // read from or written to disk
+	double busySeconds; // summed over the stage's workers
+	double waitSeconds; // blocked on a full or empty queue
+	uint32_t workers;
+};
+
+struct PipelineFailure {
+	std::string input;
+	PipelineStage stage;
+	std::string error;
+};
+
+struct PipelineStats {
+	size_t processed;
+	double seconds;
+	PipelineStageStats stages[PipelineStage_Count];
+	std::vector<PipelineFailure> failures;
+};
+
+// files matching a pattern with * and ? in its last component, sorted
+bool Pipeline_Glob(char const *pattern, std::vector<std::string> &paths);
+
+// the output path for input
+std::string Pipeline_OutputPath(std::string const &pattern, std::string const &input);
+
+// runs every input through the pipeline, returns when all are written or failed
+void Pipeline_Run(std::vector<std::string> const &inputs, PipelineOptions const &options, PipelineStats &stats);
+
+} // end namespace LuaImage
+
+#endif
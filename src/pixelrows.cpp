@@ -0,0 +1,94 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "gfx_image/utils.h"
+#include "tiny_imageformat/tinyimageformat_query.h"
+#include "tiny_imageformat/tinyimageformat_decode.h"
+#include "tiny_imageformat/tinyimageformat_encode.h"
+#include "pixelrows.hpp"
+
+namespace LuaImage {
+
+bool CanAccessPixelRuns(TinyImageFormat fmt) {
+	if (TinyImageFormat_IsCompressed(fmt)) return false;
+	if (TinyImageFormat_IsCLUT(fmt)) return false;
+	if ((TinyImageFormat_BitSizeOfBlock(fmt) % 8) != 0) return false;
+	return TinyImageFormat_CanDecodeLogicalPixelsD(fmt) &&
+			TinyImageFormat_CanEncodeLogicalPixelsD(fmt);
+}
+
+static uint8_t *PixelAddress(Image_ImageHeader const *image, size_t index) {
+	size_t const bytesPerPixel = TinyImageFormat_BitSizeOfBlock(image->format) / 8;
+	return ((uint8_t *) Image_RawDataPtr(image)) + (index * bytesPerPixel);
+}
+
+void DecodePixelRunD(Image_ImageHeader const *image, size_t index, uint32_t count, double *out) {
+	if (CanAccessPixelRuns(image->format)) {
+		TinyImageFormat_DecodeInput input{};
+		input.pixel = PixelAddress(image, index);
+		TinyImageFormat_DecodeLogicalPixelsD(image->format, &input, count, out);
+		return;
+	}
+
+	// slow path one pixel at a time
+	for (uint32_t i = 0; i < count; ++i) {
+		Image_GetPixelAtD(image, out + (i * 4), index + i);
+	}
+}
+
+void DecodePixelRunF(Image_ImageHeader const *image, size_t index, uint32_t count, float *out) {
+	if (CanAccessPixelRuns(image->format) && TinyImageFormat_CanDecodeLogicalPixelsF(image->format)) {
+		TinyImageFormat_DecodeInput input{};
+		input.pixel = PixelAddress(image, index);
+		TinyImageFormat_DecodeLogicalPixelsF(image->format, &input, count, out);
+		return;
+	}
+
+	for (uint32_t i = 0; i < count; ++i) {
+		double pixel[4];
+		Image_GetPixelAtD(image, pixel, index + i);
+		out[(i * 4) + 0] = (float) pixel[0];
+		out[(i * 4) + 1] = (float) pixel[1];
+		out[(i * 4) + 2] = (float) pixel[2];
+		out[(i * 4) + 3] = (float) pixel[3];
+	}
+}
+
+void EncodePixelRunD(Image_ImageHeader const *image, size_t index, uint32_t count, double const *in) {
+	if (CanAccessPixelRuns(image->format)) {
+		TinyImageFormat_EncodeOutput output{};
+		output.pixel = PixelAddress(image, index);
+		TinyImageFormat_EncodeLogicalPixelsD(image->format, in, count, &output);
+		return;
+	}
+
+	for (uint32_t i = 0; i < count; ++i) {
+		double pixel[4] = {
+				in[(i * 4) + 0],
+				in[(i * 4) + 1],
+				in[(i * 4) + 2],
+				in[(i * 4) + 3],
+		};
+		Image_SetPixelAtD(image, pixel, index + i);
+	}
+}
+
+void EncodePixelRunF(Image_ImageHeader const *image, size_t index, uint32_t count, float const *in) {
+	if (CanAccessPixelRuns(image->format) && TinyImageFormat_CanEncodeLogicalPixelsF(image->format)) {
+		TinyImageFormat_EncodeOutput output{};
+		output.pixel = PixelAddress(image, index);
+		TinyImageFormat_EncodeLogicalPixelsF(image->format, in, count, &output);
+		return;
+	}
+
+	for (uint32_t i = 0; i < count; ++i) {
+		double pixel[4] = {
+				in[(i * 4) + 0],
+				in[(i * 4) + 1],
+				in[(i * 4) + 2],
+				in[(i * 4) + 3],
+		};
+		Image_SetPixelAtD(image, pixel, index + i);
+	}
+}
+
+} // end namespace LuaImage
@@ -0,0 +1,24 @@
+#pragma once
+#ifndef LUA_IMAGE_PIXELROWS_HPP_
+#define LUA_IMAGE_PIXELROWS_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+
+namespace LuaImage {
+
+// true if runs of pixels in this format can be decoded/encoded in one call
+// rather than going through Image_GetPixelAtD/Image_SetPixelAtD per pixel
+bool CanAccessPixelRuns(TinyImageFormat fmt);
+
+// decode count pixels starting at pixel index into 4 channel (rgba) output
+void DecodePixelRunD(Image_ImageHeader const *image, size_t index, uint32_t count, double *out);
+void DecodePixelRunF(Image_ImageHeader const *image, size_t index, uint32_t count, float *out);
+
+// encode count 4 channel (rgba) pixels into the image starting at pixel index
+void EncodePixelRunD(Image_ImageHeader const *image, size_t index, uint32_t count, double const *in);
+void EncodePixelRunF(Image_ImageHeader const *image, size_t index, uint32_t count, float const *in);
+
+} // end namespace LuaImage
+
+#endif
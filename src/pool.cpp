@@ -0,0 +1,186 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "pool.hpp"
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace LuaImage {
+
+namespace {
+
+struct Key {
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	uint32_t slices;
+	TinyImageFormat format;
+	uint8_t flags;
+
+	bool operator==(Key const &other) const {
+		return width == other.width && height == other.height && depth == other.depth &&
+				slices == other.slices && format == other.format && flags == other.flags;
+	}
+};
+
+struct KeyHash {
+	size_t operator()(Key const &key) const {
+		size_t hash = key.width;
+		hash = (hash * 31) ^ key.height;
+		hash = (hash * 31) ^ key.depth;
+		hash = (hash * 31) ^ key.slices;
+		hash = (hash * 31) ^ (size_t) key.format;
+		hash = (hash * 31) ^ key.flags;
+		return hash;
+	}
+};
+
+struct Pool {
+	~Pool() { TrimLocked(); }
+
+	// mutex must be held
+	void TrimLocked() {
+		for (auto &entry : images) {
+			for (auto image : entry.second) {
+				Image_Destroy(image);
+			}
+		}
+		images.clear();
+		order.clear();
+		pooledBytes = 0;
+		pooledImages = 0;
+	}
+
+	// evicts the oldest recycled images until under the limit, mutex must be held
+	void EvictLocked() {
+		while (pooledBytes > limit && !order.empty()) {
+			Key const key = order.front();
+			order.pop_front();
+
+			auto it = images.find(key);
+			if (it == images.end() || it->second.empty()) continue;
+
+			// oldest image of this shape is at the front
+			auto image = it->second.front();
+			it->second.erase(it->second.begin());
+			if (it->second.empty()) images.erase(it);
+
+			pooledBytes -= Image_ByteCountOf(image);
+			pooledImages--;
+			evictions++;
+			Image_Destroy(image);
+		}
+	}
+
+	std::mutex mutex;
+	std::unordered_map<Key, std::vector<Image_ImageHeader const *>, KeyHash> images;
+	// recycle order, one entry per recycled image (entries may be stale after acquires)
+	std::deque<Key> order;
+
+	size_t limit = 0;
+	size_t pooledBytes = 0;
+	size_t pooledImages = 0;
+	size_t hits = 0;
+	size_t misses = 0;
+	size_t recycled = 0;
+	size_t evictions = 0;
+};
+
+Pool &ThePool() {
+	static Pool pool;
+	return pool;
+}
+
+} // end anonymous namespace
+
+void Pool_SetLimit(size_t bytes) {
+	auto &pool = ThePool();
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	pool.limit = bytes;
+	if (bytes == 0) {
+		pool.TrimLocked();
+	} else {
+		pool.EvictLocked();
+	}
+}
+
+Image_ImageHeader const *Pool_Acquire(uint32_t width,
+																			uint32_t height,
+																			uint32_t depth,
+																			uint32_t slices,
+																			TinyImageFormat format,
+																			uint8_t flags) {
+	auto &pool = ThePool();
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	if (pool.limit == 0) return nullptr;
+
+	auto it = pool.images.find(Key{width, height, depth, slices, format, flags});
+	if (it == pool.images.end()) {
+		pool.misses++;
+		return nullptr;
+	}
+
+	// most recently recycled is the most likely to still be in cache
+	auto image = it->second.back();
+	it->second.pop_back();
+	if (it->second.empty()) pool.images.erase(it);
+
+	pool.pooledBytes -= Image_ByteCountOf(image);
+	pool.pooledImages--;
+	pool.hits++;
+	return image;
+}
+
+bool Pool_Recycle(Image_ImageHeader const *image) {
+	if (!image) return false;
+	if (image->nextImage != nullptr) return false;
+	if (image->flags & Image_Flag_HeaderOnly) return false;
+
+	auto &pool = ThePool();
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	size_t const bytes = Image_ByteCountOf(image);
+	if (pool.limit == 0 || bytes > pool.limit) return false;
+
+	Key const key{image->width, image->height, image->depth, image->slices, image->format, image->flags};
+	pool.images[key].push_back(image);
+	pool.order.push_back(key);
+	pool.pooledBytes += bytes;
+	pool.pooledImages++;
+	pool.recycled++;
+
+	pool.EvictLocked();
+	// stale order entries are skipped by eviction, stop them growing forever
+	if (pool.order.size() > (pool.pooledImages * 2) + 64) {
+		std::deque<Key> live;
+		for (auto const &entry : pool.images) {
+			for (size_t i = 0; i < entry.second.size(); ++i) {
+				live.push_back(entry.first);
+			}
+		}
+		pool.order.swap(live);
+	}
+	return true;
+}
+
+void Pool_Trim() {
+	auto &pool = ThePool();
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	pool.TrimLocked();
+}
+
+PoolStats Pool_Stats() {
+	auto &pool = ThePool();
+	std::lock_guard<std::mutex> lock(pool.mutex);
+	return PoolStats{
+			pool.hits,
+			pool.misses,
+			pool.recycled,
+			pool.evictions,
+			pool.pooledBytes,
+			pool.pooledImages,
+			pool.limit,
+	};
+}
+
+} // end namespace LuaImage
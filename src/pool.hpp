@@ -0,0 +1,47 @@
+#pragma once
+#ifndef LUA_IMAGE_POOL_HPP_
+#define LUA_IMAGE_POOL_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+
+namespace LuaImage {
+
+// Pool of released single (unlinked) images keyed by their exact shape,
+// format and flags. A recycled image is handed back as is, header and all,
+// so repeated same sized creates skip the allocator and page faults.
+// Thread safe, disabled until a limit is set
+
+struct PoolStats {
+	size_t hits;
+	size_t misses;
+	size_t recycled;
+	size_t evictions;
+	size_t pooledBytes;
+	size_t pooledImages;
+	size_t limit;
+};
+
+// max bytes held by the pool, 0 disables pooling and frees everything pooled
+void Pool_SetLimit(size_t bytes);
+
+// returns a pooled image of exactly this shape (contents undefined) or nullptr
+Image_ImageHeader const *Pool_Acquire(uint32_t width,
+																			uint32_t height,
+																			uint32_t depth,
+																			uint32_t slices,
+																			TinyImageFormat format,
+																			uint8_t flags);
+
+// takes ownership of image if it can be pooled, returns false if the caller
+// should destroy it instead
+bool Pool_Recycle(Image_ImageHeader const *image);
+
+// frees every pooled image
+void Pool_Trim();
+
+PoolStats Pool_Stats();
+
+} // end namespace LuaImage
+
+#endif
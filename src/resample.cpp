@@ -0,0 +1,300 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "gfx_image/create.h"
+#include "tiny_imageformat/tinyimageformat_query.h"
+#include "resample.hpp"
+#include "parallel.hpp"
+#include "pixelrows.hpp"
+#include <cmath>
+
+namespace LuaImage {
+
+namespace {
+
+// enough rows per thread that scheduling doesn't dominate small levels
+size_t const MinRowsPerThread = 16;
+
+double const Pi = 3.14159265358979323846;
+
+double Sinc(double x) {
+	if (fabs(x) < 1e-8) return 1.0;
+	double const px = Pi * x;
+	return sin(px) / px;
+}
+
+double BesselI0(double x) {
+	double sum = 1.0;
+	double term = 1.0;
+	double const halfX = x * 0.5;
+	for (int k = 1; k < 32; ++k) {
+		term *= (halfX / k) * (halfX / k);
+		sum += term;
+		if (term < sum * 1e-12) break;
+	}
+	return sum;
+}
+
+// filter support in destination pixels
+double FilterSupport(ResampleFilter filter) {
+	switch (filter) {
+		case ResampleFilter::Point: return 0.5;
+		case ResampleFilter::Box: return 0.5;
+		case ResampleFilter::Triangle: return 1.0;
+		case ResampleFilter::Kaiser: return 3.0;
+		case ResampleFilter::Lanczos: return 3.0;
+	}
+	return 0.5;
+}
+
+double FilterWeight(ResampleFilter filter, double x) {
+	double const ax = fabs(x);
+	switch (filter) {
+		case ResampleFilter::Point:
+		case ResampleFilter::Box:
+			return ax < 0.5 ? 1.0 : (ax == 0.5 ? 0.5 : 0.0);
+		case ResampleFilter::Triangle:
+			return ax < 1.0 ? 1.0 - ax : 0.0;
+		case ResampleFilter::Kaiser: {
+			double const width = 3.0;
+			double const alpha = 4.0;
+			if (ax >= width) return 0.0;
+			double const t = ax / width;
+			return Sinc(x) * BesselI0(alpha * sqrt(1.0 - (t * t))) / BesselI0(alpha);
+		}
+		case ResampleFilter::Lanczos:
+			return ax < 3.0 ? Sinc(x) * Sinc(x / 3.0) : 0.0;
+	}
+	return 0.0;
+}
+
+// normalised weights for each destination pixel along one axis
+struct Taps {
+	uint32_t width;
+	std::vector<int32_t> first;
+	std::vector<float> weights; // width per destination pixel
+};
+
+Taps MakeTaps(uint32_t srcSize, uint32_t dstSize, ResampleFilter filter) {
+	double const scale = (double) srcSize / (double) dstSize;
+	Taps taps;
+	taps.first.resize(dstSize);
+
+	if (filter == ResampleFilter::Point) {
+		taps.width = 1;
+		taps.weights.assign(dstSize, 1.0f);
+		for (uint32_t i = 0; i < dstSize; ++i) {
+			taps.first[i] = (int32_t) floor((i + 0.5) * scale);
+		}
+		return taps;
+	}
+
+	// minifying widens the filter to cover every source pixel, magnifying
+	// samples the filter at its natural width
+	double const filterScale = scale > 1.0 ? scale : 1.0;
+	double const support = FilterSupport(filter) * filterScale;
+
+	taps.width = (uint32_t) ceil(support * 2.0) + 1;
+	taps.weights.resize((size_t) dstSize * taps.width);
+	for (uint32_t i = 0; i < dstSize; ++i) {
+		double const center = (i + 0.5) * scale;
+		int32_t const first = (int32_t) floor(center - support);
+		float *weights = taps.weights.data() + ((size_t) i * taps.width);
+
+		double sum = 0.0;
+		for (uint32_t k = 0; k < taps.width; ++k) {
+			double const w = FilterWeight(filter, ((first + (int32_t) k + 0.5) - center) / filterScale);
+			weights[k] = (float) w;
+			sum += w;
+		}
+		for (uint32_t k = 0; k < taps.width; ++k) {
+			weights[k] = sum != 0.0 ? (float) (weights[k] / sum) : 0.0f;
+		}
+		taps.first[i] = first;
+	}
+	return taps;
+}
+
+inline uint32_t Clamp(int32_t i, uint32_t size) {
+	return i < 0 ? 0 : ((uint32_t) i >= size ? size - 1 : (uint32_t) i);
+}
+
+float SRGBToLinear(float v) {
+	return v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+}
+
+float LinearToSRGB(float v) {
+	if (v <= 0.0f) return 0.0f;
+	return v <= 0.0031308f ? v * 12.92f : (1.055f * powf(v, 1.0f / 2.4f)) - 0.055f;
+}
+
+// horizontal pass, every row resampled from src.width to dstWidth
+void FilterX(ResamplePlane const &src, ResampleShape const &shape, ResamplePlane &dst, uint32_t dstWidth, Taps const &taps, uint32_t threads) {
+	size_t const rows = (size_t) shape.height * shape.depth * shape.slices;
+	dst.resize(rows * dstWidth * 4);
+	ParallelFor(rows, threads, MinRowsPerThread, [&](size_t begin, size_t end) {
+		for (size_t row = begin; row < end; ++row) {
+			float const *in = src.data() + (row * shape.width * 4);
+			float *out = dst.data() + (row * dstWidth * 4);
+			for (uint32_t i = 0; i < dstWidth; ++i) {
+				float const *weights = taps.weights.data() + ((size_t) i * taps.width);
+				float acc[4] = {0, 0, 0, 0};
+				for (uint32_t k = 0; k < taps.width; ++k) {
+					float const *pixel = in + (Clamp(taps.first[i] + (int32_t) k, shape.width) * 4);
+					for (int c = 0; c < 4; ++c) {
+						acc[c] += weights[k] * pixel[c];
+					}
+				}
+				for (int c = 0; c < 4; ++c) {
+					out[(i * 4) + c] = acc[c];
+				}
+			}
+		}
+	});
+}
+
+// vertical pass, whole rows are weighted and summed so the inner loop runs
+// straight down contiguous floats
+void FilterY(ResamplePlane const &src, ResampleShape const &shape, ResamplePlane &dst, uint32_t dstHeight, Taps const &taps, uint32_t threads) {
+	size_t const pages = (size_t) shape.depth * shape.slices;
+	size_t const rowFloats = (size_t) shape.width * 4;
+	dst.resize(pages * dstHeight * rowFloats);
+	ParallelFor(pages * dstHeight, threads, MinRowsPerThread, [&](size_t begin, size_t end) {
+		for (size_t item = begin; item < end; ++item) {
+			size_t const page = item / dstHeight;
+			uint32_t const y = (uint32_t) (item % dstHeight);
+			float const *weights = taps.weights.data() + ((size_t) y * taps.width);
+			float *out = dst.data() + (item * rowFloats);
+			memset(out, 0, rowFloats * sizeof(float));
+			for (uint32_t k = 0; k < taps.width; ++k) {
+				float const weight = weights[k];
+				if (weight == 0.0f) continue;
+				size_t const srcRow = (page * shape.height) + Clamp(taps.first[y] + (int32_t) k, shape.height);
+				float const *in = src.data() + (srcRow * rowFloats);
+				for (size_t i = 0; i < rowFloats; ++i) {
+					out[i] += weight * in[i];
+				}
+			}
+		}
+	});
+}
+
+// depth pass for volumes, whole pages weighted and summed a row at a time
+void FilterZ(ResamplePlane const &src, ResampleShape const &shape, ResamplePlane &dst, uint32_t dstDepth, Taps const &taps, uint32_t threads) {
+	size_t const rowFloats = (size_t) shape.width * 4;
+	size_t const pageFloats = rowFloats * shape.height;
+	dst.resize((size_t) shape.slices * dstDepth * pageFloats);
+	ParallelFor((size_t) shape.slices * dstDepth * shape.height, threads, MinRowsPerThread, [&](size_t begin, size_t end) {
+		for (size_t item = begin; item < end; ++item) {
+			uint32_t const y = (uint32_t) (item % shape.height);
+			size_t const page = item / shape.height;
+			uint32_t const z = (uint32_t) (page % dstDepth);
+			size_t const slice = page / dstDepth;
+			float const *weights = taps.weights.data() + ((size_t) z * taps.width);
+			float *out = dst.data() + (item * rowFloats);
+			memset(out, 0, rowFloats * sizeof(float));
+			for (uint32_t k = 0; k < taps.width; ++k) {
+				float const weight = weights[k];
+				if (weight == 0.0f) continue;
+				size_t const srcPage = (slice * shape.depth) + Clamp(taps.first[z] + (int32_t) k, shape.depth);
+				float const *in = src.data() + (srcPage * pageFloats) + (y * rowFloats);
+				for (size_t i = 0; i < rowFloats; ++i) {
+					out[i] += weight * in[i];
+				}
+			}
+		}
+	});
+}
+
+} // end anonymous namespace
+
+void Resample_Decode(Image_ImageHeader const *image, ResamplePlane &plane, bool srgb, uint32_t threads) {
+	size_t const rows = (size_t) image->height * image->depth * image->slices;
+	size_t const rowFloats = (size_t) image->width * 4;
+	plane.resize(rows * rowFloats);
+	ParallelFor(rows, threads, MinRowsPerThread, [&](size_t begin, size_t end) {
+		for (size_t row = begin; row < end; ++row) {
+			float *out = plane.data() + (row * rowFloats);
+			DecodePixelRunF(image, row * image->width, image->width, out);
+			if (!srgb) continue;
+			for (size_t i = 0; i < rowFloats; i += 4) {
+				out[i + 0] = SRGBToLinear(out[i + 0]);
+				out[i + 1] = SRGBToLinear(out[i + 1]);
+				out[i + 2] = SRGBToLinear(out[i + 2]);
+			}
+		}
+	});
+}
+
+void Resample_Encode(ResamplePlane const &plane, Image_ImageHeader const *image, bool srgb,
+										 std::vector<float> const &alphaScales, uint32_t threads) {
+	size_t const rows = (size_t) image->height * image->depth * image->slices;
+	size_t const rowsPerSlice = (size_t) image->height * image->depth;
+	size_t const rowFloats = (size_t) image->width * 4;
+	ParallelFor(rows, threads, MinRowsPerThread, [&](size_t begin, size_t end) {
+		std::vector<float> row(rowFloats);
+		for (size_t r = begin; r < end; ++r) {
+			memcpy(row.data(), plane.data() + (r * rowFloats), rowFloats * sizeof(float));
+			float const alphaScale = alphaScales.empty() ? 1.0f : alphaScales[r / rowsPerSlice];
+			for (size_t i = 0; i < rowFloats; i += 4) {
+				if (srgb) {
+					row[i + 0] = LinearToSRGB(row[i + 0]);
+					row[i + 1] = LinearToSRGB(row[i + 1]);
+					row[i + 2] = LinearToSRGB(row[i + 2]);
+				}
+				if (alphaScale != 1.0f) {
+					float const alpha = row[i + 3] * alphaScale;
+					row[i + 3] = alpha > 1.0f ? 1.0f : alpha;
+				}
+			}
+			EncodePixelRunF(image, r * image->width, image->width, row.data());
+		}
+	});
+}
+
+void Resample_Plane(ResamplePlane &plane,
+										ResampleShape &shape,
+										uint32_t width,
+										uint32_t height,
+										uint32_t depth,
+										ResampleFilter filter,
+										uint32_t threads) {
+	ResamplePlane scratch;
+	if (width != shape.width) {
+		FilterX(plane, shape, scratch, width, MakeTaps(shape.width, width, filter), threads);
+		shape.width = width;
+		plane.swap(scratch);
+	}
+	if (height != shape.height) {
+		FilterY(plane, shape, scratch, height, MakeTaps(shape.height, height, filter), threads);
+		shape.height = height;
+		plane.swap(scratch);
+	}
+	if (depth != shape.depth) {
+		FilterZ(plane, shape, scratch, depth, MakeTaps(shape.depth, depth, filter), threads);
+		shape.depth = depth;
+		plane.swap(scratch);
+	}
+}
+
+Image_ImageHeader const *Resample_Resize(Image_ImageHeader const *image,
+																				 uint32_t width,
+																				 uint32_t height,
+																				 uint32_t depth,
+																				 ResizeOptions const &options) {
+	if (!image || !CanAccessPixelRuns(image->format)) return nullptr;
+	if (width == 0 || height == 0 || depth == 0) return nullptr;
+
+	auto const result = (Image_ImageHeader *) Image_CreateNoClear(width, height, depth, image->slices, image->format);
+	if (!result) return nullptr;
+	result->flags = image->flags;
+
+	bool const srgb = options.srgb && !TinyImageFormat_IsSRGB(image->format);
+	ResamplePlane plane;
+	Resample_Decode(image, plane, srgb, options.threadCount);
+	ResampleShape shape{image->width, image->height, image->depth, image->slices};
+	Resample_Plane(plane, shape, width, height, depth, options.filter, options.threadCount);
+	Resample_Encode(plane, result, srgb, std::vector<float>(), options.threadCount);
+	return result;
+}
+
+} // end namespace LuaImage
@@ -0,0 +1,68 @@
+#pragma once
+#ifndef LUA_IMAGE_RESAMPLE_HPP_
+#define LUA_IMAGE_RESAMPLE_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include <vector>
+
+namespace LuaImage {
+
+enum class ResampleFilter {
+	Point,
+	Box,
+	Triangle,
+	Kaiser,
+	Lanczos,
+};
+
+// rgba float pixels of a whole image, laid out like the image
+typedef std::vector<float> ResamplePlane;
+
+struct ResampleShape {
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	uint32_t slices;
+};
+
+// decodes every pixel of image (not its linked images) into plane, with
+// colour converted from sRGB to linear if srgb
+void Resample_Decode(Image_ImageHeader const *image, ResamplePlane &plane, bool srgb, uint32_t threadCount);
+
+// encodes plane into image converting colour back to sRGB if srgb. if not
+// empty alphaScales holds a scale for each slice's alpha (clamped to 1)
+void Resample_Encode(ResamplePlane const &plane,
+										 Image_ImageHeader const *image,
+										 bool srgb,
+										 std::vector<float> const &alphaScales,
+										 uint32_t threadCount);
+
+// resamples plane (of shape) to width x height x depth, one separable pass
+// per axis that changes size, each pass split across threads by rows.
+// shape is updated to the new size
+void Resample_Plane(ResamplePlane &plane,
+										ResampleShape &shape,
+										uint32_t width,
+										uint32_t height,
+										uint32_t depth,
+										ResampleFilter filter,
+										uint32_t threadCount);
+
+struct ResizeOptions {
+	ResampleFilter filter = ResampleFilter::Triangle;
+	bool srgb = false; // see MipOptions::srgb
+	uint32_t threadCount = 0; // 0 = all hardware threads
+};
+
+// a new image (no linked images) of image's top level resized. nullptr if
+// the format can't be resampled
+Image_ImageHeader const *Resample_Resize(Image_ImageHeader const *image,
+																				 uint32_t width,
+																				 uint32_t height,
+																				 uint32_t depth,
+																				 ResizeOptions const &options);
+
+} // end namespace LuaImage
+
+#endif
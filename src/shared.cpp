@@ -0,0 +1,107 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "shared.hpp"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+namespace LuaImage {
+
+struct SharedImage {
+	Image_ImageHeader const *image;
+	MappedFile mapped;
+	size_t accountedBytes;
+	std::atomic<uint32_t> refCount;
+	std::atomic<bool> frozen;
+};
+
+namespace {
+
+struct Handles {
+	std::mutex mutex;
+	std::unordered_map<uint64_t, SharedImage *> images;
+	uint64_t next = 1;
+};
+
+Handles &TheHandles() {
+	static Handles handles;
+	return handles;
+}
+
+} // end anonymous namespace
+
+SharedImage *Shared_Create(Image_ImageHeader const *image, MappedFile const &mapped, size_t accountedBytes) {
+	if (!image) return nullptr;
+	auto shared = new SharedImage;
+	shared->image = image;
+	shared->mapped = mapped;
+	shared->accountedBytes = accountedBytes;
+	shared->refCount = 1;
+	shared->frozen = false;
+	return shared;
+}
+
+void Shared_Retain(SharedImage *shared) {
+	shared->refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool Shared_Release(SharedImage *shared,
+										Image_ImageHeader const *&image,
+										MappedFile &mapped,
+										size_t &accountedBytes) {
+	// acq_rel so every holder's writes are visible to whoever frees it
+	if (shared->refCount.fetch_sub(1, std::memory_order_acq_rel) != 1) return false;
+
+	image = shared->image;
+	mapped = shared->mapped;
+	accountedBytes = shared->accountedBytes;
+	delete shared;
+	return true;
+}
+
+Image_ImageHeader const *Shared_Image(SharedImage const *shared) {
+	return shared->image;
+}
+
+uint32_t Shared_RefCount(SharedImage const *shared) {
+	return shared->refCount.load(std::memory_order_acquire);
+}
+
+void Shared_Freeze(SharedImage *shared) {
+	shared->frozen = true;
+}
+
+bool Shared_IsFrozen(SharedImage const *shared) {
+	return shared->frozen;
+}
+
+uint64_t Shared_Export(SharedImage *shared) {
+	auto &handles = TheHandles();
+	Shared_Retain(shared);
+	std::lock_guard<std::mutex> lock(handles.mutex);
+	uint64_t const handle = handles.next++;
+	handles.images[handle] = shared;
+	return handle;
+}
+
+SharedImage *Shared_Import(uint64_t handle) {
+	auto &handles = TheHandles();
+	std::lock_guard<std::mutex> lock(handles.mutex);
+	auto it = handles.images.find(handle);
+	if (it == handles.images.end()) return nullptr;
+	// the handle's reference keeps it alive while we hold the lock
+	Shared_Retain(it->second);
+	return it->second;
+}
+
+SharedImage *Shared_Unexport(uint64_t handle) {
+	auto &handles = TheHandles();
+	std::lock_guard<std::mutex> lock(handles.mutex);
+	auto it = handles.images.find(handle);
+	if (it == handles.images.end()) return nullptr;
+	auto const shared = it->second;
+	handles.images.erase(it);
+	return shared;
+}
+
+} // end namespace LuaImage
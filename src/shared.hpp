@@ -0,0 +1,49 @@
+#pragma once
+#ifndef LUA_IMAGE_SHARED_HPP_
+#define LUA_IMAGE_SHARED_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "mapped.hpp"
+
+namespace LuaImage {
+
+// A reference counted image that any number of lua states (on any threads)
+// can hold at once. Holders only read it unless they are the last reference,
+// a frozen image is never written again so can be read from every thread.
+// Handles are process wide integers that carry a reference, so an image can
+// be passed between states as a plain number
+struct SharedImage;
+
+// takes ownership of image (and its mapping if mapped), the caller holds the
+// first reference. accountedBytes is handed back when the last reference goes
+SharedImage *Shared_Create(Image_ImageHeader const *image, MappedFile const &mapped, size_t accountedBytes);
+
+void Shared_Retain(SharedImage *shared);
+
+// drops a reference, if it was the last the image, mapping and accounted bytes
+// are handed back to the caller to free and true is returned
+bool Shared_Release(SharedImage *shared,
+										Image_ImageHeader const *&image,
+										MappedFile &mapped,
+										size_t &accountedBytes);
+
+Image_ImageHeader const *Shared_Image(SharedImage const *shared);
+uint32_t Shared_RefCount(SharedImage const *shared);
+
+// one way, once frozen writes are refused rather than copied
+void Shared_Freeze(SharedImage *shared);
+bool Shared_IsFrozen(SharedImage const *shared);
+
+// a new handle holding a reference to shared
+uint64_t Shared_Export(SharedImage *shared);
+
+// a new reference to the handle's image, nullptr if the handle is unknown
+SharedImage *Shared_Import(uint64_t handle);
+
+// forgets the handle and passes its reference to the caller, nullptr if unknown
+SharedImage *Shared_Unexport(uint64_t handle);
+
+} // end namespace LuaImage
+
+#endif
@@ -0,0 +1,150 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "stats.hpp"
+#include "parallel.hpp"
+#include "pixelrows.hpp"
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+namespace LuaImage {
+
+namespace {
+
+// count, mean and sum of squared deviations, merged with Chan's formula so
+// long images don't lose precision the way sum and sum of squares do
+struct Moments {
+	double count = 0;
+	double mean = 0;
+	double m2 = 0;
+
+	void Add(double otherCount, double otherMean, double otherM2) {
+		if (otherCount == 0) return;
+		double const total = count + otherCount;
+		double const delta = otherMean - mean;
+		mean += delta * (otherCount / total);
+		m2 += otherM2 + (delta * delta * count * otherCount / total);
+		count = total;
+	}
+};
+
+struct Accumulator {
+	Accumulator(uint32_t bins) {
+		for (int c = 0; c < 4; ++c) {
+			min[c] = std::numeric_limits<double>::infinity();
+			max[c] = -std::numeric_limits<double>::infinity();
+			histogram[c].assign(bins, 0);
+		}
+	}
+
+	void Merge(Accumulator const &other) {
+		for (int c = 0; c < 4; ++c) {
+			min[c] = std::fmin(min[c], other.min[c]);
+			max[c] = std::fmax(max[c], other.max[c]);
+			moments[c].Add(other.moments[c].count, other.moments[c].mean, other.moments[c].m2);
+			nanCount[c] += other.nanCount[c];
+			infCount[c] += other.infCount[c];
+			for (size_t b = 0; b < histogram[c].size(); ++b) histogram[c][b] += other.histogram[c][b];
+		}
+	}
+
+	double min[4];
+	double max[4];
+	Moments moments[4];
+	size_t nanCount[4] = {};
+	size_t infCount[4] = {};
+	std::vector<size_t> histogram[4];
+};
+
+void DefaultRange(TinyImageFormat format, double &low, double &high) {
+	if (TinyImageFormat_IsFloat(format)) {
+		low = 0.0;
+		high = 1.0;
+	} else if (TinyImageFormat_IsNormalised(format)) {
+		low = TinyImageFormat_IsSigned(format) ? -1.0 : 0.0;
+		high = 1.0;
+	} else {
+		low = TinyImageFormat_Min(format, 0);
+		high = TinyImageFormat_Max(format, 0);
+	}
+	if (high <= low) high = low + 1.0;
+}
+
+} // end anonymous namespace
+
+bool CollectStats(Image_ImageHeader const *image, StatsOptions const &options, ImageStats &stats) {
+	if (!image || !CanAccessPixelRuns(image->format)) return false;
+
+	stats.histogramMin = options.histogramMin;
+	stats.histogramMax = options.histogramMax;
+	if (stats.histogramMax <= stats.histogramMin) DefaultRange(image->format, stats.histogramMin, stats.histogramMax);
+	double const binScale = options.histogramBins / (stats.histogramMax - stats.histogramMin);
+	int64_t const lastBin = (int64_t) options.histogramBins - 1;
+
+	Accumulator total(options.histogramBins);
+	std::mutex mutex;
+
+	uint32_t const width = image->width;
+	size_t const rows = (size_t) image->height * image->depth * image->slices;
+	ParallelFor(rows, options.threadCount, 16, [&](size_t begin, size_t end) {
+		Accumulator local(options.histogramBins);
+		std::vector<double> pixels((size_t) width * 4);
+		for (size_t row = begin; row < end; ++row) {
+			DecodePixelRunD(image, row * width, width, pixels.data());
+
+			// sums are of values less the row's first finite one, keeping them
+			// small even for large values with little variation
+			double shift[4] = {}, sum[4] = {}, sumSq[4] = {}, count[4] = {};
+			for (size_t i = 0; i < pixels.size(); i += 4) {
+				for (int c = 0; c < 4; ++c) {
+					double const v = pixels[i + c];
+					if (std::isnan(v)) {
+						local.nanCount[c]++;
+						continue;
+					}
+					if (std::isinf(v)) {
+						local.infCount[c]++;
+						continue;
+					}
+					local.min[c] = std::fmin(local.min[c], v);
+					local.max[c] = std::fmax(local.max[c], v);
+					if (count[c] == 0) shift[c] = v;
+					double const shifted = v - shift[c];
+					sum[c] += shifted;
+					sumSq[c] += shifted * shifted;
+					count[c] += 1.0;
+					if (lastBin >= 0) {
+						int64_t bin = (int64_t) std::floor((v - stats.histogramMin) * binScale);
+						bin = bin < 0 ? 0 : (bin > lastBin ? lastBin : bin);
+						local.histogram[c][(size_t) bin]++;
+					}
+				}
+			}
+
+			for (int c = 0; c < 4; ++c) {
+				if (count[c] == 0) continue;
+				double const mean = sum[c] / count[c];
+				local.moments[c].Add(count[c], shift[c] + mean, std::fmax(0.0, sumSq[c] - (sum[c] * mean)));
+			}
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		total.Merge(local);
+	});
+
+	stats.pixels = rows * width;
+	for (int c = 0; c < 4; ++c) {
+		bool const any = total.moments[c].count > 0;
+		stats.min[c] = any ? total.min[c] : 0.0;
+		stats.max[c] = any ? total.max[c] : 0.0;
+		stats.mean[c] = total.moments[c].mean;
+		stats.variance[c] = any ? total.moments[c].m2 / total.moments[c].count : 0.0;
+		stats.nanCount[c] = total.nanCount[c];
+		stats.infCount[c] = total.infCount[c];
+		stats.constant[c] = stats.min[c] == stats.max[c] && total.nanCount[c] == 0 && total.infCount[c] == 0;
+		stats.histogram[c].swap(total.histogram[c]);
+	}
+	stats.alphaOpaque = stats.min[3] >= 1.0 && total.nanCount[3] == 0;
+	return true;
+}
+
+} // end namespace LuaImage
@@ -0,0 +1,44 @@
+#pragma once
+#ifndef LUA_IMAGE_STATS_HPP_
+#define LUA_IMAGE_STATS_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include <vector>
+
+namespace LuaImage {
+
+struct StatsOptions {
+	// 0 = no histograms
+	uint32_t histogramBins = 0;
+	// range the bins cover, values outside land in the end bins.
+	// min == max picks the format's natural range (0..1 for floats)
+	double histogramMin = 0.0;
+	double histogramMax = 0.0;
+	uint32_t threadCount = 0; // 0 = all hardware threads
+};
+
+// per channel (rgba as decoded) statistics, min/max/mean/variance are of the
+// finite values only
+struct ImageStats {
+	size_t pixels;
+	double min[4];
+	double max[4];
+	double mean[4];
+	double variance[4];
+	size_t nanCount[4];
+	size_t infCount[4];
+	bool constant[4];
+	bool alphaOpaque;
+	double histogramMin;
+	double histogramMax;
+	std::vector<size_t> histogram[4];
+};
+
+// every pixel of the image (all slices, not linked images) in one pass with
+// rows split across threads. false if the format can't be read a row at a time
+bool CollectStats(Image_ImageHeader const *image, StatsOptions const &options, ImageStats &stats);
+
+} // end namespace LuaImage
+
+#endif
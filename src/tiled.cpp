@@ -0,0 +1,399 @@
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+#include "gfx_image/create.h"
+#include "tiny_imageformat/tinyimageformat_query.h"
+#include "pixelrows.hpp"
+#include "tiled.hpp"
+#include <cstdio>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace LuaImage {
+
+namespace {
+
+// tile file header, followed by every tile in slice, page, row, column order
+struct FileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	uint32_t slices;
+	uint32_t format;
+	uint32_t tileSize;
+};
+
+uint32_t const Magic = 0x4C49544C; // 'LTIL'
+uint32_t const Version = 1;
+
+bool SeekTo(FILE *file, uint64_t offset) {
+#if defined(_WIN32)
+	return _fseeki64(file, (__int64) offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, (off_t) offset, SEEK_SET) == 0;
+#endif
+}
+
+// true if path names the same file as the open file, however it's spelt
+bool SameFile(FILE *file, char const *path) {
+#if defined(_WIN32)
+	BY_HANDLE_FILE_INFORMATION opened, named;
+	if (!GetFileInformationByHandle((HANDLE) _get_osfhandle(_fileno(file)), &opened)) return false;
+	HANDLE const other = CreateFileA(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+																	 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (other == INVALID_HANDLE_VALUE) return false;
+	bool const ok = GetFileInformationByHandle(other, &named) != 0;
+	CloseHandle(other);
+	return ok && opened.dwVolumeSerialNumber == named.dwVolumeSerialNumber &&
+			opened.nFileIndexHigh == named.nFileIndexHigh && opened.nFileIndexLow == named.nFileIndexLow;
+#else
+	struct stat opened, named;
+	if (fstat(fileno(file), &opened) != 0 || stat(path, &named) != 0) return false;
+	return opened.st_dev == named.st_dev && opened.st_ino == named.st_ino;
+#endif
+}
+
+uint32_t Half(uint32_t size) {
+	return size > 1 ? size / 2 : 1;
+}
+
+uint32_t Min(uint32_t a, uint32_t b) {
+	return a < b ? a : b;
+}
+
+} // end anonymous namespace
+
+struct TiledImage {
+	struct Tile {
+		Image_ImageHeader const *image;
+		bool dirty;
+		std::list<uint64_t>::iterator lru;
+	};
+
+	~TiledImage() {
+		FlushLocked();
+		for (auto &entry : tiles) {
+			Image_Destroy(entry.second.image);
+		}
+		if (file) fclose(file);
+	}
+
+	uint64_t TileIndex(uint32_t tx, uint32_t ty, uint32_t z, uint32_t slice) const {
+		return ((((uint64_t) slice * info.depth) + z) * tilesY + ty) * tilesX + tx;
+	}
+
+	bool WriteTileLocked(uint64_t index, Tile &tile) {
+		if (!tile.dirty) return true;
+		if (!SeekTo(file, sizeof(FileHeader) + (index * tileBytes))) return false;
+		if (fwrite(Image_RawDataPtr(tile.image), 1, tileBytes, file) != tileBytes) return false;
+		tile.dirty = false;
+		stats.writes++;
+		return true;
+	}
+
+	bool FlushLocked() {
+		bool ok = true;
+		for (auto &entry : tiles) {
+			ok &= WriteTileLocked(entry.first, entry.second);
+		}
+		if (file) ok &= fflush(file) == 0;
+		return ok;
+	}
+
+	// evicts least recently used tiles until within the cache size, always
+	// keeping the most recently used one. A dirty tile that can't be written
+	// back stays resident (over the cache size) and false is returned
+	bool EvictLocked() {
+		while (stats.residentBytes > stats.cacheBytes && tiles.size() > 1) {
+			uint64_t const index = lru.back();
+			auto it = tiles.find(index);
+			if (!WriteTileLocked(index, it->second)) return false;
+			Image_Destroy(it->second.image);
+			tiles.erase(it);
+			lru.pop_back();
+			stats.residentBytes -= tileBytes;
+			stats.evictions++;
+		}
+		return true;
+	}
+
+	// the tile holding the pixel, paging it in if needed. nullptr if it
+	// can't be or making room for it failed to write back a dirty tile
+	Image_ImageHeader const *AcquireLocked(uint32_t tx, uint32_t ty, uint32_t z, uint32_t slice, bool write) {
+		uint64_t const index = TileIndex(tx, ty, z, slice);
+		auto it = tiles.find(index);
+		if (it != tiles.end()) {
+			lru.splice(lru.begin(), lru, it->second.lru);
+			it->second.dirty |= write;
+			stats.hits++;
+			return it->second.image;
+		}
+
+		auto const image = Image_Create2DNoClear(info.tileSize, info.tileSize, info.format);
+		if (!image) return nullptr;
+
+		// tiles past the end of the file have never been written so are zero
+		size_t read = 0;
+		if (SeekTo(file, sizeof(FileHeader) + (index * tileBytes))) {
+			read = fread(Image_RawDataPtr(image), 1, tileBytes, file);
+		}
+		if (read < tileBytes) {
+			clearerr(file);
+			memset(((uint8_t *) Image_RawDataPtr(image)) + read, 0, tileBytes - read);
+		}
+
+		lru.push_front(index);
+		tiles[index] = Tile{image, write, lru.begin()};
+		stats.residentBytes += tileBytes;
+		stats.misses++;
+		if (!EvictLocked()) return nullptr;
+		return image;
+	}
+
+	// calls func(tile, tileIndex, offset, count) for each tile piece of a row
+	template<typename Func>
+	bool ForEachRunLocked(uint32_t x, uint32_t y, uint32_t z, uint32_t slice, uint32_t count, bool write, Func const &func) {
+		if (x >= info.width || y >= info.height || z >= info.depth || slice >= info.slices) return false;
+		if (count > info.width - x) return false;
+
+		uint32_t const ts = info.tileSize;
+		uint32_t done = 0;
+		while (done < count) {
+			uint32_t const px = x + done;
+			uint32_t const inTile = px % ts;
+			uint32_t const run = Min(ts - inTile, count - done);
+			auto tile = AcquireLocked(px / ts, y / ts, z, slice, write);
+			if (!tile) return false;
+			func(tile, ((size_t) (y % ts) * ts) + inTile, done, run);
+			done += run;
+		}
+		return true;
+	}
+
+	TiledInfo info;
+	FILE *file = nullptr;
+	uint32_t tilesX = 0;
+	uint32_t tilesY = 0;
+	size_t tileBytes = 0;
+
+	std::mutex mutex;
+	std::unordered_map<uint64_t, Tile> tiles;
+	// most recently used at the front
+	std::list<uint64_t> lru;
+	TiledStats stats{};
+};
+
+namespace {
+
+TiledImage *Setup(FILE *file, TiledInfo const &info, size_t cacheBytes) {
+	auto tiled = new TiledImage();
+	tiled->info = info;
+	tiled->file = file;
+	tiled->tilesX = (info.width + info.tileSize - 1) / info.tileSize;
+	tiled->tilesY = (info.height + info.tileSize - 1) / info.tileSize;
+	tiled->tileBytes = ((size_t) info.tileSize * info.tileSize * TinyImageFormat_BitSizeOfBlock(info.format)) / 8;
+	tiled->stats.cacheBytes = cacheBytes;
+	return tiled;
+}
+
+bool Valid(TiledInfo const &info) {
+	if (info.width == 0 || info.height == 0 || info.depth == 0 || info.slices == 0) return false;
+	if (info.tileSize == 0 || info.tileSize > 16384) return false;
+	return CanAccessPixelRuns(info.format);
+}
+
+} // end anonymous namespace
+
+TiledImage *Tiled_Create(char const *path,
+												 uint32_t width,
+												 uint32_t height,
+												 uint32_t depth,
+												 uint32_t slices,
+												 TinyImageFormat format,
+												 uint32_t tileSize,
+												 size_t cacheBytes) {
+	TiledInfo const info{width, height, depth, slices, format, tileSize};
+	if (!Valid(info)) return nullptr;
+
+	FILE *file = fopen(path, "w+b");
+	if (!file) return nullptr;
+
+	FileHeader const header{Magic, Version, width, height, depth, slices, (uint32_t) format, tileSize};
+	if (fwrite(&header, sizeof(header), 1, file) != 1) {
+		fclose(file);
+		return nullptr;
+	}
+	return Setup(file, info, cacheBytes);
+}
+
+TiledImage *Tiled_Open(char const *path, size_t cacheBytes) {
+	FILE *file = fopen(path, "r+b");
+	if (!file) return nullptr;
+
+	FileHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != Magic || header.version != Version) {
+		fclose(file);
+		return nullptr;
+	}
+
+	TiledInfo const info{header.width, header.height, header.depth, header.slices,
+											 (TinyImageFormat) header.format, header.tileSize};
+	if (!Valid(info)) {
+		fclose(file);
+		return nullptr;
+	}
+	return Setup(file, info, cacheBytes);
+}
+
+void Tiled_Destroy(TiledImage *tiled) {
+	delete tiled;
+}
+
+bool Tiled_Flush(TiledImage *tiled) {
+	std::lock_guard<std::mutex> lock(tiled->mutex);
+	return tiled->FlushLocked();
+}
+
+bool Tiled_IsFile(TiledImage *tiled, char const *path) {
+	std::lock_guard<std::mutex> lock(tiled->mutex);
+	return SameFile(tiled->file, path);
+}
+
+TiledInfo const &Tiled_Info(TiledImage const *tiled) {
+	return tiled->info;
+}
+
+TiledStats Tiled_Stats(TiledImage *tiled) {
+	std::lock_guard<std::mutex> lock(tiled->mutex);
+	return tiled->stats;
+}
+
+bool Tiled_SetCacheBytes(TiledImage *tiled, size_t cacheBytes) {
+	std::lock_guard<std::mutex> lock(tiled->mutex);
+	tiled->stats.cacheBytes = cacheBytes;
+	return tiled->EvictLocked();
+}
+
+bool Tiled_ReadRun(TiledImage *tiled, uint32_t x, uint32_t y, uint32_t z, uint32_t slice,
+									 uint32_t count, double *out) {
+	std::lock_guard<std::mutex> lock(tiled->mutex);
+	return tiled->ForEachRunLocked(x, y, z, slice, count, false,
+																 [out](Image_ImageHeader const *tile, size_t index, uint32_t offset, uint32_t run) {
+																	 DecodePixelRunD(tile, index, run, out + ((size_t) offset * 4));
+																 });
+}
+
+bool Tiled_WriteRun(TiledImage *tiled, uint32_t x, uint32_t y, uint32_t z, uint32_t slice,
+										uint32_t count, double const *in) {
+	std::lock_guard<std::mutex> lock(tiled->mutex);
+	return tiled->ForEachRunLocked(x, y, z, slice, count, true,
+																 [in](Image_ImageHeader const *tile, size_t index, uint32_t offset, uint32_t run) {
+																	 EncodePixelRunD(tile, index, run, in + ((size_t) offset * 4));
+																 });
+}
+
+TiledImage *Tiled_Convert(TiledImage *src, char const *path, TinyImageFormat format, size_t cacheBytes) {
+	// creating path truncates it, which would be the source's pixels
+	if (Tiled_IsFile(src, path)) return nullptr;
+	TiledInfo const &info = src->info;
+	auto dst = Tiled_Create(path, info.width, info.height, info.depth, info.slices, format, info.tileSize, cacheBytes);
+	if (!dst) return nullptr;
+
+	// same tiling on both sides so walking tile by tile pages each tile once
+	uint32_t const ts = info.tileSize;
+	std::vector<double> row((size_t) ts * 4);
+	bool ok = true;
+	for (uint32_t s = 0; s < info.slices && ok; ++s) {
+		for (uint32_t z = 0; z < info.depth && ok; ++z) {
+			for (uint32_t ty = 0; ty < src->tilesY && ok; ++ty) {
+				for (uint32_t tx = 0; tx < src->tilesX && ok; ++tx) {
+					uint32_t const x = tx * ts;
+					uint32_t const count = Min(ts, info.width - x);
+					uint32_t const yEnd = Min((ty + 1) * ts, info.height);
+					for (uint32_t y = ty * ts; y < yEnd && ok; ++y) {
+						ok = Tiled_ReadRun(src, x, y, z, s, count, row.data()) &&
+								Tiled_WriteRun(dst, x, y, z, s, count, row.data());
+					}
+				}
+			}
+		}
+	}
+
+	if (!ok || !Tiled_Flush(dst)) {
+		Tiled_Destroy(dst);
+		return nullptr;
+	}
+	return dst;
+}
+
+TiledImage *Tiled_CreateMipMap(TiledImage *src, char const *path, size_t cacheBytes) {
+	if (Tiled_IsFile(src, path)) return nullptr;
+	TiledInfo const &info = src->info;
+	uint32_t const width = Half(info.width);
+	uint32_t const height = Half(info.height);
+	uint32_t const depth = Half(info.depth);
+	auto dst = Tiled_Create(path, width, height, depth, info.slices, info.format, info.tileSize, cacheBytes);
+	if (!dst) return nullptr;
+
+	uint32_t const ts = info.tileSize;
+	// 2 source rows from each of 2 source pages per destination row
+	std::vector<double> sources[4];
+	for (auto &source : sources) {
+		source.resize((size_t) ts * 2 * 4);
+	}
+	std::vector<double> row((size_t) ts * 4);
+
+	bool ok = true;
+	for (uint32_t s = 0; s < info.slices && ok; ++s) {
+		for (uint32_t z = 0; z < depth && ok; ++z) {
+			uint32_t const sz[2] = {Min(z * 2, info.depth - 1), Min((z * 2) + 1, info.depth - 1)};
+			for (uint32_t ty = 0; ty < dst->tilesY && ok; ++ty) {
+				for (uint32_t tx = 0; tx < dst->tilesX && ok; ++tx) {
+					uint32_t const x = tx * ts;
+					uint32_t const count = Min(ts, width - x);
+					uint32_t const sx = x * 2;
+					uint32_t const sourceCount = Min(count * 2, info.width - sx);
+					uint32_t const yEnd = Min((ty + 1) * ts, height);
+
+					for (uint32_t y = ty * ts; y < yEnd && ok; ++y) {
+						uint32_t const sy[2] = {Min(y * 2, info.height - 1), Min((y * 2) + 1, info.height - 1)};
+						for (uint32_t i = 0; i < 4 && ok; ++i) {
+							ok = Tiled_ReadRun(src, sx, sy[i & 1], sz[i >> 1], s, sourceCount, sources[i].data());
+						}
+
+						for (uint32_t i = 0; i < count && ok; ++i) {
+							size_t const x0 = Min(i * 2, sourceCount - 1) * 4;
+							size_t const x1 = Min((i * 2) + 1, sourceCount - 1) * 4;
+							for (uint32_t c = 0; c < 4; ++c) {
+								double sum = 0.0;
+								for (auto const &source : sources) {
+									sum += source[x0 + c] + source[x1 + c];
+								}
+								row[(i * 4) + c] = sum * 0.125;
+							}
+						}
+						ok = ok && Tiled_WriteRun(dst, x, y, z, s, count, row.data());
+					}
+				}
+			}
+		}
+	}
+
+	if (!ok || !Tiled_Flush(dst)) {
+		Tiled_Destroy(dst);
+		return nullptr;
+	}
+	return dst;
+}
+
+} // end namespace LuaImage
@@ -0,0 +1,82 @@
+#pragma once
+#ifndef LUA_IMAGE_TILED_HPP_
+#define LUA_IMAGE_TILED_HPP_
+
+#include "al2o3_platform/platform.h"
+#include "gfx_image/image.h"
+
+namespace LuaImage {
+
+// An image too big to keep resident. Pixels live in a tile file on disk,
+// each width x height page of each slice split into tileSize square tiles,
+// and only an LRU bounded set of tiles is held in memory. Dirty tiles are
+// written back on eviction, flush and destroy. One that can't be written back
+// stays resident and the call that needed its room fails.
+// Formats must support pixel runs (see CanAccessPixelRuns).
+// All functions are thread safe per tiled image
+struct TiledImage;
+
+struct TiledInfo {
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	uint32_t slices;
+	TinyImageFormat format;
+	uint32_t tileSize;
+};
+
+struct TiledStats {
+	size_t hits;
+	size_t misses;
+	size_t writes;
+	size_t evictions;
+	size_t residentBytes;
+	size_t cacheBytes;
+};
+
+// creates (or truncates) the tile file at path, pixels start as zero
+TiledImage *Tiled_Create(char const *path,
+												 uint32_t width,
+												 uint32_t height,
+												 uint32_t depth,
+												 uint32_t slices,
+												 TinyImageFormat format,
+												 uint32_t tileSize,
+												 size_t cacheBytes);
+
+// opens an existing tile file
+TiledImage *Tiled_Open(char const *path, size_t cacheBytes);
+
+// flushes and closes
+void Tiled_Destroy(TiledImage *tiled);
+
+bool Tiled_Flush(TiledImage *tiled);
+
+// true if path names tiled's own tile file
+bool Tiled_IsFile(TiledImage *tiled, char const *path);
+
+TiledInfo const &Tiled_Info(TiledImage const *tiled);
+TiledStats Tiled_Stats(TiledImage *tiled);
+
+// changes the cache size, evicting straight away if needed. false if a dirty
+// tile couldn't be written back
+bool Tiled_SetCacheBytes(TiledImage *tiled, size_t cacheBytes);
+
+// decode/encode count RGBA double pixels of a row starting at x,y,z,slice,
+// rows can cross any number of tiles. false if outside the image or on io error
+bool Tiled_ReadRun(TiledImage *tiled, uint32_t x, uint32_t y, uint32_t z, uint32_t slice,
+									 uint32_t count, double *out);
+bool Tiled_WriteRun(TiledImage *tiled, uint32_t x, uint32_t y, uint32_t z, uint32_t slice,
+										uint32_t count, double const *in);
+
+// a new tiled image at path converted to format, tile by tile. path can't
+// be src's own tile file
+TiledImage *Tiled_Convert(TiledImage *src, char const *path, TinyImageFormat format, size_t cacheBytes);
+
+// the next mip level (half size, 2x2 or 2x2x2 box filter) as a new tiled
+// image at path, built tile by tile. path can't be src's own tile file
+TiledImage *Tiled_CreateMipMap(TiledImage *src, char const *path, size_t cacheBytes);
+
+} // end namespace LuaImage
+
+#endif